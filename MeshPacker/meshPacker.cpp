@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <map>
+#include <tuple>
+#include <string>
+#include <vector>
+#include "meshFile.h"
+#include "fileUtils.h"
+#include "meshOptimizer.h"
+#include "meshClusters.h"
+
+// Offline packer for the engine's .mesh files.
+// Every OBJ given becomes one LOD, most detailed first. Only positions, texture coordinates,
+//	normals and faces are read (faces with more than 3 corners are fanned into triangles), and corners
+//	that share all three become one vertex. Faces without normals get smooth ones generated.
+// Every LOD's triangles and vertices are reordered for the vertex cache, overdraw and vertex fetch
+//	(see meshOptimizer.h) unless --no-optimize is given, one LOD per thread.
+// Vertices are written quantized (QuantizedMeshVertex) unless --float is given.
+
+static void printUsage(void)
+{
+	fprintf(stderr, "Usage: MeshPacker [--float] [--no-optimize] <out.mesh> <lod0.obj> [lod1.obj ...]\n"
+		"       MeshPacker [--float] [--no-optimize] --sphere <out.mesh> [numLods]\n");
+}
+
+// OBJ indices start at 1, and negative ones count back from the end. Returns -1 for a bad index.
+static int resolveObjIndex(const char *text, char **end, size_t count)
+{
+	long index = strtol(text, end, 10);
+	if (index < 0)
+		index += static_cast<long>(count) + 1;
+	return index >= 1 && index <= static_cast<long>(count) ? static_cast<int>(index - 1) : -1;
+}
+
+static bool loadObj(const char *path, std::vector<MeshVertex> &vertices, std::vector<uint32_t> &indices)
+{
+	std::vector<char> text;
+	if (!readFile(path, text))
+	{
+		fprintf(stderr, "Error: Failed to read \"%s\"\n", path);
+		return false;
+	}
+	text.push_back('\0');
+
+	std::vector<float> positions, texCoords, normals;
+	std::map<std::tuple<int, int, int>, uint32_t> vertexLookup; // (position, texture coordinate, normal) -> vertex
+	std::vector<bool> needsNormal;
+	uint32_t lineNumber = 0;
+	for (char *line = text.data(); *line; )
+	{
+		char *lineEnd = line + strcspn(line, "\r\n");
+		char endChar = *lineEnd;
+		*lineEnd = '\0';
+		lineNumber++;
+
+		if (line[0] == 'v' && line[1] == 't' && line[2] == ' ')
+		{
+			// OBJ's V runs up from the bottom, Vulkan's runs down from the top.
+			char *cursor = line + 2;
+			float u = strtof(cursor, &cursor);
+			float v = strtof(cursor, &cursor);
+			texCoords.push_back(u);
+			texCoords.push_back(1.0f - v);
+		}
+		else if ((line[0] == 'v' && line[1] == ' ') || (line[0] == 'v' && line[1] == 'n' && line[2] == ' '))
+		{
+			std::vector<float> &values = line[1] == 'n' ? normals : positions;
+			char *cursor = line + (line[1] == 'n' ? 2 : 1);
+			for (uint32_t i = 0; i < 3; i++)
+				values.push_back(strtof(cursor, &cursor));
+		}
+		else if (line[0] == 'f' && line[1] == ' ')
+		{
+			// Corners are "v", "v/vt", "v//vn" or "v/vt/vn".
+			std::vector<uint32_t> face;
+			char *cursor = line + 1;
+			while (true)
+			{
+				while (*cursor == ' ' || *cursor == '\t')
+					cursor++;
+				if (!*cursor)
+					break;
+
+				int position = resolveObjIndex(cursor, &cursor, positions.size() / 3);
+				int texCoord = -1;
+				int normal = -1;
+				if (*cursor == '/')
+				{
+					cursor++;
+					if (*cursor != '/')
+						texCoord = resolveObjIndex(cursor, &cursor, texCoords.size() / 2);
+					if (*cursor == '/')
+						normal = resolveObjIndex(cursor + 1, &cursor, normals.size() / 3);
+				}
+				if (position < 0)
+				{
+					fprintf(stderr, "Error: %s:%u: Bad face\n", path, lineNumber);
+					return false;
+				}
+				while (*cursor && *cursor != ' ' && *cursor != '\t')
+					cursor++;
+
+				auto found = vertexLookup.find(std::make_tuple(position, texCoord, normal));
+				if (found == vertexLookup.end())
+				{
+					MeshVertex vertex = {
+						{ positions[position * 3], positions[position * 3 + 1], positions[position * 3 + 2] }, // Position
+						{ 0.0f, 0.0f, 0.0f }, // Normal
+						{ 0.0f, 0.0f } // UV
+					};
+					if (normal >= 0)
+						memcpy(vertex.normal, &normals[normal * 3], sizeof(vertex.normal));
+					if (texCoord >= 0)
+						memcpy(vertex.uv, &texCoords[texCoord * 2], sizeof(vertex.uv));
+					found = vertexLookup.emplace(std::make_tuple(position, texCoord, normal), static_cast<uint32_t>(vertices.size())).first;
+					vertices.push_back(vertex);
+					needsNormal.push_back(normal < 0);
+				}
+				face.push_back(found->second);
+			}
+
+			for (size_t i = 2; i < face.size(); i++)
+			{
+				indices.push_back(face[0]);
+				indices.push_back(face[i - 1]);
+				indices.push_back(face[i]);
+			}
+		}
+
+		line = endChar ? lineEnd + 1 : lineEnd;
+	}
+
+	// Area weighted face normals, summed into every corner that didn't come with one.
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const float *a = vertices[indices[i]].pos, *b = vertices[indices[i + 1]].pos, *c = vertices[indices[i + 2]].pos;
+		float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float faceNormal[3] = {
+			ab[1] * ac[2] - ab[2] * ac[1],
+			ab[2] * ac[0] - ab[0] * ac[2],
+			ab[0] * ac[1] - ab[1] * ac[0]
+		};
+		for (size_t j = i; j < i + 3; j++)
+		{
+			if (!needsNormal[indices[j]])
+				continue;
+			for (uint32_t axis = 0; axis < 3; axis++)
+				vertices[indices[j]].normal[axis] += faceNormal[axis];
+		}
+	}
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		float *normal = vertices[i].normal;
+		float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (needsNormal[i] && length > 0.0f)
+		{
+			normal[0] /= length;
+			normal[1] /= length;
+			normal[2] /= length;
+		}
+	}
+
+	if (indices.empty())
+	{
+		fprintf(stderr, "Error: \"%s\" has no faces\n", path);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	MeshVertexFormat vertexFormat = MESH_VERTEX_FORMAT_QUANTIZED;
+	bool optimize = true;
+	while (argc > 1 && (strcmp(argv[1], "--float") == 0 || strcmp(argv[1], "--no-optimize") == 0))
+	{
+		if (strcmp(argv[1], "--float") == 0)
+			vertexFormat = MESH_VERTEX_FORMAT_FLOAT;
+		else
+			optimize = false;
+		argv++;
+		argc--;
+	}
+	if (argc < 3)
+	{
+		printUsage();
+		return 1;
+	}
+
+	MeshData mesh;
+	const char *outputPath;
+	if (strcmp(argv[1], "--sphere") == 0)
+	{
+		outputPath = argv[2];
+		buildIcosphereMesh(argc > 3 ? static_cast<uint32_t>(strtoul(argv[3], nullptr, 10)) : 6, mesh);
+	}
+	else
+	{
+		outputPath = argv[1];
+		if (argc - 2 > static_cast<int>(MESH_FILE_MAX_LODS))
+		{
+			fprintf(stderr, "Error: At most %u LODs\n", MESH_FILE_MAX_LODS);
+			return 1;
+		}
+		for (int i = 2; i < argc; i++)
+		{
+			std::vector<MeshVertex> vertices;
+			std::vector<uint32_t> indices;
+			if (!loadObj(argv[i], vertices, indices))
+				return 1;
+			addMeshLod(mesh, vertices, indices);
+		}
+	}
+
+	MeshOptimizationStats optimization = {};
+	if (optimize)
+	{
+		MeshData *meshes[] = { &mesh };
+		optimizeMeshes(meshes, 1, 0, &optimization);
+	}
+	buildMeshClusters(mesh);
+
+	if (!writeMeshFile(outputPath, mesh, vertexFormat))
+		return 1;
+
+	printf("Wrote %s (%s vertices, %u bytes each, %u as floats):\n", outputPath,
+		getMeshVertexFormatName(vertexFormat), getMeshVertexStride(vertexFormat),
+		getMeshVertexStride(MESH_VERTEX_FORMAT_FLOAT));
+	for (size_t i = 0; i < mesh.lods.size(); i++)
+		printf("\tLOD %u: %u vertices, %u triangles, %u clusters\n", static_cast<uint32_t>(i),
+			mesh.lods[i].numVertices, mesh.lods[i].numIndices / 3, mesh.lods[i].numClusters);
+	if (optimize)
+	{
+		printf("Index optimization stats:\n");
+		printMeshOptimizationStats(optimization);
+	}
+	return 0;
+}
@@ -0,0 +1,673 @@
+#version 450 core
+
+// Picks what every asteroid is drawn as this frame, and builds the indirect draws for it.
+// Compiled once per stage (CULL_CLASSIFY, CULL_BUILD_DRAWS or CULL_SCATTER), dispatched in that order:
+//	CLASSIFY: frustum cull each instance and pick its LOD (or impostor) from its projected size,
+//		counting how many instances land in each bucket (slot, LOD).
+//	BUILD_DRAWS: prefix sum the counts into where each bucket's instances start, and write a
+//		draw per bucket plus one for all of the impostors.
+//	SCATTER: write each visible instance into its bucket's range of the draw list.
+// Mesh LOD buckets come first (slot * numLods + lod), then one impostor bucket per slot, so the
+//	impostors end up back to back and draw with one command.
+// With OCCLUSION_CULLING defined, all three run twice a frame (cullParams.x is the phase):
+//	Early: instances in the frustum are also tested against the Hi-Z pyramid of last frame's
+//		depth, and the ones behind it are set aside (OCCLUDED) instead of being drawn.
+//	Late: after the early draws, the pyramid is rebuilt from this frame's depth and only the set
+//		aside instances are tested again. Whatever's visible now is drawn, so something that just
+//		came out from behind a rock is only ever a phase late, never a frame.
+// With CLUSTER_CULLING defined, the mesh instances aren't drawn whole. A fourth stage, CULL_CLUSTERS,
+//	dispatched indirectly with a workgroup per visible mesh instance, culls each of its LOD's
+//	clusters (see MeshCluster in meshFile.h) by the frustum, by its normal cone (every triangle
+//	facing away from the camera) and against the Hi-Z pyramid, and writes the triangles of what's
+//	left into one index buffer for a single indexed draw. Each index is the cluster instance it's
+//	from times 64 plus a vertex of that cluster, asteroidVertex.glsl looks up the rest.
+//	Occlusion culling works the same way as for instances: the early phase sets clusters the old
+//	pyramid hides aside, and the late phase tests them again (in extra workgroups of 64 each)
+//	along with the clusters of the instances it found visible.
+// With BINDLESS_SET defined (as the set the bindless table is at) the bodies are read through the
+//	table, from the buffer bodyParams.x picks, instead of from binding 1.
+// With REMOTE_BODIES defined the instances from bodyParams.z on are the bodies the other devices
+//	simulate, from binding 15 (or the table's buffer bodyParams.y picks).
+
+#if defined(BINDLESS_SET)
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
+
+#if defined(CULL_BUILD_DRAWS)
+layout (local_size_x = 1) in; // A few hundred buckets, not worth a parallel scan.
+#elif defined(CULL_CLUSTERS)
+layout (local_size_x = 64) in; // A cluster per invocation, then a triangle per invocation.
+#else
+layout (local_size_x = 64) in;
+#endif
+
+layout (set=0, binding=0) uniform FrameParams
+{
+	mat4 viewProj;
+	vec4 frustumPlanes[6];
+	vec4 cameraPos; // xyz position, w pixels per unit at a distance of one
+	vec4 cameraRight; // xyz, w instance scale
+	vec4 cameraUp;
+	vec4 lodParams; // x full detail pixels, y level impostors start at, z hysteresis
+	uvec4 counts; // x instances, y slots, z LODs, w stats index
+	mat4 occlusionViewProj; // What the Hi-Z pyramid's depth was rendered with.
+	vec4 hiZParams; // xy viewport size the pyramid's depth was drawn at, z pyramid levels
+	uvec4 cullParams; // x phase (0 early, 1 late), y 1 to test against the pyramid, z cluster instances there's room for,
+	//	w 1 when the mesh draws are one multi-draw (each one's first instance is its bucket's start)
+	uvec4 bodyParams; // x bindless table index of the bodies, y of the remote bodies, z first remote instance
+};
+
+#if defined(OCCLUSION_CULLING)
+// Farthest depth (reversed Z) under each texel, see vulkanHiZPyramid.h.
+layout (set=1, binding=0) uniform sampler2D hiZ;
+#endif
+
+struct Body
+{
+	vec4 posMass;
+	vec4 velocity;
+};
+
+#if defined(BINDLESS_SET)
+// Every storage buffer in the bindless table (vulkanBindless.h).
+layout (set=BINDLESS_SET, binding=0) readonly buffer BindlessBodies
+{
+	Body bodies[];
+} bindlessBodies[];
+#else
+layout (set=0, binding=1) readonly buffer Bodies
+{
+	Body bodies[];
+};
+#endif
+
+#if defined(REMOTE_BODIES) && !defined(BINDLESS_SET)
+layout (set=0, binding=15) readonly buffer RemoteBodies
+{
+	Body remoteBodies[];
+};
+#endif
+
+// Instances from bodyParams.z on are the remote bodies.
+vec4 getPosMass(uint body)
+{
+#if defined(REMOTE_BODIES)
+	if (body >= bodyParams.z)
+	{
+#if defined(BINDLESS_SET)
+		return bindlessBodies[bodyParams.y].bodies[body - bodyParams.z].posMass;
+#else
+		return remoteBodies[body - bodyParams.z].posMass;
+#endif
+	}
+#endif
+#if defined(BINDLESS_SET)
+	return bindlessBodies[bodyParams.x].bodies[body].posMass;
+#else
+	return bodies[body].posMass;
+#endif
+}
+
+// lods[i] is the LOD's index count, first index, vertex offset and vertex count, the last three
+//	into the whole mesh pool. MESH_FILE_MAX_LODS of them.
+// clusterLods[i] is the LOD's first cluster and cluster count.
+struct MeshSlot
+{
+	vec4 boundingSphere;
+	vec4 boundsCenter; // Quantized positions are relative to the bounds box.
+	vec4 boundsHalfExtent;
+	uvec4 lods[8];
+	uvec4 clusterBases; // Words into the cluster data of the mesh's x clusters, y cluster vertices, z cluster triangles.
+	uvec2 clusterLods[8];
+};
+
+layout (set=0, binding=2) readonly buffer MeshSlots
+{
+	MeshSlot slots[];
+};
+
+// What each instance was drawn as last frame, plus one (0 for never).
+layout (set=0, binding=3) buffer LodStates
+{
+	uint lodStates[];
+};
+
+// Bucket and index in the bucket of each instance this frame, ~0 buckets were culled.
+// The early phase leaves the ones it found occluded as OCCLUDED for the late phase to test again.
+layout (set=0, binding=4) buffer Classified
+{
+	uvec2 classified[];
+};
+
+const uint OCCLUDED = ~1U;
+
+// Instances in each bucket and where they start in the draw list. Zeroed at the start of the frame.
+layout (set=0, binding=5) buffer Buckets
+{
+	uint lodChanges;
+	uint numOccluded;
+	uint bucketsPad1;
+	uint bucketsPad2;
+	uvec2 buckets[]; // x count, y first
+};
+
+layout (set=0, binding=6) buffer DrawList
+{
+	uint drawList[];
+};
+
+struct DrawIndexedCommand
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+layout (set=0, binding=7) buffer Draws
+{
+	uvec4 impostorDraw; // VkDrawIndirectCommand
+	DrawIndexedCommand meshDraws[];
+};
+
+struct FrameStats
+{
+	uint numVisible;
+	uint numImpostors;
+	uint numMeshDraws; // With any instances.
+	uint numLodChanges;
+	uvec2 fullDetailTriangles; // 64-bit, low word first
+	uvec2 submittedTriangles;
+	uvec2 submittedVertices; // Of the meshes, as if every vertex of a LOD was fetched once per instance.
+	uint numOccluded; // Set aside by the early phase, or still hidden in the late one.
+	// Added up by CULL_CLUSTERS. Clusters the late phase tests again only count as occluded or drawn.
+	uint numClusters;
+	uint numClustersOutside; // Of the frustum
+	uint numClustersBackfacing;
+	uint numClustersOccluded; // Set aside by the early phase, or still hidden in the late one.
+	uint numClustersDrawn;
+	uint numClustersDropped; // For lack of room.
+	uint clusterTriangles;
+	uint clusterVertices;
+	uint statsPad;
+};
+
+layout (set=0, binding=8) buffer Stats
+{
+	FrameStats stats[];
+};
+
+#if defined(CLUSTER_CULLING)
+// Every mesh's clusters as the mesh pool loaded them: the MeshClusters (12 words each), their
+//	vertices and their triangles, at each slot's clusterBases.
+layout (set=0, binding=10) readonly buffer ClusterData
+{
+	uint clusterWords[];
+};
+
+// What each cluster drawn this frame was: x body, y word of its first vertex, z vertex offset of its LOD.
+layout (set=0, binding=11) writeonly buffer ClusterInstances
+{
+	uvec4 clusterInstances[];
+};
+
+layout (set=0, binding=12) writeonly buffer ClusterIndices
+{
+	uint clusterIndices[];
+};
+
+// Zeroed at the start of the frame, the early phase's then the late phase's.
+layout (set=0, binding=13) buffer ClusterState
+{
+	DrawIndexedCommand clusterDraws[2];
+	uint numClusterInstances;
+	uint numDeferredClusters;
+	uvec4 clusterDispatches[2]; // xyz workgroups (VkDispatchIndirectCommand), w mesh instances
+};
+
+// The clusters the early phase set aside: x body, y cluster of its mesh.
+layout (set=0, binding=14) buffer DeferredClusters
+{
+	uvec2 deferredClusters[];
+};
+
+// Workgroups a row of the indirect dispatch, which can only be 65535 wide.
+const uint CLUSTER_DISPATCH_WIDTH = 256;
+const uint CLUSTER_VERTEX_BITS = 6; // MESH_CLUSTER_MAX_VERTICES is 64.
+const uint CLUSTER_WORDS = 12; // sizeof(MeshCluster) / 4
+#endif
+
+// The range of continuous LOD 'level' values LOD 'lod' covers (the impostor is LOD numLods).
+vec2 getLodRange(uint lod, uint numLods, float impostorLevel)
+{
+	if (lod >= numLods)
+		return vec2(impostorLevel, 1e30);
+	float start = lod == 0 ? -1e30 : float(lod);
+	float end = lod + 1 == numLods ? impostorLevel : float(lod + 1);
+	return vec2(min(start, impostorLevel), min(end, impostorLevel));
+}
+
+#if defined(OCCLUSION_CULLING)
+// Whether the sphere is certainly behind the depth the pyramid was built from. Tests the sphere's
+//	bounding box, projected with the matrix that depth was rendered with, against the pyramid level
+//	where the box covers at most 2x2 texels.
+bool isOccluded(vec3 center, float radius)
+{
+	vec2 boxMin = vec2(1e30);
+	vec2 boxMax = vec2(-1e30);
+	float nearestDepth = 0.0;
+	for (uint corner = 0; corner < 8; corner++)
+	{
+		vec3 offset = vec3((corner & 1) != 0 ? radius : -radius, (corner & 2) != 0 ? radius : -radius, (corner & 4) != 0 ? radius : -radius);
+		vec4 clip = occlusionViewProj * vec4(center + offset, 1.0);
+		if (clip.w <= 1e-5)
+			return false; // Crosses the camera plane, it could be anywhere on screen.
+		vec3 ndc = clip.xyz / clip.w;
+		boxMin = min(boxMin, ndc.xy);
+		boxMax = max(boxMax, ndc.xy);
+		nearestDepth = max(nearestDepth, ndc.z);
+	}
+
+	// Pixels, clamped to the screen (the frustum test has already dealt with what's off of it).
+	vec2 screenSize = hiZParams.xy;
+	boxMin = clamp((boxMin * 0.5 + 0.5) * screenSize, vec2(0.0), screenSize - 1.0);
+	boxMax = clamp((boxMax * 0.5 + 0.5) * screenSize, vec2(0.0), screenSize - 1.0);
+
+	// Texel p / 2^(level + 1) on 'level', so a level with texels at least as big as the box puts
+	//	it across at most two of them each way.
+	float extent = max(max(boxMax.x - boxMin.x, boxMax.y - boxMin.y), 1.0);
+	int level = clamp(int(ceil(log2(extent))) - 1, 0, int(hiZParams.z) - 1);
+	ivec2 levelMax = textureSize(hiZ, level) - 1;
+	ivec2 texelMin = min(ivec2(boxMin) >> (level + 1), levelMax);
+	ivec2 texelMax = min(ivec2(boxMax) >> (level + 1), levelMax);
+	float farthestDepth = min(
+		min(texelFetch(hiZ, texelMin, level).x, texelFetch(hiZ, ivec2(texelMax.x, texelMin.y), level).x),
+		min(texelFetch(hiZ, ivec2(texelMin.x, texelMax.y), level).x, texelFetch(hiZ, texelMax, level).x));
+	return nearestDepth < farthestDepth;
+}
+#endif
+
+#if defined(CULL_CLUSTERS)
+struct Cluster
+{
+	vec4 boundingSphere;
+	vec4 cone; // xyz axis, w cutoff
+	uint firstVertex; // Words into the cluster data
+	uint firstTriangle;
+	uint numVertices;
+	uint numTriangles;
+};
+
+Cluster loadCluster(uint slot, uint cluster)
+{
+	uvec4 bases = slots[slot].clusterBases;
+	uint word = bases.x + cluster * CLUSTER_WORDS;
+	Cluster result;
+	result.boundingSphere = uintBitsToFloat(uvec4(clusterWords[word], clusterWords[word + 1], clusterWords[word + 2], clusterWords[word + 3]));
+	result.cone = uintBitsToFloat(uvec4(clusterWords[word + 4], clusterWords[word + 5], clusterWords[word + 6], clusterWords[word + 7]));
+	result.firstVertex = bases.y + clusterWords[word + 8];
+	result.firstTriangle = bases.z + clusterWords[word + 9];
+	result.numVertices = clusterWords[word + 10];
+	result.numTriangles = clusterWords[word + 11];
+	return result;
+}
+
+// Whether every triangle of the cluster faces away from the camera, wherever in the sphere it is.
+//	The triangle normal that gets closest to facing the camera is 'alpha' (the cone's half angle)
+//	further round from the axis than the view direction is, so the cluster's backfacing while
+//	cos(theta + alpha) still leaves a sphere radius of margin along the view ray.
+bool isBackfacing(vec3 center, float radius, vec4 cone)
+{
+	if (cone.w <= 0.0)
+		return false;
+	vec3 toCenter = center - cameraPos.xyz;
+	float distance = length(toCenter);
+	if (distance <= radius)
+		return false;
+	float cosTheta = dot(toCenter, cone.xyz) / distance;
+	float sinTheta = sqrt(max(1.0 - cosTheta * cosTheta, 0.0));
+	float sinAlpha = sqrt(max(1.0 - cone.w * cone.w, 0.0));
+	return distance * (cosTheta * cone.w - sinTheta * sinAlpha) >= radius;
+}
+
+shared uint sharedNumEmitted;
+shared uint sharedNumTriangles;
+shared uint sharedFirstInstance;
+shared uint sharedFirstIndex;
+shared uvec4 sharedEmitted[64]; // x cluster instance, y first triangle word, z triangles, w first triangle in the group's range
+shared uint sharedStats[8]; // Added to the frame's stats once at the end, in FrameStats order from numClusters.
+
+// Append the clusters the invocations picked (one each at most) to this phase's draw, as cluster
+//	instances and the indices of their triangles. Every invocation has to call it.
+void emitClusters(bool emit, uint body, uint slot, uint lod, Cluster cluster)
+{
+	uint phase = cullParams.x;
+	if (gl_LocalInvocationIndex == 0)
+	{
+		sharedNumEmitted = 0;
+		sharedNumTriangles = 0;
+	}
+	barrier();
+
+	uint emitIndex = 0;
+	uint firstTriangle = 0;
+	if (emit)
+	{
+		emitIndex = atomicAdd(sharedNumEmitted, 1U);
+		firstTriangle = atomicAdd(sharedNumTriangles, cluster.numTriangles);
+	}
+	barrier();
+
+	// One allocation for the whole group. When there's no room for all of it, none of it's drawn
+	//	(and nothing after it will fit either).
+	uint numEmitted = sharedNumEmitted;
+	if (gl_LocalInvocationIndex == 0 && numEmitted != 0)
+	{
+		uint firstInstance = atomicAdd(numClusterInstances, numEmitted);
+		if (firstInstance + numEmitted <= cullParams.z)
+		{
+			sharedFirstInstance = firstInstance;
+			sharedFirstIndex = clusterDraws[phase].firstIndex + atomicAdd(clusterDraws[phase].indexCount, sharedNumTriangles * 3);
+			sharedStats[4] += numEmitted;
+			sharedStats[6] += sharedNumTriangles;
+		}
+		else
+		{
+			sharedFirstInstance = ~0U;
+			sharedStats[5] += numEmitted;
+		}
+	}
+	barrier();
+	if (numEmitted == 0 || sharedFirstInstance == ~0U)
+		return;
+
+	if (emit)
+	{
+		uint instance = sharedFirstInstance + emitIndex;
+		clusterInstances[instance] = uvec4(body, cluster.firstVertex, slots[slot].lods[lod].z, 0U);
+		sharedEmitted[emitIndex] = uvec4(instance, cluster.firstTriangle, cluster.numTriangles, firstTriangle);
+		atomicAdd(sharedStats[7], cluster.numVertices);
+	}
+	barrier();
+
+	// The whole group writes each cluster's triangles, one per invocation.
+	for (uint i = 0; i < numEmitted; i++)
+	{
+		uvec4 emitted = sharedEmitted[i];
+		uint triangle = gl_LocalInvocationIndex;
+		if (triangle < emitted.z)
+		{
+			uint packed = clusterWords[emitted.y + triangle];
+			uint instanceBits = emitted.x << CLUSTER_VERTEX_BITS;
+			uint index = sharedFirstIndex + (emitted.w + triangle) * 3;
+			clusterIndices[index] = instanceBits | (packed & 0xFFU);
+			clusterIndices[index + 1] = instanceBits | ((packed >> 8) & 0xFFU);
+			clusterIndices[index + 2] = instanceBits | ((packed >> 16) & 0xFFU);
+		}
+	}
+	barrier();
+}
+#endif
+
+void addProduct64(inout uvec2 sum, uint a, uint b)
+{
+	uint high, low, carry;
+	umulExtended(a, b, high, low);
+	sum.x = uaddCarry(sum.x, low, carry);
+	sum.y += high + carry;
+}
+
+void main(void)
+{
+	uint numInstances = counts.x;
+	uint numSlots = counts.y;
+	uint numLods = counts.z;
+	uint numMeshBuckets = numSlots * numLods;
+
+#if defined(CULL_CLASSIFY)
+	uint i = gl_GlobalInvocationID.x;
+	if (i >= numInstances)
+		return;
+
+	vec4 posMass = getPosMass(i);
+	uint slot = i % numSlots;
+	vec4 sphere = slots[slot].boundingSphere;
+	float scale = cameraRight.w * pow(posMass.w, 1.0 / 3.0);
+	vec3 center = posMass.xyz + sphere.xyz * scale;
+	float radius = sphere.w * scale;
+
+#if defined(OCCLUSION_CULLING)
+	// Late phase: only what the early phase set aside, with its LOD as the early phase picked it.
+	if (cullParams.x == 1)
+	{
+		if (classified[i].x != OCCLUDED)
+		{
+			classified[i] = uvec2(~0U, 0U);
+			return;
+		}
+		if (isOccluded(center, radius))
+		{
+			classified[i] = uvec2(~0U, 0U);
+			atomicAdd(numOccluded, 1U);
+			return;
+		}
+		uint lateLod = lodStates[i] - 1;
+		uint lateBucket = lateLod < numLods ? slot * numLods + lateLod : numMeshBuckets + slot;
+		classified[i] = uvec2(lateBucket, atomicAdd(buckets[lateBucket].x, 1U));
+		return;
+	}
+#endif
+
+	classified[i] = uvec2(~0U, 0U);
+	for (uint plane = 0; plane < 6; plane++)
+	{
+		if (dot(frustumPlanes[plane].xyz, center) + frustumPlanes[plane].w < -radius)
+			return;
+	}
+
+	// Continuous LOD: 0 at the full detail size, +1 every time the projected size halves (which is
+	//	what a subdivision level is worth).
+	float distance = max(length(center - cameraPos.xyz), radius);
+	float pixels = radius * cameraPos.w / distance;
+	float level = log2(lodParams.x / max(pixels, 1e-6));
+	float impostorLevel = lodParams.y;
+
+	uint lod = level >= impostorLevel ? numLods : uint(clamp(floor(level), 0.0, float(numLods - 1)));
+
+	// Hysteresis: keep last frame's LOD until the level is well past its range, so an instance
+	//	sitting on a boundary doesn't flip back and forth.
+	uint previous = lodStates[i];
+	if (previous != 0 && previous - 1 <= numLods)
+	{
+		vec2 range = getLodRange(previous - 1, numLods, impostorLevel);
+		if (level >= range.x - lodParams.z && level < range.y + lodParams.z)
+			lod = previous - 1;
+	}
+	if (lod + 1 != previous)
+	{
+		lodStates[i] = lod + 1;
+		if (previous != 0)
+			atomicAdd(lodChanges, 1U);
+	}
+
+#if defined(OCCLUSION_CULLING)
+	// The LOD is still picked above, so hysteresis carries on while it's hidden.
+	if (cullParams.y != 0 && isOccluded(center, radius))
+	{
+		classified[i] = uvec2(OCCLUDED, 0U);
+		atomicAdd(numOccluded, 1U);
+		return;
+	}
+#endif
+
+	uint bucket = lod < numLods ? slot * numLods + lod : numMeshBuckets + slot;
+	classified[i] = uvec2(bucket, atomicAdd(buckets[bucket].x, 1U));
+
+#elif defined(CULL_BUILD_DRAWS)
+	uint first = 0;
+	uint numMeshDraws = 0;
+	uvec2 fullDetailTriangles = uvec2(0);
+	uvec2 submittedTriangles = uvec2(0);
+	uvec2 submittedVertices = uvec2(0);
+	for (uint bucket = 0; bucket < numMeshBuckets; bucket++)
+	{
+		uint count = buckets[bucket].x;
+		buckets[bucket].y = first;
+		first += count;
+
+		uint slot = bucket / numLods;
+		uvec4 lod = slots[slot].lods[bucket % numLods];
+		meshDraws[bucket] = DrawIndexedCommand(lod.x, count, lod.y, int(lod.z), cullParams.w != 0 ? buckets[bucket].y : 0U);
+		addProduct64(submittedTriangles, count, lod.x / 3);
+		addProduct64(submittedVertices, count, lod.w);
+		addProduct64(fullDetailTriangles, count, slots[slot].lods[0].x / 3);
+		if (count != 0)
+			numMeshDraws++;
+	}
+
+	uint firstImpostor = first;
+	for (uint slot = 0; slot < numSlots; slot++)
+	{
+		uint count = buckets[numMeshBuckets + slot].x;
+		buckets[numMeshBuckets + slot].y = first;
+		first += count;
+		addProduct64(fullDetailTriangles, count, slots[slot].lods[0].x / 3);
+	}
+	uint numImpostors = first - firstImpostor;
+	impostorDraw = uvec4(6, numImpostors, 0, 0); // A camera facing quad each
+	addProduct64(submittedTriangles, numImpostors, 2);
+
+	stats[counts.w] = FrameStats(first, numImpostors, numMeshDraws + (numImpostors != 0 ? 1U : 0U), lodChanges,
+		fullDetailTriangles, submittedTriangles, submittedVertices, numOccluded,
+		0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U);
+
+#if defined(CLUSTER_CULLING)
+	// A workgroup per mesh instance (they're at the start of the draw list), then in the late phase
+	//	one per 64 clusters the early phase set aside.
+	uint phase = cullParams.x;
+	uint numMeshInstances = firstImpostor;
+	uint numWorkgroups = numMeshInstances;
+	if (phase == 1)
+		numWorkgroups += (min(numDeferredClusters, cullParams.z) + 63) / 64;
+	clusterDispatches[phase] = uvec4(min(numWorkgroups, CLUSTER_DISPATCH_WIDTH),
+		(numWorkgroups + CLUSTER_DISPATCH_WIDTH - 1) / CLUSTER_DISPATCH_WIDTH, 1U, numMeshInstances);
+
+	// The late phase's indices go after the early phase's.
+	clusterDraws[phase].instanceCount = 1;
+	clusterDraws[phase].firstIndex = phase == 0 ? 0U : clusterDraws[0].firstIndex + clusterDraws[0].indexCount;
+#endif
+
+#elif defined(CULL_SCATTER)
+	uint i = gl_GlobalInvocationID.x;
+	if (i >= numInstances)
+		return;
+
+	uvec2 instance = classified[i];
+	if (instance.x < numMeshBuckets + numSlots) // Not culled or OCCLUDED
+		drawList[buckets[instance.x].y + instance.y] = i;
+
+#elif defined(CULL_CLUSTERS)
+	uint phase = cullParams.x;
+	uint workgroup = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+	uint numMeshInstances = clusterDispatches[phase].w;
+	if (gl_LocalInvocationIndex < 8)
+		sharedStats[gl_LocalInvocationIndex] = 0;
+	barrier();
+
+	if (workgroup < numMeshInstances)
+	{
+		// Every cluster of a visible instance's LOD, 64 at a time.
+		uint body = drawList[workgroup];
+		uint bucket = classified[body].x;
+		uint slot = bucket / numLods;
+		uint lod = bucket % numLods;
+		vec4 posMass = getPosMass(body);
+		float scale = cameraRight.w * pow(posMass.w, 1.0 / 3.0);
+		uvec2 lodClusters = slots[slot].clusterLods[lod];
+		for (uint start = 0; start < lodClusters.y; start += 64)
+		{
+			uint index = start + gl_LocalInvocationIndex;
+			bool emit = false;
+			Cluster cluster;
+			if (index < lodClusters.y)
+			{
+				cluster = loadCluster(slot, lodClusters.x + index);
+				vec3 center = posMass.xyz + cluster.boundingSphere.xyz * scale;
+				float radius = cluster.boundingSphere.w * scale;
+				atomicAdd(sharedStats[0], 1U);
+
+				emit = true;
+				for (uint plane = 0; plane < 6; plane++)
+				{
+					if (dot(frustumPlanes[plane].xyz, center) + frustumPlanes[plane].w < -radius)
+						emit = false;
+				}
+				if (!emit)
+					atomicAdd(sharedStats[1], 1U);
+				else if (isBackfacing(center, radius, cluster.cone))
+				{
+					emit = false;
+					atomicAdd(sharedStats[2], 1U);
+				}
+#if defined(OCCLUSION_CULLING)
+				// Early: set aside for the late phase, unless there's no room to (then it's drawn).
+				//	Late: this is already the pyramid of this frame's depth.
+				else if (cullParams.y != 0 && isOccluded(center, radius))
+				{
+					atomicAdd(sharedStats[3], 1U);
+					if (phase == 0)
+					{
+						uint deferred = atomicAdd(numDeferredClusters, 1U);
+						emit = deferred >= cullParams.z;
+						if (!emit)
+							deferredClusters[deferred] = uvec2(body, lodClusters.x + index);
+					}
+					else
+						emit = false;
+				}
+#endif
+			}
+			emitClusters(emit, body, slot, lod, cluster);
+		}
+	}
+#if defined(OCCLUSION_CULLING)
+	else
+	{
+		// Late phase only: 64 of the clusters the early phase set aside, against the new pyramid.
+		uint deferred = (workgroup - numMeshInstances) * 64 + gl_LocalInvocationIndex;
+		bool emit = false;
+		uint body = 0;
+		uint slot = 0;
+		uint lod = 0;
+		Cluster cluster;
+		if (deferred < min(numDeferredClusters, cullParams.z))
+		{
+			body = deferredClusters[deferred].x;
+			slot = body % numSlots;
+			lod = lodStates[body] - 1;
+			cluster = loadCluster(slot, deferredClusters[deferred].y);
+			vec4 posMass = getPosMass(body);
+			float scale = cameraRight.w * pow(posMass.w, 1.0 / 3.0);
+			emit = !isOccluded(posMass.xyz + cluster.boundingSphere.xyz * scale, cluster.boundingSphere.w * scale);
+			if (!emit)
+				atomicAdd(sharedStats[3], 1U);
+		}
+		emitClusters(emit, body, slot, lod, cluster);
+	}
+#endif
+
+	barrier();
+	if (gl_LocalInvocationIndex == 0)
+	{
+		atomicAdd(stats[counts.w].numClusters, sharedStats[0]);
+		atomicAdd(stats[counts.w].numClustersOutside, sharedStats[1]);
+		atomicAdd(stats[counts.w].numClustersBackfacing, sharedStats[2]);
+		atomicAdd(stats[counts.w].numClustersOccluded, sharedStats[3]);
+		atomicAdd(stats[counts.w].numClustersDrawn, sharedStats[4]);
+		atomicAdd(stats[counts.w].numClustersDropped, sharedStats[5]);
+		atomicAdd(stats[counts.w].clusterTriangles, sharedStats[6]);
+		atomicAdd(stats[counts.w].clusterVertices, sharedStats[7]);
+	}
+#endif
+}
@@ -0,0 +1,19 @@
+#version 450 core
+
+// Shades an asteroid mesh: the lit albedo from asteroidVertex.glsl, with faint layers across the
+//	rock along the mesh's v coordinate. Only v: u wraps around at a seam that the triangles
+//	sharing vertices across it interpolate the whole way back over.
+
+layout (location=0) in vec4 inColor;
+layout (location=1) in vec2 inUV;
+
+layout (location=0) out vec4 outColor;
+
+const float STRATA_FREQUENCY = 90.0;
+const float STRATA_CONTRAST = 0.06;
+
+void main(void)
+{
+	float strata = 1.0 - STRATA_CONTRAST * (0.5 + 0.5 * sin(inUV.y * STRATA_FREQUENCY));
+	outColor = vec4(inColor.rgb * strata, inColor.a);
+}
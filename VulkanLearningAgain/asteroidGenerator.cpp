@@ -0,0 +1,382 @@
+#include "asteroidGenerator.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <algorithm>
+#include "fileUtils.h"
+#include "meshOptimizer.h"
+#include "meshClusters.h"
+
+// Bump this whenever the generator's output changes, so cached meshes get regenerated.
+#define ASTEROID_GENERATOR_VERSION 2U
+
+// The noise is done 4 vertices at a time with SSE2 where there is SSE2 (every x64 CPU, and Win32
+//	builds target it by default). The scalar path does the same operations in the same order.
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define ASTEROID_NOISE_SSE2 1
+#include <emmintrin.h>
+#else
+#define ASTEROID_NOISE_SSE2 0
+#endif
+
+// Lattice hash constants (large odd numbers with well mixed bits).
+#define NOISE_PRIME_X 0x8da6b343U
+#define NOISE_PRIME_Y 0xd8163841U
+#define NOISE_PRIME_Z 0xcb1ab31fU
+#define NOISE_MIX 0x85ebca6bU
+#define NOISE_OCTAVE_SEED_STEP 0x9e3779b9U
+
+// 64-bit FNV-1a, continued from 'hash'.
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size)
+{
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+uint64_t getAsteroidCacheKey(uint32_t seed, const AsteroidShape &shape, MeshVertexFormat vertexFormat)
+{
+	uint32_t versions[] = { ASTEROID_GENERATOR_VERSION, MESH_FILE_VERSION, static_cast<uint32_t>(vertexFormat) };
+	uint64_t hash = hashBytes(0xcbf29ce484222325ULL, versions, sizeof(versions));
+	hash = hashBytes(hash, &seed, sizeof(seed));
+	hash = hashBytes(hash, &shape.numLods, sizeof(shape.numLods));
+	hash = hashBytes(hash, &shape.radius, sizeof(shape.radius));
+	hash = hashBytes(hash, &shape.displacement, sizeof(shape.displacement));
+	hash = hashBytes(hash, &shape.frequency, sizeof(shape.frequency));
+	return hashBytes(hash, &shape.numOctaves, sizeof(shape.numOctaves));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Value noise
+//
+// A random value in [-1, 1) at every integer lattice point, blended with a smoothstep between them.
+//
+//////////////////////////////////////////////////////////////////////////////
+static float latticeValue(int32_t x, int32_t y, int32_t z, uint32_t seed)
+{
+	uint32_t hash = seed ^ (static_cast<uint32_t>(x) * NOISE_PRIME_X) ^ (static_cast<uint32_t>(y) * NOISE_PRIME_Y) ^ (static_cast<uint32_t>(z) * NOISE_PRIME_Z);
+	hash = (hash ^ (hash >> 13)) * NOISE_MIX;
+	hash ^= hash >> 16;
+	return static_cast<float>(static_cast<int32_t>(hash >> 8)) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+static float valueNoise(float x, float y, float z, uint32_t seed)
+{
+	float fx = floorf(x), fy = floorf(y), fz = floorf(z);
+	int32_t ix = static_cast<int32_t>(fx), iy = static_cast<int32_t>(fy), iz = static_cast<int32_t>(fz);
+	float tx = x - fx, ty = y - fy, tz = z - fz;
+	tx = tx * tx * (3.0f - 2.0f * tx);
+	ty = ty * ty * (3.0f - 2.0f * ty);
+	tz = tz * tz * (3.0f - 2.0f * tz);
+
+	float values[2][2];
+	for (int32_t dz = 0; dz < 2; dz++)
+	{
+		for (int32_t dy = 0; dy < 2; dy++)
+		{
+			float a = latticeValue(ix, iy + dy, iz + dz, seed);
+			float b = latticeValue(ix + 1, iy + dy, iz + dz, seed);
+			values[dz][dy] = a + (b - a) * tx;
+		}
+	}
+	float front = values[0][0] + (values[0][1] - values[0][0]) * ty;
+	float back = values[1][0] + (values[1][1] - values[1][0]) * ty;
+	return front + (back - front) * tz;
+}
+
+#if ASTEROID_NOISE_SSE2
+// SSE2 has no 32-bit multiply that keeps the low halves (that's SSE4.1), so do the even and odd
+//	lanes as 64-bit products and put the low halves back together.
+static inline __m128i multiplyLow32(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline __m128 latticeValue4(__m128i x, __m128i y, __m128i z, __m128i seed)
+{
+	__m128i hash = _mm_xor_si128(seed, multiplyLow32(x, _mm_set1_epi32(static_cast<int32_t>(NOISE_PRIME_X))));
+	hash = _mm_xor_si128(hash, multiplyLow32(y, _mm_set1_epi32(static_cast<int32_t>(NOISE_PRIME_Y))));
+	hash = _mm_xor_si128(hash, multiplyLow32(z, _mm_set1_epi32(static_cast<int32_t>(NOISE_PRIME_Z))));
+	hash = multiplyLow32(_mm_xor_si128(hash, _mm_srli_epi32(hash, 13)), _mm_set1_epi32(static_cast<int32_t>(NOISE_MIX)));
+	hash = _mm_xor_si128(hash, _mm_srli_epi32(hash, 16));
+	__m128 value = _mm_cvtepi32_ps(_mm_srli_epi32(hash, 8));
+	return _mm_sub_ps(_mm_mul_ps(value, _mm_set1_ps(2.0f / 16777216.0f)), _mm_set1_ps(1.0f));
+}
+
+// floorf for each lane, as a float and an int. (Truncates, then steps down where that rounded up.)
+static inline __m128 floor4(__m128 value, __m128i &integer)
+{
+	integer = _mm_cvttps_epi32(value);
+	__m128 truncated = _mm_cvtepi32_ps(integer);
+	integer = _mm_add_epi32(integer, _mm_castps_si128(_mm_cmpgt_ps(truncated, value))); // Adds -1 where true.
+	return _mm_cvtepi32_ps(integer);
+}
+
+static inline __m128 smoothstep4(__m128 t)
+{
+	return _mm_mul_ps(_mm_mul_ps(t, t), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_set1_ps(2.0f), t)));
+}
+
+static inline __m128 lerp4(__m128 a, __m128 b, __m128 t)
+{
+	return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+static __m128 valueNoise4(__m128 x, __m128 y, __m128 z, __m128i seed)
+{
+	__m128i ix, iy, iz;
+	__m128 tx = smoothstep4(_mm_sub_ps(x, floor4(x, ix)));
+	__m128 ty = smoothstep4(_mm_sub_ps(y, floor4(y, iy)));
+	__m128 tz = smoothstep4(_mm_sub_ps(z, floor4(z, iz)));
+
+	__m128i one = _mm_set1_epi32(1);
+	__m128i ix1 = _mm_add_epi32(ix, one), iy1 = _mm_add_epi32(iy, one), iz1 = _mm_add_epi32(iz, one);
+	__m128 x00 = lerp4(latticeValue4(ix, iy, iz, seed), latticeValue4(ix1, iy, iz, seed), tx);
+	__m128 x10 = lerp4(latticeValue4(ix, iy1, iz, seed), latticeValue4(ix1, iy1, iz, seed), tx);
+	__m128 x01 = lerp4(latticeValue4(ix, iy, iz1, seed), latticeValue4(ix1, iy, iz1, seed), tx);
+	__m128 x11 = lerp4(latticeValue4(ix, iy1, iz1, seed), latticeValue4(ix1, iy1, iz1, seed), tx);
+	return lerp4(lerp4(x00, x10, ty), lerp4(x01, x11, ty), tz);
+}
+#endif
+
+// Fractal (fBm) value noise at 'count' points: each octave has twice the frequency and half the
+//	amplitude of the last, and its own seed. Comes out in about [-1, 1].
+static void fractalNoise(const float *x, const float *y, const float *z, size_t count,
+	float frequency, uint32_t numOctaves, uint32_t seed, float *result)
+{
+	size_t i = 0;
+#if ASTEROID_NOISE_SSE2
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+		__m128 sum = _mm_setzero_ps();
+		float octaveFrequency = frequency, amplitude = 0.5f;
+		for (uint32_t octave = 0; octave < numOctaves; octave++)
+		{
+			__m128 scale = _mm_set1_ps(octaveFrequency);
+			__m128i octaveSeed = _mm_set1_epi32(static_cast<int32_t>(seed + octave * NOISE_OCTAVE_SEED_STEP));
+			__m128 noise = valueNoise4(_mm_mul_ps(px, scale), _mm_mul_ps(py, scale), _mm_mul_ps(pz, scale), octaveSeed);
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(amplitude), noise));
+			octaveFrequency *= 2.0f;
+			amplitude *= 0.5f;
+		}
+		_mm_storeu_ps(result + i, sum);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		float sum = 0.0f;
+		float octaveFrequency = frequency, amplitude = 0.5f;
+		for (uint32_t octave = 0; octave < numOctaves; octave++)
+		{
+			sum += amplitude * valueNoise(x[i] * octaveFrequency, y[i] * octaveFrequency, z[i] * octaveFrequency,
+				seed + octave * NOISE_OCTAVE_SEED_STEP);
+			octaveFrequency *= 2.0f;
+			amplitude *= 0.5f;
+		}
+		result[i] = sum;
+	}
+}
+
+void generateAsteroidMesh(uint32_t seed, const AsteroidShape &shape, MeshData &mesh)
+{
+	buildIcosphereMesh(shape.numLods, mesh);
+
+	// Stretch each rock a little differently, so they aren't all round.
+	uint32_t random = seed * 747796405U + 2891336453U;
+	float axisScale[3];
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		axisScale[axis] = 0.75f + 0.5f * static_cast<float>(random >> 8) / 16777216.0f;
+	}
+
+	// Sample the noise on the unit sphere, for every LOD at once.
+	size_t numVertices = mesh.vertices.size();
+	std::vector<float> x(numVertices), y(numVertices), z(numVertices), noise(numVertices);
+	for (size_t i = 0; i < numVertices; i++)
+	{
+		x[i] = mesh.vertices[i].pos[0];
+		y[i] = mesh.vertices[i].pos[1];
+		z[i] = mesh.vertices[i].pos[2];
+	}
+	fractalNoise(x.data(), y.data(), z.data(), numVertices, shape.frequency, shape.numOctaves, seed, noise.data());
+
+	for (size_t i = 0; i < numVertices; i++)
+	{
+		float radius = shape.radius * (1.0f + shape.displacement * noise[i]);
+		MeshVertex &vertex = mesh.vertices[i];
+		vertex.pos[0] = x[i] * radius * axisScale[0];
+		vertex.pos[1] = y[i] * radius * axisScale[1];
+		vertex.pos[2] = z[i] * radius * axisScale[2];
+		memset(vertex.normal, 0, sizeof(vertex.normal));
+	}
+
+	// Smooth normals: area weighted face normals summed into the corners, per LOD.
+	for (const MeshFileLod &lod : mesh.lods)
+	{
+		MeshVertex *vertices = mesh.vertices.data() + lod.vertexOffset;
+		const uint32_t *indices = mesh.indices.data() + lod.firstIndex;
+		for (uint32_t i = 0; i + 2 < lod.numIndices; i += 3)
+		{
+			const float *a = vertices[indices[i]].pos, *b = vertices[indices[i + 1]].pos, *c = vertices[indices[i + 2]].pos;
+			float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			float faceNormal[3] = {
+				ab[1] * ac[2] - ab[2] * ac[1],
+				ab[2] * ac[0] - ab[0] * ac[2],
+				ab[0] * ac[1] - ab[1] * ac[0]
+			};
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				float *normal = vertices[indices[i + j]].normal;
+				normal[0] += faceNormal[0];
+				normal[1] += faceNormal[1];
+				normal[2] += faceNormal[2];
+			}
+		}
+	}
+	for (MeshVertex &vertex : mesh.vertices)
+	{
+		float length = sqrtf(vertex.normal[0] * vertex.normal[0] + vertex.normal[1] * vertex.normal[1] + vertex.normal[2] * vertex.normal[2]);
+		if (length > 0.0f)
+		{
+			vertex.normal[0] /= length;
+			vertex.normal[1] /= length;
+			vertex.normal[2] /= length;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Worker threads
+//
+//////////////////////////////////////////////////////////////////////////////
+void AsteroidGenerator::start(const AsteroidShape &shape, MeshVertexFormat vertexFormat, uint32_t numThreads, const char *cacheDirectory)
+{
+	stop();
+	this->shape = shape;
+	this->vertexFormat = vertexFormat;
+	stopping = false;
+
+	this->cacheDirectory.clear();
+	if (cacheDirectory)
+	{
+		if (createDirectory(cacheDirectory))
+			this->cacheDirectory = cacheDirectory;
+		else
+			fprintf(stderr, "Warning: Can't create the asteroid cache directory \"%s\", asteroids won't be cached\n", cacheDirectory);
+	}
+
+	if (!numThreads)
+		numThreads = std::max(2U, std::thread::hardware_concurrency()) - 1; // It's allowed to return 0.
+	for (uint32_t i = 0; i < numThreads; i++)
+		workers.push_back(std::thread(&AsteroidGenerator::workerMain, this));
+}
+
+void AsteroidGenerator::stop(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		jobs.clear();
+	}
+	wakeCondition.notify_all();
+	for (std::thread &worker : workers)
+		worker.join();
+	workers.clear();
+}
+
+void AsteroidGenerator::submit(uint32_t id, uint32_t seed)
+{
+	Job job = {
+		id, // ID
+		seed // Seed
+	};
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(job);
+	}
+	wakeCondition.notify_one();
+}
+
+void AsteroidGenerator::collect(std::vector<GeneratedAsteroid> &results)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (GeneratedAsteroid &asteroid : finished)
+		results.push_back(std::move(asteroid));
+	finished.clear();
+}
+
+std::string AsteroidGenerator::getCachePath(uint64_t key) const
+{
+	char fileName[48];
+	snprintf(fileName, sizeof(fileName), "asteroid_%016llx.mesh", static_cast<unsigned long long>(key));
+	return cacheDirectory + "/" + fileName;
+}
+
+uint64_t AsteroidGenerator::getNumCacheWriteFailures(void)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return numCacheWriteFailures;
+}
+
+void AsteroidGenerator::workerMain(void)
+{
+	MeshData mesh; // Kept between jobs so its vectors keep their capacity.
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeCondition.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (stopping)
+				return;
+			job = jobs.front();
+			jobs.pop_front();
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		GeneratedAsteroid asteroid;
+		asteroid.id = job.id;
+		asteroid.key = getAsteroidCacheKey(job.seed, shape, vertexFormat);
+		generateAsteroidMesh(job.seed, shape, mesh);
+		optimizeMesh(mesh, &asteroid.optimization);
+		buildMeshClusters(mesh);
+		packMeshFile(mesh, asteroid.image, vertexFormat);
+		asteroid.generateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		// Written to a temporary and renamed into place, so a reader never sees half a file. It
+		//	replaces whatever was there, since a damaged or outdated entry is why it was generated.
+		bool writeFailed = false;
+		if (!cacheDirectory.empty())
+		{
+			std::string cachePath = getCachePath(asteroid.key);
+			std::string tempPath = cachePath + ".tmp";
+			FILE *file = openFile(tempPath.c_str(), "wb");
+			bool ok = file && fwrite(asteroid.image.data(), 1, asteroid.image.size(), file) == asteroid.image.size();
+			ok = file && fclose(file) == 0 && ok;
+			ok = ok && replaceFile(tempPath.c_str(), cachePath.c_str());
+			if (!ok)
+			{
+				remove(tempPath.c_str());
+				writeFailed = true;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		numCacheWriteFailures += writeFailed ? 1 : 0;
+		finished.push_back(std::move(asteroid));
+	}
+}
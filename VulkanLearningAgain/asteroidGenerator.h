@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "meshFile.h"
+#include "meshOptimizer.h"
+
+// What every asteroid in a field has in common. The seed picks the individual rock.
+struct AsteroidShape
+{
+	uint32_t numLods; // Subdivision levels of the icosphere, most detailed first.
+	float radius;
+	float displacement; // Largest bump, as a fraction of the radius.
+	float frequency; // Of the first noise octave, over the unit sphere.
+	uint32_t numOctaves;
+};
+
+// Key for the variant 'seed' of 'shape' packed with 'vertexFormat' (also covers the generator's
+//	version), so a cached mesh is only ever reused for exactly the same inputs.
+uint64_t getAsteroidCacheKey(uint32_t seed, const AsteroidShape &shape, MeshVertexFormat vertexFormat);
+
+// An icosphere LOD chain, stretched along random axes and displaced along its normals by fractal
+//	value noise, with smooth normals rebuilt afterwards. Every LOD samples the same noise, so they
+//	all have the same silhouette.
+// Deterministic for a given seed and shape.
+void generateAsteroidMesh(uint32_t seed, const AsteroidShape &shape, MeshData &mesh);
+
+// A generated asteroid, with its indices optimized, split into clusters and packed into the .mesh file format.
+struct GeneratedAsteroid
+{
+	uint32_t id; // As submitted.
+	uint64_t key;
+	std::vector<uint8_t> image; // A whole .mesh file.
+	double generateMs; // Including the optimization and clustering.
+	MeshOptimizationStats optimization;
+};
+
+// Generates asteroids on worker threads so startup isn't held up by them.
+// When there's a cache directory every mesh is also written to it (as <key>.mesh), for the next
+//	run to load instead.
+class AsteroidGenerator
+{
+	struct Job
+	{
+		uint32_t id;
+		uint32_t seed;
+	};
+
+	AsteroidShape shape = {};
+	MeshVertexFormat vertexFormat = MESH_VERTEX_FORMAT_QUANTIZED;
+	std::string cacheDirectory; // Empty when there's no cache.
+	std::vector<std::thread> workers;
+	std::mutex mutex; // Guards everything below.
+	std::condition_variable wakeCondition;
+	std::deque<Job> jobs;
+	std::vector<GeneratedAsteroid> finished;
+	bool stopping = false;
+	uint64_t numCacheWriteFailures = 0;
+
+	void workerMain(void);
+
+public:
+	AsteroidGenerator(void) = default;
+	~AsteroidGenerator(void) { stop(); }
+
+	// 'numThreads' of 0 uses every hardware thread but one (which is left for the render thread).
+	// Meshes are packed with 'vertexFormat'.
+	void start(const AsteroidShape &shape, MeshVertexFormat vertexFormat, uint32_t numThreads, const char *cacheDirectory);
+
+	// Drops the jobs that haven't started, and joins the workers.
+	void stop(void);
+
+	// Queue the asteroid for 'seed'. It comes back out of collect() tagged with 'id'.
+	void submit(uint32_t id, uint32_t seed);
+
+	// Move everything finished since the last call into 'results'. Never blocks on a job.
+	void collect(std::vector<GeneratedAsteroid> &results);
+
+	std::string getCachePath(uint64_t key) const;
+	bool hasCache(void) const { return !cacheDirectory.empty(); }
+	uint32_t getNumThreads(void) const { return static_cast<uint32_t>(workers.size()); }
+	uint64_t getNumCacheWriteFailures(void);
+};
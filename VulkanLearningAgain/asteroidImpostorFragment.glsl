@@ -0,0 +1,22 @@
+#version 450 core
+
+// Shades an impostor quad as a lit sphere, cutting it down to the disc.
+
+layout (location=0) in vec4 inColor; // Albedo
+layout (location=1) in vec2 inCorner;
+layout (location=2) flat in vec3 inLight;
+
+layout (location=0) out vec4 outColor;
+
+const float AMBIENT = 0.08;
+
+void main(void)
+{
+	float radiusSquared = dot(inCorner, inCorner);
+	if (radiusSquared > 1.0)
+		discard;
+
+	vec3 normal = vec3(inCorner.x, inCorner.y, sqrt(1.0 - radiusSquared));
+	float light = max(dot(normal, inLight), 0.0);
+	outColor = vec4(inColor.rgb * (AMBIENT + light), 1.0);
+}
@@ -0,0 +1,237 @@
+#version 450 core
+
+// Draws the asteroids asteroidCull.glsl put into a bucket. Instance i of a draw is the body at
+//	drawList[first instance of the bucket + i].
+// A bucket of ~0U is every mesh bucket in one multi-draw, where each draw's first instance is
+//	already its bucket's start, so gl_InstanceIndex indexes the draw list directly.
+// With IMPOSTOR defined it draws every impostor bucket instead, as camera facing quads sized from
+//	the mesh's bounding sphere (6 vertices each, no vertex buffer).
+// With QUANTIZED_VERTICES defined the mesh vertices are QuantizedMeshVertex (meshFile.h): snorm
+//	positions within the mesh's bounds, octahedral normals and half float UVs.
+// With CLUSTERS defined it draws the clusters asteroidCull.glsl's CULL_CLUSTERS stage wrote out,
+//	as one instance: each index is a cluster instance times 64 plus a vertex of that cluster, and
+//	the vertex is fetched from the mesh pool's vertex buffer here instead of by vertex input.
+// With BINDLESS_SET defined the bodies are read through the bindless table, and with REMOTE_BODIES
+//	defined the remote bodies are read too, like asteroidCull.glsl.
+
+#if defined(BINDLESS_SET)
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
+
+layout (set=0, binding=0) uniform FrameParams
+{
+	mat4 viewProj;
+	vec4 frustumPlanes[6];
+	vec4 cameraPos; // xyz position, w pixels per unit at a distance of one
+	vec4 cameraRight; // xyz, w instance scale
+	vec4 cameraUp;
+	vec4 lodParams;
+	uvec4 counts; // x instances, y slots, z LODs, w stats index
+	mat4 occlusionViewProj;
+	vec4 hiZParams;
+	uvec4 cullParams;
+	uvec4 bodyParams; // x bindless table index of the bodies, y of the remote bodies, z first remote instance
+};
+
+struct Body
+{
+	vec4 posMass;
+	vec4 velocity;
+};
+
+#if defined(BINDLESS_SET)
+// Every storage buffer in the bindless table (vulkanBindless.h).
+layout (set=BINDLESS_SET, binding=0) readonly buffer BindlessBodies
+{
+	Body bodies[];
+} bindlessBodies[];
+#else
+layout (set=0, binding=1) readonly buffer Bodies
+{
+	Body bodies[];
+};
+#endif
+
+#if defined(REMOTE_BODIES) && !defined(BINDLESS_SET)
+layout (set=0, binding=15) readonly buffer RemoteBodies
+{
+	Body remoteBodies[];
+};
+#endif
+
+// Instances from bodyParams.z on are the remote bodies.
+vec4 getPosMass(uint body)
+{
+#if defined(REMOTE_BODIES)
+	if (body >= bodyParams.z)
+	{
+#if defined(BINDLESS_SET)
+		return bindlessBodies[bodyParams.y].bodies[body - bodyParams.z].posMass;
+#else
+		return remoteBodies[body - bodyParams.z].posMass;
+#endif
+	}
+#endif
+#if defined(BINDLESS_SET)
+	return bindlessBodies[bodyParams.x].bodies[body].posMass;
+#else
+	return bodies[body].posMass;
+#endif
+}
+
+struct MeshSlot
+{
+	vec4 boundingSphere;
+	vec4 boundsCenter; // Quantized positions are relative to the bounds box.
+	vec4 boundsHalfExtent;
+	uvec4 lods[8];
+	uvec4 clusterBases;
+	uvec2 clusterLods[8];
+};
+
+layout (set=0, binding=2) readonly buffer MeshSlots
+{
+	MeshSlot slots[];
+};
+
+layout (set=0, binding=5) readonly buffer Buckets
+{
+	uint lodChanges;
+	uint numOccluded;
+	uint bucketsPad1;
+	uint bucketsPad2;
+	uvec2 buckets[]; // x count, y first
+};
+
+layout (set=0, binding=6) readonly buffer DrawList
+{
+	uint drawList[];
+};
+
+layout (push_constant) uniform DrawParams
+{
+	uint bucket;
+};
+
+#if defined(CLUSTERS)
+// The mesh pool's vertices, MeshVertex or QuantizedMeshVertex.
+layout (set=0, binding=9) readonly buffer VertexData
+{
+	uint vertexWords[];
+};
+
+layout (set=0, binding=10) readonly buffer ClusterData
+{
+	uint clusterWords[];
+};
+
+// x body, y word of the cluster's first vertex in clusterWords, z vertex offset of its LOD.
+layout (set=0, binding=11) readonly buffer ClusterInstances
+{
+	uvec4 clusterInstances[];
+};
+
+const uint CLUSTER_VERTEX_BITS = 6; // MESH_CLUSTER_MAX_VERTICES is 64.
+#endif
+
+#if defined(IMPOSTOR) || defined(CLUSTERS)
+#elif defined(QUANTIZED_VERTICES)
+layout (location=0) in vec4 inPos; // -1 to 1 across the bounds
+layout (location=1) in vec2 inNormal; // Octahedral
+layout (location=2) in vec2 inUV;
+#else
+layout (location=0) in vec3 inPos;
+layout (location=1) in vec3 inNormal;
+layout (location=2) in vec2 inUV;
+#endif
+
+layout (location=0) out vec4 outColor;
+#ifndef IMPOSTOR
+layout (location=1) out vec2 outUV;
+#endif
+#ifdef IMPOSTOR
+layout (location=1) out vec2 outCorner; // -1 to 1 across the quad
+layout (location=2) flat out vec3 outLight; // Sun direction in the quad's (right, up, toward the camera) basis
+#endif
+
+const vec3 SUN_DIRECTION = vec3(0.57735, 0.57735, 0.57735);
+const float AMBIENT = 0.08;
+
+// Grey to brown, per body.
+vec3 getAlbedo(uint body)
+{
+	uint hash = body * 747796405U + 2891336453U;
+	hash = ((hash >> ((hash >> 28) + 4)) ^ hash) * 277803737U;
+	float t = float(hash >> 8) * (1.0 / 16777215.0);
+	return mix(vec3(0.35, 0.33, 0.31), vec3(0.45, 0.36, 0.27), t);
+}
+
+#ifdef QUANTIZED_VERTICES
+// Unfold the lower half of the octahedron back out from the corners of the square.
+vec3 decodeOctahedral(vec2 encoded)
+{
+	vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-normal.z, 0.0);
+	normal.x += normal.x >= 0.0 ? -fold : fold;
+	normal.y += normal.y >= 0.0 ? -fold : fold;
+	return normalize(normal);
+}
+#endif
+
+void main(void)
+{
+#ifdef CLUSTERS
+	uvec4 clusterInstance = clusterInstances[gl_VertexIndex >> CLUSTER_VERTEX_BITS];
+	uint body = clusterInstance.x;
+	uint vertex = clusterInstance.z + clusterWords[clusterInstance.y + (gl_VertexIndex & ((1U << CLUSTER_VERTEX_BITS) - 1))];
+#ifdef QUANTIZED_VERTICES
+	uint word = vertex * 4; // sizeof(QuantizedMeshVertex) / 4
+	vec4 inPos = vec4(unpackSnorm2x16(vertexWords[word]), unpackSnorm2x16(vertexWords[word + 1]));
+	vec2 inNormal = unpackSnorm2x16(vertexWords[word + 2]);
+	vec2 inUV = unpackHalf2x16(vertexWords[word + 3]);
+#else
+	uint word = vertex * 8; // sizeof(MeshVertex) / 4
+	vec3 inPos = uintBitsToFloat(uvec3(vertexWords[word], vertexWords[word + 1], vertexWords[word + 2]));
+	vec3 inNormal = uintBitsToFloat(uvec3(vertexWords[word + 3], vertexWords[word + 4], vertexWords[word + 5]));
+	vec2 inUV = uintBitsToFloat(uvec2(vertexWords[word + 6], vertexWords[word + 7]));
+#endif
+#else
+	uint first = bucket == ~0U ? 0U : buckets[bucket].y;
+	uint body = drawList[first + gl_InstanceIndex];
+#endif
+	vec4 posMass = getPosMass(body);
+	float scale = cameraRight.w * pow(posMass.w, 1.0 / 3.0);
+	vec3 albedo = getAlbedo(body);
+
+#ifdef IMPOSTOR
+	const vec2 corners[6] = vec2[](vec2(-1, -1), vec2(1, -1), vec2(1, 1), vec2(-1, -1), vec2(1, 1), vec2(-1, 1));
+	vec2 corner = corners[gl_VertexIndex];
+
+	// The rock doesn't fill its bounding sphere, so the disc is a bit smaller.
+	vec4 sphere = slots[body % counts.y].boundingSphere;
+	vec3 center = posMass.xyz + sphere.xyz * scale;
+	float radius = sphere.w * scale * 0.85;
+	vec3 world = center + (cameraRight.xyz * corner.x + cameraUp.xyz * corner.y) * radius;
+	gl_Position = viewProj * vec4(world, 1.0);
+
+	vec3 toCamera = normalize(cameraPos.xyz - center);
+	outCorner = corner;
+	outLight = vec3(dot(SUN_DIRECTION, cameraRight.xyz), dot(SUN_DIRECTION, cameraUp.xyz), dot(SUN_DIRECTION, toCamera));
+	outColor = vec4(albedo, 1.0);
+#else
+#ifdef QUANTIZED_VERTICES
+	uint slot = body % counts.y;
+	vec3 pos = slots[slot].boundsCenter.xyz + inPos.xyz * slots[slot].boundsHalfExtent.xyz;
+	vec3 normal = decodeOctahedral(inNormal);
+#else
+	vec3 pos = inPos;
+	vec3 normal = inNormal;
+#endif
+	vec3 world = posMass.xyz + pos * scale;
+	gl_Position = viewProj * vec4(world, 1.0);
+
+	float light = max(dot(normal, SUN_DIRECTION), 0.0);
+	outColor = vec4(albedo * (AMBIENT + light), 1.0);
+	outUV = inUV;
+#endif
+}
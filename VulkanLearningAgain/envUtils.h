@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string>
+
+// getenv that keeps MSVC's SDL checks happy (they turn getenv's deprecation warning into an error).
+// Returns false if the variable isn't set.
+inline bool readEnvironmentVariable(const char *name, std::string &value)
+{
+#ifdef _MSC_VER
+	char *buffer = nullptr;
+	size_t length = 0;
+	if (_dupenv_s(&buffer, &length, name) != 0 || !buffer)
+		return false;
+	value = buffer;
+	free(buffer);
+	return true;
+#else
+	const char *buffer = getenv(name);
+	if (!buffer)
+		return false;
+	value = buffer;
+	return true;
+#endif
+}
+
+// True if the variable is set to anything other than "", "0", "false" or "off".
+// 'defaultValue' if it isn't set at all.
+inline bool isEnvironmentFlagSet(const char *name, bool defaultValue = false)
+{
+	std::string value;
+	if (!readEnvironmentVariable(name, value))
+		return defaultValue;
+	return !(value.empty() || value == "0" || value == "false" || value == "off");
+}
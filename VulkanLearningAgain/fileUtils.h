@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdio.h>
+#include <errno.h>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// fopen that keeps MSVC's SDL checks happy (they turn fopen's deprecation warning into an error).
+// Returns nullptr on failure, like fopen.
+inline FILE *openFile(const char *path, const char *mode)
+{
+#ifdef _MSC_VER
+	FILE *file = nullptr;
+	if (fopen_s(&file, path, mode) != 0)
+		return nullptr;
+	return file;
+#else
+	return fopen(path, mode);
+#endif
+}
+
+// Read a whole file into 'data'. Returns false if it can't be opened or read.
+inline bool readFile(const char *path, std::vector<char> &data)
+{
+	FILE *file = openFile(path, "rb");
+	if (!file)
+		return false;
+
+	bool ok = fseek(file, 0, SEEK_END) == 0;
+	long size = ok ? ftell(file) : -1;
+	ok = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+	if (ok)
+	{
+		data.resize(static_cast<size_t>(size));
+		ok = size == 0 || fread(data.data(), 1, data.size(), file) == data.size();
+	}
+	fclose(file);
+	return ok;
+}
+
+// True if 'path' can be opened for reading.
+inline bool fileExists(const char *path)
+{
+	FILE *file = openFile(path, "rb");
+	if (!file)
+		return false;
+	fclose(file);
+	return true;
+}
+
+// Rename 'from' to 'to', replacing 'to' if it's already there. Returns false if it didn't happen.
+// rename() already replaces elsewhere, but on Windows it fails when the target exists, so the
+//	target's removed first there (a reader in between just finds nothing).
+inline bool replaceFile(const char *from, const char *to)
+{
+#ifdef _WIN32
+	remove(to);
+#endif
+	return rename(from, to) == 0;
+}
+
+// Create the directory 'path' (not its parents). Returns true if it exists afterwards.
+inline bool createDirectory(const char *path)
+{
+#ifdef _WIN32
+	if (_mkdir(path) == 0)
+		return true;
+#else
+	if (mkdir(path, 0755) == 0)
+		return true;
+#endif
+	return errno == EEXIST;
+}
@@ -0,0 +1,25 @@
+#version 450 core
+
+// One level of the Hi-Z pyramid: each texel is the smallest (with reversed Z, the farthest) depth of
+//	the 2x2 texels under it in the level above, or in the depth buffer for level 0.
+// Levels are rounded up in size, so on an odd edge the last texel only covers one texel above. Reads
+//	past the edge are clamped back onto it, which never makes the result nearer than it should be.
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (set=0, binding=0) uniform sampler2D source;
+layout (set=0, binding=1, r32f) uniform writeonly image2D destination;
+
+void main(void)
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(texel, imageSize(destination))))
+		return;
+
+	ivec2 sourceMax = textureSize(source, 0) - 1;
+	ivec2 base = texel * 2;
+	float depth = min(
+		min(texelFetch(source, min(base, sourceMax), 0).x, texelFetch(source, min(base + ivec2(1, 0), sourceMax), 0).x),
+		min(texelFetch(source, min(base + ivec2(0, 1), sourceMax), 0).x, texelFetch(source, min(base + ivec2(1, 1), sourceMax), 0).x));
+	imageStore(destination, texel, vec4(depth));
+}
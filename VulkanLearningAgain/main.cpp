@@ -40,7 +40,7 @@ int main(void)
 		SDL_Window *sdlWindow = SDL_CreateWindow("LearningVulkanAgain",
 			SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
 			screenWidth, screenHeight,
-			SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_VULKAN);
+			SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
 
 		// Initialize the engine
 		VulkanEngine engine;
@@ -50,6 +50,29 @@ int main(void)
 		auto endTime = std::chrono::high_resolution_clock::now();
 
 		printf("Time to initialize engine: %lf seconds\n", std::chrono::duration<double>(endTime - startTime).count());
+
+		// Run until the window gets closed.
+		bool running = true;
+		while (running)
+		{
+			SDL_Event event;
+			while (SDL_PollEvent(&event))
+			{
+				if (event.type == SDL_QUIT)
+					running = false;
+				else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+					engine.onWindowResized();
+			}
+
+			// Don't spin while there's nothing to draw to.
+			if (SDL_GetWindowFlags(sdlWindow) & SDL_WINDOW_MINIMIZED)
+			{
+				SDL_Delay(10);
+				continue;
+			}
+
+			engine.drawFrame();
+		}
 	}
 	catch (std::exception &e)
 	{
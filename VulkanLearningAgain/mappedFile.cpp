@@ -0,0 +1,116 @@
+#include "mappedFile.h"
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+bool MappedFile::open(const char *path)
+{
+	close();
+
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	fileHandle = file;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0
+		|| static_cast<unsigned long long>(fileSize.QuadPart) > SIZE_MAX)
+	{
+		close();
+		return false;
+	}
+
+	mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mappingHandle)
+	{
+		close();
+		return false;
+	}
+
+	data = static_cast<const uint8_t *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (!data)
+	{
+		close();
+		return false;
+	}
+	size = static_cast<size_t>(fileSize.QuadPart);
+	return true;
+}
+
+void MappedFile::close(void)
+{
+	if (data)
+		UnmapViewOfFile(data);
+	if (mappingHandle)
+		CloseHandle(mappingHandle);
+	if (fileHandle)
+		CloseHandle(fileHandle);
+
+	data = nullptr;
+	size = 0;
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+}
+
+void MappedFile::prefetch(void) const
+{
+	if (!data)
+		return;
+	WIN32_MEMORY_RANGE_ENTRY range = { const_cast<uint8_t *>(data), size };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+#else
+bool MappedFile::open(const char *path)
+{
+	close();
+
+	fileDescriptor = ::open(path, O_RDONLY);
+	if (fileDescriptor < 0)
+		return false;
+
+	struct stat fileStat;
+	if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size <= 0)
+	{
+		close();
+		return false;
+	}
+
+	void *mapping = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (mapping == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	data = static_cast<const uint8_t *>(mapping);
+	size = static_cast<size_t>(fileStat.st_size);
+	madvise(mapping, size, MADV_SEQUENTIAL);
+	return true;
+}
+
+void MappedFile::close(void)
+{
+	if (data)
+		munmap(const_cast<uint8_t *>(data), size);
+	if (fileDescriptor >= 0)
+		::close(fileDescriptor);
+
+	data = nullptr;
+	size = 0;
+	fileDescriptor = -1;
+}
+
+void MappedFile::prefetch(void) const
+{
+	if (data)
+		madvise(const_cast<uint8_t *>(data), size, MADV_WILLNEED);
+}
+#endif
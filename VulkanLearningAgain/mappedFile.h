@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A whole file mapped read-only into memory, so its bytes can be copied straight to where they're
+//	going (e.g. a staging buffer) without being read into a buffer of our own first. The OS pages it
+//	in as it's touched.
+// The mapping's page aligned. Not copyable, the mapping's released when it's destroyed.
+class MappedFile
+{
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void *fileHandle = nullptr;
+	void *mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif
+
+public:
+	MappedFile(void) {}
+	~MappedFile(void) { close(); }
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	// Returns false if the file can't be opened or mapped. Empty files can't be mapped either.
+	bool open(const char *path);
+	void close(void);
+
+	// Ask the OS to start reading the whole file in, ahead of it being touched. Just a hint.
+	void prefetch(void) const;
+
+	const uint8_t *getData(void) const { return data; }
+	size_t getSize(void) const { return size; }
+	bool isOpen(void) const { return data != nullptr; }
+};
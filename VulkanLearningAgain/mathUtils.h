@@ -0,0 +1,111 @@
+#pragma once
+
+#include <math.h>
+
+// Matrices are float[16], column major (element [column * 4 + row]), the way GLSL reads a mat4.
+// Vectors are float[3].
+
+inline float dotVectors(const float a[3], const float b[3])
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+inline void crossVectors(const float a[3], const float b[3], float result[3])
+{
+	float x = a[1] * b[2] - a[2] * b[1];
+	float y = a[2] * b[0] - a[0] * b[2];
+	float z = a[0] * b[1] - a[1] * b[0];
+	result[0] = x;
+	result[1] = y;
+	result[2] = z;
+}
+
+inline void normalizeVector(float v[3])
+{
+	float length = sqrtf(dotVectors(v, v));
+	if (length > 0.0f)
+	{
+		v[0] /= length;
+		v[1] /= length;
+		v[2] /= length;
+	}
+}
+
+// result = a * b. 'result' can't be 'a' or 'b'.
+inline void multiplyMatrices(const float a[16], const float b[16], float result[16])
+{
+	for (int column = 0; column < 4; column++)
+	{
+		for (int row = 0; row < 4; row++)
+		{
+			float sum = 0.0f;
+			for (int k = 0; k < 4; k++)
+				sum += a[k * 4 + row] * b[column * 4 + k];
+			result[column * 4 + row] = sum;
+		}
+	}
+}
+
+// Right handed view looking down -Z, into Vulkan's clip space (Y down) with reversed depth: 1 at
+//	the near plane and 0 at the far one. Depth falls off as 1/distance, and a float depth buffer has
+//	the most precision near 0, so the two mostly cancel out and far away depth stays usable.
+inline void perspectiveMatrix(float fovY, float aspect, float zNear, float zFar, float result[16])
+{
+	float f = 1.0f / tanf(fovY * 0.5f);
+	for (int i = 0; i < 16; i++)
+		result[i] = 0.0f;
+	result[0] = f / aspect;
+	result[5] = -f;
+	result[10] = zNear / (zFar - zNear);
+	result[11] = -1.0f;
+	result[14] = zNear * zFar / (zFar - zNear);
+}
+
+// View matrix for a camera at 'eye' looking at 'target'. Also hands back the camera's world space
+//	right and up axes when asked for.
+inline void lookAtMatrix(const float eye[3], const float target[3], const float worldUp[3], float result[16],
+	float *rightOut = nullptr, float *upOut = nullptr)
+{
+	float forward[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+	normalizeVector(forward);
+	float right[3];
+	crossVectors(forward, worldUp, right);
+	normalizeVector(right);
+	float up[3];
+	crossVectors(right, forward, up);
+
+	result[0] = right[0]; result[4] = right[1]; result[8] = right[2]; result[12] = -dotVectors(right, eye);
+	result[1] = up[0]; result[5] = up[1]; result[9] = up[2]; result[13] = -dotVectors(up, eye);
+	result[2] = -forward[0]; result[6] = -forward[1]; result[10] = -forward[2]; result[14] = dotVectors(forward, eye);
+	result[3] = 0.0f; result[7] = 0.0f; result[11] = 0.0f; result[15] = 1.0f;
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (rightOut)
+			rightOut[i] = right[i];
+		if (upOut)
+			upOut[i] = up[i];
+	}
+}
+
+// The six planes (left, right, bottom, top, near, far) bounding what 'viewProj' can see, as
+//	xyz normal (pointing in) and w distance. A point p is inside a plane when dot(xyz, p) + w >= 0.
+inline void extractFrustumPlanes(const float viewProj[16], float planes[6][4])
+{
+	for (int i = 0; i < 4; i++)
+	{
+		float x = viewProj[i * 4 + 0], y = viewProj[i * 4 + 1], z = viewProj[i * 4 + 2], w = viewProj[i * 4 + 3];
+		planes[0][i] = w + x;
+		planes[1][i] = w - x;
+		planes[2][i] = w + y;
+		planes[3][i] = w - y;
+		planes[4][i] = w - z; // Reversed depth, so the near plane is at 1...
+		planes[5][i] = z; // ...and the far one at 0 (not -w, this is Vulkan).
+	}
+	for (int i = 0; i < 6; i++)
+	{
+		float length = sqrtf(dotVectors(planes[i], planes[i]));
+		for (int j = 0; j < 4; j++)
+			planes[i][j] /= length;
+	}
+}
@@ -0,0 +1,210 @@
+#include "meshClusters.h"
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+// How much a neighbouring triangle facing the other way counts against it, in new vertices. At 2,
+//	a triangle at right angles to the cluster is worth the same as one adding two vertices.
+#define MESH_CLUSTER_FACING_WEIGHT 2.0f
+
+static void addCluster(MeshData &mesh, const MeshVertex *vertices, const float *normals,
+	const std::vector<uint32_t> &clusterVertices, const std::vector<uint32_t> &clusterTriangles,
+	const std::vector<uint32_t> &packedTriangles)
+{
+	MeshCluster cluster = {};
+	cluster.firstVertex = static_cast<uint32_t>(mesh.clusterVertices.size());
+	cluster.firstTriangle = static_cast<uint32_t>(mesh.clusterTriangles.size());
+	cluster.numVertices = static_cast<uint32_t>(clusterVertices.size());
+	cluster.numTriangles = static_cast<uint32_t>(clusterTriangles.size());
+
+	// Sphere around the middle of the box, the same as the whole mesh's.
+	float boundsMin[3], boundsMax[3];
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		boundsMin[axis] = vertices[clusterVertices[0]].pos[axis];
+		boundsMax[axis] = boundsMin[axis];
+	}
+	for (uint32_t vertex : clusterVertices)
+	{
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			boundsMin[axis] = std::min(boundsMin[axis], vertices[vertex].pos[axis]);
+			boundsMax[axis] = std::max(boundsMax[axis], vertices[vertex].pos[axis]);
+		}
+	}
+	float radiusSquared = 0.0f;
+	for (uint32_t axis = 0; axis < 3; axis++)
+		cluster.boundingSphere[axis] = (boundsMin[axis] + boundsMax[axis]) * 0.5f;
+	for (uint32_t vertex : clusterVertices)
+	{
+		float dx = vertices[vertex].pos[0] - cluster.boundingSphere[0];
+		float dy = vertices[vertex].pos[1] - cluster.boundingSphere[1];
+		float dz = vertices[vertex].pos[2] - cluster.boundingSphere[2];
+		radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+	cluster.boundingSphere[3] = sqrtf(radiusSquared);
+
+	// Normal cone: the average facing, and the triangle furthest from it. Degenerate triangles have
+	//	no facing (and draw nothing), so they don't count.
+	float axisSum[3] = {};
+	for (uint32_t triangle : clusterTriangles)
+	{
+		for (uint32_t axis = 0; axis < 3; axis++)
+			axisSum[axis] += normals[triangle * 3 + axis];
+	}
+	float axisLength = sqrtf(axisSum[0] * axisSum[0] + axisSum[1] * axisSum[1] + axisSum[2] * axisSum[2]);
+	if (axisLength > 1e-6f)
+	{
+		float cutoff = 1.0f;
+		for (uint32_t axis = 0; axis < 3; axis++)
+			cluster.coneAxis[axis] = axisSum[axis] / axisLength;
+		for (uint32_t triangle : clusterTriangles)
+		{
+			const float *normal = &normals[triangle * 3];
+			if (normal[0] != 0.0f || normal[1] != 0.0f || normal[2] != 0.0f)
+				cutoff = std::min(cutoff, normal[0] * cluster.coneAxis[0] + normal[1] * cluster.coneAxis[1] + normal[2] * cluster.coneAxis[2]);
+		}
+		cluster.coneCutoff = cutoff;
+	}
+
+	mesh.clusters.push_back(cluster);
+	mesh.clusterVertices.insert(mesh.clusterVertices.end(), clusterVertices.begin(), clusterVertices.end());
+	mesh.clusterTriangles.insert(mesh.clusterTriangles.end(), packedTriangles.begin(), packedTriangles.end());
+}
+
+static void buildLodClusters(MeshData &mesh, MeshFileLod &lod)
+{
+	const uint32_t *indices = mesh.indices.data() + lod.firstIndex;
+	const MeshVertex *vertices = mesh.vertices.data() + lod.vertexOffset;
+	size_t numTriangles = lod.numIndices / 3;
+	lod.firstCluster = static_cast<uint32_t>(mesh.clusters.size());
+	lod.numClusters = 0;
+
+	// The triangles around each vertex.
+	std::vector<uint32_t> adjacencyOffsets(lod.numVertices + 1, 0);
+	for (size_t i = 0; i < numTriangles * 3; i++)
+		adjacencyOffsets[indices[i] + 1]++;
+	for (uint32_t vertex = 0; vertex < lod.numVertices; vertex++)
+		adjacencyOffsets[vertex + 1] += adjacencyOffsets[vertex];
+	std::vector<uint32_t> adjacency(numTriangles * 3);
+	std::vector<uint32_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t triangle = 0; triangle < numTriangles; triangle++)
+	{
+		for (uint32_t corner = 0; corner < 3; corner++)
+			adjacency[adjacencyFill[indices[triangle * 3 + corner]]++] = static_cast<uint32_t>(triangle);
+	}
+
+	// Unit face normals, zero for degenerate triangles.
+	std::vector<float> normals(numTriangles * 3, 0.0f);
+	for (size_t triangle = 0; triangle < numTriangles; triangle++)
+	{
+		const float *a = vertices[indices[triangle * 3]].pos;
+		const float *b = vertices[indices[triangle * 3 + 1]].pos;
+		const float *c = vertices[indices[triangle * 3 + 2]].pos;
+		float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float normal[3] = {
+			ab[1] * ac[2] - ab[2] * ac[1],
+			ab[2] * ac[0] - ab[0] * ac[2],
+			ab[0] * ac[1] - ab[1] * ac[0]
+		};
+		float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (length > 0.0f)
+		{
+			for (uint32_t axis = 0; axis < 3; axis++)
+				normals[triangle * 3 + axis] = normal[axis] / length;
+		}
+	}
+
+	std::vector<bool> assigned(numTriangles, false);
+	std::vector<uint32_t> localIndices(lod.numVertices, ~0U); // Of the vertices in the cluster being built.
+	std::vector<uint32_t> clusterVertices;
+	std::vector<uint32_t> clusterTriangles;
+	std::vector<uint32_t> packedTriangles;
+	std::vector<uint32_t> candidates; // Triangles next to the cluster, maybe already assigned.
+	size_t scanCursor = 0;
+	while (true)
+	{
+		while (scanCursor < numTriangles && assigned[scanCursor])
+			scanCursor++;
+		if (scanCursor == numTriangles)
+			break;
+
+		clusterVertices.clear();
+		clusterTriangles.clear();
+		packedTriangles.clear();
+		candidates.clear();
+		float facing[3] = {};
+		uint32_t nextTriangle = static_cast<uint32_t>(scanCursor);
+		while (nextTriangle != ~0U)
+		{
+			uint32_t packed = 0;
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				uint32_t vertex = indices[nextTriangle * 3 + corner];
+				if (localIndices[vertex] == ~0U)
+				{
+					localIndices[vertex] = static_cast<uint32_t>(clusterVertices.size());
+					clusterVertices.push_back(vertex);
+					for (uint32_t i = adjacencyOffsets[vertex]; i < adjacencyOffsets[vertex + 1]; i++)
+					{
+						if (!assigned[adjacency[i]])
+							candidates.push_back(adjacency[i]);
+					}
+				}
+				packed |= localIndices[vertex] << (corner * 8);
+			}
+			assigned[nextTriangle] = true;
+			clusterTriangles.push_back(nextTriangle);
+			packedTriangles.push_back(packed);
+			for (uint32_t axis = 0; axis < 3; axis++)
+				facing[axis] += normals[nextTriangle * 3 + axis];
+			if (clusterTriangles.size() == MESH_CLUSTER_MAX_TRIANGLES)
+				break;
+
+			float facingLength = sqrtf(facing[0] * facing[0] + facing[1] * facing[1] + facing[2] * facing[2]);
+			float facingScale = facingLength > 0.0f ? 1.0f / facingLength : 0.0f;
+			nextTriangle = ~0U;
+			float bestScore = 0.0f;
+			for (size_t i = 0; i < candidates.size();)
+			{
+				uint32_t triangle = candidates[i];
+				if (assigned[triangle])
+				{
+					candidates[i] = candidates.back();
+					candidates.pop_back();
+					continue;
+				}
+				i++;
+
+				uint32_t newVertices = 0;
+				for (uint32_t corner = 0; corner < 3; corner++)
+					newVertices += localIndices[indices[triangle * 3 + corner]] == ~0U ? 1 : 0;
+				if (clusterVertices.size() + newVertices > MESH_CLUSTER_MAX_VERTICES)
+					continue;
+				const float *normal = &normals[triangle * 3];
+				float alignment = (normal[0] * facing[0] + normal[1] * facing[1] + normal[2] * facing[2]) * facingScale;
+				float score = newVertices + (1.0f - alignment) * MESH_CLUSTER_FACING_WEIGHT;
+				if (nextTriangle == ~0U || score < bestScore)
+				{
+					nextTriangle = triangle;
+					bestScore = score;
+				}
+			}
+		}
+
+		addCluster(mesh, vertices, normals.data(), clusterVertices, clusterTriangles, packedTriangles);
+		lod.numClusters++;
+		for (uint32_t vertex : clusterVertices)
+			localIndices[vertex] = ~0U;
+	}
+}
+
+void buildMeshClusters(MeshData &mesh)
+{
+	mesh.clusters.clear();
+	mesh.clusterVertices.clear();
+	mesh.clusterTriangles.clear();
+	for (MeshFileLod &lod : mesh.lods)
+		buildLodClusters(mesh, lod);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+#include "meshFile.h"
+
+// Splits meshes into clusters (meshlets) of up to MESH_CLUSTER_MAX_TRIANGLES triangles and
+//	MESH_CLUSTER_MAX_VERTICES vertices, so the renderer can cull parts of a mesh that's partly
+//	visible (see MeshCluster).
+// Each cluster starts from the first triangle of the LOD that hasn't got one yet, so clusters
+//	follow the optimized index order, and grows by whichever neighbouring triangle adds the fewest
+//	new vertices and faces closest to the way the cluster does. That keeps clusters compact, for
+//	tight bounding spheres, and flat, for narrow normal cones.
+// Shared between the engine and the packer, so no Vulkan in here.
+
+// Replace 'mesh's clusters with new ones for every LOD, built from its indices as they are now.
+//	Run it after optimizeMesh(), which reorders them.
+void buildMeshClusters(MeshData &mesh);
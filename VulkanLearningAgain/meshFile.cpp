@@ -0,0 +1,401 @@
+#include "meshFile.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <map>
+#include <algorithm>
+#include "fileUtils.h"
+#include "meshClusters.h"
+
+static uint64_t alignBlob(uint64_t offset)
+{
+	return (offset + MESH_FILE_BLOB_ALIGNMENT - 1) & ~static_cast<uint64_t>(MESH_FILE_BLOB_ALIGNMENT - 1);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Vertex quantization
+//
+//////////////////////////////////////////////////////////////////////////////
+static int16_t quantizeSnorm16(float value)
+{
+	value = std::min(std::max(value, -1.0f), 1.0f);
+	return static_cast<int16_t>(floorf(value * 32767.0f + 0.5f));
+}
+
+// Round to nearest even, overflowing to infinity and underflowing through the denormals to zero.
+static uint16_t floatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t floatExponent = (bits >> 23) & 0xFF;
+	uint32_t mantissa = bits & 0x7FFFFF;
+	if (floatExponent == 0xFF)
+		return static_cast<uint16_t>(sign | 0x7C00 | (mantissa ? 0x200 : 0)); // Infinity or NaN
+	int32_t exponent = static_cast<int32_t>(floatExponent) - 127 + 15;
+	if (exponent >= 31)
+		return static_cast<uint16_t>(sign | 0x7C00);
+
+	uint32_t shift = 13;
+	uint32_t half;
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+			return static_cast<uint16_t>(sign);
+		mantissa |= 0x800000; // The implicit 1 becomes explicit in a denormal.
+		shift = static_cast<uint32_t>(14 - exponent);
+		half = mantissa >> shift;
+	}
+	else
+		half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> shift);
+
+	// A carry out of the mantissa bumps the exponent, which is still the right answer.
+	uint32_t rest = mantissa & ((1U << shift) - 1);
+	uint32_t halfway = 1U << (shift - 1);
+	if (rest > halfway || (rest == halfway && (half & 1)))
+		half++;
+	return static_cast<uint16_t>(sign | half);
+}
+
+// Project onto the octahedron |x| + |y| + |z| = 1 and fold the lower half over the upper one, so
+//	the whole sphere fits in [-1, 1]^2 (decodeOctahedral() in asteroidVertex.glsl undoes it).
+static void encodeOctahedral(const float normal[3], float result[2])
+{
+	float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+	if (length == 0.0f)
+	{
+		result[0] = result[1] = 0.0f;
+		return;
+	}
+	float x = normal[0] / length;
+	float y = normal[1] / length;
+	if (normal[2] < 0.0f)
+	{
+		float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+	result[0] = x;
+	result[1] = y;
+}
+
+uint32_t getMeshVertexStride(MeshVertexFormat format)
+{
+	return format == MESH_VERTEX_FORMAT_QUANTIZED ? sizeof(QuantizedMeshVertex) : sizeof(MeshVertex);
+}
+
+const char *getMeshVertexFormatName(MeshVertexFormat format)
+{
+	return format == MESH_VERTEX_FORMAT_QUANTIZED ? "quantized" : "float";
+}
+
+void quantizeMeshVertex(const MeshVertex &vertex, const float boundsMin[3], const float boundsMax[3], QuantizedMeshVertex &result)
+{
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		float center = (boundsMin[axis] + boundsMax[axis]) * 0.5f;
+		float halfExtent = (boundsMax[axis] - boundsMin[axis]) * 0.5f;
+		result.pos[axis] = halfExtent > 0.0f ? quantizeSnorm16((vertex.pos[axis] - center) / halfExtent) : 0;
+	}
+	result.pos[3] = 0;
+
+	float octahedral[2];
+	encodeOctahedral(vertex.normal, octahedral);
+	result.normal[0] = quantizeSnorm16(octahedral[0]);
+	result.normal[1] = quantizeSnorm16(octahedral[1]);
+
+	result.uv[0] = floatToHalf(vertex.uv[0]);
+	result.uv[1] = floatToHalf(vertex.uv[1]);
+}
+
+void addMeshLod(MeshData &mesh, const std::vector<MeshVertex> &vertices, const std::vector<uint32_t> &indices)
+{
+	MeshFileLod lod = {
+		static_cast<uint32_t>(mesh.indices.size()), // First index
+		static_cast<uint32_t>(indices.size()), // Number of indices
+		static_cast<int32_t>(mesh.vertices.size()), // Vertex offset
+		static_cast<uint32_t>(vertices.size()), // Number of vertices
+		0, // First cluster
+		0 // Number of clusters
+	};
+	mesh.lods.push_back(lod);
+	mesh.vertices.insert(mesh.vertices.end(), vertices.begin(), vertices.end());
+	mesh.indices.insert(mesh.indices.end(), indices.begin(), indices.end());
+}
+
+bool packMeshFile(const MeshData &mesh, std::vector<uint8_t> &image, MeshVertexFormat vertexFormat)
+{
+	if (mesh.lods.empty() || mesh.lods.size() > MESH_FILE_MAX_LODS)
+	{
+		fprintf(stderr, "Error (%s:%u): A mesh file needs 1 to %u LODs, not %u\n", __FILE__, __LINE__,
+			MESH_FILE_MAX_LODS, static_cast<uint32_t>(mesh.lods.size()));
+		return false;
+	}
+	if (mesh.clusters.empty() && mesh.indices.size() >= 3)
+	{
+		MeshData clustered = mesh;
+		buildMeshClusters(clustered);
+		if (!clustered.clusters.empty())
+			return packMeshFile(clustered, image, vertexFormat);
+	}
+
+	// 16-bit indices whenever every LOD's own vertex range fits, since they're relative to it.
+	bool smallIndices = true;
+	for (const MeshFileLod &lod : mesh.lods)
+		smallIndices &= lod.numVertices <= 0x10000;
+
+	MeshFileHeader header = {};
+	header.magic = MESH_FILE_MAGIC;
+	header.version = MESH_FILE_VERSION;
+	header.vertexStride = getMeshVertexStride(vertexFormat);
+	header.vertexFormat = vertexFormat;
+	header.indexSize = smallIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+	header.numVertices = static_cast<uint32_t>(mesh.vertices.size());
+	header.numIndices = static_cast<uint32_t>(mesh.indices.size());
+	header.numLods = static_cast<uint32_t>(mesh.lods.size());
+	header.clusterStride = sizeof(MeshCluster);
+	header.numClusters = static_cast<uint32_t>(mesh.clusters.size());
+	header.numClusterVertices = static_cast<uint32_t>(mesh.clusterVertices.size());
+	header.numClusterTriangles = static_cast<uint32_t>(mesh.clusterTriangles.size());
+	for (uint32_t i = 0; i < header.numLods; i++)
+		header.lods[i] = mesh.lods[i];
+
+	// Box and sphere bounds. The sphere's centered on the box, which is close enough for culling.
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		header.boundsMin[axis] = mesh.vertices.empty() ? 0.0f : mesh.vertices[0].pos[axis];
+		header.boundsMax[axis] = header.boundsMin[axis];
+	}
+	for (const MeshVertex &vertex : mesh.vertices)
+	{
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			header.boundsMin[axis] = std::min(header.boundsMin[axis], vertex.pos[axis]);
+			header.boundsMax[axis] = std::max(header.boundsMax[axis], vertex.pos[axis]);
+		}
+	}
+	float radiusSquared = 0.0f;
+	for (uint32_t axis = 0; axis < 3; axis++)
+		header.boundingSphere[axis] = (header.boundsMin[axis] + header.boundsMax[axis]) * 0.5f;
+	for (const MeshVertex &vertex : mesh.vertices)
+	{
+		float dx = vertex.pos[0] - header.boundingSphere[0];
+		float dy = vertex.pos[1] - header.boundingSphere[1];
+		float dz = vertex.pos[2] - header.boundingSphere[2];
+		radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+	header.boundingSphere[3] = sqrtf(radiusSquared);
+
+	// Quantized positions can land up to half a step outside of where they were.
+	float quantizationMargin = 0.0f;
+	if (vertexFormat == MESH_VERTEX_FORMAT_QUANTIZED)
+	{
+		float largestHalfExtent = 0.0f;
+		for (uint32_t axis = 0; axis < 3; axis++)
+			largestHalfExtent = std::max(largestHalfExtent, (header.boundsMax[axis] - header.boundsMin[axis]) * 0.5f);
+		quantizationMargin = largestHalfExtent / 32767.0f;
+	}
+	header.boundingSphere[3] += quantizationMargin;
+
+	header.vertexDataOffset = alignBlob(sizeof(MeshFileHeader));
+	header.vertexDataSize = static_cast<uint64_t>(header.numVertices) * header.vertexStride;
+	header.indexDataOffset = alignBlob(header.vertexDataOffset + header.vertexDataSize);
+	header.indexDataSize = static_cast<uint64_t>(header.numIndices) * header.indexSize;
+	header.clusterDataOffset = alignBlob(header.indexDataOffset + header.indexDataSize);
+	header.clusterDataSize = static_cast<uint64_t>(header.numClusters) * header.clusterStride
+		+ (static_cast<uint64_t>(header.numClusterVertices) + header.numClusterTriangles) * sizeof(uint32_t);
+
+	// Everything between and after the blobs is zero padding.
+	image.assign(static_cast<size_t>(header.clusterDataOffset + header.clusterDataSize), 0);
+	memcpy(image.data(), &header, sizeof(header));
+	if (vertexFormat == MESH_VERTEX_FORMAT_QUANTIZED)
+	{
+		uint8_t *vertexData = image.data() + header.vertexDataOffset;
+		for (size_t i = 0; i < mesh.vertices.size(); i++)
+		{
+			QuantizedMeshVertex vertex;
+			quantizeMeshVertex(mesh.vertices[i], header.boundsMin, header.boundsMax, vertex);
+			memcpy(vertexData + i * sizeof(vertex), &vertex, sizeof(vertex));
+		}
+	}
+	else if (!mesh.vertices.empty())
+		memcpy(image.data() + header.vertexDataOffset, mesh.vertices.data(), static_cast<size_t>(header.vertexDataSize));
+	uint8_t *indexData = image.data() + header.indexDataOffset;
+	for (size_t i = 0; i < mesh.indices.size(); i++)
+	{
+		if (smallIndices)
+		{
+			uint16_t index = static_cast<uint16_t>(mesh.indices[i]);
+			memcpy(indexData + i * sizeof(index), &index, sizeof(index));
+		}
+		else
+			memcpy(indexData + i * sizeof(uint32_t), &mesh.indices[i], sizeof(uint32_t));
+	}
+
+	uint8_t *clusterData = image.data() + header.clusterDataOffset;
+	for (size_t i = 0; i < mesh.clusters.size(); i++)
+	{
+		MeshCluster cluster = mesh.clusters[i];
+		cluster.boundingSphere[3] += quantizationMargin;
+		memcpy(clusterData, &cluster, sizeof(cluster));
+		clusterData += sizeof(cluster);
+	}
+	if (!mesh.clusterVertices.empty())
+		memcpy(clusterData, mesh.clusterVertices.data(), mesh.clusterVertices.size() * sizeof(uint32_t));
+	clusterData += mesh.clusterVertices.size() * sizeof(uint32_t);
+	if (!mesh.clusterTriangles.empty())
+		memcpy(clusterData, mesh.clusterTriangles.data(), mesh.clusterTriangles.size() * sizeof(uint32_t));
+	return true;
+}
+
+bool writeMeshFile(const char *path, const MeshData &mesh, MeshVertexFormat vertexFormat)
+{
+	std::vector<uint8_t> image;
+	if (!packMeshFile(mesh, image, vertexFormat))
+		return false;
+
+	FILE *file = openFile(path, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Error (%s:%u): Failed to open \"%s\" for writing\n", __FILE__, __LINE__, path);
+		return false;
+	}
+	bool ok = fwrite(image.data(), 1, image.size(), file) == image.size();
+	ok = fclose(file) == 0 && ok;
+
+	if (!ok)
+		fprintf(stderr, "Error (%s:%u): Failed to write \"%s\"\n", __FILE__, __LINE__, path);
+	return ok;
+}
+
+// 'offset' + 'size' is inside a file of 'fileSize' bytes, without overflowing.
+static bool isInFile(uint64_t offset, uint64_t size, uint64_t fileSize)
+{
+	return offset <= fileSize && size <= fileSize - offset;
+}
+
+const MeshFileHeader *validateMeshFile(const void *data, size_t size)
+{
+	if (size < sizeof(MeshFileHeader))
+		return nullptr;
+
+	// The data's a mapping or a packed image (both at least 8 byte aligned), so the header can be used in place.
+	const MeshFileHeader *header = static_cast<const MeshFileHeader *>(data);
+	if (header->magic != MESH_FILE_MAGIC
+		|| header->version != MESH_FILE_VERSION
+		|| header->vertexFormat >= MESH_VERTEX_FORMAT_COUNT
+		|| header->vertexStride != getMeshVertexStride(static_cast<MeshVertexFormat>(header->vertexFormat))
+		|| (header->indexSize != sizeof(uint16_t) && header->indexSize != sizeof(uint32_t))
+		|| header->clusterStride != sizeof(MeshCluster)
+		|| header->numLods == 0 || header->numLods > MESH_FILE_MAX_LODS)
+		return nullptr;
+
+	if (header->vertexDataOffset % MESH_FILE_BLOB_ALIGNMENT != 0
+		|| header->indexDataOffset % MESH_FILE_BLOB_ALIGNMENT != 0
+		|| header->clusterDataOffset % MESH_FILE_BLOB_ALIGNMENT != 0
+		|| header->vertexDataSize != static_cast<uint64_t>(header->numVertices) * header->vertexStride
+		|| header->indexDataSize != static_cast<uint64_t>(header->numIndices) * header->indexSize
+		|| header->clusterDataSize != static_cast<uint64_t>(header->numClusters) * header->clusterStride
+			+ (static_cast<uint64_t>(header->numClusterVertices) + header->numClusterTriangles) * sizeof(uint32_t)
+		|| !isInFile(header->vertexDataOffset, header->vertexDataSize, size)
+		|| !isInFile(header->indexDataOffset, header->indexDataSize, size)
+		|| !isInFile(header->clusterDataOffset, header->clusterDataSize, size))
+		return nullptr;
+
+	for (uint32_t i = 0; i < header->numLods; i++)
+	{
+		const MeshFileLod &lod = header->lods[i];
+		if (lod.vertexOffset < 0
+			|| !isInFile(lod.firstIndex, lod.numIndices, header->numIndices)
+			|| !isInFile(static_cast<uint64_t>(lod.vertexOffset), lod.numVertices, header->numVertices)
+			|| !isInFile(lod.firstCluster, lod.numClusters, header->numClusters))
+			return nullptr;
+	}
+
+	// The renderer reads clusters' ranges straight out of the pool, so they have to be checked too.
+	const uint8_t *clusterData = static_cast<const uint8_t *>(data) + header->clusterDataOffset;
+	for (uint32_t i = 0; i < header->numClusters; i++)
+	{
+		MeshCluster cluster;
+		memcpy(&cluster, clusterData + i * sizeof(cluster), sizeof(cluster));
+		if (cluster.numVertices > MESH_CLUSTER_MAX_VERTICES
+			|| cluster.numTriangles > MESH_CLUSTER_MAX_TRIANGLES
+			|| !isInFile(cluster.firstVertex, cluster.numVertices, header->numClusterVertices)
+			|| !isInFile(cluster.firstTriangle, cluster.numTriangles, header->numClusterTriangles))
+			return nullptr;
+	}
+	return header;
+}
+
+void buildIcosphereMesh(uint32_t numLods, MeshData &mesh)
+{
+	mesh = MeshData();
+	numLods = std::max(1U, std::min(numLods, MESH_FILE_MAX_LODS));
+
+	// Icosahedron
+	const float t = (1.0f + sqrtf(5.0f)) * 0.5f;
+	std::vector<MeshVertex> baseVertices;
+	const float corners[12][3] = {
+		{ -1, t, 0 }, { 1, t, 0 }, { -1, -t, 0 }, { 1, -t, 0 },
+		{ 0, -1, t }, { 0, 1, t }, { 0, -1, -t }, { 0, 1, -t },
+		{ t, 0, -1 }, { t, 0, 1 }, { -t, 0, -1 }, { -t, 0, 1 }
+	};
+	auto addVertex = [](std::vector<MeshVertex> &vertices, float x, float y, float z) -> uint32_t {
+		const float pi = 3.14159265f;
+		float length = sqrtf(x * x + y * y + z * z);
+		MeshVertex vertex = {
+			{ x / length, y / length, z / length }, // Position
+			{ x / length, y / length, z / length }, // Normal
+			{ atan2f(z, x) / (2.0f * pi) + 0.5f, acosf(std::min(std::max(y / length, -1.0f), 1.0f)) / pi } // UV
+		};
+		vertices.push_back(vertex);
+		return static_cast<uint32_t>(vertices.size() - 1);
+	};
+	for (const float *corner : corners)
+		addVertex(baseVertices, corner[0], corner[1], corner[2]);
+	std::vector<uint32_t> baseIndices = {
+		0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11,
+		1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+		3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9,
+		4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1
+	};
+
+	// Each level splits every triangle in 4, sharing the new vertex on each edge.
+	std::vector<std::vector<MeshVertex>> levelVertices(1, baseVertices);
+	std::vector<std::vector<uint32_t>> levelIndices(1, baseIndices);
+	for (uint32_t level = 1; level < numLods; level++)
+	{
+		std::vector<MeshVertex> vertices = levelVertices.back();
+		const std::vector<uint32_t> &previousIndices = levelIndices.back();
+		std::vector<uint32_t> indices;
+		indices.reserve(previousIndices.size() * 4);
+		std::map<uint64_t, uint32_t> midpoints;
+		auto getMidpoint = [&](uint32_t a, uint32_t b) -> uint32_t {
+			uint64_t key = (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+			auto found = midpoints.find(key);
+			if (found != midpoints.end())
+				return found->second;
+			uint32_t index = addVertex(vertices,
+				vertices[a].pos[0] + vertices[b].pos[0],
+				vertices[a].pos[1] + vertices[b].pos[1],
+				vertices[a].pos[2] + vertices[b].pos[2]);
+			midpoints.emplace(key, index);
+			return index;
+		};
+		for (size_t i = 0; i + 2 < previousIndices.size(); i += 3)
+		{
+			uint32_t a = previousIndices[i], b = previousIndices[i + 1], c = previousIndices[i + 2];
+			uint32_t ab = getMidpoint(a, b), bc = getMidpoint(b, c), ca = getMidpoint(c, a);
+			uint32_t triangles[] = { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca };
+			indices.insert(indices.end(), triangles, triangles + 12);
+		}
+		levelVertices.push_back(vertices);
+		levelIndices.push_back(indices);
+	}
+
+	// Most detailed first.
+	for (uint32_t level = numLods; level-- > 0;)
+		addMeshLod(mesh, levelVertices[level], levelIndices[level]);
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Packed binary mesh container (.mesh), written offline by MeshPacker and read by memory mapping it.
+// Layout: MeshFileHeader, then the vertex blob and the index blob, each starting on a
+//	MESH_FILE_BLOB_ALIGNMENT boundary so they can be copied straight out of the mapping.
+// Every LOD is a range of the one index blob, indexing into the one vertex blob (offset by its
+//	vertexOffset), and a range of the cluster blob, so a whole mesh uploads as three copies.
+// The cluster blob is the MeshClusters, then their vertices, then their triangles (see MeshCluster).
+// The vertex blob is in the file's MeshVertexFormat, so the vertices go to the GPU exactly as packed.
+// Everything is little endian, which is all the engine runs on.
+// Shared between the engine and the packer, so no Vulkan in here.
+#define MESH_FILE_MAGIC 0x4853454DU // "MESH"
+#define MESH_FILE_VERSION 3U
+#define MESH_FILE_BLOB_ALIGNMENT 64U
+#define MESH_FILE_MAX_LODS 8U
+
+// Most a cluster holds, so a cluster's triangles index its vertices in 6 bits.
+#define MESH_CLUSTER_MAX_VERTICES 64U
+#define MESH_CLUSTER_MAX_TRIANGLES 64U
+
+// Full precision, what the CPU side works with.
+struct MeshVertex
+{
+	float pos[3];
+	float normal[3];
+	float uv[2];
+};
+
+// Half the size of a MeshVertex, decoded in the vertex shader:
+//	pos: 16-bit snorm within the mesh's bounds, boundsCenter + pos * boundsHalfExtent. w is 0.
+//	normal: 16-bit snorm octahedral encoding of the unit normal.
+//	uv: half floats.
+struct QuantizedMeshVertex
+{
+	int16_t pos[4];
+	int16_t normal[2];
+	uint16_t uv[2];
+};
+
+enum MeshVertexFormat
+{
+	MESH_VERTEX_FORMAT_FLOAT = 0, // MeshVertex
+	MESH_VERTEX_FORMAT_QUANTIZED = 1, // QuantizedMeshVertex
+	MESH_VERTEX_FORMAT_COUNT
+};
+
+struct MeshFileLod
+{
+	uint32_t firstIndex;
+	uint32_t numIndices;
+	int32_t vertexOffset; // Added to every index of the LOD.
+	uint32_t numVertices;
+	uint32_t firstCluster;
+	uint32_t numClusters;
+};
+
+// A few dozen neighbouring triangles of one LOD, bounded so they can be culled on their own.
+// The cluster's vertices are indices into its LOD's vertices (relative to the LOD's vertexOffset
+//	like its indices are), and its triangles are three 8-bit indices into the cluster's vertices,
+//	packed into the low 24 bits of a uint32_t.
+struct MeshCluster
+{
+	float boundingSphere[4]; // xyz center, w radius
+	float coneAxis[3]; // Average facing of the triangles.
+	float coneCutoff; // Cosine of the widest angle a triangle faces away from the axis. 0 or less can't cull anything.
+	uint32_t firstVertex; // Into the mesh's cluster vertices.
+	uint32_t firstTriangle; // Into the mesh's cluster triangles.
+	uint32_t numVertices;
+	uint32_t numTriangles;
+};
+
+struct MeshFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexStride; // Size of a vertex in vertexFormat.
+	uint32_t indexSize; // 2 or 4 bytes.
+	uint32_t numVertices; // Across all LODs.
+	uint32_t numIndices; // Across all LODs.
+	uint32_t numLods;
+	uint32_t vertexFormat; // MeshVertexFormat
+	uint32_t clusterStride; // Size of a MeshCluster.
+	uint32_t numClusters; // Across all LODs.
+	uint32_t numClusterVertices;
+	uint32_t numClusterTriangles;
+	float boundsMin[3];
+	float boundsMax[3];
+	float boundingSphere[4]; // xyz center, w radius
+	uint64_t vertexDataOffset; // From the start of the file.
+	uint64_t vertexDataSize;
+	uint64_t indexDataOffset;
+	uint64_t indexDataSize;
+	uint64_t clusterDataOffset;
+	uint64_t clusterDataSize;
+	MeshFileLod lods[MESH_FILE_MAX_LODS]; // LOD 0 is the most detailed.
+};
+
+// A mesh on the CPU side, before it's packed.
+struct MeshData
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices; // Relative to each LOD's vertexOffset.
+	std::vector<MeshFileLod> lods;
+	std::vector<MeshCluster> clusters; // Filled in by buildMeshClusters().
+	std::vector<uint32_t> clusterVertices;
+	std::vector<uint32_t> clusterTriangles;
+};
+
+// Append 'vertices'/'indices' to 'mesh' as its next LOD.
+void addMeshLod(MeshData &mesh, const std::vector<MeshVertex> &vertices, const std::vector<uint32_t> &indices);
+
+// Bytes per vertex in 'format'.
+uint32_t getMeshVertexStride(MeshVertexFormat format);
+const char *getMeshVertexFormatName(MeshVertexFormat format);
+
+// Encode 'vertex' for a mesh with the given bounds.
+void quantizeMeshVertex(const MeshVertex &vertex, const float boundsMin[3], const float boundsMax[3], QuantizedMeshVertex &result);
+
+// Pack 'mesh' into 'image' exactly as it'd be in a file, with 16-bit indices when every LOD fits.
+// Clusters are built for a mesh that hasn't got any yet. Returns false if the mesh has no LODs or too many.
+bool packMeshFile(const MeshData &mesh, std::vector<uint8_t> &image, MeshVertexFormat vertexFormat = MESH_VERTEX_FORMAT_QUANTIZED);
+
+// packMeshFile() straight to 'path'. Returns false on a write error.
+bool writeMeshFile(const char *path, const MeshData &mesh, MeshVertexFormat vertexFormat = MESH_VERTEX_FORMAT_QUANTIZED);
+
+// Check that 'data' (a whole file, at least 8 byte aligned) is a mesh file this version can read, and that everything the
+//	header points at is inside it. Returns the header, or nullptr.
+const MeshFileHeader *validateMeshFile(const void *data, size_t size);
+
+// A unit sphere (subdivided icosahedron), one LOD per subdivision level, most detailed first, with
+//	UVs of longitude and latitude.
+// Test content for the packer and the load benchmark.
+void buildIcosphereMesh(uint32_t numLods, MeshData &mesh);
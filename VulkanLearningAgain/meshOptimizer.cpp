@@ -0,0 +1,416 @@
+#include "meshOptimizer.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// FIFO post-transform cache, simulated with a timestamp per vertex. A vertex is in the cache while
+//	fewer than 'cacheSize' others have gone in after it.
+class VertexCacheSimulator
+{
+	std::vector<uint32_t> insertTimes;
+	uint32_t cacheSize;
+	uint32_t time;
+
+public:
+	VertexCacheSimulator(uint32_t numVertices, uint32_t cacheSize)
+		: insertTimes(numVertices, 0), cacheSize(cacheSize), time(cacheSize + 1)
+	{
+	}
+
+	// Returns 1 on a miss (which puts the vertex in the cache).
+	uint32_t access(uint32_t vertex)
+	{
+		if (time - insertTimes[vertex] <= cacheSize)
+			return 0;
+		insertTimes[vertex] = time++;
+		return 1;
+	}
+
+	void flush(void) { time += cacheSize + 1; }
+};
+
+uint64_t countVertexCacheMisses(const uint32_t *indices, size_t numIndices, uint32_t numVertices, uint32_t cacheSize)
+{
+	VertexCacheSimulator cache(numVertices, cacheSize);
+	uint64_t misses = 0;
+	for (size_t i = 0; i < numIndices; i++)
+		misses += cache.access(indices[i]);
+	return misses;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Vertex cache (Tipsify)
+//
+//////////////////////////////////////////////////////////////////////////////
+void optimizeVertexCache(const uint32_t *indices, size_t numIndices, uint32_t numVertices, uint32_t cacheSize,
+	uint32_t *result, std::vector<uint32_t> *hardBoundaries)
+{
+	size_t numTriangles = numIndices / 3;
+	if (hardBoundaries)
+		hardBoundaries->clear();
+
+	// The triangles around each vertex, and how many of them are still to be emitted.
+	std::vector<uint32_t> liveTriangles(numVertices, 0);
+	for (size_t i = 0; i < numTriangles * 3; i++)
+		liveTriangles[indices[i]]++;
+	std::vector<uint32_t> adjacencyOffsets(numVertices + 1, 0);
+	for (uint32_t vertex = 0; vertex < numVertices; vertex++)
+		adjacencyOffsets[vertex + 1] = adjacencyOffsets[vertex] + liveTriangles[vertex];
+	std::vector<uint32_t> adjacency(numTriangles * 3);
+	std::vector<uint32_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t triangle = 0; triangle < numTriangles; triangle++)
+	{
+		for (uint32_t corner = 0; corner < 3; corner++)
+			adjacency[adjacencyFill[indices[triangle * 3 + corner]]++] = static_cast<uint32_t>(triangle);
+	}
+
+	std::vector<uint32_t> cacheTimes(numVertices, 0);
+	std::vector<bool> emitted(numTriangles, false);
+	std::vector<uint32_t> deadEnds; // Recently emitted vertices, to restart from when a fan runs out.
+	std::vector<uint32_t> candidates;
+	uint32_t time = cacheSize + 1;
+	uint32_t scanCursor = 0;
+	size_t numOutput = 0;
+
+	// Somewhere to carry on from once nothing around the last fan is worth it: the most recent dead
+	//	end that's still live, or else the next live vertex in index order.
+	auto restart = [&]() -> uint32_t {
+		while (!deadEnds.empty())
+		{
+			uint32_t vertex = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[vertex])
+				return vertex;
+		}
+		for (; scanCursor < numVertices; scanCursor++)
+		{
+			if (liveTriangles[scanCursor])
+				return scanCursor;
+		}
+		return ~0U;
+	};
+
+	uint32_t fanVertex = restart();
+	if (hardBoundaries && fanVertex != ~0U)
+		hardBoundaries->push_back(0);
+	while (fanVertex != ~0U)
+	{
+		// Emit every triangle left around the fan vertex.
+		candidates.clear();
+		for (uint32_t i = adjacencyOffsets[fanVertex]; i < adjacencyOffsets[fanVertex + 1]; i++)
+		{
+			uint32_t triangle = adjacency[i];
+			if (emitted[triangle])
+				continue;
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				uint32_t vertex = indices[triangle * 3 + corner];
+				result[numOutput++] = vertex;
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+				if (time - cacheTimes[vertex] > cacheSize)
+					cacheTimes[vertex] = time++;
+			}
+			emitted[triangle] = true;
+		}
+
+		// Fan around the oldest candidate that'll still be in the cache once all of its triangles
+		//	are emitted. Ones that won't be are worth nothing over starting somewhere new.
+		uint32_t nextVertex = ~0U;
+		int64_t bestPriority = -1;
+		for (uint32_t vertex : candidates)
+		{
+			if (!liveTriangles[vertex])
+				continue;
+			int64_t priority = 0;
+			if (time - cacheTimes[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+				priority = time - cacheTimes[vertex];
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				nextVertex = vertex;
+			}
+		}
+		if (nextVertex == ~0U)
+		{
+			nextVertex = restart();
+			if (hardBoundaries && nextVertex != ~0U)
+				hardBoundaries->push_back(static_cast<uint32_t>(numOutput));
+		}
+		fanVertex = nextVertex;
+	}
+
+	// A trailing partial triangle isn't drawn, but keep it.
+	for (size_t i = numTriangles * 3; i < numIndices; i++)
+		result[numOutput++] = indices[i];
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Overdraw
+//
+//////////////////////////////////////////////////////////////////////////////
+void optimizeOverdraw(uint32_t *indices, size_t numIndices, const MeshVertex *vertices, uint32_t numVertices,
+	const std::vector<uint32_t> &hardBoundaries, uint32_t cacheSize, float threshold)
+{
+	size_t numTriangles = numIndices / 3;
+	if (numTriangles < 2 || hardBoundaries.empty())
+		return;
+
+	//////////////////////////////////////////////////////////////////////////////
+	// Split each hard cluster wherever the part before the split has already got
+	//	its cache misses down to 'threshold' times the whole cluster's. Starting
+	//	the next part with a cold cache then costs about what the threshold allows.
+	//////////////////////////////////////////////////////////////////////////////
+	VertexCacheSimulator cache(numVertices, cacheSize);
+	std::vector<size_t> clusterStarts; // In triangles
+	for (size_t i = 0; i < hardBoundaries.size(); i++)
+	{
+		size_t start = hardBoundaries[i] / 3;
+		size_t end = i + 1 < hardBoundaries.size() ? hardBoundaries[i + 1] / 3 : numTriangles;
+		if (start >= end)
+			continue;
+
+		cache.flush();
+		uint32_t hardMisses = 0;
+		for (size_t triangle = start; triangle < end; triangle++)
+		{
+			for (uint32_t corner = 0; corner < 3; corner++)
+				hardMisses += cache.access(indices[triangle * 3 + corner]);
+		}
+		float missThreshold = threshold * hardMisses / static_cast<float>(end - start);
+
+		cache.flush();
+		clusterStarts.push_back(start);
+		size_t softStart = start;
+		uint32_t softMisses = 0;
+		for (size_t triangle = start; triangle < end; triangle++)
+		{
+			for (uint32_t corner = 0; corner < 3; corner++)
+				softMisses += cache.access(indices[triangle * 3 + corner]);
+			if (triangle + 1 < end && softMisses <= missThreshold * (triangle + 1 - softStart))
+			{
+				softStart = triangle + 1;
+				softMisses = 0;
+				clusterStarts.push_back(softStart);
+				cache.flush();
+			}
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	// Sort the clusters by how far out from the middle of the mesh they are, along
+	//	the way they face. Those are the ones that cover the rest from most angles.
+	//////////////////////////////////////////////////////////////////////////////
+	float meshCentroid[3] = {};
+	float meshArea = 0.0f;
+	std::vector<float> clusterCentroids(clusterStarts.size() * 3, 0.0f);
+	std::vector<float> clusterNormals(clusterStarts.size() * 3, 0.0f);
+	std::vector<float> clusterAreas(clusterStarts.size(), 0.0f);
+	for (size_t cluster = 0; cluster < clusterStarts.size(); cluster++)
+	{
+		size_t end = cluster + 1 < clusterStarts.size() ? clusterStarts[cluster + 1] : numTriangles;
+		for (size_t triangle = clusterStarts[cluster]; triangle < end; triangle++)
+		{
+			const float *a = vertices[indices[triangle * 3]].pos;
+			const float *b = vertices[indices[triangle * 3 + 1]].pos;
+			const float *c = vertices[indices[triangle * 3 + 2]].pos;
+			float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			float normal[3] = {
+				ab[1] * ac[2] - ab[2] * ac[1],
+				ab[2] * ac[0] - ab[0] * ac[2],
+				ab[0] * ac[1] - ab[1] * ac[0]
+			};
+			float area = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				float center = (a[axis] + b[axis] + c[axis]) / 3.0f;
+				clusterCentroids[cluster * 3 + axis] += center * area;
+				clusterNormals[cluster * 3 + axis] += normal[axis];
+				meshCentroid[axis] += center * area;
+			}
+			clusterAreas[cluster] += area;
+			meshArea += area;
+		}
+	}
+	for (uint32_t axis = 0; axis < 3; axis++)
+		meshCentroid[axis] = meshArea > 0.0f ? meshCentroid[axis] / meshArea : 0.0f;
+
+	std::vector<float> sortKeys(clusterStarts.size(), 0.0f);
+	std::vector<uint32_t> clusterOrder(clusterStarts.size());
+	for (size_t cluster = 0; cluster < clusterStarts.size(); cluster++)
+	{
+		clusterOrder[cluster] = static_cast<uint32_t>(cluster);
+		const float *normal = &clusterNormals[cluster * 3];
+		float normalLength = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (clusterAreas[cluster] <= 0.0f || normalLength <= 0.0f)
+			continue;
+		for (uint32_t axis = 0; axis < 3; axis++)
+			sortKeys[cluster] += (clusterCentroids[cluster * 3 + axis] / clusterAreas[cluster] - meshCentroid[axis]) * normal[axis] / normalLength;
+	}
+	std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](uint32_t a, uint32_t b) {
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	std::vector<uint32_t> sorted;
+	sorted.reserve(numTriangles * 3);
+	for (uint32_t cluster : clusterOrder)
+	{
+		size_t end = cluster + 1 < clusterStarts.size() ? clusterStarts[cluster + 1] : numTriangles;
+		sorted.insert(sorted.end(), indices + clusterStarts[cluster] * 3, indices + end * 3);
+	}
+	memcpy(indices, sorted.data(), sorted.size() * sizeof(uint32_t));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Vertex fetch
+//
+//////////////////////////////////////////////////////////////////////////////
+void optimizeVertexFetch(MeshVertex *vertices, uint32_t numVertices, uint32_t *indices, size_t numIndices)
+{
+	std::vector<uint32_t> remap(numVertices, ~0U);
+	uint32_t nextVertex = 0;
+	for (size_t i = 0; i < numIndices; i++)
+	{
+		if (remap[indices[i]] == ~0U)
+			remap[indices[i]] = nextVertex++;
+		indices[i] = remap[indices[i]];
+	}
+	for (uint32_t vertex = 0; vertex < numVertices; vertex++)
+	{
+		if (remap[vertex] == ~0U)
+			remap[vertex] = nextVertex++;
+	}
+
+	std::vector<MeshVertex> reordered(numVertices);
+	for (uint32_t vertex = 0; vertex < numVertices; vertex++)
+		reordered[remap[vertex]] = vertices[vertex];
+	std::copy(reordered.begin(), reordered.end(), vertices);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Whole meshes
+//
+//////////////////////////////////////////////////////////////////////////////
+void addMeshOptimizationStats(MeshOptimizationStats &total, const MeshOptimizationStats &stats)
+{
+	total.numTriangles += stats.numTriangles;
+	total.numVertices += stats.numVertices;
+	total.cacheMissesBefore += stats.cacheMissesBefore;
+	total.cacheMissesAfter += stats.cacheMissesAfter;
+	total.cpuMs += stats.cpuMs;
+}
+
+void printMeshOptimizationStats(const MeshOptimizationStats &stats)
+{
+	double triangles = static_cast<double>(std::max<uint64_t>(stats.numTriangles, 1));
+	double vertices = static_cast<double>(std::max<uint64_t>(stats.numVertices, 1));
+	printf("\tACMR: %.3lf -> %.3lf, ATVR: %.3lf -> %.3lf (%llu triangles, cache of %u)\n",
+		stats.cacheMissesBefore / triangles, stats.cacheMissesAfter / triangles,
+		stats.cacheMissesBefore / vertices, stats.cacheMissesAfter / vertices,
+		static_cast<unsigned long long>(stats.numTriangles), MESH_OPTIMIZER_CACHE_SIZE);
+	printf("\tOptimization time: %.3lf ms\n", stats.cpuMs);
+}
+
+// LODs are separate ranges of the mesh's vertices and indices, so different threads can optimize
+//	different LODs of the same mesh.
+static void optimizeMeshLod(MeshData &mesh, uint32_t lodIndex, MeshOptimizationStats &stats)
+{
+	const MeshFileLod &lod = mesh.lods[lodIndex];
+	uint32_t *indices = mesh.indices.data() + lod.firstIndex;
+	MeshVertex *vertices = mesh.vertices.data() + lod.vertexOffset;
+	size_t numIndices = lod.numIndices;
+
+	std::vector<bool> used(lod.numVertices, false);
+	for (size_t i = 0; i < numIndices; i++)
+		used[indices[i]] = true;
+	stats.numTriangles = numIndices / 3;
+	stats.numVertices = static_cast<uint64_t>(std::count(used.begin(), used.end(), true));
+	stats.cacheMissesBefore = countVertexCacheMisses(indices, numIndices, lod.numVertices, MESH_OPTIMIZER_CACHE_SIZE);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<uint32_t> reordered(numIndices);
+	std::vector<uint32_t> hardBoundaries;
+	optimizeVertexCache(indices, numIndices, lod.numVertices, MESH_OPTIMIZER_CACHE_SIZE, reordered.data(), &hardBoundaries);
+	optimizeOverdraw(reordered.data(), numIndices, vertices, lod.numVertices, hardBoundaries,
+		MESH_OPTIMIZER_CACHE_SIZE, MESH_OPTIMIZER_OVERDRAW_THRESHOLD);
+	optimizeVertexFetch(vertices, lod.numVertices, reordered.data(), numIndices);
+	std::copy(reordered.begin(), reordered.end(), indices);
+	stats.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	stats.cacheMissesAfter = countVertexCacheMisses(indices, numIndices, lod.numVertices, MESH_OPTIMIZER_CACHE_SIZE);
+}
+
+void optimizeMesh(MeshData &mesh, MeshOptimizationStats *stats)
+{
+	MeshOptimizationStats total = {};
+	for (uint32_t lod = 0; lod < mesh.lods.size(); lod++)
+	{
+		MeshOptimizationStats lodStats = {};
+		optimizeMeshLod(mesh, lod, lodStats);
+		addMeshOptimizationStats(total, lodStats);
+	}
+	if (stats)
+		*stats = total;
+}
+
+void optimizeMeshes(MeshData *const *meshes, size_t numMeshes, uint32_t numThreads, MeshOptimizationStats *stats)
+{
+	struct Job
+	{
+		uint32_t mesh;
+		uint32_t lod;
+		MeshOptimizationStats stats;
+	};
+	std::vector<Job> jobs;
+	for (size_t mesh = 0; mesh < numMeshes; mesh++)
+	{
+		for (uint32_t lod = 0; lod < meshes[mesh]->lods.size(); lod++)
+		{
+			Job job = {
+				static_cast<uint32_t>(mesh), // Mesh
+				lod, // LOD
+				{} // Stats
+			};
+			jobs.push_back(job);
+		}
+	}
+
+	// Biggest LODs first, so a thread doesn't pick up a big one at the very end.
+	std::sort(jobs.begin(), jobs.end(), [&](const Job &a, const Job &b) {
+		return meshes[a.mesh]->lods[a.lod].numIndices > meshes[b.mesh]->lods[b.lod].numIndices;
+	});
+
+	std::atomic<size_t> nextJob(0);
+	auto worker = [&]() {
+		for (size_t i = nextJob++; i < jobs.size(); i = nextJob++)
+			optimizeMeshLod(*meshes[jobs[i].mesh], jobs[i].lod, jobs[i].stats);
+	};
+
+	if (!numThreads)
+		numThreads = std::max(1U, std::thread::hardware_concurrency());
+	numThreads = static_cast<uint32_t>(std::min<size_t>(numThreads, jobs.size()));
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < numThreads; i++)
+		threads.push_back(std::thread(worker));
+	worker();
+	for (std::thread &thread : threads)
+		thread.join();
+
+	if (stats)
+	{
+		for (size_t mesh = 0; mesh < numMeshes; mesh++)
+			stats[mesh] = MeshOptimizationStats();
+		for (const Job &job : jobs)
+			addMeshOptimizationStats(stats[job.mesh], job.stats);
+	}
+}
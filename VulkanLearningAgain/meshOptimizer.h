@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "meshFile.h"
+
+// Index and vertex reordering for meshes before they're packed. Every LOD is optimized on its own,
+//	in three steps:
+//	1. Vertex cache: triangles reordered with Tipsify (Sander et al. 2007), which fans around
+//		whichever recently used vertex will stay in the post-transform cache, so most vertices
+//		only get shaded once.
+//	2. Overdraw: the vertex cache order is cut into clusters wherever that costs little in cache
+//		misses, and the clusters are sorted to draw the outward facing, outermost ones first, so
+//		more of the rest fails the depth test.
+//	3. Vertex fetch: vertices renumbered in the order the indices first use them, so fetching them
+//		walks through memory instead of jumping around.
+// Shared between the engine and the packer, so no Vulkan in here.
+
+// What most GPUs' post-transform caches act like. Only used to order triangles and measure them.
+#define MESH_OPTIMIZER_CACHE_SIZE 16U
+
+// How much worse (as a fraction of ACMR) the vertex cache can get in exchange for less overdraw.
+#define MESH_OPTIMIZER_OVERDRAW_THRESHOLD 1.05f
+
+// Vertex cache misses of an index order, simulating a FIFO cache of 'cacheSize' vertices.
+// ACMR (average cache miss ratio) is misses per triangle, 0.5 is about as low as a regular mesh
+//	goes and 3 is every vertex missing. ATVR (average transformed vertex ratio) is misses per
+//	vertex the indices use, where 1 is ideal.
+uint64_t countVertexCacheMisses(const uint32_t *indices, size_t numIndices, uint32_t numVertices, uint32_t cacheSize);
+
+// Reorder 'indices' (triangles into 'numVertices' vertices) for the vertex cache into 'result'.
+// If 'hardBoundaries' is given, it gets the first index of each run of triangles Tipsify had to
+//	start somewhere new, which optimizeOverdraw() never splits.
+void optimizeVertexCache(const uint32_t *indices, size_t numIndices, uint32_t numVertices, uint32_t cacheSize,
+	uint32_t *result, std::vector<uint32_t> *hardBoundaries = nullptr);
+
+// Reorder clusters of the triangles in 'indices' (already in vertex cache order) for less overdraw,
+//	giving up at most 'threshold' times the vertex cache misses.
+void optimizeOverdraw(uint32_t *indices, size_t numIndices, const MeshVertex *vertices, uint32_t numVertices,
+	const std::vector<uint32_t> &hardBoundaries, uint32_t cacheSize, float threshold);
+
+// Renumber 'vertices' in the order 'indices' first use them and rewrite the indices to match.
+// Vertices nothing uses end up at the back.
+void optimizeVertexFetch(MeshVertex *vertices, uint32_t numVertices, uint32_t *indices, size_t numIndices);
+
+// Summed over every LOD that was optimized.
+struct MeshOptimizationStats
+{
+	uint64_t numTriangles;
+	uint64_t numVertices; // Used by the indices.
+	uint64_t cacheMissesBefore;
+	uint64_t cacheMissesAfter;
+	double cpuMs; // Summed over the threads.
+};
+
+void addMeshOptimizationStats(MeshOptimizationStats &total, const MeshOptimizationStats &stats);
+
+// Prints ACMR and ATVR before and after, and the time taken, as tab indented lines.
+void printMeshOptimizationStats(const MeshOptimizationStats &stats);
+
+// Run all three steps on every LOD of 'mesh', on this thread.
+void optimizeMesh(MeshData &mesh, MeshOptimizationStats *stats = nullptr);
+
+// optimizeMesh() for a batch of meshes, spread over 'numThreads' threads (0 for every hardware
+//	thread) one LOD at a time. 'stats', if given, gets one entry per mesh.
+void optimizeMeshes(MeshData *const *meshes, size_t numMeshes, uint32_t numThreads, MeshOptimizationStats *stats = nullptr);
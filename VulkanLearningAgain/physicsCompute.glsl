@@ -0,0 +1,90 @@
+#version 450 core
+
+// Steps every body one fixed time step around a central mass (semi-implicit Euler).
+// Reads last step's state and writes the next one, the two buffers swap every step.
+
+// Specialized per device (see PhysicsKernelConfig), so these are compile time constants.
+layout (local_size_x_id = 0) in;
+layout (constant_id = 1) const uint BODIES_PER_INVOCATION = 1;
+layout (constant_id = 2) const bool SCATTER = false; // Scatter the bodies instead of stepping them (first step).
+
+struct Body
+{
+	vec4 posMass; // xyz position, w mass
+	vec4 velocity; // xyz velocity, w unused
+};
+
+layout (set=0, binding=0) readonly buffer PreviousState
+{
+	Body previousBodies[];
+};
+layout (set=0, binding=1) writeonly buffer NextState
+{
+	Body nextBodies[];
+};
+
+layout (push_constant) uniform StepParams
+{
+	float timeStep;
+	uint numBodies;
+	float centralMass;
+};
+
+uint hash(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352dU;
+	x ^= x >> 15;
+	x *= 0x846ca68bU;
+	x ^= x >> 16;
+	return x;
+}
+
+float random01(inout uint state)
+{
+	state = hash(state);
+	return float(state) * (1.0 / 4294967295.0);
+}
+
+// Spread the bodies through a flat ring on circular orbits.
+Body scatterBody(uint i)
+{
+	uint state = i * 747796405U + 2891336453U;
+	float angle = random01(state) * 6.28318531;
+	float radius = mix(20.0, 100.0, random01(state));
+	float height = (random01(state) - 0.5) * 4.0;
+	float speed = sqrt(centralMass / radius);
+
+	Body body;
+	body.posMass = vec4(cos(angle) * radius, height, sin(angle) * radius, mix(0.1, 1.0, random01(state)));
+	body.velocity = vec4(-sin(angle) * speed, 0.0, cos(angle) * speed, 0.0);
+	return body;
+}
+
+Body stepBody(Body body)
+{
+	vec3 pos = body.posMass.xyz;
+	float distanceSquared = max(dot(pos, pos), 1.0);
+	vec3 acceleration = -centralMass * pos * inversesqrt(distanceSquared) / distanceSquared;
+	body.velocity.xyz += acceleration * timeStep;
+	body.posMass.xyz += body.velocity.xyz * timeStep;
+	return body;
+}
+
+void main(void)
+{
+	// Each invocation handles BODIES_PER_INVOCATION bodies a workgroup apart, so neighbouring
+	//	invocations still touch neighbouring bodies.
+	uint first = gl_WorkGroupID.x * gl_WorkGroupSize.x * BODIES_PER_INVOCATION + gl_LocalInvocationID.x;
+	for (uint k = 0; k < BODIES_PER_INVOCATION; k++)
+	{
+		uint i = first + k * gl_WorkGroupSize.x;
+		if (i >= numBodies)
+			return;
+
+		if (SCATTER)
+			nextBodies[i] = scatterBody(i);
+		else
+			nextBodies[i] = stepBody(previousBodies[i]);
+	}
+}
@@ -1,10 +0,0 @@
-#version 450 core
-
-layout (location=0) in vec4 inColor;
-
-layout (location=0) out vec4 outColor;
-
-void main(void)
-{
-	outColor = inColor;
-}
\ No newline at end of file
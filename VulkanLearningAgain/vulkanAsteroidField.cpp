@@ -0,0 +1,140 @@
+#include "vulkanAsteroidField.h"
+#include <stdio.h>
+#include <stdexcept>
+#include "vulkanDebug.h"
+#include "fileUtils.h"
+
+void AsteroidField::create(MeshPool &meshPool, QueueTimeline &timeline, const AsteroidShape &shape,
+	uint32_t numThreads, const char *cacheDirectory)
+{
+	this->meshPool = &meshPool;
+	this->timeline = &timeline;
+	this->shape = shape;
+	generator.start(shape, meshPool.getVertexFormat(), numThreads, cacheDirectory);
+
+	if (VERBOSE)
+		printf("Asteroid generator: %u threads, cache %s\n", generator.getNumThreads(),
+			generator.hasCache() ? cacheDirectory : "disabled");
+}
+
+void AsteroidField::destroy(void)
+{
+	generator.stop();
+}
+
+void AsteroidField::generate(uint32_t variantIndex)
+{
+	generator.submit(variantIndex, variants[variantIndex].seed);
+	numGenerating++;
+}
+
+void AsteroidField::request(const uint32_t *seeds, uint32_t numSeeds)
+{
+	if (ready)
+		requestTime = PresentLatencyTracker::Clock::now();
+	ready = false;
+
+	for (uint32_t i = 0; i < numSeeds; i++)
+	{
+		numRequested++;
+		uint64_t key = getAsteroidCacheKey(seeds[i], shape, meshPool->getVertexFormat());
+		auto found = variantIndices.find(key);
+		if (found != variantIndices.end())
+		{
+			slotVariants.push_back(found->second);
+			numShared++;
+			continue;
+		}
+
+		uint32_t variantIndex = static_cast<uint32_t>(variants.size());
+		Variant variant = {};
+		variant.key = key;
+		variant.seed = seeds[i];
+		variants.push_back(variant);
+		variantIndices.emplace(key, variantIndex);
+		slotVariants.push_back(variantIndex);
+
+		// Only check the cache here, mapping it has to wait for update() on the render thread.
+		if (generator.hasCache() && fileExists(generator.getCachePath(key).c_str()))
+			cachedVariants.push_back(variantIndex);
+		else
+			generate(variantIndex);
+	}
+}
+
+bool AsteroidField::update(void)
+{
+	if (ready)
+		return true;
+
+	// Cached meshes are copied straight from the file mapping into the staging ring.
+	bool uploaded = false;
+	for (uint32_t variantIndex : cachedVariants)
+	{
+		Variant &variant = variants[variantIndex];
+		variant.loaded = meshPool->load(generator.getCachePath(variant.key).c_str(), variant.meshId);
+		if (variant.loaded)
+			numFromCache++;
+		else
+			generate(variantIndex); // Damaged or from an older version, so make it again.
+		uploaded |= variant.loaded;
+	}
+	cachedVariants.clear();
+
+	generated.clear();
+	generator.collect(generated);
+	for (const GeneratedAsteroid &asteroid : generated)
+	{
+		Variant &variant = variants[asteroid.id];
+		variant.loaded = meshPool->load(asteroid.image.data(), asteroid.image.size(), "generated asteroid", variant.meshId);
+		if (!variant.loaded)
+		{
+			fprintf(stderr, "Error (%s:%u): The mesh pool is out of space for asteroid %u\n", __FILE__, __LINE__, variant.seed);
+			throw std::runtime_error("The mesh pool is out of space for the asteroid field");
+		}
+		numGenerating--;
+		numGenerated++;
+		generateCpuMs += asteroid.generateMs;
+		addMeshOptimizationStats(optimization, asteroid.optimization);
+		uploaded = true;
+	}
+	if (!generated.empty() && !numGenerating)
+		generationMs = PresentLatencyTracker::millisecondsSince(requestTime);
+
+	// Submit what came in this frame, rather than holding it until the last one is done.
+	if (uploaded)
+		uploadValue = meshPool->flush();
+
+	if (numGenerating || !timeline->isComplete(uploadValue))
+		return false;
+
+	ready = true;
+	readyMs = PresentLatencyTracker::millisecondsSince(requestTime);
+	if (VERBOSE)
+		printf("Asteroid field ready: %u meshes in %.3lf ms\n", static_cast<uint32_t>(variants.size()), readyMs);
+	return true;
+}
+
+void AsteroidField::printStats(void)
+{
+	printf("Asteroid field stats:\n");
+	printf("\tMeshes: %llu requested, %llu unique (%llu shared a seed), %llu from the cache, %llu generated\n",
+		static_cast<unsigned long long>(numRequested),
+		static_cast<unsigned long long>(variants.size()),
+		static_cast<unsigned long long>(numShared),
+		static_cast<unsigned long long>(numFromCache),
+		static_cast<unsigned long long>(numGenerated));
+	if (numGenerated && generationMs > 0.0)
+		printf("\tGenerated in %.3lf ms on %u threads (%.3lf ms/mesh of CPU time), %.0lf meshes/s\n",
+			generationMs, generator.getNumThreads(), generateCpuMs / numGenerated,
+			numGenerated * 1000.0 / generationMs);
+	if (ready && numRequested)
+		printf("\tTime to first usable field: %.3lf ms\n", readyMs);
+	if (generator.getNumCacheWriteFailures())
+		printf("\tFailed cache writes: %llu\n", static_cast<unsigned long long>(generator.getNumCacheWriteFailures()));
+	if (numGenerated)
+	{
+		printf("Generated asteroid index optimization stats:\n");
+		printMeshOptimizationStats(optimization);
+	}
+}
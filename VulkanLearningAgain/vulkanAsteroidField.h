@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "asteroidGenerator.h"
+#include "vulkanMeshPool.h"
+#include "vulkanTimeline.h"
+#include "vulkanPresent.h"
+
+// The asteroid meshes of a field, one per seed.
+// Seeds that come out the same (same key) share one mesh. Meshes that were generated on an earlier
+//	run are mapped straight from the generator's cache directory, and the rest are generated on the
+//	worker threads and uploaded from memory as they finish, so startup never waits on them.
+class AsteroidField
+{
+	struct Variant
+	{
+		uint64_t key;
+		uint32_t seed;
+		uint32_t meshId; // In the mesh pool, once loaded.
+		bool loaded;
+	};
+
+	MeshPool *meshPool = nullptr;
+	QueueTimeline *timeline = nullptr;
+	AsteroidShape shape = {};
+	AsteroidGenerator generator;
+	std::vector<Variant> variants;
+	std::unordered_map<uint64_t, uint32_t> variantIndices; // Key -> variants[]
+	std::vector<uint32_t> slotVariants; // Requested seed -> variants[]
+	std::vector<uint32_t> cachedVariants; // Found in the cache, loaded on the next update().
+	std::vector<GeneratedAsteroid> generated; // Scratch for collect()
+	uint32_t numGenerating = 0;
+	uint64_t uploadValue = 0; // Timeline value the last upload is done at.
+	bool ready = true;
+
+	// Stats
+	PresentLatencyTracker::Clock::time_point requestTime;
+	double generationMs = 0.0; // From the request to the last mesh coming off the workers.
+	double readyMs = 0.0; // From the request to every mesh being on the GPU.
+	double generateCpuMs = 0.0; // Summed over the workers.
+	uint64_t numRequested = 0;
+	uint64_t numShared = 0;
+	uint64_t numFromCache = 0;
+	uint64_t numGenerated = 0;
+	MeshOptimizationStats optimization = {}; // Over every generated mesh.
+
+	void generate(uint32_t variantIndex);
+
+public:
+	// 'numThreads' of 0 uses every hardware thread but one. A null 'cacheDirectory' regenerates
+	//	every run.
+	void create(MeshPool &meshPool, QueueTimeline &timeline, const AsteroidShape &shape,
+		uint32_t numThreads, const char *cacheDirectory);
+	void destroy(void);
+
+	// Start on the meshes for 'seeds'. They get slots in the order given, after any from earlier calls.
+	void request(const uint32_t *seeds, uint32_t numSeeds);
+
+	// Upload whatever's been loaded or generated since the last call. Call once a frame, on the
+	//	render thread, until it returns true (everything requested is on the GPU).
+	bool update(void);
+
+	bool isReady(void) const { return ready; }
+	uint32_t getNumSlots(void) const { return static_cast<uint32_t>(slotVariants.size()); }
+	const PooledMesh &getMesh(uint32_t slot) const { return meshPool->getMesh(variants[slotVariants[slot]].meshId); }
+	void printStats(void);
+};
@@ -0,0 +1,1002 @@
+#include "vulkanAsteroidRenderer.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdexcept>
+#include <algorithm>
+#include "vulkanDebug.h"
+#include "vulkanMemory.h"
+#include "mathUtils.h"
+
+// Invocations per workgroup of the classify and scatter stages (local_size_x in asteroidCull.glsl).
+#define CULL_WORKGROUP_SIZE 64
+
+// Size of VkDrawIndirectCommand / VkDrawIndexedIndirectCommand as the shader writes them.
+#define IMPOSTOR_DRAW_SIZE 16
+#define MESH_DRAW_STRIDE 20
+
+// Bytes of counters in front of the buckets in the bucket buffer.
+#define BUCKET_HEADER_SIZE 16
+
+// The cluster state buffer (ClusterState in asteroidCull.glsl): a VkDrawIndexedIndirectCommand per
+//	phase, two counters, then a VkDispatchIndirectCommand per phase (padded to 16 bytes).
+#define CLUSTER_STATE_SIZE 80
+#define CLUSTER_DISPATCH_OFFSET 48
+#define CLUSTER_DISPATCH_STRIDE 16
+
+// What a cluster instance and an entry in the deferred clusters take.
+#define CLUSTER_INSTANCE_SIZE 16
+#define DEFERRED_CLUSTER_SIZE 8
+
+void AsteroidRenderer::create(VkDevice device, const DeviceDispatch &dispatch,
+	const VkPhysicalDeviceMemoryProperties &memoryProperties,
+	const AsteroidLodConfig &config,
+	const MeshPool &meshPool,
+	uint32_t numLocalInstances,
+	uint32_t maxClusters,
+	bool multiDrawIndirect,
+	const VkBuffer bodyBuffers[2],
+	VkBuffer remoteBodyBuffer,
+	uint32_t numRemoteInstances,
+	uint32_t maxSlots,
+	uint32_t numFrames,
+	const FrameUploadArena &uploadArena,
+	VkRenderPass renderPass,
+	const HiZPyramid *hiZPyramid,
+	BindlessDescriptorTable *bindlessTable,
+	ShaderLibrary &shaders,
+	VkPipelineCache pipelineCache,
+	const VkAllocationCallbacks *allocator)
+{
+	this->device = device;
+	this->dispatch = &dispatch;
+	this->allocator = allocator;
+	this->config = config;
+	this->vertexFormat = meshPool.getVertexFormat();
+	this->indexType = meshPool.getIndexType();
+	this->numLocalInstances = numLocalInstances;
+	this->numInstances = numLocalInstances + (remoteBodyBuffer ? numRemoteInstances : 0);
+	this->remoteBodyBuffer = remoteBodyBuffer;
+	this->maxClusters = maxClusters;
+	this->multiDraw = multiDrawIndirect && !maxClusters;
+	this->maxSlots = maxSlots;
+	this->hiZPyramid = hiZPyramid;
+	this->bindlessTable = bindlessTable;
+	frameCulled.assign(numFrames, false);
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Buffers. Sized for every slot at the most LODs a mesh file can have.
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	uint32_t maxBuckets = maxSlots * (MESH_FILE_MAX_LODS + 1);
+	bucketBufferSize = BUCKET_HEADER_SIZE + sizeof(uint32_t) * 2 * maxBuckets;
+
+	void *mappedData;
+	createBufferWithMemory(device, dispatch, memoryProperties,
+		sizeof(GpuMeshSlot) * maxSlots,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, allocator,
+		slotBuffer, slotMemory);
+	HANDLE_VK(dispatch.vkMapMemory(device, slotMemory, 0, VK_WHOLE_SIZE, 0, &mappedData),
+		"Mapping the asteroid mesh slots");
+	mappedSlots = static_cast<GpuMeshSlot *>(mappedData);
+
+	createBufferWithMemory(device, dispatch, memoryProperties,
+		sizeof(uint32_t) * numInstances,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocator,
+		lodStateBuffer, lodStateMemory);
+	createBufferWithMemory(device, dispatch, memoryProperties,
+		sizeof(uint32_t) * 2 * numInstances,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocator,
+		classifiedBuffer, classifiedMemory);
+	createBufferWithMemory(device, dispatch, memoryProperties,
+		bucketBufferSize,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocator,
+		bucketBuffer, bucketMemory);
+	createBufferWithMemory(device, dispatch, memoryProperties,
+		sizeof(uint32_t) * numInstances,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocator,
+		drawListBuffer, drawListMemory);
+	createBufferWithMemory(device, dispatch, memoryProperties,
+		IMPOSTOR_DRAW_SIZE + MESH_DRAW_STRIDE * maxSlots * MESH_FILE_MAX_LODS,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocator,
+		drawBuffer, drawMemory);
+
+	createBufferWithMemory(device, dispatch, memoryProperties,
+		sizeof(GpuFrameStats) * numFrames * 2,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT, allocator,
+		statsBuffer, statsMemory);
+	HANDLE_VK(dispatch.vkMapMemory(device, statsMemory, 0, VK_WHOLE_SIZE, 0, &mappedData),
+		"Mapping the asteroid culling stats");
+	mappedStats = static_cast<GpuFrameStats *>(mappedData);
+
+	// Every cluster drawn can be a full one, so the indices are sized for that.
+	if (maxClusters)
+	{
+		createBufferWithMemory(device, dispatch, memoryProperties,
+			static_cast<VkDeviceSize>(CLUSTER_INSTANCE_SIZE) * maxClusters,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocator,
+			clusterInstanceBuffer, clusterInstanceMemory);
+		createBufferWithMemory(device, dispatch, memoryProperties,
+			sizeof(uint32_t) * 3 * static_cast<VkDeviceSize>(MESH_CLUSTER_MAX_TRIANGLES) * maxClusters,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocator,
+			clusterIndexBuffer, clusterIndexMemory);
+		createBufferWithMemory(device, dispatch, memoryProperties,
+			CLUSTER_STATE_SIZE,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocator,
+			clusterStateBuffer, clusterStateMemory);
+		createBufferWithMemory(device, dispatch, memoryProperties,
+			static_cast<VkDeviceSize>(DEFERRED_CLUSTER_SIZE) * maxClusters,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocator,
+			deferredClusterBuffer, deferredClusterMemory);
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Descriptors. Every stage sees the same set, there's one per physics state buffer.
+	//	Cluster culling adds the mesh pool's vertices and clusters and its own buffers.
+	//	With a bindless table the bodies (binding 1) are read through it instead, by
+	//	the index in the frame parameters, so the one set serves both state buffers.
+	//	The remote bodies are binding 15, or in the table as well.
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	const uint32_t maxBindings = 16;
+	uint32_t numBindings = 0;
+	VkDescriptorSetLayoutBinding bindings[maxBindings];
+	for (uint32_t binding = 0; binding < maxBindings; binding++)
+	{
+		if ((binding == 1 && bindlessTable)
+			|| (binding >= 9 && binding < 15 && !maxClusters)
+			|| (binding == 15 && (!remoteBodyBuffer || bindlessTable)))
+			continue;
+		bindings[numBindings++] = {
+			binding, // Binding
+			binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // Descriptor Type
+			1, // Descriptor count
+			VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT, // Stage flags
+			nullptr // Immutable samplers
+		};
+	}
+	uint32_t numSets = bindlessTable ? 1U : 2U;
+
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		nullptr, // pNext
+		0, // flags
+		numBindings, // Binding Count
+		bindings
+	};
+	HANDLE_VK(dispatch.vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, allocator, &descriptorSetLayout),
+		"Creating the asteroid descriptor set layout");
+
+	VkDescriptorPoolSize poolSizes[] = {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, numSets }, // Type, descriptor count
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, numSets * (numBindings - 1) }
+	};
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		nullptr, // pNext
+		0, // flags
+		numSets, // Max sets
+		2, // Pool size count
+		poolSizes // Pool sizes
+	};
+	HANDLE_VK(dispatch.vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, allocator, &descriptorPool),
+		"Creating the asteroid descriptor pool");
+
+	VkDescriptorSetLayout setLayouts[] = { descriptorSetLayout, descriptorSetLayout };
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		nullptr, // pNext
+		descriptorPool, // Descriptor pool
+		numSets, // Descriptor set count
+		setLayouts // Set layouts
+	};
+	HANDLE_VK(dispatch.vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, descriptorSets),
+		"Allocating the asteroid descriptor sets");
+
+	VkDescriptorBufferInfo bufferInfos[2][maxBindings];
+	VkWriteDescriptorSet descriptorWrites[2 * maxBindings];
+	for (uint32_t i = 0; i < numSets; i++)
+	{
+		bufferInfos[i][0] = { uploadArena.getBuffer(), 0, uploadArena.getBindRange() }; // Frame parameters
+		bufferInfos[i][1] = { bodyBuffers[i], 0, VK_WHOLE_SIZE };
+		bufferInfos[i][2] = { slotBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[i][3] = { lodStateBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[i][4] = { classifiedBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[i][5] = { bucketBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[i][6] = { drawListBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[i][7] = { drawBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[i][8] = { statsBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[i][9] = { meshPool.getVertexBuffer(), 0, VK_WHOLE_SIZE };
+		bufferInfos[i][10] = { meshPool.getClusterBuffer(), 0, VK_WHOLE_SIZE };
+		bufferInfos[i][11] = { clusterInstanceBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[i][12] = { clusterIndexBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[i][13] = { clusterStateBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[i][14] = { deferredClusterBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[i][15] = { remoteBodyBuffer, 0, VK_WHOLE_SIZE };
+		for (uint32_t j = 0; j < numBindings; j++)
+		{
+			uint32_t binding = bindings[j].binding;
+			descriptorWrites[i * numBindings + j] = {
+				VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				nullptr, // pNext
+				descriptorSets[i], // Destination set
+				binding, // Destination binding
+				0, // Destination array element
+				1, // Descriptor count
+				bindings[j].descriptorType, // Descriptor type
+				nullptr, // Image info
+				&bufferInfos[i][binding], // Buffer info
+				nullptr // Texel buffer view
+			};
+		}
+	}
+	dispatch.vkUpdateDescriptorSets(device, numSets * numBindings, descriptorWrites, 0, nullptr);
+	for (uint32_t i = 0; bindlessTable && i < 2; i++)
+		bodyBindlessIndices[i] = bindlessTable->addStorageBuffer(bodyBuffers[i], 0, VK_WHOLE_SIZE);
+	if (bindlessTable && remoteBodyBuffer)
+		remoteBindlessIndex = bindlessTable->addStorageBuffer(remoteBodyBuffer, 0, VK_WHOLE_SIZE);
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Pipelines
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	// Set 1 is the Hi-Z pyramid, only the culling reads it. The bindless table comes after it. The
+	//	draws push which bucket they're drawing.
+	VkDescriptorSetLayout pipelineSetLayouts[3] = { descriptorSetLayout };
+	uint32_t numSetLayouts = 1;
+	if (hiZPyramid)
+		pipelineSetLayouts[numSetLayouts++] = hiZPyramid->getReadSetLayout();
+	if (bindlessTable)
+	{
+		bindlessSet = numSetLayouts;
+		pipelineSetLayouts[numSetLayouts++] = bindlessTable->getLayout();
+	}
+	VkPushConstantRange pushConstantRange = {
+		VK_SHADER_STAGE_VERTEX_BIT, // Stage flags
+		0, // Offset
+		sizeof(uint32_t) // Size
+	};
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
+		VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		nullptr, // pNext
+		0, // flags
+		numSetLayouts, // Set Layout Count
+		pipelineSetLayouts, // Set Layouts
+		1, // Num Push Constant Ranges
+		&pushConstantRange // Push Constant Ranges
+	};
+	HANDLE_VK(dispatch.vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, allocator, &pipelineLayout),
+		"Creating the asteroid pipeline layout");
+
+	// The culling stages are one source compiled three ways, or four with cluster culling.
+	char bindlessSetValue[4];
+	snprintf(bindlessSetValue, sizeof(bindlessSetValue), "%u", bindlessSet);
+	ShaderDefine bindlessDefine = { "BINDLESS_SET", bindlessSetValue };
+	ShaderDefine remoteDefine = { "REMOTE_BODIES", nullptr };
+	const char *cullStages[] = { "CULL_CLASSIFY", "CULL_BUILD_DRAWS", "CULL_SCATTER", "CULL_CLUSTERS" };
+	VkPipeline *cullPipelines[] = { &classifyPipeline, &buildDrawsPipeline, &scatterPipeline, &clusterCullPipeline };
+	for (uint32_t stage = 0; stage < (maxClusters ? 4U : 3U); stage++)
+	{
+		ShaderDefine cullDefines[5] = {
+			{ cullStages[stage], nullptr }
+		};
+		uint32_t numCullDefines = 1;
+		if (hiZPyramid)
+			cullDefines[numCullDefines++] = { "OCCLUSION_CULLING", nullptr };
+		if (maxClusters)
+			cullDefines[numCullDefines++] = { "CLUSTER_CULLING", nullptr };
+		if (bindlessTable)
+			cullDefines[numCullDefines++] = bindlessDefine;
+		if (remoteBodyBuffer)
+			cullDefines[numCullDefines++] = remoteDefine;
+		VkComputePipelineCreateInfo computePipelineCreateInfo = {
+			VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+			nullptr, // pNext
+			0, // flags
+			{ // Stage
+				VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+				nullptr, // pNext
+				0, // Flags
+				VK_SHADER_STAGE_COMPUTE_BIT, // Stage
+				shaders.getModule("asteroidCull.glsl", VK_SHADER_STAGE_COMPUTE_BIT, cullDefines, numCullDefines), // Shader module
+				"main", // Shader entry point
+				nullptr // Specialization info
+			},
+			pipelineLayout, // Layout
+			VK_NULL_HANDLE, // Base Pipeline Handle
+			0 // Base pipeline index
+		};
+		HANDLE_VK(dispatch.vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, allocator, cullPipelines[stage]),
+			"Creating the asteroid %s pipeline", cullStages[stage]);
+	}
+
+	ShaderDefine impostorDefines[3] = {
+		{ "IMPOSTOR", nullptr }
+	};
+	uint32_t numImpostorDefines = 1;
+	ShaderDefine meshDefines[4];
+	uint32_t numMeshDefines = 0;
+	if (vertexFormat == MESH_VERTEX_FORMAT_QUANTIZED)
+		meshDefines[numMeshDefines++] = { "QUANTIZED_VERTICES", nullptr };
+	if (maxClusters)
+		meshDefines[numMeshDefines++] = { "CLUSTERS", nullptr };
+	if (bindlessTable)
+	{
+		meshDefines[numMeshDefines++] = bindlessDefine;
+		impostorDefines[numImpostorDefines++] = bindlessDefine;
+	}
+	if (remoteBodyBuffer)
+	{
+		meshDefines[numMeshDefines++] = remoteDefine;
+		impostorDefines[numImpostorDefines++] = remoteDefine;
+	}
+	meshPipeline = createGraphicsPipeline(
+		shaders.getModule("asteroidVertex.glsl", VK_SHADER_STAGE_VERTEX_BIT, numMeshDefines ? meshDefines : nullptr, numMeshDefines),
+		shaders.getModule("asteroidFragment.glsl", VK_SHADER_STAGE_FRAGMENT_BIT),
+		false, maxClusters != 0, renderPass, pipelineCache);
+	impostorPipeline = createGraphicsPipeline(
+		shaders.getModule("asteroidVertex.glsl", VK_SHADER_STAGE_VERTEX_BIT, impostorDefines, numImpostorDefines),
+		shaders.getModule("asteroidImpostorFragment.glsl", VK_SHADER_STAGE_FRAGMENT_BIT),
+		true, true, renderPass, pipelineCache);
+
+	if (VERBOSE)
+	{
+		printf("Asteroid renderer: %u instances (%u remote), up to %u mesh slots, LOD 0 down to %.1f px, impostors below %.1f px%s%s\n",
+			numInstances, numInstances - numLocalInstances, maxSlots, config.fullDetailPixels * 0.5f, config.impostorPixels,
+			hiZPyramid ? ", occlusion culled" : "",
+			bindlessTable ? ", bodies read through the bindless table" : "");
+		if (maxClusters)
+			printf("Asteroid renderer: Cluster culled, up to %u clusters a frame (%llu KB of indices)\n", maxClusters,
+				static_cast<unsigned long long>(sizeof(uint32_t) * 3 * MESH_CLUSTER_MAX_TRIANGLES * static_cast<uint64_t>(maxClusters) / 1024));
+		else
+			printf("Asteroid renderer: %s\n", multiDraw ? "One multi-draw indirect call for every slot and LOD" : "One indirect draw call per slot and LOD");
+	}
+}
+
+VkPipeline AsteroidRenderer::createGraphicsPipeline(VkShaderModule vertexShader, VkShaderModule fragmentShader, bool impostor,
+	bool pulledVertices, VkRenderPass renderPass, VkPipelineCache pipelineCache)
+{
+	VkPipelineShaderStageCreateInfo pipelineShaderStageCreateInfos[] = {
+		{ // Vertex Shader
+			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			nullptr, // pNext
+			0, // Flags
+			VK_SHADER_STAGE_VERTEX_BIT, // Stage
+			vertexShader, // shader module
+			"main", // Shader entry point
+			nullptr // Specialization info
+		},
+		{ // Fragment Shader
+			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			nullptr, // pNext
+			0, // Flags
+			VK_SHADER_STAGE_FRAGMENT_BIT, // Stage
+			fragmentShader, // Shader module
+			"main", // Shader entry point
+			nullptr // Specialization info
+		}
+	};
+
+	// Meshes come from the mesh pool's vertex buffer, impostors make their quads up from the vertex index.
+	//	Clusters read the vertex buffer in the shader ('pulledVertices').
+	bool quantized = vertexFormat == MESH_VERTEX_FORMAT_QUANTIZED;
+	VkVertexInputBindingDescription vertexInputBindingDescription = {
+		0, // Binding
+		getMeshVertexStride(vertexFormat), // Stride
+		VK_VERTEX_INPUT_RATE_VERTEX // Vertex Input Rate
+	};
+
+	VkVertexInputAttributeDescription vertexAttributeDescriptions[] = {
+		{
+			0, // Location
+			0, // Binding
+			quantized ? VK_FORMAT_R16G16B16A16_SNORM : VK_FORMAT_R32G32B32_SFLOAT, // Format
+			quantized ? static_cast<uint32_t>(offsetof(QuantizedMeshVertex, pos)) : static_cast<uint32_t>(offsetof(MeshVertex, pos)) // Offset
+		},
+		{
+			1, // Location
+			0, // Binding
+			quantized ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_R32G32B32_SFLOAT, // Format
+			quantized ? static_cast<uint32_t>(offsetof(QuantizedMeshVertex, normal)) : static_cast<uint32_t>(offsetof(MeshVertex, normal)) // Offset
+		},
+		{
+			2, // Location
+			0, // Binding
+			quantized ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R32G32_SFLOAT, // Format
+			quantized ? static_cast<uint32_t>(offsetof(QuantizedMeshVertex, uv)) : static_cast<uint32_t>(offsetof(MeshVertex, uv)) // Offset
+		}
+	};
+
+	VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {
+		VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		nullptr, // pNext
+		0, // Flags
+		pulledVertices ? 0U : 1U, // Vertex Binding Description Count
+		&vertexInputBindingDescription, // Vertex Binding Descriptions
+		pulledVertices ? 0U : 3U, // Vertex Attribute Description Count
+		vertexAttributeDescriptions, // Vertex Attribute Descriptions
+	};
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo = {
+		VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+		nullptr, // pNext
+		0, // Flags
+		VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, // Topology
+		VK_FALSE // Primitive restart enable
+	};
+
+	VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {
+		VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+		nullptr, // pNext
+		0, // Flags
+		1, // Viewport Count
+		nullptr, // Viewports (dynamic)
+		1, // Scissor Count
+		nullptr // Scissors (dynamic)
+	};
+
+	VkPipelineRasterizationStateCreateInfo rasterizationState = {
+		VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+		nullptr, // pNext,
+		0, // Flags
+		VK_FALSE, // Depth Clamp Enable
+		VK_FALSE, // Rasterizer Discard Enable
+		VK_POLYGON_MODE_FILL, // Polygon Mode
+		impostor ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT, // Cull Mode
+		VK_FRONT_FACE_COUNTER_CLOCKWISE, // Front Face
+		VK_FALSE, // Depth Bias Enable
+		0.0f, // Depth Bias constant factor
+		0.0f, // Depth Bias clamp
+		0.0f, // Depth Bias slope factor
+		1.0f // Line Width
+	};
+
+	VkPipelineMultisampleStateCreateInfo multisampleState = {
+		VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+		nullptr, // pNext,
+		0, // Flags
+		VK_SAMPLE_COUNT_1_BIT, // Rasterization samples
+		VK_FALSE, // Sample Shading Enable
+		1.0f, // Min Sample Shading
+		nullptr, // Sample Mask
+		VK_FALSE, // Alpha to Coverage Enable
+		VK_FALSE, // Alpha to One Enable
+	};
+
+	VkStencilOpState stencilOpState = {
+		VK_STENCIL_OP_KEEP, // Fail Op
+		VK_STENCIL_OP_KEEP, // Pass Op
+		VK_STENCIL_OP_KEEP, // Depth Fail Op
+		VK_COMPARE_OP_ALWAYS, // Compare Op
+		0U, // Compare Mask
+		0U, // Write Mask
+		0U  // Reference
+	};
+
+	VkPipelineDepthStencilStateCreateInfo depthStencilState = {
+		VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+		nullptr, // pNext
+		0, // Flags
+		VK_TRUE, // Depth Test Enable
+		VK_TRUE, // Depth Write Enable
+		VK_COMPARE_OP_GREATER, // Depth Compare Op (reversed Z)
+		VK_FALSE, // Depth Bounds Test Enable
+		VK_FALSE, // Stencil Test Enable
+		stencilOpState, // Front Stencil Op State
+		stencilOpState, // Back Stencil Op State
+		0.0f, // Min Depth Bounds
+		1.0f // Max Depth Bounds
+	};
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachmentState = {
+		VK_FALSE, // Blend enable
+		VK_BLEND_FACTOR_ZERO, // Source color blend factor
+		VK_BLEND_FACTOR_ZERO, // Destination color blend factor
+		VK_BLEND_OP_ADD, // Color Blend operator
+		VK_BLEND_FACTOR_ZERO, // Source Alpha Blend factor
+		VK_BLEND_FACTOR_ZERO, // Destination alpha blend factor
+		VK_BLEND_OP_ADD, // Alpha blend operator
+		VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT // Color Write mask
+	};
+
+	VkPipelineColorBlendStateCreateInfo colorBlendState = {
+		VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+		nullptr, // pNext
+		0, // Flags
+		VK_FALSE, // Logic Op Enable
+		VK_LOGIC_OP_COPY, // Logic Op
+		1, // Attachment count
+		&colorBlendAttachmentState, // Attachment states
+		{ 1.0f, 1.0f, 1.0f, 1.0f } // Blend Constants
+	};
+
+	VkDynamicState dynamicStates[] = {
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR
+	};
+
+	VkPipelineDynamicStateCreateInfo dynamicState = {
+		VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+		nullptr, // pNext
+		0, // Flags
+		2, // Dynamic state count
+		dynamicStates // Dynamic states
+	};
+
+	VkGraphicsPipelineCreateInfo graphicsPipelineCreateInfo = {
+		VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+		nullptr, // pNext,
+		0, // flags
+		2, // Stage count
+		pipelineShaderStageCreateInfos, // Stages
+		&vertexInputStateCreateInfo, // Vertex Input State
+		&inputAssemblyStateCreateInfo, // Input Assembly State
+		nullptr, // Tessellation state
+		&viewportStateCreateInfo, // Viewport State
+		&rasterizationState, // Rasterization state
+		&multisampleState, // Multisample state
+		&depthStencilState, // Depth Stencil State
+		&colorBlendState, // Color Blend State
+		&dynamicState, // Dynamic State
+		pipelineLayout, // Layout
+		renderPass, // Render pass
+		0, // Sub-pass index
+		VK_NULL_HANDLE, // Base Pipeline Handle
+		0 // Base pipeline index
+	};
+
+	VkPipeline pipeline;
+	HANDLE_VK(dispatch->vkCreateGraphicsPipelines(device, pipelineCache, 1, &graphicsPipelineCreateInfo, allocator, &pipeline),
+		"Creating the asteroid %s pipeline", impostor ? "impostor" : "mesh");
+	return pipeline;
+}
+
+void AsteroidRenderer::destroy(void)
+{
+	if (!device)
+		return;
+
+	VkPipeline pipelines[] = { classifyPipeline, buildDrawsPipeline, scatterPipeline, clusterCullPipeline, meshPipeline, impostorPipeline };
+	for (VkPipeline pipeline : pipelines)
+	{
+		if (pipeline)
+			dispatch->vkDestroyPipeline(device, pipeline, allocator);
+	}
+	if (pipelineLayout)
+		dispatch->vkDestroyPipelineLayout(device, pipelineLayout, allocator);
+	if (descriptorPool)
+		dispatch->vkDestroyDescriptorPool(device, descriptorPool, allocator);
+	if (descriptorSetLayout)
+		dispatch->vkDestroyDescriptorSetLayout(device, descriptorSetLayout, allocator);
+	for (uint32_t i = 0; bindlessTable && i < 2; i++)
+		bindlessTable->removeStorageBuffer(bodyBindlessIndices[i]);
+	if (bindlessTable && remoteBodyBuffer)
+		bindlessTable->removeStorageBuffer(remoteBindlessIndex);
+
+	VkBuffer buffers[] = { slotBuffer, lodStateBuffer, classifiedBuffer, bucketBuffer, drawListBuffer, drawBuffer, statsBuffer,
+		clusterInstanceBuffer, clusterIndexBuffer, clusterStateBuffer, deferredClusterBuffer };
+	VkDeviceMemory memories[] = { slotMemory, lodStateMemory, classifiedMemory, bucketMemory, drawListMemory, drawMemory, statsMemory,
+		clusterInstanceMemory, clusterIndexMemory, clusterStateMemory, deferredClusterMemory };
+	for (VkBuffer buffer : buffers)
+	{
+		if (buffer)
+			dispatch->vkDestroyBuffer(device, buffer, allocator);
+	}
+	for (VkDeviceMemory memory : memories)
+	{
+		if (memory)
+			dispatch->vkFreeMemory(device, memory, allocator);
+	}
+
+	device = VK_NULL_HANDLE;
+}
+
+void AsteroidRenderer::setMeshes(const AsteroidField &field)
+{
+	numSlots = std::min(field.getNumSlots(), maxSlots);
+	numLods = MESH_FILE_MAX_LODS;
+	slotMeshes.resize(numSlots);
+	for (uint32_t slot = 0; slot < numSlots; slot++)
+	{
+		slotMeshes[slot] = field.getMesh(slot);
+		numLods = std::min(numLods, slotMeshes[slot].numLods);
+	}
+
+	// Nothing's been culled with the slots yet, so they can be written in place.
+	for (uint32_t slot = 0; slot < numSlots; slot++)
+	{
+		const PooledMesh &mesh = slotMeshes[slot];
+		GpuMeshSlot &gpuSlot = mappedSlots[slot];
+		memcpy(gpuSlot.boundingSphere, mesh.boundingSphere, sizeof(gpuSlot.boundingSphere));
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			gpuSlot.boundsCenter[axis] = (mesh.boundsMin[axis] + mesh.boundsMax[axis]) * 0.5f;
+			gpuSlot.boundsHalfExtent[axis] = (mesh.boundsMax[axis] - mesh.boundsMin[axis]) * 0.5f;
+		}
+		gpuSlot.boundsCenter[3] = 0.0f;
+		gpuSlot.boundsHalfExtent[3] = 0.0f;
+		memset(gpuSlot.lods, 0, sizeof(gpuSlot.lods));
+		for (uint32_t lod = 0; lod < numLods; lod++)
+		{
+			gpuSlot.lods[lod][0] = mesh.lods[lod].numIndices;
+			gpuSlot.lods[lod][1] = mesh.lods[lod].firstIndex;
+			gpuSlot.lods[lod][2] = static_cast<uint32_t>(mesh.lods[lod].vertexOffset);
+			gpuSlot.lods[lod][3] = mesh.lods[lod].numVertices;
+		}
+
+		// In words, the way the cluster stage reads them.
+		gpuSlot.clusterBases[0] = static_cast<uint32_t>(mesh.clusterOffset / sizeof(uint32_t));
+		gpuSlot.clusterBases[1] = gpuSlot.clusterBases[0] + mesh.numClusters * static_cast<uint32_t>(sizeof(MeshCluster) / sizeof(uint32_t));
+		gpuSlot.clusterBases[2] = gpuSlot.clusterBases[1] + mesh.numClusterVertices;
+		gpuSlot.clusterBases[3] = 0;
+		memset(gpuSlot.clusterLods, 0, sizeof(gpuSlot.clusterLods));
+		for (uint32_t lod = 0; lod < numLods; lod++)
+		{
+			gpuSlot.clusterLods[lod][0] = mesh.lods[lod].firstCluster;
+			gpuSlot.clusterLods[lod][1] = mesh.lods[lod].numClusters;
+		}
+		if (maxClusters && !mesh.numClusters)
+		{
+			fprintf(stderr, "Error (%s:%u): Asteroid mesh slot %u has no clusters to cull\n", __FILE__, __LINE__, slot);
+			throw std::runtime_error("Asteroid mesh without clusters");
+		}
+	}
+
+	if (VERBOSE)
+	{
+		printf("Asteroid renderer: Drawing %u mesh slots with %u LODs\n", numSlots, numLods);
+		if (maxClusters)
+		{
+			uint32_t lodClusters[MESH_FILE_MAX_LODS] = {};
+			for (uint32_t slot = 0; slot < numSlots; slot++)
+			{
+				for (uint32_t lod = 0; lod < numLods; lod++)
+					lodClusters[lod] += slotMeshes[slot].lods[lod].numClusters;
+			}
+			printf("Asteroid renderer: Clusters per mesh by LOD:");
+			for (uint32_t lod = 0; lod < numLods; lod++)
+				printf(" %.1f", static_cast<float>(lodClusters[lod]) / numSlots);
+			printf("\n");
+		}
+	}
+}
+
+void AsteroidRenderer::beginFrame(uint32_t frameIndex)
+{
+	if (!frameCulled[frameIndex])
+		return;
+	frameCulled[frameIndex] = false;
+
+	// Both phases draw, so the frame is their sum. Without occlusion culling the late one is never written.
+	uint64_t frameSubmittedTriangles = 0;
+	uint64_t frameClustersDrawn = 0;
+	numFramesCulled++;
+	for (uint32_t phase = 0; phase < (hiZPyramid ? 2U : 1U); phase++)
+	{
+		const GpuFrameStats &frameStats = mappedStats[frameIndex * 2 + phase];
+		numVisible += frameStats.numVisible;
+		numImpostors += frameStats.numImpostors;
+		numMeshDraws += frameStats.numMeshDraws;
+		numLodChanges += frameStats.numLodChanges;
+		fullDetailTriangles += frameStats.fullDetailTriangles[0] | static_cast<uint64_t>(frameStats.fullDetailTriangles[1]) << 32;
+		if (phase == 0)
+			numEarlyOccluded += frameStats.numOccluded;
+		else
+			numOccluded += frameStats.numOccluded;
+
+		// Only what's left of the meshes is drawn, and their vertices are fetched once per cluster.
+		if (maxClusters)
+		{
+			numClusters += frameStats.numClusters;
+			numClustersOutside += frameStats.numClustersOutside;
+			numClustersBackfacing += frameStats.numClustersBackfacing;
+			if (phase == 0)
+				numClustersEarlyOccluded += frameStats.numClustersOccluded;
+			else
+				numClustersOccluded += frameStats.numClustersOccluded;
+			numClustersDrawn += frameStats.numClustersDrawn;
+			frameClustersDrawn += frameStats.numClustersDrawn;
+			numClustersDropped += frameStats.numClustersDropped;
+			frameSubmittedTriangles += frameStats.clusterTriangles + 2ULL * frameStats.numImpostors;
+			submittedVertices += frameStats.clusterVertices;
+		}
+		else
+		{
+			frameSubmittedTriangles += frameStats.submittedTriangles[0] | static_cast<uint64_t>(frameStats.submittedTriangles[1]) << 32;
+			submittedVertices += frameStats.submittedVertices[0] | static_cast<uint64_t>(frameStats.submittedVertices[1]) << 32;
+		}
+	}
+	submittedTriangles += frameSubmittedTriangles;
+	maxClustersDrawn = std::max(maxClustersDrawn, frameClustersDrawn);
+	maxSubmittedTriangles = std::max(maxSubmittedTriangles, frameSubmittedTriangles);
+}
+
+void AsteroidRenderer::recordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t stateIndex,
+	const AsteroidCamera &camera, FrameUploadArena &uploadArena)
+{
+	// The late phase's parameters are the same but for the phase and what it tests against.
+	FrameParams *lateParams = hiZPyramid ? uploadArena.allocate<FrameParams>(lateParamsOffset) : nullptr;
+	FrameParams *params = uploadArena.allocate<FrameParams>(frameParamsOffset);
+	memcpy(params->viewProj, camera.viewProj, sizeof(params->viewProj));
+	extractFrustumPlanes(camera.viewProj, params->frustumPlanes);
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		params->cameraPos[i] = camera.position[i];
+		params->cameraRight[i] = camera.right[i];
+		params->cameraUp[i] = camera.up[i];
+	}
+	params->cameraPos[3] = camera.pixelsPerUnit;
+	params->cameraRight[3] = config.instanceScale;
+	params->cameraUp[3] = 0.0f;
+	params->lodParams[0] = config.fullDetailPixels;
+	params->lodParams[1] = log2f(config.fullDetailPixels / config.impostorPixels);
+	params->lodParams[2] = config.hysteresis;
+	params->lodParams[3] = 0.0f;
+	params->counts[0] = numInstances;
+	params->counts[1] = numSlots;
+	params->counts[2] = numLods;
+	params->counts[3] = frameIndex * 2;
+	memset(params->occlusionViewProj, 0, sizeof(params->occlusionViewProj));
+	memset(params->hiZParams, 0, sizeof(params->hiZParams));
+	memset(params->cullParams, 0, sizeof(params->cullParams));
+	params->cullParams[2] = maxClusters;
+	params->cullParams[3] = multiDraw ? 1U : 0U;
+	memset(params->bodyParams, 0, sizeof(params->bodyParams));
+	if (bindlessTable)
+	{
+		params->bodyParams[0] = bodyBindlessIndices[stateIndex];
+		params->bodyParams[1] = remoteBindlessIndex;
+	}
+	params->bodyParams[2] = numLocalInstances;
+	if (hiZPyramid)
+	{
+		// The pyramid's last build is from last frame's depth, so it's tested with last frame's camera.
+		memcpy(params->occlusionViewProj, hiZPyramid->getBuiltViewProj(), sizeof(params->occlusionViewProj));
+		params->hiZParams[0] = hiZPyramid->getBuiltViewportSize()[0];
+		params->hiZParams[1] = hiZPyramid->getBuiltViewportSize()[1];
+		params->hiZParams[2] = static_cast<float>(hiZPyramid->getNumLevels());
+		params->cullParams[1] = hiZPyramid->isBuilt() ? 1U : 0U;
+
+		// By then it's been rebuilt from this frame's.
+		*lateParams = *params;
+		memcpy(lateParams->occlusionViewProj, camera.viewProj, sizeof(lateParams->occlusionViewProj));
+		lateParams->hiZParams[0] = camera.viewportSize[0];
+		lateParams->hiZParams[1] = camera.viewportSize[1];
+		lateParams->counts[3] = frameIndex * 2 + 1;
+		lateParams->cullParams[0] = 1;
+		lateParams->cullParams[1] = 1;
+	}
+	frameDescriptorSet = descriptorSets[bindlessTable ? 0 : stateIndex];
+	cullFrameIndex = frameIndex;
+	numFramesRecorded++;
+
+	recordCullPhase(commandBuffer, 0);
+}
+
+void AsteroidRenderer::recordLateCull(VkCommandBuffer commandBuffer)
+{
+	frameParamsOffset = lateParamsOffset;
+	recordCullPhase(commandBuffer, 1);
+}
+
+void AsteroidRenderer::recordCullPhase(VkCommandBuffer commandBuffer, uint32_t phase)
+{
+	// What the last frame (or the early phase) did with the buffers is the caller's to wait on.
+	if (phase == 0 && !lodStatesCleared)
+	{
+		dispatch->vkCmdFillBuffer(commandBuffer, lodStateBuffer, 0, VK_WHOLE_SIZE, 0);
+		lodStatesCleared = true;
+	}
+	dispatch->vkCmdFillBuffer(commandBuffer, bucketBuffer, 0, VK_WHOLE_SIZE, 0);
+	if (phase == 0 && maxClusters)
+		dispatch->vkCmdFillBuffer(commandBuffer, clusterStateBuffer, 0, VK_WHOLE_SIZE, 0);
+
+	VkMemoryBarrier clearBarrier = {
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		nullptr, // pNext
+		VK_ACCESS_TRANSFER_WRITE_BIT, // Source access mask
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT // Destination access mask
+	};
+	dispatch->vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+	// Each stage reads what the one before it wrote.
+	VkMemoryBarrier stageBarrier = {
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		nullptr, // pNext
+		VK_ACCESS_SHADER_WRITE_BIT, // Source access mask
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT // Destination access mask
+	};
+	uint32_t numWorkgroups = (numInstances + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE;
+	dispatch->vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout,
+		0, 1, &frameDescriptorSet, // First set, set count, sets
+		1, &frameParamsOffset); // Dynamic offset count, dynamic offsets
+	if (hiZPyramid)
+	{
+		VkDescriptorSet hiZSet = hiZPyramid->getReadSet();
+		dispatch->vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout,
+			1, 1, &hiZSet, // First set, set count, sets
+			0, nullptr); // Dynamic offset count, dynamic offsets
+	}
+	if (bindlessTable)
+	{
+		VkDescriptorSet bindlessSetHandle = bindlessTable->getSet();
+		dispatch->vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout,
+			bindlessSet, 1, &bindlessSetHandle, // First set, set count, sets
+			0, nullptr); // Dynamic offset count, dynamic offsets
+	}
+
+	dispatch->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, classifyPipeline);
+	dispatch->vkCmdDispatch(commandBuffer, numWorkgroups, 1, 1);
+	dispatch->vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &stageBarrier, 0, nullptr, 0, nullptr);
+
+	dispatch->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, buildDrawsPipeline);
+	dispatch->vkCmdDispatch(commandBuffer, 1, 1, 1);
+	dispatch->vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &stageBarrier, 0, nullptr, 0, nullptr);
+
+	dispatch->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, scatterPipeline);
+	dispatch->vkCmdDispatch(commandBuffer, numWorkgroups, 1, 1);
+
+	// The cluster stage reads the draw list, and how many workgroups to run from the state buffer.
+	if (maxClusters)
+	{
+		VkMemoryBarrier clusterBarrier = {
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			nullptr, // pNext
+			VK_ACCESS_SHADER_WRITE_BIT, // Source access mask
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT // Destination access mask
+		};
+		dispatch->vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+			0, 1, &clusterBarrier, 0, nullptr, 0, nullptr);
+
+		dispatch->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, clusterCullPipeline);
+		dispatch->vkCmdDispatchIndirect(commandBuffer, clusterStateBuffer, CLUSTER_DISPATCH_OFFSET + CLUSTER_DISPATCH_STRIDE * phase);
+	}
+
+	drawPhase = phase;
+	frameCulled[cullFrameIndex] = true;
+}
+
+void AsteroidRenderer::recordDraw(VkCommandBuffer commandBuffer, VkBuffer vertexBuffer, VkBuffer indexBuffer)
+{
+	dispatch->vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+		0, 1, &frameDescriptorSet, // First set, set count, sets
+		1, &frameParamsOffset); // Dynamic offset count, dynamic offsets
+	numDescriptorSetBinds++;
+	if (bindlessTable)
+	{
+		VkDescriptorSet bindlessSetHandle = bindlessTable->getSet();
+		dispatch->vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+			bindlessSet, 1, &bindlessSetHandle, // First set, set count, sets
+			0, nullptr); // Dynamic offset count, dynamic offsets
+		numDescriptorSetBinds++;
+	}
+
+	// All of the clusters the phase kept are one draw, their vertices come from the descriptors.
+	dispatch->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipeline);
+	numPipelineBinds++;
+	if (maxClusters)
+	{
+		dispatch->vkCmdBindIndexBuffer(commandBuffer, clusterIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+		dispatch->vkCmdDrawIndexedIndirect(commandBuffer, clusterStateBuffer, MESH_DRAW_STRIDE * drawPhase, 1, MESH_DRAW_STRIDE);
+		numBufferBinds++;
+		numDrawCalls++;
+		numIndirectDraws++;
+	}
+	else
+	{
+		// Every LOD of every mesh is somewhere in the pool's two buffers, so they're bound once.
+		VkDeviceSize vertexOffset = 0;
+		dispatch->vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &vertexOffset);
+		dispatch->vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+		numBufferBinds += 2;
+
+		// An indirect draw per slot and LOD, most of them with no instances, but the GPU decides that.
+		uint32_t numMeshBuckets = numSlots * numLods;
+		if (multiDraw)
+		{
+			uint32_t allBuckets = ~0U;
+			dispatch->vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(allBuckets), &allBuckets);
+			dispatch->vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, IMPOSTOR_DRAW_SIZE, numMeshBuckets, MESH_DRAW_STRIDE);
+			numPushConstants++;
+			numDrawCalls++;
+		}
+		else
+		{
+			for (uint32_t bucket = 0; bucket < numMeshBuckets; bucket++)
+			{
+				dispatch->vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(bucket), &bucket);
+				dispatch->vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, IMPOSTOR_DRAW_SIZE + MESH_DRAW_STRIDE * bucket, 1, MESH_DRAW_STRIDE);
+			}
+			numPushConstants += numMeshBuckets;
+			numDrawCalls += numMeshBuckets;
+		}
+		numIndirectDraws += numMeshBuckets;
+	}
+
+	// The impostor buckets are back to back, so the first one's start covers all of them.
+	uint32_t firstImpostorBucket = numSlots * numLods;
+	dispatch->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, impostorPipeline);
+	dispatch->vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(firstImpostorBucket), &firstImpostorBucket);
+	dispatch->vkCmdDrawIndirect(commandBuffer, drawBuffer, 0, 1, IMPOSTOR_DRAW_SIZE);
+	numPipelineBinds++;
+	numPushConstants++;
+	numDrawCalls++;
+	numIndirectDraws++;
+}
+
+void AsteroidRenderer::printStats(void) const
+{
+	printf("Asteroid renderer stats:\n");
+	printf("\tInstances: %u, %u mesh slots x %u LODs\n", numInstances, numSlots, numLods);
+	printf("\tVertices: %s, %u bytes each (%u as floats)\n", getMeshVertexFormatName(vertexFormat),
+		getMeshVertexStride(vertexFormat), getMeshVertexStride(MESH_VERTEX_FORMAT_FLOAT));
+	if (!numFramesCulled)
+		return;
+
+	double frames = static_cast<double>(numFramesCulled);
+	if (maxClusters)
+		printf("\tPer frame: %.0lf visible (%.0lf impostors), %.1lf LOD changes, 2 draws a phase (clusters, impostors)\n",
+			numVisible / frames, numImpostors / frames, numLodChanges / frames);
+	else
+		printf("\tPer frame: %.0lf visible (%.0lf impostors), %.1lf LOD changes, %.1lf of %u draws with instances\n",
+			numVisible / frames, numImpostors / frames, numLodChanges / frames,
+			numMeshDraws / frames, numSlots * numLods + 1);
+	if (maxClusters)
+	{
+		printf("\tClusters per frame: %.0lf tested, %.0lf (%.1lf%%) outside the frustum, %.0lf (%.1lf%%) backfacing, %.0lf occluded, %.0lf drawn (max %llu of %u)\n",
+			numClusters / frames,
+			numClustersOutside / frames, numClusters ? 100.0 * numClustersOutside / numClusters : 0.0,
+			numClustersBackfacing / frames, numClusters ? 100.0 * numClustersBackfacing / numClusters : 0.0,
+			(hiZPyramid ? numClustersOccluded : numClustersEarlyOccluded) / frames,
+			numClustersDrawn / frames, static_cast<unsigned long long>(maxClustersDrawn), maxClusters);
+		if (numClustersDropped)
+			printf("\tClusters dropped for lack of room: %.1lf per frame\n", numClustersDropped / frames);
+	}
+	printf("\tTriangles per frame: %.0lf submitted (max %llu), %.0lf at full detail (%.1lf%% of it)\n",
+		submittedTriangles / frames, static_cast<unsigned long long>(maxSubmittedTriangles),
+		fullDetailTriangles / frames,
+		fullDetailTriangles ? 100.0 * submittedTriangles / fullDetailTriangles : 0.0);
+	if (hiZPyramid)
+		printf("\tOcclusion culled per frame: %.0lf set aside by the first phase, %.0lf (%.1lf%%) still hidden after the second\n",
+			numEarlyOccluded / frames, numOccluded / frames,
+			numEarlyOccluded ? 100.0 * numOccluded / numEarlyOccluded : 0.0);
+	printf("\tVertex data per frame: %.2lf MB (%.2lf MB as floats)\n",
+		submittedVertices / frames * getMeshVertexStride(vertexFormat) / (1024.0 * 1024.0),
+		submittedVertices / frames * getMeshVertexStride(MESH_VERTEX_FORMAT_FLOAT) / (1024.0 * 1024.0));
+	if (numFramesRecorded)
+	{
+		double recorded = static_cast<double>(numFramesRecorded);
+		printf("\tDraw calls per frame: %.1lf (%.1lf indirect draws in them)\n",
+			numDrawCalls / recorded, numIndirectDraws / recorded);
+		printf("\tBinds per frame: %.1lf pipelines, %.1lf descriptor sets, %.1lf vertex/index buffers, %.1lf push constants\n",
+			numPipelineBinds / recorded, numDescriptorSetBinds / recorded, numBufferBinds / recorded, numPushConstants / recorded);
+	}
+}
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+#include "vulkanDispatch.h"
+#include "vulkanShaders.h"
+#include "vulkanUploadArena.h"
+#include "vulkanMeshPool.h"
+#include "vulkanAsteroidField.h"
+#include "vulkanHiZPyramid.h"
+#include "vulkanBindless.h"
+
+// Where the field is seen from this frame.
+struct AsteroidCamera
+{
+	float viewProj[16];
+	float position[3];
+	float right[3]; // World space axes of the view, the impostors face along them.
+	float up[3];
+	float pixelsPerUnit; // Projected size of one unit at a distance of one: viewport height / (2 tan(fovY / 2)).
+	float viewportSize[2]; // In pixels, what the frame's drawn at.
+};
+
+// When to switch LODs. Sizes are the projected radius of an instance's bounding sphere, in pixels.
+struct AsteroidLodConfig
+{
+	float instanceScale; // An instance is its mesh scaled by this times the cube root of its body's mass.
+	float fullDetailPixels; // LOD 0 down to half this size, then each LOD covers half the size of the one before.
+	float impostorPixels; // Smaller than this is drawn as an impostor.
+	float hysteresis; // In LODs. An instance keeps its LOD until it's this far outside of the LOD's range.
+};
+
+// Draws an asteroid for every physics body, with the asteroid field's meshes (body i uses slot
+//	i % slots). Bodies simulated on other devices are drawn after the local ones.
+// Every frame a compute pass (asteroidCull.glsl) frustum culls the bodies and picks each one's LOD
+//	from its size on screen, with hysteresis against popping, or a camera facing impostor once it's
+//	only a few pixels across. It writes the indirect draws, so the CPU records the same commands
+//	every frame whatever's visible.
+// Given a Hi-Z pyramid it also occlusion culls, in two phases: recordCull() sets aside what's
+//	behind the pyramid as last built, recordDraw() draws the rest, the caller rebuilds the
+//	pyramid from that depth, then recordLateCull() picks out what the first phase hid wrongly
+//	for a second recordDraw().
+// Given room for clusters it also culls within the meshes: a workgroup per visible mesh instance
+//	tests each of its LOD's clusters (MeshCluster) against the frustum, their normal cones and the
+//	pyramid, and writes the triangles of the rest out as indices into one buffer, so each phase
+//	draws all of its meshes with a single indexed indirect draw. The vertex shader pulls the
+//	vertices from the mesh pool itself. A frame with more visible clusters than there's room for
+//	drops the ones that don't fit (the stats count them).
+// Otherwise, given multi-draw indirect, every slot and LOD is one draw of a single indirect call:
+//	the mesh pool's LODs are addressed by their first index and vertex offset into its one vertex
+//	and index buffer, so nothing is rebound between them.
+class AsteroidRenderer
+{
+	// Mirrors the uniform block in asteroidCull.glsl and asteroidVertex.glsl.
+	struct FrameParams
+	{
+		float viewProj[16];
+		float frustumPlanes[6][4];
+		float cameraPos[4]; // w pixels per unit
+		float cameraRight[4]; // w instance scale
+		float cameraUp[4];
+		float lodParams[4]; // x full detail pixels, y level impostors start at, z hysteresis
+		uint32_t counts[4]; // x instances, y slots, z LODs, w stats index
+		float occlusionViewProj[16]; // What the Hi-Z pyramid's depth was rendered with.
+		float hiZParams[4]; // xy viewport size the pyramid's depth was drawn at, z pyramid levels
+		uint32_t cullParams[4]; // x phase, y 1 to test against the pyramid, z max clusters, w 1 for one multi-draw
+		uint32_t bodyParams[4]; // x bindless table index of the bodies, y of the remote bodies (only with a bindless table), z first remote instance
+	};
+
+	// Mirrors MeshSlot in the shaders.
+	struct GpuMeshSlot
+	{
+		float boundingSphere[4];
+		float boundsCenter[4];
+		float boundsHalfExtent[4];
+		uint32_t lods[MESH_FILE_MAX_LODS][4]; // Index count, first index, vertex offset (into the pool), vertex count
+		uint32_t clusterBases[4]; // Words into the cluster buffer of the clusters, cluster vertices and cluster triangles.
+		uint32_t clusterLods[MESH_FILE_MAX_LODS][2]; // First cluster, cluster count
+	};
+
+	// Mirrors FrameStats in asteroidCull.glsl.
+	struct GpuFrameStats
+	{
+		uint32_t numVisible;
+		uint32_t numImpostors;
+		uint32_t numMeshDraws;
+		uint32_t numLodChanges;
+		uint32_t fullDetailTriangles[2]; // Low word first
+		uint32_t submittedTriangles[2];
+		uint32_t submittedVertices[2];
+		uint32_t numOccluded;
+		uint32_t numClusters;
+		uint32_t numClustersOutside;
+		uint32_t numClustersBackfacing;
+		uint32_t numClustersOccluded;
+		uint32_t numClustersDrawn;
+		uint32_t numClustersDropped;
+		uint32_t clusterTriangles;
+		uint32_t clusterVertices;
+		uint32_t pad;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	const DeviceDispatch *dispatch = nullptr;
+	const VkAllocationCallbacks *allocator = nullptr;
+	AsteroidLodConfig config = {};
+	MeshVertexFormat vertexFormat = MESH_VERTEX_FORMAT_QUANTIZED;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT16; // The mesh pool's
+	uint32_t numInstances = 0; // Local bodies, then remote ones.
+	uint32_t numLocalInstances = 0;
+	uint32_t maxClusters = 0; // 0 draws whole instances.
+	bool multiDraw = false; // Whole instances in one multi-draw indirect call, rather than one per slot and LOD.
+	uint32_t maxSlots = 0;
+	uint32_t numSlots = 0; // 0 until setMeshes()
+	uint32_t numLods = 0;
+	std::vector<PooledMesh> slotMeshes;
+
+	VkBuffer slotBuffer = VK_NULL_HANDLE; // Host visible GpuMeshSlots
+	VkDeviceMemory slotMemory = VK_NULL_HANDLE;
+	GpuMeshSlot *mappedSlots = nullptr;
+	VkBuffer lodStateBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory lodStateMemory = VK_NULL_HANDLE;
+	VkBuffer classifiedBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory classifiedMemory = VK_NULL_HANDLE;
+	VkBuffer bucketBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory bucketMemory = VK_NULL_HANDLE;
+	VkDeviceSize bucketBufferSize = 0;
+	VkBuffer drawListBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory drawListMemory = VK_NULL_HANDLE;
+	VkBuffer drawBuffer = VK_NULL_HANDLE; // Impostor draw, then a draw per mesh bucket.
+	VkDeviceMemory drawMemory = VK_NULL_HANDLE;
+	VkBuffer statsBuffer = VK_NULL_HANDLE; // Host visible, a GpuFrameStats per frame in flight and phase.
+	VkDeviceMemory statsMemory = VK_NULL_HANDLE;
+	GpuFrameStats *mappedStats = nullptr;
+	bool lodStatesCleared = false;
+
+	// Cluster culling
+	VkBuffer clusterInstanceBuffer = VK_NULL_HANDLE; // Body, first cluster vertex and LOD vertex offset of each cluster drawn.
+	VkDeviceMemory clusterInstanceMemory = VK_NULL_HANDLE;
+	VkBuffer clusterIndexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory clusterIndexMemory = VK_NULL_HANDLE;
+	VkBuffer clusterStateBuffer = VK_NULL_HANDLE; // Both phases' draws and dispatches, and the counters.
+	VkDeviceMemory clusterStateMemory = VK_NULL_HANDLE;
+	VkBuffer deferredClusterBuffer = VK_NULL_HANDLE; // Clusters the early phase set aside.
+	VkDeviceMemory deferredClusterMemory = VK_NULL_HANDLE;
+
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet descriptorSets[2] = {}; // [i] reads the bodies from physics state buffer i. Only [0] with a bindless table.
+	BindlessDescriptorTable *bindlessTable = nullptr; // Reads the bodies through it when there is one.
+	uint32_t bindlessSet = 0; // Where the table is in the pipeline layout.
+	uint32_t bodyBindlessIndices[2] = {}; // Of physics state buffer i in the table.
+	VkBuffer remoteBodyBuffer = VK_NULL_HANDLE;
+	uint32_t remoteBindlessIndex = 0;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline classifyPipeline = VK_NULL_HANDLE;
+	VkPipeline buildDrawsPipeline = VK_NULL_HANDLE;
+	VkPipeline scatterPipeline = VK_NULL_HANDLE;
+	VkPipeline clusterCullPipeline = VK_NULL_HANDLE;
+	VkPipeline meshPipeline = VK_NULL_HANDLE; // Draws clusters when culling them.
+	VkPipeline impostorPipeline = VK_NULL_HANDLE;
+	const HiZPyramid *hiZPyramid = nullptr; // Not occlusion culling without one.
+
+	// Set by recordCull() for recordDraw() and recordLateCull()
+	VkDescriptorSet frameDescriptorSet = VK_NULL_HANDLE;
+	uint32_t frameParamsOffset = 0; // Of the phase being drawn.
+	uint32_t lateParamsOffset = 0;
+	uint32_t cullFrameIndex = 0;
+	uint32_t drawPhase = 0;
+	std::vector<bool> frameCulled; // Per frame in flight, its stats slot has results to read.
+
+	// Stats
+	uint64_t numFramesCulled = 0;
+	uint64_t numVisible = 0;
+	uint64_t numImpostors = 0;
+	uint64_t numMeshDraws = 0;
+	uint64_t numLodChanges = 0;
+	uint64_t fullDetailTriangles = 0;
+	uint64_t submittedTriangles = 0;
+	uint64_t maxSubmittedTriangles = 0;
+	uint64_t submittedVertices = 0;
+	uint64_t numEarlyOccluded = 0; // Set aside by the first phase.
+	uint64_t numOccluded = 0; // Still hidden after the second.
+	uint64_t numClusters = 0; // Of the visible mesh instances
+	uint64_t numClustersOutside = 0;
+	uint64_t numClustersBackfacing = 0;
+	uint64_t numClustersEarlyOccluded = 0;
+	uint64_t numClustersOccluded = 0;
+	uint64_t numClustersDrawn = 0;
+	uint64_t numClustersDropped = 0;
+	uint64_t maxClustersDrawn = 0;
+	uint64_t numFramesRecorded = 0; // The rest are counted as recordDraw() records them.
+	uint64_t numDrawCalls = 0;
+	uint64_t numIndirectDraws = 0; // What the draw calls expand to.
+	uint64_t numPipelineBinds = 0;
+	uint64_t numDescriptorSetBinds = 0;
+	uint64_t numBufferBinds = 0; // Vertex and index
+	uint64_t numPushConstants = 0;
+
+	VkPipeline createGraphicsPipeline(VkShaderModule vertexShader, VkShaderModule fragmentShader, bool impostor,
+		bool pulledVertices, VkRenderPass renderPass, VkPipelineCache pipelineCache);
+	void recordCullPhase(VkCommandBuffer commandBuffer, uint32_t phase);
+
+public:
+	// 'bodyBuffers' are the physics simulation's two state buffers, with 'numLocalInstances' bodies.
+	//	'remoteBodyBuffer' (or VK_NULL_HANDLE) has 'numRemoteInstances' more, drawn after those.
+	// 'numFrames' is the frames in flight.
+	// The pipelines draw in subpass 0 of 'renderPass', reading vertices in 'meshPool's vertex format.
+	// 'hiZPyramid' turns on occlusion culling, it has to outlive the renderer.
+	// 'bindlessTable' has the shaders read the bodies through it, by index, instead of from a set per
+	//	state buffer. It has to outlive the renderer too.
+	// 'maxClusters' turns on cluster culling, with room for that many clusters drawn a frame.
+	// 'multiDrawIndirect' says the device has multiDrawIndirect and drawIndirectFirstInstance enabled.
+	void create(VkDevice device, const DeviceDispatch &dispatch,
+		const VkPhysicalDeviceMemoryProperties &memoryProperties,
+		const AsteroidLodConfig &config,
+		const MeshPool &meshPool,
+		uint32_t numLocalInstances,
+		uint32_t maxClusters,
+		bool multiDrawIndirect,
+		const VkBuffer bodyBuffers[2],
+		VkBuffer remoteBodyBuffer,
+		uint32_t numRemoteInstances,
+		uint32_t maxSlots,
+		uint32_t numFrames,
+		const FrameUploadArena &uploadArena,
+		VkRenderPass renderPass,
+		const HiZPyramid *hiZPyramid,
+		BindlessDescriptorTable *bindlessTable,
+		ShaderLibrary &shaders,
+		VkPipelineCache pipelineCache,
+		const VkAllocationCallbacks *allocator);
+	void destroy(void);
+
+	// Start drawing 'field's meshes. It has to be ready, and nothing can be drawn before this.
+	void setMeshes(const AsteroidField &field);
+	bool hasMeshes(void) const { return numSlots != 0; }
+
+	// Read back what 'frameIndex' culled last time. The GPU has to be done with the frame.
+	void beginFrame(uint32_t frameIndex);
+
+	// Record the culling and LOD selection for this frame (outside of a render pass), reading the
+	//	bodies from physics state buffer 'stateIndex'.
+	// The frame's parameters go into 'uploadArena', which the caller flushes.
+	// Only the culling's own steps are ordered here. The caller orders the transfer and compute
+	//	writes to the renderer's buffers against the last frame's (and the other phase's) uses, and
+	//	makes them visible to the draws (indirect and vertex shader) and the host after.
+	void recordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t stateIndex,
+		const AsteroidCamera &camera, FrameUploadArena &uploadArena);
+
+	// Occlusion culling only: record the second phase (outside of a render pass), once the pyramid
+	//	has been rebuilt from the depth of the first phase's draws.
+	void recordLateCull(VkCommandBuffer commandBuffer);
+
+	// Record the draws the last recordCull() or recordLateCull() set up, inside the render pass. The
+	//	buffers are the mesh pool's.
+	void recordDraw(VkCommandBuffer commandBuffer, VkBuffer vertexBuffer, VkBuffer indexBuffer);
+
+	void printStats(void) const;
+};
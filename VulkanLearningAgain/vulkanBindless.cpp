@@ -0,0 +1,280 @@
+#include "vulkanBindless.h"
+#include <stdio.h>
+#include <stdexcept>
+#include <algorithm>
+#include "vulkanDebug.h"
+
+bool BindlessDescriptorTable::querySupport(VkPhysicalDevice physicalDevice,
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT &enabledFeatures,
+	uint32_t &maxUpdateAfterBindBuffers,
+	uint32_t &maxUpdateAfterBindImages)
+{
+	// Query the descriptor indexing features.
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+	indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	VkPhysicalDeviceFeatures2 features2 = {
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+		&indexingFeatures, // pNext
+		{} // features
+	};
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+	if (!indexingFeatures.runtimeDescriptorArray
+		|| !indexingFeatures.descriptorBindingPartiallyBound
+		|| !indexingFeatures.descriptorBindingUpdateUnusedWhilePending
+		|| !indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind
+		|| !indexingFeatures.descriptorBindingSampledImageUpdateAfterBind
+		|| !indexingFeatures.shaderStorageBufferArrayNonUniformIndexing
+		|| !indexingFeatures.shaderSampledImageArrayNonUniformIndexing)
+	{
+		return false;
+	}
+
+	// Query how big the update-after-bind arrays are allowed to be.
+	VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties = {};
+	indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+	VkPhysicalDeviceProperties2 properties2 = {};
+	properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties2.pNext = &indexingProperties;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+	maxUpdateAfterBindBuffers = std::min({ maxUpdateAfterBindBuffers,
+		indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+		indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+	// The images are combined image samplers, so each one counts as a sampler as well.
+	maxUpdateAfterBindImages = std::min({ maxUpdateAfterBindImages,
+		indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+		indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+		indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers });
+
+	// Both arrays are visible to every stage, so together they count against the per stage
+	//	resource limit too, along with the other sets in a pipeline layout (a few left for them).
+	//	Share it out in proportion to what was asked for.
+	uint64_t totalResources = static_cast<uint64_t>(maxUpdateAfterBindBuffers) + maxUpdateAfterBindImages;
+	uint32_t maxResources = indexingProperties.maxPerStageUpdateAfterBindResources;
+	maxResources = maxResources > RESERVED_STAGE_RESOURCES ? maxResources - RESERVED_STAGE_RESOURCES : 0;
+	if (totalResources > maxResources)
+	{
+		maxUpdateAfterBindBuffers = static_cast<uint32_t>(maxResources * static_cast<uint64_t>(maxUpdateAfterBindBuffers) / totalResources);
+		maxUpdateAfterBindImages = maxResources - maxUpdateAfterBindBuffers;
+	}
+	if (!maxUpdateAfterBindBuffers || !maxUpdateAfterBindImages)
+		return false;
+
+	// Only turn on what we actually use.
+	enabledFeatures = {};
+	enabledFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	enabledFeatures.runtimeDescriptorArray = VK_TRUE;
+	enabledFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+	enabledFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	enabledFeatures.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+	enabledFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	enabledFeatures.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+	enabledFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+
+	return true;
+}
+
+void BindlessDescriptorTable::create(VkDevice device, const DeviceDispatch &dispatch, uint32_t maxBuffers, uint32_t maxImages)
+{
+	this->device = device;
+	this->dispatch = &dispatch;
+	this->maxBuffers = maxBuffers;
+	this->maxImages = maxImages;
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Create the descriptor set layout
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	VkDescriptorSetLayoutBinding bindings[] = {
+		{ // Storage buffers
+			STORAGE_BUFFER_BINDING, // Binding
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // Descriptor Type
+			maxBuffers, // Descriptor count
+			VK_SHADER_STAGE_ALL, // Stage flags
+			nullptr // Immutable samplers
+		},
+		{ // Sampled images
+			SAMPLED_IMAGE_BINDING, // Binding
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // Descriptor Type
+			maxImages, // Descriptor count
+			VK_SHADER_STAGE_ALL, // Stage flags
+			nullptr // Immutable samplers
+		}
+	};
+
+	// Slots are allowed to be empty and to be written while the set is bound.
+	VkDescriptorBindingFlagsEXT bindingFlags[] = {
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT
+			| VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT
+			| VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT,
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT
+			| VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT
+			| VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT
+	};
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsCreateInfo = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT,
+		nullptr, // pNext
+		2, // Binding count
+		bindingFlags // Binding flags
+	};
+
+	VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		&bindingFlagsCreateInfo, // pNext
+		VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT, // flags
+		2, // Binding count
+		bindings // Bindings
+	};
+
+	HANDLE_VK(dispatch.vkCreateDescriptorSetLayout(device, &layoutCreateInfo, nullptr, &layout),
+		"Creating bindless descriptor set layout (%u buffers, %u images)", maxBuffers, maxImages);
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Create the pool and the one set everything lives in
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	VkDescriptorPoolSize poolSizes[] = {
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, maxBuffers },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxImages }
+	};
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		nullptr, // pNext
+		VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT, // flags
+		1, // Max sets
+		2, // Pool size count
+		poolSizes // Pool sizes
+	};
+
+	HANDLE_VK(dispatch.vkCreateDescriptorPool(device, &poolCreateInfo, nullptr, &pool),
+		"Creating bindless descriptor pool");
+
+	VkDescriptorSetAllocateInfo setAllocateInfo = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		nullptr, // pNext
+		pool, // Descriptor pool
+		1, // Descriptor set count
+		&layout // Set layouts
+	};
+
+	HANDLE_VK(dispatch.vkAllocateDescriptorSets(device, &setAllocateInfo, &set),
+		"Allocating the bindless descriptor set");
+}
+
+void BindlessDescriptorTable::destroy(void)
+{
+	// Destroying the pool frees the set as well.
+	if (pool)
+		dispatch->vkDestroyDescriptorPool(device, pool, nullptr);
+	if (layout)
+		dispatch->vkDestroyDescriptorSetLayout(device, layout, nullptr);
+
+	pool = VK_NULL_HANDLE;
+	layout = VK_NULL_HANDLE;
+	set = VK_NULL_HANDLE;
+	freeBufferSlots.clear();
+	freeImageSlots.clear();
+	nextBufferSlot = 0;
+	nextImageSlot = 0;
+}
+
+uint32_t BindlessDescriptorTable::addStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	uint32_t index;
+	if (freeBufferSlots.size())
+	{
+		index = freeBufferSlots.back();
+		freeBufferSlots.pop_back();
+	}
+	else if (nextBufferSlot < maxBuffers)
+	{
+		index = nextBufferSlot++;
+	}
+	else
+	{
+		fprintf(stderr, "Error (%s:%u): Bindless storage buffer table is full (%u entries)\n", __FILE__, __LINE__, maxBuffers);
+		throw std::runtime_error("Bindless storage buffer table is full");
+	}
+
+	VkDescriptorBufferInfo bufferInfo = {
+		buffer, // Buffer
+		offset, // Offset
+		range // Range
+	};
+
+	VkWriteDescriptorSet write = {
+		VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		nullptr, // pNext
+		set, // Destination set
+		STORAGE_BUFFER_BINDING, // Destination binding
+		index, // Destination array element
+		1, // Descriptor count
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // Descriptor type
+		nullptr, // Image info
+		&bufferInfo, // Buffer info
+		nullptr // Texel buffer view
+	};
+	dispatch->vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+	return index;
+}
+
+uint32_t BindlessDescriptorTable::addSampledImage(VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout)
+{
+	uint32_t index;
+	if (freeImageSlots.size())
+	{
+		index = freeImageSlots.back();
+		freeImageSlots.pop_back();
+	}
+	else if (nextImageSlot < maxImages)
+	{
+		index = nextImageSlot++;
+	}
+	else
+	{
+		fprintf(stderr, "Error (%s:%u): Bindless image table is full (%u entries)\n", __FILE__, __LINE__, maxImages);
+		throw std::runtime_error("Bindless image table is full");
+	}
+
+	VkDescriptorImageInfo imageInfo = {
+		sampler, // Sampler
+		imageView, // Image view
+		imageLayout // Image layout
+	};
+
+	VkWriteDescriptorSet write = {
+		VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		nullptr, // pNext
+		set, // Destination set
+		SAMPLED_IMAGE_BINDING, // Destination binding
+		index, // Destination array element
+		1, // Descriptor count
+		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // Descriptor type
+		&imageInfo, // Image info
+		nullptr, // Buffer info
+		nullptr // Texel buffer view
+	};
+	dispatch->vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+	return index;
+}
+
+void BindlessDescriptorTable::removeStorageBuffer(uint32_t index)
+{
+	// Partially bound means we don't have to overwrite the slot, just stop handing it out.
+	assert(index < nextBufferSlot);
+	freeBufferSlots.push_back(index);
+}
+
+void BindlessDescriptorTable::removeSampledImage(uint32_t index)
+{
+	assert(index < nextImageSlot);
+	freeImageSlots.push_back(index);
+}
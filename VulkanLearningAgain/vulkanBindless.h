@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+#include "vulkanDispatch.h"
+
+// Bindless descriptor table built on VK_EXT_descriptor_indexing.
+// Keeps one large update-after-bind set holding arrays of storage buffers and sampled
+//	images. Resources are registered once and referred to by their array index, so shaders
+//	index resources by ID and a whole pass only has to bind this one set.
+//
+// Shader side (set index is whatever the pipeline layout puts it at):
+//	layout (set=1, binding=0) buffer BindlessBuffers { uint data[]; } bindlessBuffers[];
+//	layout (set=1, binding=1) uniform sampler2D bindlessImages[];
+class BindlessDescriptorTable
+{
+	VkDevice device = VK_NULL_HANDLE;
+	const DeviceDispatch *dispatch = nullptr;
+	VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	VkDescriptorSet set = VK_NULL_HANDLE;
+	uint32_t maxBuffers = 0;
+	uint32_t maxImages = 0;
+	uint32_t nextBufferSlot = 0;
+	uint32_t nextImageSlot = 0;
+	std::vector<uint32_t> freeBufferSlots; // Slots released by removeStorageBuffer, reused first.
+	std::vector<uint32_t> freeImageSlots; // Slots released by removeSampledImage, reused first.
+
+public:
+	static const uint32_t STORAGE_BUFFER_BINDING = 0;
+	static const uint32_t SAMPLED_IMAGE_BINDING = 1;
+	static const uint32_t INVALID_INDEX = ~0U;
+	// Per stage resources kept back from the arrays for the non-bindless sets they're used alongside.
+	static const uint32_t RESERVED_STAGE_RESOURCES = 64;
+
+	// Checks if the physical device exposes the descriptor indexing features bindless needs.
+	// On success, 'enabledFeatures' is filled in with just the features to enable at device creation.
+	// The array sizes go in as how many are wanted and come back cut down to what the device allows,
+	//	each on its own and both together in one stage.
+	static bool querySupport(VkPhysicalDevice physicalDevice,
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT &enabledFeatures,
+		uint32_t &maxUpdateAfterBindBuffers,
+		uint32_t &maxUpdateAfterBindImages);
+
+	void create(VkDevice device, const DeviceDispatch &dispatch, uint32_t maxBuffers, uint32_t maxImages);
+	void destroy(void);
+
+	// Register a resource in the table and get back the index shaders should use for it.
+	// Update-after-bind means this is safe to call while the set is bound in pending command buffers,
+	//	as long as the slot being written isn't being used by them.
+	uint32_t addStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+	uint32_t addSampledImage(VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout);
+
+	// Release an index. The caller must make sure the GPU is done with it first.
+	void removeStorageBuffer(uint32_t index);
+	void removeSampledImage(uint32_t index);
+
+	VkDescriptorSetLayout getLayout(void) const { return layout; }
+	VkDescriptorSet getSet(void) const { return set; }
+	uint32_t getNumBuffers(void) const { return nextBufferSlot - static_cast<uint32_t>(freeBufferSlots.size()); }
+	uint32_t getNumImages(void) const { return nextImageSlot - static_cast<uint32_t>(freeImageSlots.size()); }
+};
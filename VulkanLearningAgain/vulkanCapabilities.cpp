@@ -0,0 +1,389 @@
+#include "vulkanCapabilities.h"
+#include <stdio.h>
+#include <string.h>
+#include "vulkanDebug.h"
+#include "fileUtils.h"
+
+// Bump this whenever the layout of the cache file changes.
+#define CAPABILITY_CACHE_MAGIC 0x50434B56U // "VKCP"
+#define CAPABILITY_CACHE_VERSION 3U
+
+// Sanity limit on array sizes read from the cache, so a corrupt file can't ask for gigabytes.
+#define CAPABILITY_CACHE_MAX_ARRAY 65536U
+
+uint64_t NameLookup::hash(const char *name)
+{
+	uint64_t result = 0xcbf29ce484222325ULL;
+	for (; *name; name++)
+	{
+		result ^= static_cast<uint8_t>(*name);
+		result *= 0x100000001b3ULL;
+	}
+	return result;
+}
+
+bool NameLookup::contains(const char *name) const
+{
+	auto found = names.find(hash(name));
+	return found != names.end() && strcmp(found->second, name) == 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Instance
+//
+//////////////////////////////////////////////////////////////////////////////
+void VulkanCapabilities::queryInstance(void)
+{
+	HANDLE_VK(vkEnumerateInstanceVersion(&instanceVersion), "Getting Vulkan instance version");
+
+	uint32_t numLayers;
+	HANDLE_VK(vkEnumerateInstanceLayerProperties(&numLayers, nullptr),
+		"Querying number of Vulkan instance layer properties");
+	std::vector<VkLayerProperties> layers(numLayers);
+	HANDLE_VK(vkEnumerateInstanceLayerProperties(&numLayers, layers.data()),
+		"Querying Vulkan instance layer properties");
+
+	instanceLayers.resize(numLayers);
+	for (uint32_t i = 0; i < numLayers; i++)
+	{
+		instanceLayers[i].properties = layers[i];
+
+		uint32_t numExtensions;
+		HANDLE_VK(vkEnumerateInstanceExtensionProperties(layers[i].layerName, &numExtensions, nullptr),
+			"Querying number of Vulkan instance extensions for layer \"%s\"", layers[i].layerName);
+		instanceLayers[i].extensions.resize(numExtensions);
+		HANDLE_VK(vkEnumerateInstanceExtensionProperties(layers[i].layerName, &numExtensions, instanceLayers[i].extensions.data()),
+			"Querying Vulkan instance extensions for layer \"%s\"", layers[i].layerName);
+	}
+
+	uint32_t numExtensions;
+	HANDLE_VK(vkEnumerateInstanceExtensionProperties(nullptr, &numExtensions, nullptr),
+		"Fetching number of Vulkan instance extensions");
+	instanceExtensions.resize(numExtensions);
+	HANDLE_VK(vkEnumerateInstanceExtensionProperties(nullptr, &numExtensions, instanceExtensions.data()),
+		"Fetching Vulkan instance extensions");
+
+	instanceLayerLookup.clear();
+	for (const LayerInfo &layer : instanceLayers)
+		instanceLayerLookup.add(layer.properties.layerName);
+	instanceExtensionLookup.clear();
+	for (const VkExtensionProperties &extension : instanceExtensions)
+		instanceExtensionLookup.add(extension.extensionName);
+
+	setEnabledInstanceLayers(0, nullptr);
+}
+
+namespace
+{
+	// Continue a 64-bit FNV-1a hash over some bytes.
+	uint64_t hashBytes(uint64_t hash, const void *data, size_t size)
+	{
+		const uint8_t *bytes = static_cast<const uint8_t *>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 0x100000001b3ULL;
+		}
+		return hash;
+	}
+}
+
+void VulkanCapabilities::setEnabledInstanceLayers(uint32_t numLayers, const char *const *layerNames)
+{
+	// A layer's versions change with it even when its name doesn't.
+	environmentKey = hashBytes(0xcbf29ce484222325ULL, &instanceVersion, sizeof(instanceVersion));
+	for (uint32_t i = 0; i < numLayers; i++)
+	{
+		environmentKey = hashBytes(environmentKey, layerNames[i], strlen(layerNames[i]) + 1);
+		for (const LayerInfo &layer : instanceLayers)
+		{
+			if (strcmp(layer.properties.layerName, layerNames[i]) == 0)
+			{
+				environmentKey = hashBytes(environmentKey, &layer.properties.specVersion, sizeof(layer.properties.specVersion));
+				environmentKey = hashBytes(environmentKey, &layer.properties.implementationVersion, sizeof(layer.properties.implementationVersion));
+			}
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Physical devices
+//
+//////////////////////////////////////////////////////////////////////////////
+void VulkanCapabilities::queryPhysicalDevices(uint32_t numPhysicalDevices, const VkPhysicalDevice *physicalDevices, const char *cacheFilePath)
+{
+	devices.clear();
+	devices.resize(numPhysicalDevices);
+
+	// The properties are what the cache is keyed on, so they're always queried.
+	for (uint32_t i = 0; i < numPhysicalDevices; i++)
+	{
+		vkGetPhysicalDeviceProperties(physicalDevices[i], &devices[i].properties);
+		devices[i].fromCache = false;
+	}
+
+	bool allCached = cacheFilePath && loadDeviceCache(cacheFilePath);
+
+	for (uint32_t i = 0; i < numPhysicalDevices; i++)
+	{
+		if (!devices[i].fromCache)
+			queryDevice(physicalDevices[i], devices[i]);
+		buildDeviceLookups(devices[i]);
+	}
+
+	if (cacheFilePath && !allCached)
+		saveDeviceCache(cacheFilePath);
+}
+
+void VulkanCapabilities::reorderDevices(const std::vector<uint32_t> &order)
+{
+	// Moving a DeviceInfo keeps the lookups valid, the name arrays they point into move with it.
+	std::vector<DeviceInfo> reordered;
+	reordered.reserve(order.size());
+	for (uint32_t index : order)
+		reordered.push_back(std::move(devices[index]));
+	devices = std::move(reordered);
+}
+
+void VulkanCapabilities::queryDevice(VkPhysicalDevice physicalDevice, DeviceInfo &device)
+{
+	vkGetPhysicalDeviceFeatures(physicalDevice, &device.features);
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &device.memoryProperties);
+
+	uint32_t numQueueFamilies;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &numQueueFamilies, nullptr);
+	device.queueFamilies.resize(numQueueFamilies);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &numQueueFamilies, device.queueFamilies.data());
+
+	uint32_t numLayers;
+	HANDLE_VK(vkEnumerateDeviceLayerProperties(physicalDevice, &numLayers, nullptr),
+		"Getting number of device layers");
+	std::vector<VkLayerProperties> layers(numLayers);
+	HANDLE_VK(vkEnumerateDeviceLayerProperties(physicalDevice, &numLayers, layers.data()),
+		"Getting device layers");
+
+	device.layers.resize(numLayers);
+	for (uint32_t i = 0; i < numLayers; i++)
+	{
+		device.layers[i].properties = layers[i];
+
+		uint32_t numExtensions;
+		HANDLE_VK(vkEnumerateDeviceExtensionProperties(physicalDevice, layers[i].layerName, &numExtensions, nullptr),
+			"Getting number of device extensions for layer \"%s\"", layers[i].layerName);
+		device.layers[i].extensions.resize(numExtensions);
+		HANDLE_VK(vkEnumerateDeviceExtensionProperties(physicalDevice, layers[i].layerName, &numExtensions, device.layers[i].extensions.data()),
+			"Getting device extensions for layer \"%s\"", layers[i].layerName);
+	}
+
+	uint32_t numExtensions;
+	HANDLE_VK(vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &numExtensions, nullptr),
+		"Getting number of device extensions");
+	device.extensions.resize(numExtensions);
+	HANDLE_VK(vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &numExtensions, device.extensions.data()),
+		"Getting device extensions");
+
+	// Extension features are only chained in when the device has the extension.
+	buildDeviceLookups(device);
+	device.descriptorIndexingFeatures = {};
+	device.descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures = {};
+	timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	VkPhysicalDeviceFeatures2 features2 = {};
+	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	if (device.hasExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME))
+	{
+		device.descriptorIndexingFeatures.pNext = features2.pNext;
+		features2.pNext = &device.descriptorIndexingFeatures;
+	}
+	if (device.hasExtension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME))
+	{
+		timelineSemaphoreFeatures.pNext = features2.pNext;
+		features2.pNext = &timelineSemaphoreFeatures;
+	}
+	if (features2.pNext)
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+	device.descriptorIndexingFeatures.pNext = nullptr;
+	device.timelineSemaphore = timelineSemaphoreFeatures.timelineSemaphore;
+
+	// Subgroup properties are core in 1.1, and the kernel tuning sizes workgroups by them.
+	device.subgroupSize = 0;
+	if (device.properties.apiVersion >= VK_API_VERSION_1_1)
+	{
+		VkPhysicalDeviceSubgroupProperties subgroupProperties = {};
+		subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+		VkPhysicalDeviceProperties2 properties2 = {};
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties2.pNext = &subgroupProperties;
+		vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+		device.subgroupSize = subgroupProperties.subgroupSize;
+	}
+}
+
+void VulkanCapabilities::buildDeviceLookups(DeviceInfo &device)
+{
+	device.layerLookup.clear();
+	for (const LayerInfo &layer : device.layers)
+		device.layerLookup.add(layer.properties.layerName);
+	device.extensionLookup.clear();
+	for (const VkExtensionProperties &extension : device.extensions)
+		device.extensionLookup.add(extension.extensionName);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Disk cache
+// Everything in DeviceInfo is plain old data (or arrays of it), so it's written as raw bytes.
+// Layout: magic, version, loader and layer key, device count, then per device:
+//	key (vendor, device, driver version, api version, pipeline cache UUID),
+//	features, memory properties, descriptor indexing features, timeline semaphore, subgroup size,
+//	queue families, extensions, layers (each with their extensions).
+//
+//////////////////////////////////////////////////////////////////////////////
+namespace
+{
+	template<typename T>
+	bool readValue(FILE *file, T &value)
+	{
+		return fread(&value, sizeof(T), 1, file) == 1;
+	}
+
+	template<typename T>
+	bool readArray(FILE *file, std::vector<T> &values)
+	{
+		uint32_t count;
+		if (!readValue(file, count) || count > CAPABILITY_CACHE_MAX_ARRAY)
+			return false;
+		values.resize(count);
+		return count == 0 || fread(values.data(), sizeof(T), count, file) == count;
+	}
+
+	template<typename T>
+	void writeValue(FILE *file, const T &value)
+	{
+		fwrite(&value, sizeof(T), 1, file);
+	}
+
+	template<typename T>
+	void writeArray(FILE *file, const std::vector<T> &values)
+	{
+		writeValue(file, static_cast<uint32_t>(values.size()));
+		if (!values.empty())
+			fwrite(values.data(), sizeof(T), values.size(), file);
+	}
+
+	bool sameDevice(const VkPhysicalDeviceProperties &a, const VkPhysicalDeviceProperties &b)
+	{
+		return a.vendorID == b.vendorID
+			&& a.deviceID == b.deviceID
+			&& a.driverVersion == b.driverVersion
+			&& a.apiVersion == b.apiVersion
+			&& memcmp(a.pipelineCacheUUID, b.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+}
+
+bool VulkanCapabilities::loadDeviceCache(const char *cacheFilePath)
+{
+	FILE *file = openFile(cacheFilePath, "rb");
+	if (!file)
+		return false;
+
+	uint32_t magic, version, numEntries;
+	uint64_t cachedEnvironmentKey;
+	if (!readValue(file, magic) || magic != CAPABILITY_CACHE_MAGIC
+		|| !readValue(file, version) || version != CAPABILITY_CACHE_VERSION
+		|| !readValue(file, cachedEnvironmentKey) || cachedEnvironmentKey != environmentKey
+		|| !readValue(file, numEntries))
+	{
+		fclose(file);
+		return false;
+	}
+
+	uint32_t numFound = 0;
+	for (uint32_t entry = 0; entry < numEntries; entry++)
+	{
+		DeviceInfo cached;
+		bool ok = readValue(file, cached.properties)
+			&& readValue(file, cached.features)
+			&& readValue(file, cached.memoryProperties)
+			&& readValue(file, cached.descriptorIndexingFeatures)
+			&& readValue(file, cached.timelineSemaphore)
+			&& readValue(file, cached.subgroupSize)
+			&& readArray(file, cached.queueFamilies)
+			&& readArray(file, cached.extensions);
+
+		uint32_t numLayers = 0;
+		ok = ok && readValue(file, numLayers) && numLayers <= CAPABILITY_CACHE_MAX_ARRAY;
+		if (ok)
+		{
+			cached.layers.resize(numLayers);
+			for (uint32_t i = 0; ok && i < numLayers; i++)
+				ok = readValue(file, cached.layers[i].properties) && readArray(file, cached.layers[i].extensions);
+		}
+
+		if (!ok)
+		{
+			fprintf(stderr, "Warning: Capability cache \"%s\" is truncated or corrupt, ignoring it\n", cacheFilePath);
+			for (DeviceInfo &device : devices)
+				device.fromCache = false;
+			fclose(file);
+			return false;
+		}
+
+		cached.descriptorIndexingFeatures.pNext = nullptr;
+		for (DeviceInfo &device : devices)
+		{
+			if (!device.fromCache && sameDevice(device.properties, cached.properties))
+			{
+				// Keep the freshly queried properties, only the key fields were compared.
+				VkPhysicalDeviceProperties properties = device.properties;
+				device = std::move(cached);
+				device.properties = properties;
+				device.fromCache = true;
+				numFound++;
+				break;
+			}
+		}
+	}
+
+	fclose(file);
+
+	if (VERBOSE)
+		printf("Capability cache: %u of %zu devices loaded from \"%s\"\n", numFound, devices.size(), cacheFilePath);
+	return numFound == devices.size();
+}
+
+void VulkanCapabilities::saveDeviceCache(const char *cacheFilePath) const
+{
+	FILE *file = openFile(cacheFilePath, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Warning: Failed to open capability cache \"%s\" for writing\n", cacheFilePath);
+		return;
+	}
+
+	writeValue(file, CAPABILITY_CACHE_MAGIC);
+	writeValue(file, CAPABILITY_CACHE_VERSION);
+	writeValue(file, environmentKey);
+	writeValue(file, static_cast<uint32_t>(devices.size()));
+	for (const DeviceInfo &device : devices)
+	{
+		writeValue(file, device.properties);
+		writeValue(file, device.features);
+		writeValue(file, device.memoryProperties);
+		writeValue(file, device.descriptorIndexingFeatures);
+		writeValue(file, device.timelineSemaphore);
+		writeValue(file, device.subgroupSize);
+		writeArray(file, device.queueFamilies);
+		writeArray(file, device.extensions);
+		writeValue(file, static_cast<uint32_t>(device.layers.size()));
+		for (const LayerInfo &layer : device.layers)
+		{
+			writeValue(file, layer.properties);
+			writeArray(file, layer.extensions);
+		}
+	}
+
+	fclose(file);
+}
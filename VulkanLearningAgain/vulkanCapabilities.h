@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+
+// Hashed lookup of extension/layer names.
+// Names are hashed with 64-bit FNV-1a, and a hit is confirmed with a strcmp against the stored name.
+class NameLookup
+{
+	std::unordered_map<uint64_t, const char *> names; // Points into the owning capability arrays.
+
+public:
+	static uint64_t hash(const char *name);
+
+	void clear(void) { names.clear(); }
+	void add(const char *name) { names.emplace(hash(name), name); }
+	bool contains(const char *name) const;
+};
+
+// Snapshot of everything init and the info printers want to know about the instance and the
+//	physical devices, queried once instead of re-enumerating (and re-allocating) at every use.
+// The per physical device part can be saved to a cache file keyed by vendor/device/driver version,
+//	so a warm start only has to call vkGetPhysicalDeviceProperties for each device. The loader's
+//	version and the layers enabled on the instance are part of the key too, since they sit between
+//	us and the driver.
+class VulkanCapabilities
+{
+public:
+	struct LayerInfo
+	{
+		VkLayerProperties properties;
+		std::vector<VkExtensionProperties> extensions;
+	};
+
+	struct DeviceInfo
+	{
+		VkPhysicalDeviceProperties properties;
+		VkPhysicalDeviceFeatures features;
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures; // Zeroed without the extension.
+		VkBool32 timelineSemaphore; // VK_FALSE without the extension.
+		uint32_t subgroupSize; // 0 on Vulkan 1.0 devices, which can't report it.
+		std::vector<VkQueueFamilyProperties> queueFamilies;
+		std::vector<LayerInfo> layers;
+		std::vector<VkExtensionProperties> extensions;
+		NameLookup layerLookup;
+		NameLookup extensionLookup;
+		bool fromCache;
+
+		bool hasLayer(const char *name) const { return layerLookup.contains(name); }
+		bool hasExtension(const char *name) const { return extensionLookup.contains(name); }
+	};
+
+private:
+	uint32_t instanceVersion = 0;
+	uint64_t environmentKey = 0; // Hash of the loader version and the enabled instance layers.
+	std::vector<LayerInfo> instanceLayers;
+	std::vector<VkExtensionProperties> instanceExtensions;
+	NameLookup instanceLayerLookup;
+	NameLookup instanceExtensionLookup;
+
+	std::vector<DeviceInfo> devices;
+
+	void queryDevice(VkPhysicalDevice physicalDevice, DeviceInfo &device);
+	void buildDeviceLookups(DeviceInfo &device);
+	bool loadDeviceCache(const char *cacheFilePath);
+	void saveDeviceCache(const char *cacheFilePath) const;
+
+public:
+	// Instance level layers and extensions. Doesn't need an instance.
+	void queryInstance(void);
+
+	// Record the layers the instance was created with, for the cache key. Call after queryInstance().
+	void setEnabledInstanceLayers(uint32_t numLayers, const char *const *layerNames);
+
+	// Per physical device info, in the same order as 'physicalDevices'.
+	// If 'cacheFilePath' is set, devices found in the cache (same vendor, device and driver version)
+	//	skip the queries, and the cache gets rewritten if anything had to be queried.
+	void queryPhysicalDevices(uint32_t numPhysicalDevices, const VkPhysicalDevice *physicalDevices, const char *cacheFilePath = nullptr);
+
+	uint32_t getInstanceVersion(void) const { return instanceVersion; }
+	const std::vector<LayerInfo> &getInstanceLayers(void) const { return instanceLayers; }
+	const std::vector<VkExtensionProperties> &getInstanceExtensions(void) const { return instanceExtensions; }
+	bool hasInstanceLayer(const char *name) const { return instanceLayerLookup.contains(name); }
+	bool hasInstanceExtension(const char *name) const { return instanceExtensionLookup.contains(name); }
+
+	// Puts the devices in a new order: new index i holds what was at 'order[i]'.
+	void reorderDevices(const std::vector<uint32_t> &order);
+
+	uint32_t getNumDevices(void) const { return static_cast<uint32_t>(devices.size()); }
+	const DeviceInfo &getDevice(uint32_t index) const { return devices[index]; }
+};
@@ -0,0 +1,255 @@
+#include "vulkanDebugSink.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "vulkanCapabilities.h"
+
+// Copies as much of 'source' as fits, always null terminating.
+static void copyTruncated(char *destination, size_t destinationSize, const char *source)
+{
+	if (!source)
+		source = "";
+	size_t length = strlen(source);
+	if (length >= destinationSize)
+		length = destinationSize - 1;
+	memcpy(destination, source, length);
+	destination[length] = '\0';
+}
+
+static const char *getSeverityName(VkDebugUtilsMessageSeverityFlagBitsEXT severity)
+{
+	switch (severity)
+	{
+	case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT: return "VERBOSE";
+	case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT: return "INFO";
+	case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT: return "WARNING";
+	case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT: return "ERROR";
+	default: return "Unknown severity";
+	}
+}
+
+void DebugMessageSink::start(uint32_t queueSize, uint32_t maxRepeatsPerId, uint32_t maxPrintsPerSecond)
+{
+	if (running)
+		return;
+
+	uint32_t size = 2;
+	while (size < queueSize)
+		size <<= 1;
+
+	queue.reset(new QueuedMessage[size]);
+	queueMask = size - 1;
+	for (uint32_t i = 0; i < size; i++)
+		queue[i].sequence.store(i, std::memory_order_relaxed);
+	enqueuePosition.store(0, std::memory_order_relaxed);
+	dequeuePosition = 0;
+
+	this->maxRepeatsPerId = maxRepeatsPerId;
+	this->maxPrintsPerSecond = maxPrintsPerSecond;
+	rateWindowStart = std::chrono::steady_clock::now();
+
+	running = true;
+	loggerThread = std::thread(&DebugMessageSink::loggerMain, this);
+}
+
+void DebugMessageSink::stop(void)
+{
+	if (!running)
+		return;
+
+	running = false;
+	wakeCondition.notify_one();
+	loggerThread.join();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Queue (bounded multi-producer single-consumer ring)
+//
+// Each slot's sequence says whose turn it is:
+//	sequence == position		: free, the producer claiming 'position' may write it.
+//	sequence == position + 1	: written, the consumer at 'position' may read it.
+// After reading, the consumer hands the slot to the producer one lap later (position + size).
+//
+//////////////////////////////////////////////////////////////////////////////
+bool DebugMessageSink::push(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type,
+	const VkDebugUtilsMessengerCallbackDataEXT *callbackData)
+{
+	QueuedMessage *slot;
+	uint64_t position = enqueuePosition.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		slot = &queue[position & queueMask];
+		uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+		int64_t difference = static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+		if (difference == 0)
+		{
+			if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (difference < 0)
+		{
+			return false; // Full
+		}
+		else
+		{
+			position = enqueuePosition.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->severity = severity;
+	slot->type = type;
+	slot->messageIdNumber = callbackData->messageIdNumber;
+	copyTruncated(slot->messageIdName, sizeof(slot->messageIdName), callbackData->pMessageIdName);
+	copyTruncated(slot->message, sizeof(slot->message), callbackData->pMessage);
+	slot->sequence.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+bool DebugMessageSink::pop(QueuedMessage &message)
+{
+	QueuedMessage &slot = queue[dequeuePosition & queueMask];
+	if (slot.sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+		return false; // Empty (or the producer hasn't finished writing it yet)
+
+	message.severity = slot.severity;
+	message.type = slot.type;
+	message.messageIdNumber = slot.messageIdNumber;
+	memcpy(message.messageIdName, slot.messageIdName, sizeof(message.messageIdName));
+	memcpy(message.message, slot.message, sizeof(message.message));
+	slot.sequence.store(dequeuePosition + queueMask + 1, std::memory_order_release);
+	dequeuePosition++;
+	return true;
+}
+
+VkBool32 DebugMessageSink::callback(
+	VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+	VkDebugUtilsMessageTypeFlagsEXT messageType,
+	const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
+	void *pUserData)
+{
+	DebugMessageSink *sink = static_cast<DebugMessageSink *>(pUserData);
+	if (!sink->isRunning() || !sink->push(messageSeverity, messageType, pCallbackData))
+		sink->numDropped.fetch_add(1, std::memory_order_relaxed);
+	else
+		sink->wakeCondition.notify_one();
+
+	return VK_FALSE;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Logger thread
+//
+//////////////////////////////////////////////////////////////////////////////
+void DebugMessageSink::loggerMain(void)
+{
+	QueuedMessage *message = new QueuedMessage;
+	for (;;)
+	{
+		// Read 'running' before draining, so nothing pushed before stop() gets left behind.
+		bool keepRunning = running.load(std::memory_order_acquire);
+
+		while (pop(*message))
+			handleMessage(*message);
+		fflush(stdout);
+
+		if (!keepRunning)
+			break;
+
+		// Producers notify without the mutex, so a wakeup can be missed. The timeout covers that.
+		std::unique_lock<std::mutex> lock(wakeMutex);
+		wakeCondition.wait_for(lock, std::chrono::milliseconds(10));
+	}
+	delete message;
+}
+
+void DebugMessageSink::handleMessage(const QueuedMessage &message)
+{
+	numReceived++;
+
+	// Some messages (mostly loader/general ones) don't have an ID number, so group those by name.
+	uint64_t key = message.messageIdNumber ? static_cast<uint32_t>(message.messageIdNumber)
+		: NameLookup::hash(message.messageIdName[0] ? message.messageIdName : message.message) | (1ULL << 63);
+	MessageStats &stats = messageStats[key];
+	if (stats.count == 0)
+	{
+		stats.severity = message.severity;
+		stats.messageIdName = message.messageIdName;
+	}
+	stats.count++;
+
+	if (maxRepeatsPerId && stats.numPrinted >= maxRepeatsPerId)
+	{
+		numDeduplicated++;
+		return;
+	}
+
+	// Errors are never rate limited.
+	if (maxPrintsPerSecond && message.severity != VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now - rateWindowStart >= std::chrono::seconds(1))
+		{
+			rateWindowStart = now;
+			printsThisSecond = 0;
+		}
+		if (printsThisSecond >= maxPrintsPerSecond)
+		{
+			numRateLimited++;
+			return;
+		}
+		printsThisSecond++;
+	}
+
+	printMessage(message);
+	stats.numPrinted++;
+	numPrinted++;
+	if (maxRepeatsPerId && stats.numPrinted == maxRepeatsPerId && VERBOSE)
+		printf("(Further \"%s\" messages will only be counted)\n\n", message.messageIdName);
+}
+
+void DebugMessageSink::printMessage(const QueuedMessage &message)
+{
+	printf("%s ", getSeverityName(message.severity));
+
+	switch (message.type)
+	{
+	case VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT: printf(" (GENERAL)"); break;
+	case VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT: printf(" (VALIDATION)"); break;
+	case VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT: printf(" (PERFORMANCE)"); break;
+	default: printf(" (Unknown type)");
+	}
+
+	printf(": %s ", message.messageIdName);
+	printf(": %d ", message.messageIdNumber);
+	printf(": %s\n\n", message.message);
+}
+
+void DebugMessageSink::printSummary(void) const
+{
+	// Only call once the logger thread is stopped.
+	std::vector<const MessageStats *> sortedStats;
+	for (const auto &entry : messageStats)
+		sortedStats.push_back(&entry.second);
+	std::sort(sortedStats.begin(), sortedStats.end(), [](const MessageStats *a, const MessageStats *b) {
+		return a->count > b->count;
+	});
+
+	printf("Debug message summary:\n");
+	printf("\tReceived: %llu (%llu unique)\n",
+		static_cast<unsigned long long>(numReceived),
+		static_cast<unsigned long long>(messageStats.size()));
+	printf("\tPrinted: %llu\n", static_cast<unsigned long long>(numPrinted));
+	printf("\tSuppressed repeats: %llu\n", static_cast<unsigned long long>(numDeduplicated));
+	printf("\tRate limited: %llu\n", static_cast<unsigned long long>(numRateLimited));
+	printf("\tDropped (queue full): %llu\n", static_cast<unsigned long long>(numDropped.load()));
+	for (const MessageStats *stats : sortedStats)
+	{
+		printf("\t\t%llu x %s %s\n",
+			static_cast<unsigned long long>(stats->count),
+			getSeverityName(stats->severity),
+			stats->messageIdName.c_str());
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <unordered_map>
+#include <string>
+
+// Longest message text kept per queued message. Longer messages are truncated.
+#define DEBUG_SINK_MAX_MESSAGE_LENGTH 2048
+#define DEBUG_SINK_MAX_ID_NAME_LENGTH 128
+
+// Takes debug utils messages off the driver's thread and prints them from a logger thread.
+// The callback only copies the message into a bounded lock-free queue (multiple producers,
+//	one consumer), so validation doesn't serialize the app on printf.
+// The logger thread prints the first few messages of each message ID, suppresses the repeats,
+//	and rate limits everything but errors. A summary of what was seen is printed on stop().
+class DebugMessageSink
+{
+	struct QueuedMessage
+	{
+		std::atomic<uint64_t> sequence; // Slot ownership, see push()/pop().
+		VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+		VkDebugUtilsMessageTypeFlagsEXT type;
+		int32_t messageIdNumber;
+		char messageIdName[DEBUG_SINK_MAX_ID_NAME_LENGTH];
+		char message[DEBUG_SINK_MAX_MESSAGE_LENGTH];
+	};
+
+	struct MessageStats
+	{
+		uint64_t count = 0;
+		uint64_t numPrinted = 0;
+		VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+		std::string messageIdName;
+	};
+
+	std::unique_ptr<QueuedMessage[]> queue;
+	uint32_t queueMask = 0; // Queue size - 1. The size is a power of 2.
+	std::atomic<uint64_t> enqueuePosition{ 0 };
+	uint64_t dequeuePosition = 0; // Only touched by the logger thread.
+	std::atomic<uint64_t> numDropped{ 0 }; // Messages that arrived while the queue was full.
+	std::atomic<bool> running{ false };
+
+	std::thread loggerThread;
+	std::mutex wakeMutex; // Only used to sleep the logger thread, the producers never take it.
+	std::condition_variable wakeCondition;
+
+	// Logger thread state
+	uint32_t maxRepeatsPerId = 0;
+	uint32_t maxPrintsPerSecond = 0;
+	std::unordered_map<uint64_t, MessageStats> messageStats;
+	uint64_t numReceived = 0;
+	uint64_t numPrinted = 0;
+	uint64_t numDeduplicated = 0;
+	uint64_t numRateLimited = 0;
+	uint32_t printsThisSecond = 0;
+	std::chrono::steady_clock::time_point rateWindowStart;
+
+	bool push(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type,
+		const VkDebugUtilsMessengerCallbackDataEXT *callbackData);
+	bool pop(QueuedMessage &message);
+	void loggerMain(void);
+	void handleMessage(const QueuedMessage &message);
+	static void printMessage(const QueuedMessage &message);
+
+public:
+	DebugMessageSink(void) = default;
+	~DebugMessageSink(void) { stop(); }
+
+	// 'queueSize' is rounded up to a power of 2.
+	// A 'maxRepeatsPerId' or 'maxPrintsPerSecond' of 0 means no limit.
+	void start(uint32_t queueSize, uint32_t maxRepeatsPerId, uint32_t maxPrintsPerSecond);
+
+	// Drains whatever is still queued, then joins the logger thread.
+	void stop(void);
+
+	bool isRunning(void) const { return running.load(std::memory_order_relaxed); }
+
+	void printSummary(void) const;
+
+	// Pass the sink as pUserData.
+	static VKAPI_ATTR VkBool32 VKAPI_CALL callback(
+		VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+		VkDebugUtilsMessageTypeFlagsEXT messageType,
+		const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
+		void *pUserData);
+};
@@ -0,0 +1,77 @@
+#include "vulkanDeletionQueue.h"
+#include <stdio.h>
+#include <algorithm>
+
+void DeferredDeletionQueue::enqueueHandle(VkObjectType type, uint64_t handle, uint64_t retireValue, const VkAllocationCallbacks *allocator)
+{
+	Entry entry = { type, handle, retireValue, allocator };
+
+	// Almost everything gets queued in order, so this is nearly always a push_back.
+	if (entries.empty() || entries.back().retireValue <= retireValue)
+		entries.push_back(entry);
+	else
+		entries.insert(std::upper_bound(entries.begin(), entries.end(), entry,
+			[](const Entry &a, const Entry &b) { return a.retireValue < b.retireValue; }), entry);
+
+	numQueued++;
+	maxDepth = std::max(maxDepth, entries.size());
+}
+
+uint32_t DeferredDeletionQueue::collect(uint64_t completedValue)
+{
+	uint32_t numCollected = 0;
+	while (!entries.empty() && entries.front().retireValue <= completedValue)
+	{
+		destroyEntry(entries.front());
+		entries.pop_front();
+		numCollected++;
+	}
+
+	return numCollected;
+}
+
+void DeferredDeletionQueue::destroyAll(void)
+{
+	for (const Entry &entry : entries)
+		destroyEntry(entry);
+	entries.clear();
+}
+
+void DeferredDeletionQueue::destroyEntry(const Entry &entry)
+{
+	switch (entry.type)
+	{
+	case VK_OBJECT_TYPE_SEMAPHORE: dispatch->vkDestroySemaphore(device, reinterpret_cast<VkSemaphore>(entry.handle), entry.allocator); break;
+	case VK_OBJECT_TYPE_FENCE: dispatch->vkDestroyFence(device, reinterpret_cast<VkFence>(entry.handle), entry.allocator); break;
+	case VK_OBJECT_TYPE_DEVICE_MEMORY: dispatch->vkFreeMemory(device, reinterpret_cast<VkDeviceMemory>(entry.handle), entry.allocator); break;
+	case VK_OBJECT_TYPE_BUFFER: dispatch->vkDestroyBuffer(device, reinterpret_cast<VkBuffer>(entry.handle), entry.allocator); break;
+	case VK_OBJECT_TYPE_IMAGE: dispatch->vkDestroyImage(device, reinterpret_cast<VkImage>(entry.handle), entry.allocator); break;
+	case VK_OBJECT_TYPE_QUERY_POOL: dispatch->vkDestroyQueryPool(device, reinterpret_cast<VkQueryPool>(entry.handle), entry.allocator); break;
+	case VK_OBJECT_TYPE_IMAGE_VIEW: dispatch->vkDestroyImageView(device, reinterpret_cast<VkImageView>(entry.handle), entry.allocator); break;
+	case VK_OBJECT_TYPE_SHADER_MODULE: dispatch->vkDestroyShaderModule(device, reinterpret_cast<VkShaderModule>(entry.handle), entry.allocator); break;
+	case VK_OBJECT_TYPE_PIPELINE_LAYOUT: dispatch->vkDestroyPipelineLayout(device, reinterpret_cast<VkPipelineLayout>(entry.handle), entry.allocator); break;
+	case VK_OBJECT_TYPE_RENDER_PASS: dispatch->vkDestroyRenderPass(device, reinterpret_cast<VkRenderPass>(entry.handle), entry.allocator); break;
+	case VK_OBJECT_TYPE_PIPELINE: dispatch->vkDestroyPipeline(device, reinterpret_cast<VkPipeline>(entry.handle), entry.allocator); break;
+	case VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT: dispatch->vkDestroyDescriptorSetLayout(device, reinterpret_cast<VkDescriptorSetLayout>(entry.handle), entry.allocator); break;
+	case VK_OBJECT_TYPE_SAMPLER: dispatch->vkDestroySampler(device, reinterpret_cast<VkSampler>(entry.handle), entry.allocator); break;
+	case VK_OBJECT_TYPE_DESCRIPTOR_POOL: dispatch->vkDestroyDescriptorPool(device, reinterpret_cast<VkDescriptorPool>(entry.handle), entry.allocator); break;
+	case VK_OBJECT_TYPE_FRAMEBUFFER: dispatch->vkDestroyFramebuffer(device, reinterpret_cast<VkFramebuffer>(entry.handle), entry.allocator); break;
+	case VK_OBJECT_TYPE_COMMAND_POOL: dispatch->vkDestroyCommandPool(device, reinterpret_cast<VkCommandPool>(entry.handle), entry.allocator); break;
+	case VK_OBJECT_TYPE_SWAPCHAIN_KHR: dispatch->vkDestroySwapchainKHR(device, reinterpret_cast<VkSwapchainKHR>(entry.handle), entry.allocator); break;
+	default:
+		fprintf(stderr, "Error (%s:%u): Deferred deletion of object type %d is not supported, leaking it\n",
+			__FILE__, __LINE__, entry.type);
+		return;
+	}
+
+	numDestroyed++;
+}
+
+void DeferredDeletionQueue::printStats(void) const
+{
+	printf("Deferred deletion queue stats:\n");
+	printf("\tQueued: %llu, destroyed: %llu\n",
+		static_cast<unsigned long long>(numQueued),
+		static_cast<unsigned long long>(numDestroyed));
+	printf("\tDepth: %zu (max %zu)\n", entries.size(), maxDepth);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <deque>
+#include "vulkanDispatch.h"
+
+// Deferred destruction of Vulkan objects.
+// Objects get queued along with a retire value: the point (frame count or timeline value) the
+//	GPU has to pass before nothing references them anymore. collect() destroys everything whose
+//	retire value has been reached, so freeing something never has to wait on the GPU.
+class DeferredDeletionQueue
+{
+	struct Entry
+	{
+		VkObjectType type;
+		uint64_t handle;
+		uint64_t retireValue;
+		const VkAllocationCallbacks *allocator; // Has to match what the object was created with.
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	const DeviceDispatch *dispatch = nullptr;
+	std::deque<Entry> entries; // Kept sorted by retire value so collect() only looks at the front.
+
+	// Stats
+	uint64_t numQueued = 0;
+	uint64_t numDestroyed = 0;
+	size_t maxDepth = 0;
+
+	void enqueueHandle(VkObjectType type, uint64_t handle, uint64_t retireValue, const VkAllocationCallbacks *allocator);
+	void destroyEntry(const Entry &entry);
+
+public:
+	void init(VkDevice device, const DeviceDispatch &dispatch)
+	{
+		this->device = device;
+		this->dispatch = &dispatch;
+	}
+
+	// Queue 'handle' to be destroyed once collect() is called with a completed value >= 'retireValue'.
+	// Handles are pointers on 64-bit builds and uint64_t on 32-bit builds, hence the template.
+	template<typename T>
+	void enqueue(VkObjectType type, T handle, uint64_t retireValue, const VkAllocationCallbacks *allocator = nullptr)
+	{
+		if (handle != VK_NULL_HANDLE)
+			enqueueHandle(type, reinterpret_cast<uint64_t>(handle), retireValue, allocator);
+	}
+
+	// Destroy everything the GPU is done with. 'completedValue' is the last value the GPU has passed.
+	// Returns how many objects were destroyed.
+	uint32_t collect(uint64_t completedValue);
+
+	// Destroy everything regardless of retire value. Only for when the device is idle (shutdown).
+	void destroyAll(void);
+
+	size_t getDepth(void) const { return entries.size(); }
+	size_t getMaxDepth(void) const { return maxDepth; }
+	uint64_t getNumDestroyed(void) const { return numDestroyed; }
+	void printStats(void) const;
+};
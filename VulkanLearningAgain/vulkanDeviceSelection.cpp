@@ -0,0 +1,384 @@
+#include "vulkanDeviceSelection.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include "vulkanDebug.h"
+#include "vulkanDispatch.h"
+#include "vulkanMemory.h"
+
+// Points for each part of the score.
+// The device type dominates, everything else mostly breaks ties between devices of the same type.
+#define SCORE_DISCRETE_GPU 10000
+#define SCORE_INTEGRATED_GPU 5000
+#define SCORE_VIRTUAL_GPU 2500
+#define SCORE_CPU 500
+#define SCORE_PER_GB_DEVICE_LOCAL 64
+#define SCORE_DEDICATED_TRANSFER_QUEUE 300
+#define SCORE_ASYNC_COMPUTE_QUEUE 300
+#define SCORE_OPTIONAL_FEATURE 100
+#define SCORE_PER_GB_PER_SECOND_PROBE 10
+
+// The probe fills this much device local memory, this many times.
+#define PROBE_BUFFER_SIZE (64 * 1024 * 1024)
+#define PROBE_NUM_FILLS 8
+
+static void addReason(PhysicalDeviceScore &score, int64_t points, const char *format, ...)
+{
+	char reason[256];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(reason, sizeof(reason), format, args);
+	va_end(args);
+
+	char entry[320];
+	if (points)
+		snprintf(entry, sizeof(entry), "%s%s (%+lld)", score.reasons.empty() ? "" : ", ", reason, static_cast<long long>(points));
+	else
+		snprintf(entry, sizeof(entry), "%s%s", score.reasons.empty() ? "" : ", ", reason);
+	score.reasons += entry;
+	score.score += points;
+}
+
+static void markUnusable(PhysicalDeviceScore &score, const char *reason)
+{
+	score.usable = false;
+	addReason(score, 0, "UNUSABLE: %s", reason);
+}
+
+// Times PROBE_NUM_FILLS vkCmdFillBuffers over a device local buffer on a throwaway device.
+// Uses timestamp queries when the queue family supports them, otherwise the CPU time of the submit.
+// Returns GB/s, or 0 if anything about the probe failed.
+static double probeFillBandwidth(VkPhysicalDevice physicalDevice, const VulkanCapabilities::DeviceInfo &deviceInfo, uint32_t queueFamilyIndex)
+{
+	VkDevice device = VK_NULL_HANDLE;
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkFence fence = VK_NULL_HANDLE;
+	DeviceDispatch dispatch;
+	bool dispatchLoaded = false; // Everything but the device is created through it.
+	double gbPerSecond = 0.0;
+
+	try
+	{
+		float queuePriority = 1.0f;
+		VkDeviceQueueCreateInfo queueCreateInfo = {
+			VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			nullptr, // pNext
+			0, // Flags
+			queueFamilyIndex, // Queue Family Index
+			1, // Number of queues to make
+			&queuePriority // Queue priorities
+		};
+		VkDeviceCreateInfo deviceCreateInfo = {
+			VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+			nullptr, // pNext
+			0, // Flags
+			1, // Number of queue families to create
+			&queueCreateInfo,
+			0, // Number of layers to enable
+			nullptr, // Layers to enable
+			0, // Number of extensions to enable
+			nullptr, // Extensions to enable
+			nullptr // Features to enable
+		};
+		HANDLE_VK(vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &device),
+			"Creating the device selection probe device");
+		dispatch.load(device);
+		dispatchLoaded = true;
+
+		VkQueue queue;
+		dispatch.vkGetDeviceQueue(device, queueFamilyIndex, 0, &queue);
+
+		VkCommandPoolCreateInfo commandPoolCreateInfo = {
+			VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			nullptr, // pNext
+			VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, // Flags
+			queueFamilyIndex // Queue Family Index
+		};
+		HANDLE_VK(dispatch.vkCreateCommandPool(device, &commandPoolCreateInfo, nullptr, &commandPool),
+			"Creating the device selection probe command pool");
+
+		VkCommandBufferAllocateInfo commandBufferAllocInfo = {
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			nullptr, // pNext
+			commandPool, // Command Pool
+			VK_COMMAND_BUFFER_LEVEL_PRIMARY, // Buffer level
+			1 // Num command buffers to alloc
+		};
+		VkCommandBuffer commandBuffer;
+		HANDLE_VK(dispatch.vkAllocateCommandBuffers(device, &commandBufferAllocInfo, &commandBuffer),
+			"Allocating the device selection probe command buffer");
+
+		createBufferWithMemory(device, dispatch, deviceInfo.memoryProperties, PROBE_BUFFER_SIZE,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, nullptr,
+			buffer, memory);
+
+		bool useTimestamps = deviceInfo.queueFamilies[queueFamilyIndex].timestampValidBits != 0;
+		if (useTimestamps)
+		{
+			VkQueryPoolCreateInfo queryPoolCreateInfo = {
+				VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+				nullptr, // pNext
+				0, // Flags
+				VK_QUERY_TYPE_TIMESTAMP, // Query type
+				2, // Query count
+				0 // Pipeline statistics
+			};
+			HANDLE_VK(dispatch.vkCreateQueryPool(device, &queryPoolCreateInfo, nullptr, &queryPool),
+				"Creating the device selection probe query pool");
+		}
+
+		VkFenceCreateInfo fenceCreateInfo = {
+			VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+			nullptr, // pNext
+			0 // Flags
+		};
+		HANDLE_VK(dispatch.vkCreateFence(device, &fenceCreateInfo, nullptr, &fence),
+			"Creating the device selection probe fence");
+
+		VkCommandBufferBeginInfo beginInfo = {
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			nullptr, // pNext
+			0, // Flags
+			nullptr // Inheritance info
+		};
+		HANDLE_VK(dispatch.vkBeginCommandBuffer(commandBuffer, &beginInfo), "Beginning the device selection probe");
+		if (useTimestamps)
+		{
+			dispatch.vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+			dispatch.vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+		}
+		for (uint32_t i = 0; i < PROBE_NUM_FILLS; i++)
+			dispatch.vkCmdFillBuffer(commandBuffer, buffer, 0, VK_WHOLE_SIZE, i);
+		if (useTimestamps)
+			dispatch.vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+		HANDLE_VK(dispatch.vkEndCommandBuffer(commandBuffer), "Ending the device selection probe");
+
+		VkSubmitInfo submitInfo = {
+			VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			nullptr, // pNext
+			0, // Wait semaphore count
+			nullptr, // Wait semaphores
+			nullptr, // Wait stages
+			1, // Command buffer count
+			&commandBuffer, // Command buffers
+			0, // Signal semaphore count
+			nullptr // Signal semaphores
+		};
+
+		std::chrono::high_resolution_clock::time_point submitTime = std::chrono::high_resolution_clock::now();
+		HANDLE_VK(dispatch.vkQueueSubmit(queue, 1, &submitInfo, fence), "Submitting the device selection probe");
+		HANDLE_VK(dispatch.vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX), "Waiting for the device selection probe");
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - submitTime).count();
+
+		if (useTimestamps)
+		{
+			uint64_t timestamps[2];
+			HANDLE_VK(dispatch.vkGetQueryPoolResults(device, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+					VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT),
+				"Getting the device selection probe timestamps");
+			seconds = (timestamps[1] - timestamps[0]) * static_cast<double>(deviceInfo.properties.limits.timestampPeriod) * 1e-9;
+		}
+
+		if (seconds > 0.0)
+			gbPerSecond = (static_cast<double>(PROBE_BUFFER_SIZE) * PROBE_NUM_FILLS) / (seconds * 1024.0 * 1024.0 * 1024.0);
+	}
+	catch (const std::runtime_error &)
+	{
+		// The probe is only a hint. The error has already been printed.
+		gbPerSecond = 0.0;
+	}
+
+	if (dispatchLoaded)
+	{
+		dispatch.vkDeviceWaitIdle(device);
+		if (fence)
+			dispatch.vkDestroyFence(device, fence, nullptr);
+		if (queryPool)
+			dispatch.vkDestroyQueryPool(device, queryPool, nullptr);
+		if (buffer)
+			dispatch.vkDestroyBuffer(device, buffer, nullptr);
+		if (memory)
+			dispatch.vkFreeMemory(device, memory, nullptr);
+		if (commandPool)
+			dispatch.vkDestroyCommandPool(device, commandPool, nullptr);
+		dispatch.vkDestroyDevice(device, nullptr);
+	}
+	else if (device)
+	{
+		// Loading the dispatch table is what failed, so there's nothing else to destroy.
+		vkDestroyDevice(device, nullptr);
+	}
+
+	return gbPerSecond;
+}
+
+std::vector<PhysicalDeviceScore> scorePhysicalDevices(const VulkanCapabilities &capabilities,
+	const VkPhysicalDevice *physicalDevices,
+	VkSurfaceKHR surface,
+	const std::vector<const char *> &requiredDeviceExtensions,
+	bool runProbe)
+{
+	std::vector<PhysicalDeviceScore> scores(capabilities.getNumDevices());
+	for (uint32_t i = 0; i < capabilities.getNumDevices(); i++)
+	{
+		const VulkanCapabilities::DeviceInfo &deviceInfo = capabilities.getDevice(i);
+		PhysicalDeviceScore &score = scores[i];
+		score.index = i;
+
+		// Device type
+		switch (deviceInfo.properties.deviceType)
+		{
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: addReason(score, SCORE_DISCRETE_GPU, "discrete GPU"); break;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: addReason(score, SCORE_INTEGRATED_GPU, "integrated GPU"); break;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: addReason(score, SCORE_VIRTUAL_GPU, "virtual GPU"); break;
+		case VK_PHYSICAL_DEVICE_TYPE_CPU: addReason(score, SCORE_CPU, "CPU"); break;
+		default: addReason(score, 0, "unknown device type"); break;
+		}
+
+		// Largest device local heap
+		VkDeviceSize largestDeviceLocalHeap = 0;
+		for (uint32_t j = 0; j < deviceInfo.memoryProperties.memoryHeapCount; j++)
+		{
+			const VkMemoryHeap &heap = deviceInfo.memoryProperties.memoryHeaps[j];
+			if (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+				largestDeviceLocalHeap = std::max(largestDeviceLocalHeap, heap.size);
+		}
+		addReason(score, static_cast<int64_t>(largestDeviceLocalHeap / (1024 * 1024 * 1024)) * SCORE_PER_GB_DEVICE_LOCAL,
+			"%llu MB device local", static_cast<unsigned long long>(largestDeviceLocalHeap / (1024 * 1024)));
+
+		// Queue families
+		uint32_t graphicsQueueFamily = ~0U;
+		bool hasDedicatedTransfer = false;
+		bool hasAsyncCompute = false;
+		for (uint32_t j = 0; j < deviceInfo.queueFamilies.size(); j++)
+		{
+			VkQueueFlags flags = deviceInfo.queueFamilies[j].queueFlags;
+			if (graphicsQueueFamily == ~0U && flags & VK_QUEUE_GRAPHICS_BIT)
+				graphicsQueueFamily = j;
+			if (flags & VK_QUEUE_TRANSFER_BIT && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+				hasDedicatedTransfer = true;
+			if (flags & VK_QUEUE_COMPUTE_BIT && !(flags & VK_QUEUE_GRAPHICS_BIT))
+				hasAsyncCompute = true;
+		}
+		if (graphicsQueueFamily == ~0U)
+			markUnusable(score, "no graphics queue");
+		else
+		{
+			// The engine presents from the graphics queue. A failed query counts as a no.
+			VkBool32 canPresent = VK_FALSE;
+			if (vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevices[i], graphicsQueueFamily, surface, &canPresent) != VK_SUCCESS
+				|| canPresent != VK_TRUE)
+			{
+				markUnusable(score, "graphics queue can't present");
+			}
+		}
+		if (hasDedicatedTransfer)
+			addReason(score, SCORE_DEDICATED_TRANSFER_QUEUE, "dedicated transfer queue");
+		if (hasAsyncCompute)
+			addReason(score, SCORE_ASYNC_COMPUTE_QUEUE, "async compute queue");
+
+		// Required and optional extensions/features
+		for (const char *requiredDeviceExtension : requiredDeviceExtensions)
+		{
+			if (!deviceInfo.hasExtension(requiredDeviceExtension))
+			{
+				char reason[VK_MAX_EXTENSION_NAME_SIZE + 16];
+				snprintf(reason, sizeof(reason), "missing %s", requiredDeviceExtension);
+				markUnusable(score, reason);
+			}
+		}
+		if (deviceInfo.timelineSemaphore)
+			addReason(score, SCORE_OPTIONAL_FEATURE, "timeline semaphores");
+		if (deviceInfo.descriptorIndexingFeatures.runtimeDescriptorArray)
+			addReason(score, SCORE_OPTIONAL_FEATURE, "descriptor indexing");
+
+		// Micro-benchmark
+		if (runProbe && score.usable)
+		{
+			score.probeGBPerSecond = probeFillBandwidth(physicalDevices[i], deviceInfo, graphicsQueueFamily);
+			addReason(score, static_cast<int64_t>(score.probeGBPerSecond * SCORE_PER_GB_PER_SECOND_PROBE),
+				"probe %.1lf GB/s fill", score.probeGBPerSecond);
+		}
+	}
+
+	return scores;
+}
+
+std::vector<uint32_t> rankPhysicalDevices(const VulkanCapabilities &capabilities,
+	const std::vector<PhysicalDeviceScore> &scores,
+	const char *overrideDevice)
+{
+	std::vector<uint32_t> order(scores.size());
+	for (uint32_t i = 0; i < order.size(); i++)
+		order[i] = i;
+
+	// Usable devices first, then by score. Ties keep the enumeration order.
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		if (scores[a].usable != scores[b].usable)
+			return scores[a].usable;
+		return scores[a].score > scores[b].score;
+	});
+
+	if (order.empty() || !scores[order[0]].usable)
+	{
+		fprintf(stderr, "Error (%s:%u): None of the %zu physical devices can be used\n", __FILE__, __LINE__, scores.size());
+		throw std::runtime_error("No usable physical device");
+	}
+
+	if (overrideDevice && *overrideDevice)
+	{
+		// An index if it's all digits, otherwise part of the device name.
+		bool isIndex = true;
+		for (const char *c = overrideDevice; *c; c++)
+			isIndex = isIndex && isdigit(static_cast<unsigned char>(*c));
+
+		uint32_t match = ~0U;
+		for (uint32_t i = 0; i < scores.size() && match == ~0U; i++)
+		{
+			if (isIndex ? strtoul(overrideDevice, nullptr, 10) == i
+				: strstr(capabilities.getDevice(i).properties.deviceName, overrideDevice) != nullptr)
+				match = i;
+		}
+
+		if (match == ~0U)
+			fprintf(stderr, "Warning: Device override \"%s\" doesn't match any physical device, using the best scoring one\n", overrideDevice);
+		else if (!scores[match].usable)
+			fprintf(stderr, "Warning: Device override \"%s\" matches %s, which can't be used (%s)\n",
+				overrideDevice, capabilities.getDevice(match).properties.deviceName, scores[match].reasons.c_str());
+		else
+		{
+			order.erase(std::find(order.begin(), order.end(), match));
+			order.insert(order.begin(), match);
+			if (VERBOSE)
+				printf("Device override \"%s\" selects %s\n", overrideDevice, capabilities.getDevice(match).properties.deviceName);
+		}
+	}
+
+	return order;
+}
+
+void printPhysicalDeviceScores(const VulkanCapabilities &capabilities,
+	const std::vector<PhysicalDeviceScore> &scores,
+	const std::vector<uint32_t> &order)
+{
+	printf("Physical device ranking:\n");
+	for (uint32_t rank = 0; rank < order.size(); rank++)
+	{
+		const PhysicalDeviceScore &score = scores[order[rank]];
+		printf("\t%u. [%u] %s : %lld : %s\n",
+			rank + 1,
+			score.index,
+			capabilities.getDevice(score.index).properties.deviceName,
+			static_cast<long long>(score.score),
+			score.reasons.c_str());
+	}
+	printf("Selected physical device: %s\n", capabilities.getDevice(order[0]).properties.deviceName);
+}
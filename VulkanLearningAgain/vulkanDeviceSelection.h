@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include "vulkanCapabilities.h"
+
+// How one physical device scored. Higher is better, unusable devices are never picked by score.
+struct PhysicalDeviceScore
+{
+	uint32_t index = 0; // Index of the device as enumerated.
+	bool usable = true; // False if the device is missing something the engine can't run without.
+	int64_t score = 0;
+	double probeGBPerSecond = 0.0; // Fill bandwidth measured by the probe. 0 if it wasn't run.
+	std::string reasons; // What the score is made of, for printing.
+};
+
+// Scores each physical device on its type, device local memory, queue families and required
+//	extensions. A device whose graphics queue family can't present to 'surface' is unusable. With 'runProbe' each usable device also gets a short fill bandwidth benchmark,
+//	which creates (and destroys) a throwaway logical device.
+std::vector<PhysicalDeviceScore> scorePhysicalDevices(const VulkanCapabilities &capabilities,
+	const VkPhysicalDevice *physicalDevices,
+	VkSurfaceKHR surface,
+	const std::vector<const char *> &requiredDeviceExtensions,
+	bool runProbe);
+
+// Returns the enumeration indices ordered best device first.
+// 'overrideDevice' is either an index or part of a device name. When it matches a usable device,
+//	that device goes first regardless of its score.
+// Throws if no device is usable.
+std::vector<uint32_t> rankPhysicalDevices(const VulkanCapabilities &capabilities,
+	const std::vector<PhysicalDeviceScore> &scores,
+	const char *overrideDevice);
+
+void printPhysicalDeviceScores(const VulkanCapabilities &capabilities,
+	const std::vector<PhysicalDeviceScore> &scores,
+	const std::vector<uint32_t> &order);
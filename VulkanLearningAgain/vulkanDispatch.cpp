@@ -0,0 +1,92 @@
+#include "vulkanDispatch.h"
+#include <stdio.h>
+#include <stdexcept>
+#include <chrono>
+#include <algorithm>
+#include "vulkanDebug.h"
+
+// Each round records this many vkCmdSetViewport + vkCmdSetScissor pairs.
+#define DISPATCH_BENCHMARK_NUM_COMMANDS 100000
+#define DISPATCH_BENCHMARK_ROUNDS 5
+
+void DeviceDispatch::load(VkDevice device)
+{
+#define LOAD_DEVICE_DISPATCH_FUNCTION(name) \
+	name = (PFN_##name)vkGetDeviceProcAddr(device, #name); \
+	if (!name) \
+	{ \
+		fprintf(stderr, "Error (%s:%u): Failed to get device function \"%s\"\n", __FILE__, __LINE__, #name); \
+		throw std::runtime_error("Failed to load the device dispatch table"); \
+	}
+	DEVICE_DISPATCH_FUNCTIONS(LOAD_DEVICE_DISPATCH_FUNCTION)
+#undef LOAD_DEVICE_DISPATCH_FUNCTION
+
+#define LOAD_OPTIONAL_DEVICE_DISPATCH_FUNCTION(name) \
+	name = (PFN_##name)vkGetDeviceProcAddr(device, #name);
+	DEVICE_DISPATCH_OPTIONAL_FUNCTIONS(LOAD_OPTIONAL_DEVICE_DISPATCH_FUNCTION)
+#undef LOAD_OPTIONAL_DEVICE_DISPATCH_FUNCTION
+}
+
+// Records the benchmark command stream with the given entry points, returns nanoseconds per call.
+static double recordBenchmarkCommands(const DeviceDispatch &dispatch, VkCommandBuffer commandBuffer,
+	PFN_vkCmdSetViewport cmdSetViewport, PFN_vkCmdSetScissor cmdSetScissor)
+{
+	VkCommandBufferBeginInfo beginInfo = {
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		nullptr, // pNext
+		VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, // Flags
+		nullptr // Inheritance info
+	};
+	HANDLE_VK(dispatch.vkResetCommandBuffer(commandBuffer, 0), "Resetting the dispatch benchmark command buffer");
+	HANDLE_VK(dispatch.vkBeginCommandBuffer(commandBuffer, &beginInfo), "Beginning the dispatch benchmark command buffer");
+
+	VkViewport viewport = { 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f };
+	VkRect2D scissor = { { 0, 0 }, { 1, 1 } };
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < DISPATCH_BENCHMARK_NUM_COMMANDS; i++)
+	{
+		viewport.width = static_cast<float>(1 + (i & 1023)); // Keep the driver from skipping redundant state.
+		scissor.extent.width = 1 + (i & 1023);
+		cmdSetViewport(commandBuffer, 0, 1, &viewport);
+		cmdSetScissor(commandBuffer, 0, 1, &scissor);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	HANDLE_VK(dispatch.vkEndCommandBuffer(commandBuffer), "Ending the dispatch benchmark command buffer");
+	return seconds * 1e9 / (2.0 * DISPATCH_BENCHMARK_NUM_COMMANDS);
+}
+
+void benchmarkDeviceDispatch(VkDevice device, const DeviceDispatch &dispatch, VkCommandPool commandPool)
+{
+	VkCommandBufferAllocateInfo commandBufferAllocInfo = {
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		nullptr, // pNext
+		commandPool, // Command Pool
+		VK_COMMAND_BUFFER_LEVEL_PRIMARY, // Buffer level
+		1 // Num command buffers to alloc
+	};
+	VkCommandBuffer commandBuffer;
+	HANDLE_VK(dispatch.vkAllocateCommandBuffers(device, &commandBufferAllocInfo, &commandBuffer),
+		"Allocating the dispatch benchmark command buffer");
+
+	// Alternate between the two so neither gets all the warm caches, and keep the best round of each.
+	double loaderNsPerCall = 1e30;
+	double dispatchNsPerCall = 1e30;
+	for (uint32_t round = 0; round < DISPATCH_BENCHMARK_ROUNDS; round++)
+	{
+		loaderNsPerCall = std::min(loaderNsPerCall,
+			recordBenchmarkCommands(dispatch, commandBuffer, vkCmdSetViewport, vkCmdSetScissor));
+		dispatchNsPerCall = std::min(dispatchNsPerCall,
+			recordBenchmarkCommands(dispatch, commandBuffer, dispatch.vkCmdSetViewport, dispatch.vkCmdSetScissor));
+	}
+
+	dispatch.vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+
+	printf("Device dispatch benchmark (%u calls per round, best of %u rounds):\n",
+		2 * DISPATCH_BENCHMARK_NUM_COMMANDS, DISPATCH_BENCHMARK_ROUNDS);
+	printf("\tLoader trampolines: %.2lf ns/call\n", loaderNsPerCall);
+	printf("\tDevice dispatch table: %.2lf ns/call\n", dispatchNsPerCall);
+	printf("\tSaved: %.2lf ns/call (%.1lf%%)\n",
+		loaderNsPerCall - dispatchNsPerCall,
+		100.0 * (loaderNsPerCall - dispatchNsPerCall) / loaderNsPerCall);
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+// Device level functions the engine calls, fetched straight from the driver (or the first enabled
+//	layer) with vkGetDeviceProcAddr. Calling the loader's exported vk* functions instead goes through
+//	a trampoline that looks up the device's dispatch table on every call.
+#define DEVICE_DISPATCH_FUNCTIONS(X) \
+	X(vkDestroyDevice) \
+	X(vkGetDeviceQueue) \
+	X(vkDeviceWaitIdle) \
+	X(vkQueueSubmit) \
+	X(vkQueueWaitIdle) \
+	X(vkAllocateMemory) \
+	X(vkFreeMemory) \
+	X(vkMapMemory) \
+	X(vkUnmapMemory) \
+	X(vkFlushMappedMemoryRanges) \
+	X(vkCreateBuffer) \
+	X(vkDestroyBuffer) \
+	X(vkGetBufferMemoryRequirements) \
+	X(vkBindBufferMemory) \
+	X(vkCreateImage) \
+	X(vkDestroyImage) \
+	X(vkGetImageMemoryRequirements) \
+	X(vkBindImageMemory) \
+	X(vkGetDeviceMemoryCommitment) \
+	X(vkCreateImageView) \
+	X(vkDestroyImageView) \
+	X(vkCreateSampler) \
+	X(vkDestroySampler) \
+	X(vkCreateFence) \
+	X(vkDestroyFence) \
+	X(vkResetFences) \
+	X(vkGetFenceStatus) \
+	X(vkWaitForFences) \
+	X(vkCreateSemaphore) \
+	X(vkDestroySemaphore) \
+	X(vkCreateQueryPool) \
+	X(vkDestroyQueryPool) \
+	X(vkGetQueryPoolResults) \
+	X(vkCreateShaderModule) \
+	X(vkDestroyShaderModule) \
+	X(vkCreatePipelineCache) \
+	X(vkDestroyPipelineCache) \
+	X(vkGetPipelineCacheData) \
+	X(vkCreateGraphicsPipelines) \
+	X(vkCreateComputePipelines) \
+	X(vkDestroyPipeline) \
+	X(vkCreatePipelineLayout) \
+	X(vkDestroyPipelineLayout) \
+	X(vkCreateDescriptorSetLayout) \
+	X(vkDestroyDescriptorSetLayout) \
+	X(vkCreateDescriptorPool) \
+	X(vkDestroyDescriptorPool) \
+	X(vkAllocateDescriptorSets) \
+	X(vkUpdateDescriptorSets) \
+	X(vkCreateFramebuffer) \
+	X(vkDestroyFramebuffer) \
+	X(vkCreateRenderPass) \
+	X(vkDestroyRenderPass) \
+	X(vkCreateCommandPool) \
+	X(vkDestroyCommandPool) \
+	X(vkResetCommandPool) \
+	X(vkAllocateCommandBuffers) \
+	X(vkFreeCommandBuffers) \
+	X(vkBeginCommandBuffer) \
+	X(vkEndCommandBuffer) \
+	X(vkResetCommandBuffer) \
+	X(vkCmdBindPipeline) \
+	X(vkCmdSetViewport) \
+	X(vkCmdSetScissor) \
+	X(vkCmdBindDescriptorSets) \
+	X(vkCmdBindIndexBuffer) \
+	X(vkCmdBindVertexBuffers) \
+	X(vkCmdDraw) \
+	X(vkCmdDrawIndexed) \
+	X(vkCmdDrawIndirect) \
+	X(vkCmdDrawIndexedIndirect) \
+	X(vkCmdDispatch) \
+	X(vkCmdDispatchIndirect) \
+	X(vkCmdCopyBuffer) \
+	X(vkCmdCopyBufferToImage) \
+	X(vkCmdBlitImage) \
+	X(vkCmdFillBuffer) \
+	X(vkCmdClearColorImage) \
+	X(vkCmdPipelineBarrier) \
+	X(vkCmdResetQueryPool) \
+	X(vkCmdWriteTimestamp) \
+	X(vkCmdPushConstants) \
+	X(vkCmdBeginRenderPass) \
+	X(vkCmdEndRenderPass) \
+	X(vkCreateSwapchainKHR) \
+	X(vkDestroySwapchainKHR) \
+	X(vkGetSwapchainImagesKHR) \
+	X(vkAcquireNextImageKHR) \
+	X(vkQueuePresentKHR)
+
+// Extension functions that are only there when their extension got enabled. Left null otherwise.
+#define DEVICE_DISPATCH_OPTIONAL_FUNCTIONS(X) \
+	X(vkWaitSemaphoresKHR) \
+	X(vkGetSemaphoreCounterValueKHR)
+
+struct DeviceDispatch
+{
+#define DECLARE_DEVICE_DISPATCH_FUNCTION(name) PFN_##name name = nullptr;
+	DEVICE_DISPATCH_FUNCTIONS(DECLARE_DEVICE_DISPATCH_FUNCTION)
+	DEVICE_DISPATCH_OPTIONAL_FUNCTIONS(DECLARE_DEVICE_DISPATCH_FUNCTION)
+#undef DECLARE_DEVICE_DISPATCH_FUNCTION
+
+	// Throws if any of the required functions can't be found.
+	void load(VkDevice device);
+};
+
+// Records the same dynamic state heavy command stream through the loader trampolines and through
+//	'dispatch', and prints the average cost per call of each.
+// 'commandPool' has to allow resetting individual command buffers.
+void benchmarkDeviceDispatch(VkDevice device, const DeviceDispatch &dispatch, VkCommandPool commandPool);
@@ -0,0 +1,71 @@
+#include "vulkanDynamicResolution.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+void DynamicResolution::create(const DynamicResolutionConfig &config)
+{
+	this->config = config;
+	this->config.granularity = std::max(config.granularity, 1U);
+	scale = config.maxScale;
+	lowestScale = scale;
+	updateRenderSize();
+}
+
+void DynamicResolution::setOutputSize(uint32_t width, uint32_t height)
+{
+	outputWidth = width;
+	outputHeight = height;
+	updateRenderSize();
+}
+
+void DynamicResolution::updateRenderSize(void)
+{
+	// Rounded to the granularity (so small changes in scale don't change the size every frame),
+	//	but never bigger than the output or smaller than one step.
+	auto scaleSize = [this](uint32_t size) {
+		uint32_t scaled = static_cast<uint32_t>(size * scale / config.granularity + 0.5f) * config.granularity;
+		return std::min(std::max(scaled, config.granularity), size);
+	};
+	renderWidth = scaleSize(outputWidth);
+	renderHeight = scaleSize(outputHeight);
+}
+
+void DynamicResolution::update(double gpuMs)
+{
+	numFrames++;
+	if (gpuMs > config.budgetMs)
+		numBudgetHits++;
+
+	averageMs = hasAverage ? averageMs + (gpuMs - averageMs) * config.smoothing : gpuMs;
+	hasAverage = true;
+
+	float target = scale;
+	if (averageMs > config.budgetMs || averageMs < config.budgetMs * (1.0 - config.headroom))
+		target = scale * static_cast<float>(sqrt(config.budgetMs / std::max(averageMs, 0.001)));
+	target = std::min(std::max(target, scale - config.maxStep), scale + config.maxStep);
+	target = std::min(std::max(target, config.minScale), config.maxScale);
+
+	uint32_t lastWidth = renderWidth, lastHeight = renderHeight;
+	scale = target;
+	updateRenderSize();
+	if (renderWidth != lastWidth || renderHeight != lastHeight)
+		numResizes++;
+
+	totalScale += scale;
+	lowestScale = std::min(lowestScale, scale);
+}
+
+void DynamicResolution::printStats(void) const
+{
+	printf("Dynamic resolution stats:\n");
+	printf("\tBudget: %.2lf ms GPU time per frame, scale %.2f to %.2f\n", config.budgetMs, config.minScale, config.maxScale);
+	printf("\tOver budget: %llu of %llu frames\n",
+		static_cast<unsigned long long>(numBudgetHits), static_cast<unsigned long long>(numFrames));
+	if (numFrames)
+	{
+		printf("\tScale: %.2f now (%u x %u of %u x %u), %.2f average, %.2f lowest\n",
+			scale, renderWidth, renderHeight, outputWidth, outputHeight, totalScale / numFrames, lowestScale);
+		printf("\tRender size changed on %llu frames\n", static_cast<unsigned long long>(numResizes));
+	}
+}
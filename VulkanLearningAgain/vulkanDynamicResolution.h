@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+
+struct DynamicResolutionConfig
+{
+	double budgetMs; // GPU time a frame should take.
+	float minScale; // Of the output size, on each axis.
+	float maxScale;
+	float smoothing; // Weight of each new frame time in the running average, 0 to 1.
+	float maxStep; // Most the scale changes by in one frame.
+	float headroom; // Only scale up while the average is this fraction under budget, so it doesn't oscillate.
+	uint32_t granularity; // Render sizes are multiples of this many pixels.
+};
+
+// Picks the resolution to render at from how long the GPU took on recent frames.
+// Frame times are smoothed with an exponential moving average, and the scale moves towards
+//	sqrt(budget / average) of what it is, since GPU time goes roughly with the number of pixels.
+//	It drops as soon as the average is over budget, but only comes back up with some headroom.
+// The measurements are a few frames old by the time they're read back (the GPU profiler reads a
+//	frame's timestamps the next time its frame in flight comes around), which the smoothing and
+//	the step limit keep from turning into oscillation.
+class DynamicResolution
+{
+	DynamicResolutionConfig config = {};
+	uint32_t outputWidth = 0;
+	uint32_t outputHeight = 0;
+	float scale = 1.0f;
+	uint32_t renderWidth = 0;
+	uint32_t renderHeight = 0;
+	double averageMs = 0.0;
+	bool hasAverage = false;
+
+	// Stats
+	uint64_t numFrames = 0;
+	uint64_t numBudgetHits = 0; // Frames that went over budget.
+	uint64_t numResizes = 0; // Frames where the render size changed.
+	double totalScale = 0.0;
+	float lowestScale = 1.0f;
+
+	void updateRenderSize(void);
+
+public:
+	void create(const DynamicResolutionConfig &config);
+
+	// The size being scaled up to (the swapchain's). Keeps the current scale.
+	void setOutputSize(uint32_t width, uint32_t height);
+
+	// Feed in how long the GPU took on a frame, and pick the scale for the next one.
+	void update(double gpuMs);
+
+	float getScale(void) const { return scale; }
+	uint32_t getRenderWidth(void) const { return renderWidth; }
+	uint32_t getRenderHeight(void) const { return renderHeight; }
+	double getBudgetMs(void) const { return config.budgetMs; }
+	uint64_t getNumBudgetHits(void) const { return numBudgetHits; }
+
+	void printStats(void) const;
+};
@@ -1,52 +1,191 @@
 #include "vulkanEngine.h"
 #include <stdio.h>
+#include <math.h>
 #include <assert.h>
 #include <stdexcept>
 #include <sstream>
+#include <algorithm>
 #include "vulkanEngineInfo.h"
 #include "vulkanDebug.h"
-
-// Include SPIR-V
-#include "simpleVertex.h"
-#include "simpleFragment.h"
+#include "vulkanDeviceSelection.h"
+#include "envUtils.h"
+#include "vulkanDebugSink.h"
+#include "vulkanMemory.h"
+#include "vulkanKernelTuning.h"
+#include "mathUtils.h"
 
 // Using SDL2 to simplify cross platform displays.
 #include <SDL.h>
 #include <SDL_vulkan.h>
 
+// Default for the validation layer. VALIDATION_ENV (0/1) switches it at runtime.
 #define ENABLE_VALIDATION_LAYER 1
+#define VALIDATION_ENV "VLA_VALIDATION"
+
+// Debug messages are printed from a logger thread. Each message ID is printed this many times
+//	and then only counted, and non-error messages are capped per second.
+#define DEBUG_SINK_QUEUE_SIZE 1024
+#define DEBUG_SINK_MAX_REPEATS 5
+#define DEBUG_SINK_MAX_PRINTS_PER_SECOND 20
+
+// Upper bounds for the bindless descriptor arrays. The device limits may lower these further.
+#define BINDLESS_MAX_BUFFERS 16384U
+#define BINDLESS_MAX_IMAGES 4096U
+
+// Use VK_KHR_timeline_semaphore for queue synchronization when the device has it. (Falls back to fences.)
+#define ENABLE_TIMELINE_SEMAPHORES 1
+
+// Cache the per physical device capabilities between runs. (Re-queried whenever the driver version changes.)
+#define USE_CAPABILITY_CACHE 1
+#define CAPABILITY_CACHE_FILE "vulkanCapabilities.cache"
+
+// Shaders are compiled from their GLSL at runtime, and the SPIR-V is cached by content hash so warm
+//	starts skip the compiler. SHADER_DIRECTORY_ENV points at the sources when they aren't in the
+//	working directory.
+#define SHADER_SOURCE_DIRECTORY "."
+#define SHADER_DIRECTORY_ENV "VLA_SHADER_DIR"
+#define USE_SHADER_CACHE 1
+#define SHADER_CACHE_DIRECTORY "shaderCache"
+#define OPTIMIZE_SHADERS 1
+
+// The pipeline cache is saved between runs, along with the constants the compute kernels get
+//	specialized with on this device. KERNEL_AUTOTUNE_ENV (0/1) times the candidate constants at
+//	startup when the file doesn't have measured ones yet (delete the file to measure again).
+#define USE_PIPELINE_CACHE_FILE 1
+#define PIPELINE_CACHE_FILE "vulkanPipeline.cache"
+#define ENABLE_KERNEL_AUTOTUNE 0
+#define KERNEL_AUTOTUNE_ENV "VLA_AUTOTUNE"
+
+// Physical device selection. Devices are ranked by score and the best one becomes physicalDevices[0].
+// DEVICE_OVERRIDE_ENV picks a device by index or (part of its) name instead.
+// The bandwidth probe creates a throwaway device per GPU, so it's opt in through DEVICE_PROBE_ENV.
+#define DEVICE_OVERRIDE_ENV "VLA_DEVICE"
+#define DEVICE_PROBE_ENV "VLA_DEVICE_PROBE"
+#define ENABLE_DEVICE_PROBE 0
+
+// Time recording commands through the loader's trampolines vs the device dispatch table after init.
+#define ENABLE_DISPATCH_BENCHMARK 0
+#define DISPATCH_BENCHMARK_ENV "VLA_DISPATCH_BENCHMARK"
+
+// Compile a small render graph whose transients do alias at startup, and fail if they don't. The
+//	engine's own graph has none with disjoint lifetimes, so this is what exercises the aliasing.
+#define ENABLE_RENDER_GRAPH_CHECK VERBOSE
+#define RENDER_GRAPH_CHECK_ENV "VLA_RENDER_GRAPH_CHECK"
+
+// Step the physics on a compute queue of its own (a compute only family, or else a second queue of the
+//	graphics family), overlapped with the previous frame's graphics work. Without one it's recorded
+//	at the start of the frame's graphics work. ASYNC_COMPUTE_ENV (0/1) switches it at runtime.
+#define ENABLE_ASYNC_COMPUTE 1
+#define ASYNC_COMPUTE_ENV "VLA_ASYNC_COMPUTE"
+
+// Bodies in the physics simulation, stepped once a frame.
+#define PHYSICS_NUM_BODIES (256 * 1024)
+#define PHYSICS_TIME_STEP (1.0f / 60.0f)
+
+// Bodies each secondary device simulates when USE_MULTI_GPU is on.
+#define PHYSICS_SECONDARY_NUM_BODIES (64 * 1024)
+
+// Timed scopes per frame in flight.
+#define GPU_PROFILER_MAX_SCOPES 16
+
+// Size of each frame's region of the upload arena, and how much of it one dynamic uniform binding covers.
+#define UPLOAD_ARENA_FRAME_SIZE (1024 * 1024)
+#define UPLOAD_ARENA_BIND_RANGE 256
+
+// Geometry loaded from mesh files lives in one vertex, one index and one cluster buffer, and is staged
+//	through a ring of host memory the files are copied into straight from their mappings.
+#define MESH_POOL_VERTEX_CAPACITY (64 * 1024 * 1024)
+#define MESH_POOL_INDEX_CAPACITY (32 * 1024 * 1024)
+#define MESH_POOL_CLUSTER_CAPACITY (16 * 1024 * 1024)
+#define MESH_STAGING_RING_SIZE (16 * 1024 * 1024)
+// One index type per pool so it's bound once. The asteroids are all well under 65536 vertices a LOD.
+#define MESH_POOL_INDEX_TYPE VK_INDEX_TYPE_UINT16
+
+// Mesh vertices are quantized to 16 bytes (QuantizedMeshVertex) instead of 32 bytes of floats.
+// Set VLA_QUANTIZED_VERTICES=0 to draw the float layout, and compare the GPU profiler's draw times.
+#define USE_QUANTIZED_VERTICES 1
+#define QUANTIZED_VERTICES_ENV "VLA_QUANTIZED_VERTICES"
+
+// Occlusion cull the asteroids against a Hi-Z pyramid of the depth buffer, in two phases: draw what
+//	was visible by last frame's pyramid, rebuild it from that depth, then draw what it got wrong.
+// The depth buffers have to be stored and sampled for it, so they stop being transient.
+// Set VLA_OCCLUSION_CULLING=0 to turn it off, and compare the GPU profiler's scopes.
+#define USE_OCCLUSION_CULLING 1
+#define OCCLUSION_CULLING_ENV "VLA_OCCLUSION_CULLING"
+
+// Render the scene into an offscreen target at a fraction of the swapchain's size, picked every frame
+//	to keep the GPU's time on the frame (as the GPU profiler measured it) around DYNAMIC_RESOLUTION_BUDGET_MS,
+//	then blit it (bilinear) up to the back buffer. Needs the GPU profiler's timestamps to do anything.
+// Set VLA_DYNAMIC_RESOLUTION=0 to render straight to the back buffer, and VLA_GPU_BUDGET_MS to change the budget.
+#define USE_DYNAMIC_RESOLUTION 1
+#define DYNAMIC_RESOLUTION_ENV "VLA_DYNAMIC_RESOLUTION"
+#define DYNAMIC_RESOLUTION_BUDGET_MS 12.0
+#define DYNAMIC_RESOLUTION_BUDGET_ENV "VLA_GPU_BUDGET_MS"
+#define DYNAMIC_RESOLUTION_MIN_SCALE 0.5f
+#define DYNAMIC_RESOLUTION_SMOOTHING 0.1f
+#define DYNAMIC_RESOLUTION_MAX_STEP 0.02f
+#define DYNAMIC_RESOLUTION_HEADROOM 0.15f
+#define DYNAMIC_RESOLUTION_GRANULARITY 8
+
+// Write a generated mesh file and time loading it over and over after init.
+#define ENABLE_MESH_BENCHMARK 0
+#define MESH_BENCHMARK_ENV "VLA_MESH_BENCHMARK"
+#define MESH_BENCHMARK_FILE "meshBenchmark.mesh"
+#define MESH_BENCHMARK_LODS 6
+#define MESH_BENCHMARK_LOADS 128
+
+// Procedural asteroids: ASTEROID_NUM_VARIANTS different rocks, generated on worker threads while the
+//	engine starts up and uploaded as they finish. Each one's saved to ASTEROID_CACHE_DIRECTORY under
+//	a key of its seed and shape, and loaded from there on later runs instead of being generated.
+#define ASTEROID_FIELD_SEED 1U
+#define ASTEROID_NUM_VARIANTS 32
+#define ASTEROID_NUM_LODS 5
+#define ASTEROID_GENERATOR_THREADS 0 // 0 uses every hardware thread but one.
+#define USE_ASTEROID_CACHE 1
+#define ASTEROID_CACHE_DIRECTORY "asteroidCache"
+
+// How the asteroids are drawn. Each body is an asteroid of ASTEROID_INSTANCE_SCALE times the cube
+//	root of its mass, at full detail until it's smaller than ASTEROID_FULL_DETAIL_PIXELS / 2 across
+//	(radius, in pixels), one LOD down every time its size halves after that, and an impostor below
+//	ASTEROID_IMPOSTOR_PIXELS. LODs switch ASTEROID_LOD_HYSTERESIS of a LOD late, so they don't flicker.
+#define ASTEROID_INSTANCE_SCALE 0.25f
+#define ASTEROID_FULL_DETAIL_PIXELS 64.0f
+#define ASTEROID_IMPOSTOR_PIXELS 3.0f
+#define ASTEROID_LOD_HYSTERESIS 0.2f
+
+// Cull the visible asteroids' clusters (up to 64 triangles each) too, by the frustum, their normal
+//	cones and the Hi-Z pyramid, and draw what's left of every mesh with one indirect draw a phase.
+//	ASTEROID_MAX_CLUSTERS is how many can be drawn a frame, the index buffer's sized for all of
+//	them being full (768 bytes each), and any over it are dropped.
+// Set VLA_CLUSTER_CULLING=0 to draw whole instances per slot and LOD instead.
+#define USE_CLUSTER_CULLING 1
+#define CLUSTER_CULLING_ENV "VLA_CLUSTER_CULLING"
+#define ASTEROID_MAX_CLUSTERS (64 * 1024)
+
+// Without cluster culling, every slot and LOD is drawn from the one mesh pool with a single
+//	multi-draw indirect call, if the device has multiDrawIndirect and drawIndirectFirstInstance.
+#define USE_MULTI_DRAW_INDIRECT 1
+
+// The camera circles the field inside the ring, looking along it.
+#define CAMERA_FOV_Y 1.0471976f // 60 degrees
+#define CAMERA_NEAR 0.1f
+#define CAMERA_FAR 500.0f
+#define CAMERA_ORBIT_RADIUS 60.0f
+#define CAMERA_ORBIT_HEIGHT 3.0f
+#define CAMERA_ORBIT_SPEED 0.05f // Radians per second
 
 PFN_vkCreateDebugUtilsMessengerEXT vkCreateDebugUtilsMessengerFunc;
 PFN_vkDestroyDebugUtilsMessengerEXT vkDestroyDebugUtilsMessengerEXTFunc;
 
-VkBool32 debugUtilsMessengerCallbackFunc(
-	VkDebugUtilsMessageSeverityFlagBitsEXT           messageSeverity,
-	VkDebugUtilsMessageTypeFlagsEXT                  messageType,
-	const VkDebugUtilsMessengerCallbackDataEXT*      pCallbackData,
-	void*                                            pUserData)
+static const char *getDepthFormatName(VkFormat format)
 {
-	switch (messageSeverity)
-	{
-	case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT: printf("VERBOSE "); break;
-	case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT: printf("INFO "); break;
-	case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT: printf("WARNING "); break;
-	case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT: printf("ERROR "); break;
-	default: printf("Unknown severity ");
-	}
-
-	switch (messageType)
+	switch (format)
 	{
-	case VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT: printf(" (GENERAL)"); break;
-	case VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT: printf(" (VALIDATION)"); break;
-	case VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT: printf(" (PERFORMANCE)"); break;
-	default: printf(" (Unknown type)");
+	case VK_FORMAT_D32_SFLOAT: return "VK_FORMAT_D32_SFLOAT";
+	case VK_FORMAT_D24_UNORM_S8_UINT: return "VK_FORMAT_D24_UNORM_S8_UINT";
+	case VK_FORMAT_D16_UNORM: return "VK_FORMAT_D16_UNORM";
+	default: return "Unknown depth format";
 	}
-
-	printf(": %s ", pCallbackData->pMessageIdName);
-	printf(": %d ", pCallbackData->messageIdNumber);
-	printf(": %s\n\n", pCallbackData->pMessage);
-
-	return VK_FALSE;
 }
 
 VulkanEngine::VulkanEngine(void)
@@ -55,80 +194,276 @@ VulkanEngine::VulkanEngine(void)
 
 VulkanEngine::~VulkanEngine(void)
 {
-	// Wait for the devices to finish their work.
-	for (auto device : devices)
+	// Init may have thrown before any device was created. Nothing below is called without one.
+	static const DeviceDispatch noDeviceDispatch;
+	const DeviceDispatch &dispatch = deviceDispatch.empty() ? noDeviceDispatch : deviceDispatch[0];
+	double runMs = frameNumber ? PresentLatencyTracker::millisecondsSince(firstFrameTime) : 0.0;
+
+	// Wait for the devices to finish their work. This is the only place the engine idles a device.
+	for (uint32_t i = 0; i < deviceDispatch.size(); i++)
 	{
-		VkResult result = vkDeviceWaitIdle(devices[0]);
+		VkResult result = deviceDispatch[i].vkDeviceWaitIdle(devices[i]);
 		if (result != VK_SUCCESS)
-			fprintf(stderr, "Vulkan Error: Failed to wait for device 0 to idle : %X\n", result);
+			fprintf(stderr, "Vulkan Error: Failed to wait for device %u to idle : %X\n", i, result);
 	}
 
-	// Destroy the graphics pipeline
-	if (simpleGraphicsPipeline)
-		vkDestroyPipeline(devices[0], simpleGraphicsPipeline, nullptr);
-
-	// Destroy the pipeline layout
-	if (simplePipelineLayout)
-		vkDestroyPipelineLayout(devices[0], simplePipelineLayout, nullptr);
+	// Everything still waiting on the GPU can go now.
+	if (VERBOSE && !devices.empty())
+		deletionQueue.printStats();
+	deletionQueue.destroyAll();
+
+	if (VERBOSE && frameNumber)
+		presentLatency.printStats();
+
+	// Destroy the frame synchronization objects
+	if (VERBOSE && frameNumber)
+		graphicsTimeline.printStats();
+	graphicsTimeline.destroy();
+	if (VERBOSE && frameNumber && asyncComputeEnabled)
+		computeTimeline.printStats();
+	computeTimeline.destroy();
+	for (VkSemaphore semaphore : imageAvailableSemaphores)
+		dispatch.vkDestroySemaphore(devices[0], semaphore, hostMemory.getCallbacks(HOST_SCOPE_DEVICE));
+	for (VkSemaphore semaphore : physicsDoneSemaphores)
+		dispatch.vkDestroySemaphore(devices[0], semaphore, hostMemory.getCallbacks(HOST_SCOPE_DEVICE));
+
+	// Destroy the GPU profiler
+	if (VERBOSE && frameNumber)
+		gpuProfiler.printStats();
+	gpuProfiler.destroy(hostMemory.getCallbacks(HOST_SCOPE_DEVICE));
+
+	// How much of the run each device's GPU spent working.
+	if (VERBOSE && frameNumber && gpuProfiler.isEnabled())
+	{
+		double msPerFrame = runMs / frameNumber;
+		printf("Device utilization (%.3lf ms/frame):\n", msPerFrame);
+		printf("\tDevice 0: %.1lf%%\n", 100.0 * gpuProfiler.getBusyMsPerFrame() / msPerFrame);
+		for (uint32_t i = 0; i < secondaryWorkers.size(); i++)
+			printf("\tDevice %u: %.1lf%%\n", i + 1, 100.0 * secondaryWorkers[i].getBusyMsPerFrame() / msPerFrame);
+	}
 
-	// Destroy the pipeline cache
+	// Destroy the asteroid renderer
+	if (VERBOSE && frameNumber)
+		asteroidRenderer.printStats();
+	asteroidRenderer.destroy();
+
+	// Destroy the Hi-Z pyramid
+	if (VERBOSE && frameNumber && occlusionCullingEnabled)
+		hiZPyramid.printStats();
+	hiZPyramid.destroy();
+
+	// Stop the asteroid generator, then release the mesh pool
+	if (VERBOSE && !devices.empty())
+		asteroidField.printStats();
+	asteroidField.destroy();
+	if (VERBOSE && !devices.empty())
+		meshPool.printStats();
+	meshPool.destroy();
+
+	// Destroy the physics simulation
+	physics.destroy(hostMemory.getCallbacks(HOST_SCOPE_PIPELINE));
+	for (SecondaryDeviceWorker &worker : secondaryWorkers)
+	{
+		if (VERBOSE && frameNumber)
+			worker.printStats();
+		worker.destroy(hostMemory.getCallbacks(HOST_SCOPE_DEVICE));
+	}
+	if (remoteBodiesBuffer)
+		dispatch.vkDestroyBuffer(devices[0], remoteBodiesBuffer, hostMemory.getCallbacks(HOST_SCOPE_DEVICE));
+	if (remoteBodiesMemory)
+		dispatch.vkFreeMemory(devices[0], remoteBodiesMemory, hostMemory.getCallbacks(HOST_SCOPE_DEVICE));
+	if (remoteStagingBuffer)
+		dispatch.vkDestroyBuffer(devices[0], remoteStagingBuffer, hostMemory.getCallbacks(HOST_SCOPE_DEVICE));
+	if (remoteStagingMemory)
+		dispatch.vkFreeMemory(devices[0], remoteStagingMemory, hostMemory.getCallbacks(HOST_SCOPE_DEVICE));
+
+	// Save the pipeline cache (with the kernel tuning) for the next run, and destroy it
 	if (pipelineCache)
-		vkDestroyPipelineCache(devices[0], pipelineCache, nullptr);
+	{
+		size_t pipelineCacheSize = 0;
+		if (USE_PIPELINE_CACHE_FILE
+			&& dispatch.vkGetPipelineCacheData(devices[0], pipelineCache, &pipelineCacheSize, nullptr) == VK_SUCCESS)
+		{
+			std::vector<char> pipelineCacheData(pipelineCacheSize);
+			if (dispatch.vkGetPipelineCacheData(devices[0], pipelineCache, &pipelineCacheSize, pipelineCacheData.data()) == VK_SUCCESS)
+			{
+				pipelineCacheData.resize(pipelineCacheSize);
+				savePipelineCacheFile(PIPELINE_CACHE_FILE, primaryDeviceProperties, pipelineCacheData, kernelTuning);
+			}
+		}
+		dispatch.vkDestroyPipelineCache(devices[0], pipelineCache, hostMemory.getCallbacks(HOST_SCOPE_PIPELINE));
+	}
 	
-	// Destroy the descriptor set layout
-	if (simpleDescriptorSetLayout)
-		vkDestroyDescriptorSetLayout(devices[0], simpleDescriptorSetLayout, nullptr);
+	// Destroy the bindless descriptor table
+	bindlessTable.destroy();
+
+	// Release the frame upload arena
+	if (VERBOSE)
+		uploadArena.printStats();
+	uploadArena.destroy();
+
+	// Destroy the framebuffers and what they're made of
+	for (VkFramebuffer framebuffer : framebuffers)
+		dispatch.vkDestroyFramebuffer(devices[0], framebuffer, hostMemory.getCallbacks(HOST_SCOPE_SWAPCHAIN));
+	for (VkImageView imageView : swapchainImageViews)
+		dispatch.vkDestroyImageView(devices[0], imageView, hostMemory.getCallbacks(HOST_SCOPE_SWAPCHAIN));
+	if (VERBOSE && depthImageViews[0])
+	{
+		printf("Depth buffer stats:\n");
+		printf("\tFormat: %s, reversed Z%s\n", getDepthFormatName(depthFormat),
+			occlusionCullingEnabled ? ", stored for occlusion culling" : "");
+	}
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		if (depthImageViews[i])
+			dispatch.vkDestroyImageView(devices[0], depthImageViews[i], hostMemory.getCallbacks(HOST_SCOPE_SWAPCHAIN));
+		if (depthSampledViews[i])
+			dispatch.vkDestroyImageView(devices[0], depthSampledViews[i], hostMemory.getCallbacks(HOST_SCOPE_SWAPCHAIN));
+		if (sceneColorViews[i])
+			dispatch.vkDestroyImageView(devices[0], sceneColorViews[i], hostMemory.getCallbacks(HOST_SCOPE_SWAPCHAIN));
+	}
+	if (VERBOSE && frameNumber && dynamicResolutionEnabled)
+		dynamicResolution.printStats();
+
+	// Destroy the render graph, and its transients (the depth buffers among them)
+	if (VERBOSE && frameNumber)
+		renderGraph.printStats();
+	renderGraph.destroy();
 
-	// Kill the render pass
+	// Kill the render passes
 	if (simpleRenderPass)
-		vkDestroyRenderPass(devices[0], simpleRenderPass, nullptr);
+		dispatch.vkDestroyRenderPass(devices[0], simpleRenderPass, hostMemory.getCallbacks(HOST_SCOPE_PIPELINE));
+	if (lateRenderPass)
+		dispatch.vkDestroyRenderPass(devices[0], lateRenderPass, hostMemory.getCallbacks(HOST_SCOPE_PIPELINE));
 
-	// Destroy the shader modules
-	if (simpleVertexShaderModule)
-		vkDestroyShaderModule(devices[0], simpleVertexShaderModule, nullptr);
-	if (simpleFragmentShaderModule)
-		vkDestroyShaderModule(devices[0], simpleFragmentShaderModule, nullptr);
+	// Destroy the shader libraries (and the shader modules they own)
+	for (uint32_t i = 0; i < shaderLibraries.size(); i++)
+	{
+		if (VERBOSE)
+		{
+			char name[32];
+			snprintf(name, sizeof(name), "Device %u", i);
+			shaderLibraries[i].printStats(name);
+		}
+		shaderLibraries[i].destroy();
+	}
 
 	// Kill the swapchain
+	for (VkSemaphore semaphore : renderFinishedSemaphores)
+		dispatch.vkDestroySemaphore(devices[0], semaphore, hostMemory.getCallbacks(HOST_SCOPE_SWAPCHAIN));
 	if (swapchain)
-		vkDestroySwapchainKHR(devices[0], swapchain, nullptr);
+		dispatch.vkDestroySwapchainKHR(devices[0], swapchain, hostMemory.getCallbacks(HOST_SCOPE_SWAPCHAIN));
 
 	// Kill the command pool
 	for (uint32_t i = 0; i < commandPools.size(); i++)
-		vkDestroyCommandPool(devices[i], commandPools[i], nullptr);
+		deviceDispatch[i].vkDestroyCommandPool(devices[i], commandPools[i], hostMemory.getCallbacks(HOST_SCOPE_DEVICE));
+	if (computeCommandPool)
+		dispatch.vkDestroyCommandPool(devices[0], computeCommandPool, hostMemory.getCallbacks(HOST_SCOPE_DEVICE));
 
 	// Kill the devices
-	for (auto device : devices)
-		vkDestroyDevice(device, nullptr);
+	for (uint32_t i = 0; i < deviceDispatch.size(); i++)
+		deviceDispatch[i].vkDestroyDevice(devices[i], hostMemory.getCallbacks(HOST_SCOPE_DEVICE));
 
-	// Cleanup the memory used for the physical devices
-	if (physicalDevices) delete[] physicalDevices;
+	// Kill the surface (SDL created it without allocation callbacks)
+	if (surface)
+		vkDestroySurfaceKHR(instance, surface, nullptr);
 
 	if (debugUtilsMessenger)
-		vkDestroyDebugUtilsMessengerEXTFunc(instance, debugUtilsMessenger, nullptr);
+		vkDestroyDebugUtilsMessengerEXTFunc(instance, debugUtilsMessenger, hostMemory.getCallbacks(HOST_SCOPE_INSTANCE));
+
+	// Print whatever the logger thread hasn't gotten to yet, then what it saw over the run.
+	if (debugSink.isRunning())
+	{
+		debugSink.stop();
+		debugSink.printSummary();
+	}
 
 	// Kill the instance.
 	if (instance)
-		vkDestroyInstance(instance, nullptr);
+		vkDestroyInstance(instance, hostMemory.getCallbacks(HOST_SCOPE_INSTANCE));
+
+	// Everything's destroyed, so any host memory still in use here was leaked.
+	if (VERBOSE)
+	{
+		hostMemory.printReport();
+		initArena.printStats("Init");
+	}
 }
 
 void VulkanEngine::init(SDL_Window *sdlWindow, int screenWidth, int screenHeight)
 {
+	// Time each phase of init, so it's obvious where startup time goes.
+	std::vector<std::pair<const char *, double>> initTimings;
+	PresentLatencyTracker::Clock::time_point initStart = PresentLatencyTracker::Clock::now();
+	PresentLatencyTracker::Clock::time_point phaseStart = initStart;
+	auto endPhase = [&](const char *phaseName) {
+		initTimings.push_back(std::make_pair(phaseName, PresentLatencyTracker::millisecondsSince(phaseStart)));
+		phaseStart = PresentLatencyTracker::Clock::now();
+	};
+
+	window = sdlWindow;
 	createInstance(sdlWindow);
+	createSurface(sdlWindow); // Before the devices, which are scored on whether they can present to it.
+	endPhase("Instance and surface");
 	createDevices();
-	createSurface(sdlWindow);
-	createSwapchain(static_cast<uint32_t>(screenWidth), static_cast<uint32_t>(screenHeight));
+	deletionQueue.init(devices[0], deviceDispatch[0]);
+	createShaderLibraries();
+	endPhase("Devices");
+	if (!createSwapchain(static_cast<uint32_t>(screenWidth), static_cast<uint32_t>(screenHeight)))
+		swapchainOutOfDate = true; // Window started out with no size, try again on the first frame.
+	endPhase("Swapchain");
 	createCommandPools();
-	createGraphicsPipeline();
+	createSyncObjects();
+	endPhase("Command pools and sync objects");
+	createUploadArena();
+	endPhase("Upload arena");
+	createMeshPool();
+	endPhase("Mesh pool");
+	createAsteroidField();
+	endPhase("Asteroid field (started)");
+	createRenderPass();
+	createPipelineCache();
+	if (!swapchainOutOfDate)
+		createFramebuffers();
+	endPhase("Render passes and pipeline cache");
+	createPhysics();
+	endPhase("Physics");
+	createAsteroidRenderer();
+	endPhase("Asteroid renderer");
+
+	if (VERBOSE)
+	{
+		printf("Init timings:\n");
+		for (const std::pair<const char *, double> &timing : initTimings)
+			printf("\t%s: %.3lf ms\n", timing.first, timing.second);
+		printf("\tTotal: %.3lf ms\n", PresentLatencyTracker::millisecondsSince(initStart));
+	}
+
+	if (ENABLE_DISPATCH_BENCHMARK || isEnvironmentFlagSet(DISPATCH_BENCHMARK_ENV))
+		benchmarkDeviceDispatch(devices[0], deviceDispatch[0], commandPools[0]);
+
+	if (ENABLE_MESH_BENCHMARK || isEnvironmentFlagSet(MESH_BENCHMARK_ENV))
+	{
+		MeshData benchmarkMesh;
+		buildIcosphereMesh(MESH_BENCHMARK_LODS, benchmarkMesh);
+		if (writeMeshFile(MESH_BENCHMARK_FILE, benchmarkMesh, meshPool.getVertexFormat()))
+			benchmarkMeshLoading(meshPool, graphicsTimeline, MESH_BENCHMARK_FILE, MESH_BENCHMARK_LOADS);
+	}
 }
 
 void VulkanEngine::createInstance(SDL_Window *sdlWindow)
 {
+	validationEnabled = isEnvironmentFlagSet(VALIDATION_ENV, ENABLE_VALIDATION_LAYER != 0);
+	if (VERBOSE)
+		printf("Validation layer: %s\n", validationEnabled ? "Enabled" : "Disabled");
+
+	// Query the instance layers and extensions once, everything below checks against this.
+	capabilities.queryInstance();
+
 	// Get the Vulkan instance version
 	if (VERBOSE)
 	{
-		uint32_t apiVersion = 0;
-		HANDLE_VK(vkEnumerateInstanceVersion(&apiVersion), "Getting Vulkan instance version");
+		uint32_t apiVersion = capabilities.getInstanceVersion();
 		printf("Vulkan Instance Version: %u.%u.%u\n",
 			VK_VERSION_MAJOR(apiVersion),
 			VK_VERSION_MINOR(apiVersion),
@@ -137,53 +472,21 @@ void VulkanEngine::createInstance(SDL_Window *sdlWindow)
 
 	// Print the instance capabilities out to the user
 	if (VERBOSE)
-		printInstanceCapabilities();
+		printInstanceCapabilities(capabilities);
 
 	//////////////////////////////////////////////////////////////
 	// Check for the required instances
 	//////////////////////////////////////////////////////////////
 	std::vector<const char *> requiredInstanceLayers;
-	if (ENABLE_VALIDATION_LAYER)
+	if (validationEnabled)
 		requiredInstanceLayers.push_back("VK_LAYER_LUNARG_standard_validation");
 
-	if (requiredInstanceLayers.size())
+	for (const char *requiredInstanceLayer : requiredInstanceLayers)
 	{
-		// Get what the instance layer properties are available.
-		uint32_t numInstanceProperties;
-		HANDLE_VK(vkEnumerateInstanceLayerProperties(&numInstanceProperties, nullptr),
-			"Querying number of Vulkan instance layer properties");
-		VkLayerProperties *instanceLayerProperties = numInstanceProperties ? new VkLayerProperties[numInstanceProperties] : nullptr;
-		if (instanceLayerProperties)
+		if (!capabilities.hasInstanceLayer(requiredInstanceLayer))
 		{
-			HANDLE_VK(vkEnumerateInstanceLayerProperties(&numInstanceProperties, instanceLayerProperties),
-				"Querying Vulkan instance layer properties");
-
-			for (const char *requiredInstanceLayer : requiredInstanceLayers)
-			{
-				bool found = false;
-				for (uint32_t i = 0; i < numInstanceProperties; i++)
-				{
-					if (strcmp(requiredInstanceLayer, instanceLayerProperties[i].layerName) == 0)
-					{
-						found = true;
-						break;
-					}
-				}
-				if (!found)
-				{
-					fprintf(stderr, "Error (%s:%u): Failed to find required instance layer \"%s\"\n",
-						__FILE__, __LINE__, requiredInstanceLayer);
-					throw std::runtime_error("Failed to find required instance layers");
-				}
-			}
-
-			// Cleanup
-			if (instanceLayerProperties) delete[] instanceLayerProperties;
-		}
-		else
-		{
-			fprintf(stderr, "ERROR (%s:%u): No instance layers found, but %zu are required.\n",
-				__FILE__, __LINE__, requiredInstanceLayers.size());
+			fprintf(stderr, "Error (%s:%u): Failed to find required instance layer \"%s\"\n",
+				__FILE__, __LINE__, requiredInstanceLayer);
 			throw std::runtime_error("Failed to find required instance layers");
 		}
 	}
@@ -203,7 +506,7 @@ void VulkanEngine::createInstance(SDL_Window *sdlWindow)
 	}
 
 	std::vector<const char *> requiredExtensions;
-	if (ENABLE_VALIDATION_LAYER)
+	if (validationEnabled)
 		requiredExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 
 	requiredExtensions.resize(requiredExtensions.size() + numRequiredExtensionsSDL);
@@ -216,23 +519,10 @@ void VulkanEngine::createInstance(SDL_Window *sdlWindow)
 		throw std::runtime_error(errMsg);
 	}
 
-	// Get the available instance extensions.
-	uint32_t numInstanceExtensions;
-	HANDLE_VK(vkEnumerateInstanceExtensionProperties("", &numInstanceExtensions, nullptr), "Fetching number of Vulkan instance extensions");
-	VkExtensionProperties *instanceExtensions = numInstanceExtensions ? new VkExtensionProperties[numInstanceExtensions] : nullptr;
-	HANDLE_VK(vkEnumerateInstanceExtensionProperties("", &numInstanceExtensions, instanceExtensions), "Fetching Vulkan instance extensions");
-
 	// Verify the required extensions are available.
 	for (const char *requiredExtension : requiredExtensions)
 	{
-		bool found = false;
-		for (unsigned int i = 0; i < numInstanceExtensions; i++)
-			if (strcmp(requiredExtension, instanceExtensions[i].extensionName) == 0)
-			{
-				found = true;
-				break;
-			}
-		if (!found)
+		if (!capabilities.hasInstanceExtension(requiredExtension))
 		{
 			char errMsg[1024];
 			snprintf(errMsg, 1024, "Error(%s:%u): Required Vulkan instance extension \"%s\" is not available.\n",
@@ -242,9 +532,6 @@ void VulkanEngine::createInstance(SDL_Window *sdlWindow)
 		}
 	}
 
-	if (instanceExtensions)
-		delete[] instanceExtensions;
-
 	/////////////////////////////////////////////////////////////
 	// Create the Vulkan instance.
 	/////////////////////////////////////////////////////////////
@@ -269,12 +556,15 @@ void VulkanEngine::createInstance(SDL_Window *sdlWindow)
 		requiredExtensions.data()  // Enabled extension names
 	};
 
-	HANDLE_VK(vkCreateInstance(&instanceCreateInfo, nullptr, &instance), "Creating Vulkan instance");
+	HANDLE_VK(vkCreateInstance(&instanceCreateInfo, hostMemory.getCallbacks(HOST_SCOPE_INSTANCE), &instance), "Creating Vulkan instance");
+	capabilities.setEnabledInstanceLayers(static_cast<uint32_t>(requiredInstanceLayers.size()), requiredInstanceLayers.data());
 	khrSurfaceExtEnabled = true; // SDL requires KHR_surface so we know it's enabled.
 
 	// Enable debugging
-	if (ENABLE_VALIDATION_LAYER)
+	if (validationEnabled)
 	{
+		debugSink.start(DEBUG_SINK_QUEUE_SIZE, DEBUG_SINK_MAX_REPEATS, DEBUG_SINK_MAX_PRINTS_PER_SECOND);
+
 		VkDebugUtilsMessengerCreateInfoEXT debugUtilsMessengerCreateInfo = {
 			VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
 			nullptr, // pNext
@@ -286,8 +576,8 @@ void VulkanEngine::createInstance(SDL_Window *sdlWindow)
 			VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT
 				| VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
 				| VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
-			debugUtilsMessengerCallbackFunc,
-			nullptr
+			DebugMessageSink::callback,
+			&debugSink // User data
 		};
 
 		vkCreateDebugUtilsMessengerFunc = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
@@ -295,7 +585,7 @@ void VulkanEngine::createInstance(SDL_Window *sdlWindow)
 
 		vkDestroyDebugUtilsMessengerEXTFunc = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
 
-		HANDLE_VK(vkCreateDebugUtilsMessengerFunc(instance, &debugUtilsMessengerCreateInfo, nullptr, &debugUtilsMessenger),
+		HANDLE_VK(vkCreateDebugUtilsMessengerFunc(instance, &debugUtilsMessengerCreateInfo, hostMemory.getCallbacks(HOST_SCOPE_INSTANCE), &debugUtilsMessenger),
 			"Creating the Debug Utils Messenger. Cause let's face it... This got a lot harder than I expected...");
 	}
 }
@@ -303,13 +593,15 @@ void VulkanEngine::createInstance(SDL_Window *sdlWindow)
 void VulkanEngine::createDevices(void)
 {
 	std::vector<const char *> requiredDeviceLayers;
-	if (ENABLE_VALIDATION_LAYER)
+	if (validationEnabled)
 		requiredDeviceLayers.push_back("VK_LAYER_LUNARG_standard_validation");
 
 	std::vector<const char *> requiredDeviceExtensions = {
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME
 	};
 
+	bool asyncComputeRequested = isEnvironmentFlagSet(ASYNC_COMPUTE_ENV, ENABLE_ASYNC_COMPUTE != 0);
+
 	// Get the physical devices.
 	HANDLE_VK(vkEnumeratePhysicalDevices(instance, &numPhysicalDevices, nullptr),
 		"Querying the number of Vulkan physical devices");
@@ -318,187 +610,294 @@ void VulkanEngine::createDevices(void)
 		fprintf(stderr, "ERROR (%s:%u): No Vulkan physical devices detected!\n", __FILE__, __LINE__);
 		throw std::runtime_error("No Vulkan physical devices detected");
 	}
-	physicalDevices = new VkPhysicalDevice[numPhysicalDevices];
-	HANDLE_VK(vkEnumeratePhysicalDevices(instance, &numPhysicalDevices, physicalDevices),
+	physicalDevices.resize(numPhysicalDevices);
+	HANDLE_VK(vkEnumeratePhysicalDevices(instance, &numPhysicalDevices, physicalDevices.data()),
 		"Querying Vulkan physical devices");
 
-	// Print the physical device properties for the user.
+	// Snapshot what each physical device supports. (Loaded from the cache when the driver hasn't changed.)
+	capabilities.queryPhysicalDevices(numPhysicalDevices, physicalDevices.data(), USE_CAPABILITY_CACHE ? CAPABILITY_CACHE_FILE : nullptr);
+
+	// Rank the devices and move the best one to the front, everything after this renders on physicalDevices[0].
+	std::string overrideDevice;
+	readEnvironmentVariable(DEVICE_OVERRIDE_ENV, overrideDevice);
+	std::vector<PhysicalDeviceScore> deviceScores = scorePhysicalDevices(capabilities, physicalDevices.data(), surface,
+		requiredDeviceExtensions, ENABLE_DEVICE_PROBE || isEnvironmentFlagSet(DEVICE_PROBE_ENV));
+	std::vector<uint32_t> deviceOrder = rankPhysicalDevices(capabilities, deviceScores, overrideDevice.c_str());
 	if (VERBOSE)
-		printPhysicalDeviceDetails(numPhysicalDevices, physicalDevices, PRINT_FULL_DEVICE_DETAILS);
+		printPhysicalDeviceScores(capabilities, deviceScores, deviceOrder);
 
-	// Get the physical device queue families.
+	HostArenaScope arenaScope(initArena);
+	VkPhysicalDevice *enumeratedDevices = initArena.allocateArray<VkPhysicalDevice>(numPhysicalDevices);
+	memcpy(enumeratedDevices, physicalDevices.data(), sizeof(VkPhysicalDevice) * numPhysicalDevices);
 	for (uint32_t i = 0; i < numPhysicalDevices; i++)
-	{
-		uint32_t numQueueFamilies;
-		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevices[i], &numQueueFamilies, nullptr);
-		VkQueueFamilyProperties *queueFamilyProperties = numQueueFamilies ? new VkQueueFamilyProperties[numQueueFamilies] : nullptr;
-		if (queueFamilyProperties)
-			vkGetPhysicalDeviceQueueFamilyProperties(physicalDevices[i], &numQueueFamilies, queueFamilyProperties);
-		physicalDeviceQueueFamilies.push_back(std::make_pair(numQueueFamilies, queueFamilyProperties));
-	}
+		physicalDevices[i] = enumeratedDevices[deviceOrder[i]];
+	capabilities.reorderDevices(deviceOrder);
+
+	// Print the physical device properties for the user.
+	if (VERBOSE)
+		printPhysicalDeviceDetails(capabilities, physicalDevices.data(), PRINT_FULL_DEVICE_DETAILS);
+	if (VERBOSE && PRINT_FULL_DEVICE_DETAILS)
+		printPhysicalSurfaceDetails(physicalDevices.data(), numPhysicalDevices, surface);
 
 	if (VERBOSE && USE_MULTI_GPU && numPhysicalDevices > 1)
 		printf("Using Multi-GPU\n");
 	for (uint32_t i = 0; i < (USE_MULTI_GPU ? numPhysicalDevices : 1); i++)
 	{
 		VkDevice device;
+		const VulkanCapabilities::DeviceInfo &deviceInfo = capabilities.getDevice(i);
+		const std::vector<VkQueueFamilyProperties> &queueFamilies = deviceInfo.queueFamilies;
 
 		// Find which queue family has the graphics capability
 		uint32_t graphicsQueueIndex = ~0U;
 		uint32_t transferQueueIndex = ~0U;
+		uint32_t computeQueueIndex = ~0U;
 		uint8_t selectedTransferQueueNumFlags = 0xFF;
-		for (uint32_t j = 0; j < physicalDeviceQueueFamilies[i].first; j++)
+		uint8_t selectedComputeQueueNumFlags = 0xFF;
+		for (uint32_t j = 0; j < queueFamilies.size(); j++)
 		{
 			// Find the first graphics capable queue family
 			if (graphicsQueueIndex == ~0U
-				&& physicalDeviceQueueFamilies[i].second[j].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+				&& queueFamilies[j].queueFlags & VK_QUEUE_GRAPHICS_BIT)
 			{
 				graphicsQueueIndex = j;
 			}
 
 			// Select the Transfer capable queue with the least other capabilities (preferably a transfer-only queue family).
 			uint8_t numFlags = 0;
-			VkQueueFlags flags = physicalDeviceQueueFamilies[i].second[j].queueFlags;
+			VkQueueFlags flags = queueFamilies[j].queueFlags;
 			do numFlags += flags & 1; while (flags = (flags >> 1));
-			if (physicalDeviceQueueFamilies[i].second[j].queueFlags & VK_QUEUE_TRANSFER_BIT
+			if (queueFamilies[j].queueFlags & VK_QUEUE_TRANSFER_BIT
 				&& numFlags < selectedTransferQueueNumFlags)
 			{
 				transferQueueIndex = j;
 				selectedTransferQueueNumFlags = numFlags;
 			}
+
+			// Same for async compute, but it has to be a family without graphics.
+			if (queueFamilies[j].queueFlags & VK_QUEUE_COMPUTE_BIT
+				&& !(queueFamilies[j].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+				&& numFlags < selectedComputeQueueNumFlags)
+			{
+				computeQueueIndex = j;
+				selectedComputeQueueNumFlags = numFlags;
+			}
 		}
 
+		// Only the primary device runs physics. Without a compute only family, try for a second
+		//	queue in the graphics family (see addQueue below).
+		bool useAsyncCompute = asyncComputeRequested && i == 0;
+		if (!useAsyncCompute || computeQueueIndex == ~0U)
+			computeQueueIndex = graphicsQueueIndex;
+
 		if (VERBOSE)
 			printf("Graphics Queue Family Index: %u\n"
-				   "Transfer Queue Family Index: %u\n",
-				graphicsQueueIndex, transferQueueIndex);
+				   "Transfer Queue Family Index: %u\n"
+				   "Compute Queue Family Index: %u\n",
+				graphicsQueueIndex, transferQueueIndex, computeQueueIndex);
 
 		// Check for required layers.
-		if (requiredDeviceLayers.size())
+		for (const char *requiredLayer : requiredDeviceLayers)
 		{
-			uint32_t numLayers;
-			HANDLE_VK(vkEnumerateDeviceLayerProperties(physicalDevices[i], &numLayers, nullptr),
-				"Getting number of device layers on physical device %u", i);
-			if (!numLayers)
+			if (!deviceInfo.hasLayer(requiredLayer))
 			{
-				fprintf(stderr, "Error (%s:%u): No device layers found, but there are %zu required layers\n",
-					__FILE__, __LINE__, requiredDeviceLayers.size());
+				fprintf(stderr, "Error (%s:%u): Failed to find required layer \"%s\"\n",
+					__FILE__, __LINE__, requiredLayer);
 				throw std::runtime_error("Failed to find required device layers");
 			}
-			VkLayerProperties *layers = new VkLayerProperties[numLayers];
-			if (layers)
+		}
+
+		// Check for required extensions.
+		for (const char *requiredDeviceExtension : requiredDeviceExtensions)
+		{
+			if (!deviceInfo.hasExtension(requiredDeviceExtension))
 			{
-				HANDLE_VK(vkEnumerateDeviceLayerProperties(physicalDevices[i], &numLayers, layers),
-					"Getting device layers on physical device %u", i);
-				for (const char *requiredLayer : requiredDeviceLayers)
-				{
-					bool found = false;
-					for (uint32_t j = 0; j < numLayers; j++)
-					{
-						if (strcmp(requiredLayer, layers[j].layerName) == 0)
-						{
-							found = true;
-							break;
-						}
-					}
-					if (!found)
-					{
-						fprintf(stderr, "Error (%s:%u): Failed to find required layer \"%s\"\n",
-							__FILE__, __LINE__, requiredLayer);
-						throw std::runtime_error("Failed to find required device layers");
-					}
-				}
+				fprintf(stderr, "Error (%s:%u): Failed to find required device extension \"%s\" on physical device %u",
+					__FILE__, __LINE__,
+					requiredDeviceExtension,
+					i);
+				throw std::runtime_error("Device does not have required extensions");
+			}
+		}
 
-				delete[] layers;
+		// Check if bindless descriptors can be used. Only the primary (rendering) device needs them.
+		// Optional features get pushed onto the front of the enabledFeatures2 pNext chain.
+		std::vector<const char *> deviceExtensions = requiredDeviceExtensions;
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures = {};
+		VkPhysicalDeviceFeatures2 enabledFeatures2 = {};
+		enabledFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		if (USE_BINDLESS && i == 0)
+		{
+			maxBindlessBuffers = BINDLESS_MAX_BUFFERS;
+			maxBindlessImages = BINDLESS_MAX_IMAGES;
+			if (deviceInfo.hasExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)
+				&& BindlessDescriptorTable::querySupport(physicalDevices[i], descriptorIndexingFeatures,
+					maxBindlessBuffers, maxBindlessImages))
+			{
+				deviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+				descriptorIndexingFeatures.pNext = enabledFeatures2.pNext;
+				enabledFeatures2.pNext = &descriptorIndexingFeatures;
+				bindlessEnabled = true;
 			}
+
+			if (VERBOSE)
+				printf("Bindless descriptors: %s\n", bindlessEnabled ? "Enabled" : "Not supported, using classic descriptor sets");
 		}
 
-		// Check for required extensions.
-		uint32_t numDeviceExtensions;
-		HANDLE_VK(vkEnumerateDeviceExtensionProperties(physicalDevices[i], "", &numDeviceExtensions, nullptr),
-			"Getting number of device extensions on physical device %u", i);
-		if (!numDeviceExtensions)
+		// Check for timeline semaphores (core in 1.2, but we ask for a 1.1 instance so it's the KHR extension).
+		VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures = {};
+		timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+		if (ENABLE_TIMELINE_SEMAPHORES && i == 0 && deviceInfo.timelineSemaphore)
 		{
-			fprintf(stderr, "Error (%s:%u): Physical device %u does not have any device extensions\n", __FILE__, __LINE__, i);
-			throw std::runtime_error("Device does not have required extensions");
+			deviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+			timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+			timelineSemaphoreFeatures.pNext = enabledFeatures2.pNext;
+			enabledFeatures2.pNext = &timelineSemaphoreFeatures;
+			timelineSemaphoresEnabled = true;
 		}
-		VkExtensionProperties *exts = new VkExtensionProperties[numDeviceExtensions];
-		HANDLE_VK(vkEnumerateDeviceExtensionProperties(physicalDevices[i], "", &numDeviceExtensions, exts),
-			"Getting device extensions on physical device %u", i);
 
-		for (uint32_t j = 0; j < requiredDeviceExtensions.size(); j++)
+		// Multi-draw indirect, for drawing every asteroid slot and LOD in one call.
+		if (USE_MULTI_DRAW_INDIRECT && i == 0)
 		{
-			bool found = false;
-			for (uint32_t k = 0; k < numDeviceExtensions; k++)
+			if (deviceInfo.features.multiDrawIndirect && deviceInfo.features.drawIndirectFirstInstance)
 			{
-				if (strcmp(requiredDeviceExtensions[j], exts[k].extensionName) == 0)
-				{
-					found = true;
-					break;
-				}
+				enabledFeatures2.features.multiDrawIndirect = VK_TRUE;
+				enabledFeatures2.features.drawIndirectFirstInstance = VK_TRUE;
+				multiDrawIndirectEnabled = true;
 			}
-			if (!found)
+
+			if (VERBOSE)
+				printf("Multi-draw indirect: %s\n", multiDrawIndirectEnabled ? "Enabled" : "Not supported, one draw per slot and LOD");
+		}
+
+		// Pick the queues. Each family gets one create info, and asking for a family again adds
+		//	another queue to it while the family has more. Returns the queue's index in its family.
+		float queuePriorities[] = { 1.0f, 1.0f };
+		std::vector<VkDeviceQueueCreateInfo> deviceQueueCreateInfos;
+		auto addQueue = [&](uint32_t family) -> uint32_t {
+			for (VkDeviceQueueCreateInfo &queueCreateInfo : deviceQueueCreateInfos)
 			{
-				fprintf(stderr, "Error (%s:%u): Failed to find required device extension \"%s\" on physical device %u",
-					__FILE__, __LINE__,
-					requiredDeviceExtensions[j],
-					i);
-				throw std::runtime_error("Device does not have required extensions");
+				if (queueCreateInfo.queueFamilyIndex == family)
+				{
+					if (queueCreateInfo.queueCount < queueFamilies[family].queueCount && queueCreateInfo.queueCount < 2)
+						queueCreateInfo.queueCount++;
+					return queueCreateInfo.queueCount - 1;
+				}
 			}
-		}
 
-		if (exts)
-			delete[] exts;
-		
-		// Create the device
-		float queuePriorities[] = { 1.0f };
-		VkDeviceQueueCreateInfo deviceQueueCreateInfo[] = {
-			{ // Graphics Queue
-				VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-				nullptr, // pNext
-				0, // Flags
-				graphicsQueueIndex, // Queue Family Index
-				1, // Number of queues to make
-				queuePriorities // Queue priorities
-			},
-			{ // Transfer queue
+			VkDeviceQueueCreateInfo queueCreateInfo = {
 				VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
 				nullptr, // pNext
 				0, // Flags
-				transferQueueIndex, // Queue Family Index
+				family, // Queue Family Index
 				1, // Number of queues to make
 				queuePriorities // Queue priorities
-			}
+			};
+			deviceQueueCreateInfos.push_back(queueCreateInfo);
+			return 0;
 		};
+
+		addQueue(graphicsQueueIndex);
+		if (USE_MULTI_GPU && graphicsQueueIndex != transferQueueIndex)
+			addQueue(transferQueueIndex);
+		uint32_t computeQueueNumber = 0;
+		if (useAsyncCompute)
+		{
+			computeQueueNumber = addQueue(computeQueueIndex);
+
+			// Ended up on the graphics queue itself, so nothing would run asynchronously.
+			if (computeQueueIndex == graphicsQueueIndex && computeQueueNumber == 0)
+				useAsyncCompute = false;
+		}
+
+		if (VERBOSE && i == 0)
+		{
+			if (!useAsyncCompute)
+				printf("Async compute: Disabled, physics runs on the graphics queue\n");
+			else if (computeQueueIndex != graphicsQueueIndex)
+				printf("Async compute: Compute only queue family %u\n", computeQueueIndex);
+			else
+				printf("Async compute: Second queue of the graphics family\n");
+		}
+
+		// Create the device
 		VkDeviceCreateInfo deviceCreateInfo = {
 			VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-			nullptr, // pNext - TODO: There are some features we can add here.
+			&enabledFeatures2, // pNext - Features to enable are chained here.
 			0, // Flags, reserved for future use.
-			USE_MULTI_GPU && graphicsQueueIndex != transferQueueIndex ? 2U : 1U, // Number of queue families to create.
-			deviceQueueCreateInfo,
+			static_cast<uint32_t>(deviceQueueCreateInfos.size()), // Number of queue families to create.
+			deviceQueueCreateInfos.data(),
 			static_cast<uint32_t>(requiredDeviceLayers.size()), // Number of layers to enable
 			requiredDeviceLayers.data(), // Layers to enable
-			static_cast<uint32_t>(requiredDeviceExtensions.size()), // Number of extensions to enable
-			requiredDeviceExtensions.data(), // Extensions to enable
-			nullptr  // Features to enable
+			static_cast<uint32_t>(deviceExtensions.size()), // Number of extensions to enable
+			deviceExtensions.data(), // Extensions to enable
+			nullptr  // Features to enable (using VkPhysicalDeviceFeatures2 in pNext instead)
 		};
 
-		HANDLE_VK(vkCreateDevice(physicalDevices[i], &deviceCreateInfo, nullptr, &device),
+		HANDLE_VK(vkCreateDevice(physicalDevices[i], &deviceCreateInfo, hostMemory.getCallbacks(HOST_SCOPE_DEVICE), &device),
 			"Creating Vulkan device from physical device %u\n", i);
 
+		// Call the device's functions directly instead of through the loader's trampolines.
+		// The device and its table go in together, so teardown never sees one without the other.
+		DeviceDispatch dispatch;
+		try
+		{
+			dispatch.load(device);
+		}
+		catch (...)
+		{
+			vkDestroyDevice(device, hostMemory.getCallbacks(HOST_SCOPE_DEVICE));
+			throw;
+		}
 		devices.push_back(device);
+		deviceDispatch.push_back(dispatch);
 		graphicsQueueFamilyIndex.push_back(graphicsQueueIndex);
 		transferQueueFamilyIndex.push_back(transferQueueIndex);
 
+		// Keep the properties of the primary device around, everything is created on it.
+		if (i == 0)
+		{
+			primaryDeviceProperties = deviceInfo.properties;
+			primaryDeviceMemoryProperties = deviceInfo.memoryProperties;
+		}
+
 		// Go ahead and get the grapics queue.
 		VkQueue graphicsQueue;
-		vkGetDeviceQueue(device, graphicsQueueIndex, 0, &graphicsQueue);
+		deviceDispatch[i].vkGetDeviceQueue(device, graphicsQueueIndex, 0, &graphicsQueue);
 		graphicsQueues.push_back(graphicsQueue);
+
+		// And the compute queue (the graphics queue again without async compute).
+		VkQueue computeQueue;
+		deviceDispatch[i].vkGetDeviceQueue(device, computeQueueIndex, computeQueueNumber, &computeQueue);
+		computeQueues.push_back(computeQueue);
+		computeQueueFamilyIndex.push_back(computeQueueIndex);
+		if (i == 0)
+			asyncComputeEnabled = useAsyncCompute;
 	}
 }
 
+void VulkanEngine::createShaderLibraries(void)
+{
+	std::string sourceDirectory = SHADER_SOURCE_DIRECTORY;
+	readEnvironmentVariable(SHADER_DIRECTORY_ENV, sourceDirectory);
+
+	// Every device gets its own modules, but they all share the cache, so one compile serves them all.
+	shaderLibraries.resize(devices.size());
+	for (uint32_t i = 0; i < devices.size(); i++)
+		shaderLibraries[i].create(devices[i], deviceDispatch[i],
+			sourceDirectory.c_str(),
+			USE_SHADER_CACHE ? SHADER_CACHE_DIRECTORY : nullptr,
+			OPTIMIZE_SHADERS,
+			hostMemory.getCallbacks(HOST_SCOPE_PIPELINE));
+
+	if (VERBOSE)
+		printf("Shaders: Compiled from \"%s\", cache %s\n", sourceDirectory.c_str(),
+			USE_SHADER_CACHE ? "\"" SHADER_CACHE_DIRECTORY "\"" : "disabled");
+}
+
 void VulkanEngine::createCommandPools(void)
 {
+	const DeviceDispatch &dispatch = deviceDispatch[0];
+
 	// Create the command pool
 	for (uint32_t i = 0; i < devices.size(); i++)
 	{
@@ -506,26 +905,108 @@ void VulkanEngine::createCommandPools(void)
 		VkCommandPoolCreateInfo createInfo = {
 			VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
 			nullptr, // pNext,
-			0, // Flags
+			VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, // Flags (command buffers get re-recorded every frame)
 			graphicsQueueFamilyIndex[i] // Queue Family Index
 		};
-		HANDLE_VK(vkCreateCommandPool(devices[i], &createInfo, nullptr, &commandPool),
+		HANDLE_VK(deviceDispatch[i].vkCreateCommandPool(devices[i], &createInfo, hostMemory.getCallbacks(HOST_SCOPE_DEVICE), &commandPool),
 			"Creating graphics command pool for device %u", i);
 
 		commandPools.push_back(commandPool);
 	}
 
-	// Create one command buffer for each swap image.
-	commandBuffers.resize(swapchainImages.size());
+	// Create one command buffer for each frame in flight.
+	// These don't depend on the swapchain, so they survive it being recreated.
+	commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
 	VkCommandBufferAllocateInfo commandBufferAllocInfo = {
 		VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
 		nullptr, // pNext
 		commandPools[0], // Command Pool
 		VK_COMMAND_BUFFER_LEVEL_PRIMARY, // Buffer level
-		static_cast<uint32_t>(swapchainImages.size()) // Num command buffers to alloc
+		MAX_FRAMES_IN_FLIGHT // Num command buffers to alloc
+	};
+	HANDLE_VK(dispatch.vkAllocateCommandBuffers(devices[0], &commandBufferAllocInfo, commandBuffers.data()),
+		"Allocating %u command buffers on device 0", MAX_FRAMES_IN_FLIGHT);
+
+	// The async compute queue needs a pool of its own if it's in another family, and one per queue
+	//	keeps the two from sharing a pool across threads later anyway.
+	if (asyncComputeEnabled)
+	{
+		VkCommandPoolCreateInfo computeCreateInfo = {
+			VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			nullptr, // pNext,
+			VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, // Flags (command buffers get re-recorded every frame)
+			computeQueueFamilyIndex[0] // Queue Family Index
+		};
+		HANDLE_VK(dispatch.vkCreateCommandPool(devices[0], &computeCreateInfo, hostMemory.getCallbacks(HOST_SCOPE_DEVICE), &computeCommandPool),
+			"Creating the async compute command pool");
+
+		computeCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+		commandBufferAllocInfo.commandPool = computeCommandPool;
+		HANDLE_VK(dispatch.vkAllocateCommandBuffers(devices[0], &commandBufferAllocInfo, computeCommandBuffers.data()),
+			"Allocating %u async compute command buffers", MAX_FRAMES_IN_FLIGHT);
+	}
+}
+
+void VulkanEngine::createSyncObjects(void)
+{
+	const DeviceDispatch &dispatch = deviceDispatch[0];
+
+	// Frames are tracked by the value they signal on the graphics queue's timeline.
+	graphicsTimeline.create(devices[0], dispatch, graphicsQueues[0], timelineSemaphoresEnabled, "Graphics");
+
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {
+		VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		nullptr, // pNext
+		0 // Flags
+	};
+
+	imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		HANDLE_VK(dispatch.vkCreateSemaphore(devices[0], &semaphoreCreateInfo, hostMemory.getCallbacks(HOST_SCOPE_DEVICE), &imageAvailableSemaphores[i]),
+			"Creating image available semaphore for frame %u", i);
+
+	// The physics step hands its results to the graphics queue with a plain semaphore, so the
+	//	handoff stays on the GPU even without timeline semaphores.
+	if (asyncComputeEnabled)
+	{
+		computeTimeline.create(devices[0], dispatch, computeQueues[0], timelineSemaphoresEnabled, "Async compute");
+
+		physicsDoneSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+		for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+			HANDLE_VK(dispatch.vkCreateSemaphore(devices[0], &semaphoreCreateInfo, hostMemory.getCallbacks(HOST_SCOPE_DEVICE), &physicsDoneSemaphores[i]),
+				"Creating physics done semaphore for frame %u", i);
+	}
+
+	// Time the work on both queues. A queue family with no timestamp bits can't be timed.
+	const std::vector<VkQueueFamilyProperties> &queueFamilies = capabilities.getDevice(0).queueFamilies;
+	uint32_t timestampValidBits[GPU_LANE_COUNT] = {
+		queueFamilies[graphicsQueueFamilyIndex[0]].timestampValidBits, // Graphics
+		asyncComputeEnabled ? queueFamilies[computeQueueFamilyIndex[0]].timestampValidBits : 0U // Async compute
+	};
+	gpuProfiler.create(devices[0], dispatch, primaryDeviceProperties.limits.timestampPeriod, timestampValidBits,
+		MAX_FRAMES_IN_FLIGHT, GPU_PROFILER_MAX_SCOPES, hostMemory.getCallbacks(HOST_SCOPE_DEVICE));
+
+	// Starts at full resolution, and only moves once there are frame times.
+	std::string budget;
+	DynamicResolutionConfig dynamicResolutionConfig = {
+		readEnvironmentVariable(DYNAMIC_RESOLUTION_BUDGET_ENV, budget) ? atof(budget.c_str()) : DYNAMIC_RESOLUTION_BUDGET_MS, // Budget
+		DYNAMIC_RESOLUTION_MIN_SCALE, // Min scale
+		1.0f, // Max scale
+		DYNAMIC_RESOLUTION_SMOOTHING, // Smoothing
+		DYNAMIC_RESOLUTION_MAX_STEP, // Max step
+		DYNAMIC_RESOLUTION_HEADROOM, // Headroom
+		DYNAMIC_RESOLUTION_GRANULARITY // Granularity
 	};
-	HANDLE_VK(vkAllocateCommandBuffers(devices[0], &commandBufferAllocInfo, commandBuffers.data()),
-		"Allocating %zu command buffers on device 0", swapchainImages.size());
+	if (dynamicResolutionConfig.budgetMs <= 0.0)
+		dynamicResolutionConfig.budgetMs = DYNAMIC_RESOLUTION_BUDGET_MS;
+	dynamicResolution.create(dynamicResolutionConfig);
+
+	// Declared (and its transients created) along with the framebuffers.
+	renderGraph.create(devices[0], dispatch, primaryDeviceMemoryProperties, primaryDeviceProperties.limits.bufferImageGranularity,
+		MAX_FRAMES_IN_FLIGHT, hostMemory.getCallbacks(HOST_SCOPE_SWAPCHAIN));
+	if (isEnvironmentFlagSet(RENDER_GRAPH_CHECK_ENV, ENABLE_RENDER_GRAPH_CHECK != 0))
+		RenderGraph::checkAliasing(devices[0], dispatch, primaryDeviceMemoryProperties, primaryDeviceProperties.limits.bufferImageGranularity,
+			hostMemory.getCallbacks(HOST_SCOPE_SWAPCHAIN));
 }
 
 void VulkanEngine::createSurface(SDL_Window *sdlWindow)
@@ -536,13 +1017,12 @@ void VulkanEngine::createSurface(SDL_Window *sdlWindow)
 			__FILE__, __LINE__, SDL_GetError());
 		throw std::runtime_error("Failed to create Vulkan surface from SDL window");
 	}
-
-	if (VERBOSE && PRINT_FULL_DEVICE_DETAILS)
-		printPhysicalSurfaceDetails(physicalDevices, numPhysicalDevices, surface);
 }
 
-void VulkanEngine::createSwapchain(uint32_t width, uint32_t height)
+bool VulkanEngine::createSwapchain(uint32_t width, uint32_t height)
 {
+	const DeviceDispatch &dispatch = deviceDispatch[0];
+
 	//////////////////////////////////////////////////////////////////////////////
 	//
 	// Select an image format and color space to use based on what is supported.
@@ -559,7 +1039,8 @@ void VulkanEngine::createSwapchain(uint32_t width, uint32_t height)
 		VK_COLOR_SPACE_SRGB_NONLINEAR_KHR
 	};
 
-	// Get the available formats.
+	// Get the available formats. (Only needed until a format is picked, so it comes from the init arena.)
+	HostArenaScope arenaScope(initArena);
 	uint32_t numFormats;
 	HANDLE_VK(vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevices[0], surface, &numFormats, nullptr),
 		"Getting number of supported formats");
@@ -568,7 +1049,7 @@ void VulkanEngine::createSwapchain(uint32_t width, uint32_t height)
 		fprintf(stderr, "Error (%s:%u): No surface formats found!\n", __FILE__, __LINE__);
 		throw std::runtime_error("Failed to find any surface formats");
 	}
-	VkSurfaceFormatKHR *formats = new VkSurfaceFormatKHR[numFormats];
+	VkSurfaceFormatKHR *formats = initArena.allocateArray<VkSurfaceFormatKHR>(numFormats);
 	HANDLE_VK(vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevices[0], surface, &numFormats, formats),
 		"Getting surface formats");
 
@@ -607,6 +1088,56 @@ void VulkanEngine::createSwapchain(uint32_t width, uint32_t height)
 		putc('\n', stdout);
 	}
 
+	swapchainImageFormat = desiredImageFormats[selectedFormatIndex];
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Size the swapchain and pick the present mode from the surface capabilities.
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	VkSurfaceCapabilitiesKHR surfaceCapabilities;
+	HANDLE_VK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevices[0], surface, &surfaceCapabilities),
+		"Getting surface capabilities");
+
+	// A current extent of 0xFFFFFFFF means the surface takes on whatever size the swapchain is.
+	VkExtent2D extent = surfaceCapabilities.currentExtent;
+	if (extent.width == 0xFFFFFFFF)
+	{
+		extent.width = std::min(std::max(width, surfaceCapabilities.minImageExtent.width), surfaceCapabilities.maxImageExtent.width);
+		extent.height = std::min(std::max(height, surfaceCapabilities.minImageExtent.height), surfaceCapabilities.maxImageExtent.height);
+	}
+
+	// Nothing to present to while the window is minimized. The caller tries again later.
+	if (extent.width == 0 || extent.height == 0)
+		return false;
+
+	// One more than the minimum so there's always an image to acquire while the presentation
+	//	engine holds on to the rest. (MAILBOX needs this to not block on acquire.)
+	uint32_t minImageCount = surfaceCapabilities.minImageCount + 1;
+	if (surfaceCapabilities.maxImageCount && minImageCount > surfaceCapabilities.maxImageCount)
+		minImageCount = surfaceCapabilities.maxImageCount;
+
+	// Drawn to through the render pass, or with dynamic resolution, blitted to from the scene's
+	//	offscreen target. That needs the blit (with a linear filter) and the transfer usage, or
+	//	the scene's drawn straight to the back buffer after all.
+	swapchainImageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	dynamicResolutionEnabled = false;
+	if (isEnvironmentFlagSet(DYNAMIC_RESOLUTION_ENV, USE_DYNAMIC_RESOLUTION != 0))
+	{
+		VkFormatProperties swapchainFormatProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevices[0], swapchainImageFormat, &swapchainFormatProperties);
+		VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT
+			| VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		dynamicResolutionEnabled = (swapchainFormatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures
+			&& (surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) != 0;
+		if (dynamicResolutionEnabled)
+			swapchainImageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		else if (VERBOSE)
+			printf("Dynamic resolution: the swapchain can't be blitted to, rendering at full resolution\n");
+	}
+
+	presentMode = selectPresentMode(physicalDevices[0], surface, presentModePolicy);
+
 	//////////////////////////////////////////////////////////////////////////////
 	//
 	// Create the swapchain
@@ -621,34 +1152,51 @@ void VulkanEngine::createSwapchain(uint32_t width, uint32_t height)
 		throw std::runtime_error("Physical devices 0 does not support presenting to the SDL surface");
 	}
 
+	// Handing the current swapchain in as the old one lets the driver reuse its resources
+	//	and keep presenting its queued images while the new one comes up.
+	VkSwapchainKHR oldSwapchain = swapchain;
 	VkSwapchainCreateInfoKHR swapchainCreateInfo =
 	{
 		VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
 		nullptr, // pNext
 		0, // flags
 		surface,
-		3, // Min # images
+		minImageCount, // Min # images
 		desiredImageFormats[selectedFormatIndex], // image format
 		desiredImageColorSpaces[selectedColorSpaceIndex], // image color space
-		{ width, height }, // image extent
+		extent, // image extent
 		1, // Number of image array layers
-		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, // Image Usage
+		swapchainImageUsage, // Image Usage
 		VK_SHARING_MODE_EXCLUSIVE, // Sharing mode.
 		1, // Number of queue families
 		&graphicsQueueFamilyIndex[0], // Queue family indices
 		VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR, // Pre-Transform. TODO: Add checking for this.
 		VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR, // Composite Alpha. TODO: Add checking for this.
-		VK_PRESENT_MODE_FIFO_KHR, // Present Mode. TODO: Add checking for this.
+		presentMode, // Present Mode.
 		VK_FALSE, // Clipped
-		VK_NULL_HANDLE // Old Swapchain.
+		oldSwapchain // Old Swapchain.
 	};
-	swapchainImageFormat = desiredImageFormats[selectedFormatIndex];
 
-	HANDLE_VK(vkCreateSwapchainKHR(devices[0], &swapchainCreateInfo, nullptr, &swapchain),
+	HANDLE_VK(dispatch.vkCreateSwapchainKHR(devices[0], &swapchainCreateInfo, hostMemory.getCallbacks(HOST_SCOPE_SWAPCHAIN), &swapchain),
 		"Creating the Vulkan swapchain for device 0");
-	screenWidth = width;
-	screenHeight = height;
+	screenWidth = extent.width;
+	screenHeight = extent.height;
+	dynamicResolution.setOutputSize(screenWidth, screenHeight);
 
+	// Frames already submitted can still be presenting from the old swapchain (and waiting on
+	//	its semaphores), so don't wait on the device, retire it once those frames are done.
+	if (oldSwapchain)
+	{
+		uint64_t lastUse = graphicsTimeline.getLastSubmittedValue();
+		for (VkSemaphore semaphore : renderFinishedSemaphores)
+			deletionQueue.enqueue(VK_OBJECT_TYPE_SEMAPHORE, semaphore, lastUse, hostMemory.getCallbacks(HOST_SCOPE_SWAPCHAIN));
+		deletionQueue.enqueue(VK_OBJECT_TYPE_SWAPCHAIN_KHR, oldSwapchain, lastUse, hostMemory.getCallbacks(HOST_SCOPE_SWAPCHAIN));
+		renderFinishedSemaphores.clear();
+	}
+
+	if (VERBOSE)
+		printf("Swapchain: %u x %u, min %u images, %s\n",
+			extent.width, extent.height, minImageCount, getPresentModeName(presentMode));
 
 	//////////////////////////////////////////////////////////////////////////////
 	//
@@ -656,36 +1204,106 @@ void VulkanEngine::createSwapchain(uint32_t width, uint32_t height)
 	//
 	//////////////////////////////////////////////////////////////////////////////
 	uint32_t numSwapchainImages;
-	HANDLE_VK(vkGetSwapchainImagesKHR(devices[0], swapchain, &numSwapchainImages, nullptr),
+	HANDLE_VK(dispatch.vkGetSwapchainImagesKHR(devices[0], swapchain, &numSwapchainImages, nullptr),
 		"Getting number of swap chain images");
 	swapchainImages.resize(numSwapchainImages);
-	HANDLE_VK(vkGetSwapchainImagesKHR(devices[0], swapchain, &numSwapchainImages, swapchainImages.data()));
+	HANDLE_VK(dispatch.vkGetSwapchainImagesKHR(devices[0], swapchain, &numSwapchainImages, swapchainImages.data()));
+
+	// Each image gets its own render finished semaphore. The present waiting on it doesn't
+	//	signal anything we can wait on, so one is only safe to reuse once its image comes back.
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {
+		VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		nullptr, // pNext
+		0 // Flags
+	};
+	renderFinishedSemaphores.resize(numSwapchainImages);
+	for (uint32_t i = 0; i < numSwapchainImages; i++)
+		HANDLE_VK(dispatch.vkCreateSemaphore(devices[0], &semaphoreCreateInfo, hostMemory.getCallbacks(HOST_SCOPE_SWAPCHAIN), &renderFinishedSemaphores[i]),
+			"Creating render finished semaphore for swapchain image %u", i);
+
+	presentLatency.onSwapchainCreated(numSwapchainImages, oldSwapchain != VK_NULL_HANDLE);
+	return true;
+}
+
+void VulkanEngine::recreateSwapchain(void)
+{
+	int width, height;
+	SDL_Vulkan_GetDrawableSize(window, &width, &height);
+
+	// Stays flagged as out of date until the window has a size again.
+	swapchainOutOfDate = !createSwapchain(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+	if (!swapchainOutOfDate)
+		createFramebuffers();
+}
+
+void VulkanEngine::setPresentModePolicy(PresentModePolicy policy)
+{
+	if (policy != presentModePolicy)
+	{
+		presentModePolicy = policy;
+		swapchainOutOfDate = true;
+	}
 }
 
 void VulkanEngine::createRenderPass(void)
 {
+	const DeviceDispatch &dispatch = deviceDispatch[0];
+	occlusionCullingEnabled = isEnvironmentFlagSet(OCCLUSION_CULLING_ENV, USE_OCCLUSION_CULLING != 0);
+
+	// The first of these that can be a depth attachment (and be sampled, for occlusion culling).
+	// Depth is reversed (1 at the near plane, 0 at the far one), which only pays off with a float
+	//	format: the float's exponent gives values near 0 (far away) the precision the projection
+	//	takes from them. D16 always can, so it's the fallback.
+	const VkFormat depthFormatCandidates[] = {
+		VK_FORMAT_D32_SFLOAT,
+		VK_FORMAT_D24_UNORM_S8_UINT,
+		VK_FORMAT_D16_UNORM
+	};
+	VkFormatFeatureFlags depthFeatures = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	if (occlusionCullingEnabled)
+		depthFeatures |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+	depthFormat = VK_FORMAT_UNDEFINED;
+	for (VkFormat candidate : depthFormatCandidates)
+	{
+		VkFormatProperties depthFormatProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevices[0], candidate, &depthFormatProperties);
+		if ((depthFormatProperties.optimalTilingFeatures & depthFeatures) == depthFeatures)
+		{
+			depthFormat = candidate;
+			break;
+		}
+	}
+	if (depthFormat == VK_FORMAT_UNDEFINED)
+	{
+		fprintf(stderr, "Error (%s:%u): Device 0 has no usable depth format\n", __FILE__, __LINE__);
+		throw std::runtime_error("No usable depth format");
+	}
+
+	// The render graph puts the attachments in their layouts before the pass and takes them out of
+	//	them after, so the pass leaves them where they are. With occlusion culling the depth is
+	//	stored for the Hi-Z pyramid build.
 	VkAttachmentDescription simpleRenderPassAttachments[] = {
 		{ // Depth Buffer
 			0, // flags
-			VK_FORMAT_R32_SFLOAT, // Format
+			depthFormat, // Format
 			VK_SAMPLE_COUNT_1_BIT, // Sample count
-			VK_ATTACHMENT_LOAD_OP_DONT_CARE, // Load Op
-			VK_ATTACHMENT_STORE_OP_DONT_CARE, // Store Op
+			VK_ATTACHMENT_LOAD_OP_CLEAR, // Load Op
+			occlusionCullingEnabled ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE, // Store Op
 			VK_ATTACHMENT_LOAD_OP_DONT_CARE, // Stencil Load Op
 			VK_ATTACHMENT_STORE_OP_DONT_CARE, // Stencil Store Op
-			VK_IMAGE_LAYOUT_UNDEFINED, // Initial layout
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, // Initial layout
 			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL  // Final layout
 		},
 		{ // Back Buffer
 			0, // flags
 			swapchainImageFormat, // Format
 			VK_SAMPLE_COUNT_1_BIT, // Sample count
-			VK_ATTACHMENT_LOAD_OP_DONT_CARE, // Load Op
+			VK_ATTACHMENT_LOAD_OP_CLEAR, // Load Op
 			VK_ATTACHMENT_STORE_OP_STORE, // Store Op
 			VK_ATTACHMENT_LOAD_OP_DONT_CARE, // Stencil Load Op
 			VK_ATTACHMENT_STORE_OP_DONT_CARE, // Stencil Store Op
-			VK_IMAGE_LAYOUT_UNDEFINED, // Initial layout
-			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR // Final layout
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, // Initial layout
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL // Final layout
 		}
 	};
 
@@ -720,294 +1338,834 @@ void VulkanEngine::createRenderPass(void)
 		simpleRenderPassAttachments, // Attachment descriptions
 		1, // Subpass count
 		&simpleRenderSubPass, // Subpasses
-		0, // Dependency Count
+		0, // Dependency Count (the render graph's barriers order the pass)
 		nullptr // Dependencies
 	};
 
-	HANDLE_VK(vkCreateRenderPass(devices[0], &simpleRenderPassCreateInfo, nullptr, &simpleRenderPass),
+	HANDLE_VK(dispatch.vkCreateRenderPass(devices[0], &simpleRenderPassCreateInfo, hostMemory.getCallbacks(HOST_SCOPE_PIPELINE), &simpleRenderPass),
 		"Creating the simple render pass on device 0");
-}
 
-void VulkanEngine::createGraphicsPipelineLayout(void)
-{
+	if (!occlusionCullingEnabled)
+		return;
+
 	//////////////////////////////////////////////////////////////////////////////
 	//
-	// Create descriptor set layout
+	// The late render pass picks up where the simple one left off, and is
+	//	compatible with it, so the framebuffers and pipelines work with both.
 	//
 	//////////////////////////////////////////////////////////////////////////////
-	VkDescriptorSetLayoutBinding uboBinding = {
-		1, // Binding
-		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, // Descriptor Type
-		1, // Descriptor count
-		VK_SHADER_STAGE_VERTEX_BIT, // Stage flags
-		nullptr // Immuntable samplers
+	VkAttachmentDescription lateRenderPassAttachments[] = {
+		{ // Depth Buffer
+			0, // flags
+			depthFormat, // Format
+			VK_SAMPLE_COUNT_1_BIT, // Sample count
+			VK_ATTACHMENT_LOAD_OP_LOAD, // Load Op
+			VK_ATTACHMENT_STORE_OP_DONT_CARE, // Store Op
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE, // Stencil Load Op
+			VK_ATTACHMENT_STORE_OP_DONT_CARE, // Stencil Store Op
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, // Initial layout
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL  // Final layout
+		},
+		{ // Back Buffer
+			0, // flags
+			swapchainImageFormat, // Format
+			VK_SAMPLE_COUNT_1_BIT, // Sample count
+			VK_ATTACHMENT_LOAD_OP_LOAD, // Load Op
+			VK_ATTACHMENT_STORE_OP_STORE, // Store Op
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE, // Stencil Load Op
+			VK_ATTACHMENT_STORE_OP_DONT_CARE, // Stencil Store Op
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, // Initial layout
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL // Final layout
+		}
 	};
 
-	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {
-		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+	VkRenderPassCreateInfo lateRenderPassCreateInfo = {
+		VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
 		nullptr, // pNext
 		0, // flags
-		1, // Binding Count
-		&uboBinding
+		2, // Attachment count
+		lateRenderPassAttachments, // Attachment descriptions
+		1, // Subpass count
+		&simpleRenderSubPass, // Subpasses
+		0, // Dependency Count
+		nullptr // Dependencies
 	};
 
-	HANDLE_VK(vkCreateDescriptorSetLayout(devices[0], &descriptorSetLayoutCreateInfo, nullptr, &simpleDescriptorSetLayout),
-		"Creating descriptor set layout");
+	HANDLE_VK(dispatch.vkCreateRenderPass(devices[0], &lateRenderPassCreateInfo, hostMemory.getCallbacks(HOST_SCOPE_PIPELINE), &lateRenderPass),
+		"Creating the late render pass on device 0");
+}
+
+void VulkanEngine::createFramebuffers(void)
+{
+	const DeviceDispatch &dispatch = deviceDispatch[0];
+	const VkAllocationCallbacks *allocator = hostMemory.getCallbacks(HOST_SCOPE_SWAPCHAIN);
+
+	// Frames still in flight can be drawing to the old ones, retire them once those are done.
+	uint64_t lastUse = graphicsTimeline.getLastSubmittedValue();
+	for (VkFramebuffer framebuffer : framebuffers)
+		deletionQueue.enqueue(VK_OBJECT_TYPE_FRAMEBUFFER, framebuffer, lastUse, allocator);
+	for (VkImageView imageView : swapchainImageViews)
+		deletionQueue.enqueue(VK_OBJECT_TYPE_IMAGE_VIEW, imageView, lastUse, allocator);
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		deletionQueue.enqueue(VK_OBJECT_TYPE_IMAGE_VIEW, depthImageViews[i], lastUse, allocator);
+		deletionQueue.enqueue(VK_OBJECT_TYPE_IMAGE_VIEW, depthSampledViews[i], lastUse, allocator);
+		deletionQueue.enqueue(VK_OBJECT_TYPE_IMAGE_VIEW, sceneColorViews[i], lastUse, allocator);
+		depthImageViews[i] = VK_NULL_HANDLE;
+		depthSampledViews[i] = VK_NULL_HANDLE;
+		sceneColorViews[i] = VK_NULL_HANDLE;
+	}
+	framebuffers.clear();
+	swapchainImageViews.clear();
+
+	// The graph's declared for the new size, which creates the depth buffers.
+	renderGraph.reset(deletionQueue, lastUse);
+	buildRenderGraph();
 
 	//////////////////////////////////////////////////////////////////////////////
 	//
-	// Create pipeline layout
+	// Views of the depth buffers
 	//
 	//////////////////////////////////////////////////////////////////////////////
-	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
-		VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+	// A combined depth/stencil format's attachment view has to have both aspects.
+	VkImageAspectFlags depthAspects = VK_IMAGE_ASPECT_DEPTH_BIT;
+	if (depthFormat == VK_FORMAT_D24_UNORM_S8_UINT)
+		depthAspects |= VK_IMAGE_ASPECT_STENCIL_BIT;
+
+	VkImageViewCreateInfo imageViewCreateInfo = {
+		VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
 		nullptr, // pNext
-		0, // flags
-		1, // Set Layout Count
-		&simpleDescriptorSetLayout, // Set Layouts
-		0, // Num Push Constant Ranges
-		nullptr // Push Constant Ranges
+		0, // Flags
+		VK_NULL_HANDLE, // Image
+		VK_IMAGE_VIEW_TYPE_2D, // View type
+		depthFormat, // Format
+		{ VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY }, // Components
+		{ depthAspects, 0, 1, 0, 1 } // Subresource range (aspect, base mip, levels, base layer, layers)
 	};
 
-	HANDLE_VK(vkCreatePipelineLayout(devices[0], &pipelineLayoutCreateInfo, nullptr, &simplePipelineLayout),
-		"Creating pipeline layout");
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		imageViewCreateInfo.image = renderGraph.getImage(depthResource, i);
+		HANDLE_VK(dispatch.vkCreateImageView(devices[0], &imageViewCreateInfo, allocator, &depthImageViews[i]),
+			"Creating the view of depth buffer %u", i);
+
+		// A sampled view can only have one aspect.
+		if (occlusionCullingEnabled)
+		{
+			imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+			HANDLE_VK(dispatch.vkCreateImageView(devices[0], &imageViewCreateInfo, allocator, &depthSampledViews[i]),
+				"Creating the sampled view of depth buffer %u", i);
+			imageViewCreateInfo.subresourceRange.aspectMask = depthAspects;
+		}
+	}
+	if (occlusionCullingEnabled)
+		hiZPyramid.resize(screenWidth, screenHeight, depthSampledViews, MAX_FRAMES_IN_FLIGHT, deletionQueue, lastUse);
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// A view per swapchain image, and a framebuffer for every pairing of a
+	//	frame's depth buffer with a swapchain image. With dynamic resolution the
+	//	scene's drawn to the frame's own color target instead, so there's just
+	//	one per frame.
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	uint32_t numImages = static_cast<uint32_t>(swapchainImages.size());
+	uint32_t numColorTargets = dynamicResolutionEnabled ? 1 : numImages;
+	swapchainImageViews.resize(numImages);
+	framebuffers.resize(MAX_FRAMES_IN_FLIGHT * numColorTargets);
+	imageViewCreateInfo.format = swapchainImageFormat;
+	imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	for (uint32_t i = 0; i < numImages; i++)
+	{
+		imageViewCreateInfo.image = swapchainImages[i];
+		HANDLE_VK(dispatch.vkCreateImageView(devices[0], &imageViewCreateInfo, allocator, &swapchainImageViews[i]),
+			"Creating the view of swapchain image %u", i);
+	}
+	for (uint32_t i = 0; dynamicResolutionEnabled && i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		imageViewCreateInfo.image = renderGraph.getImage(sceneColorResource, i);
+		HANDLE_VK(dispatch.vkCreateImageView(devices[0], &imageViewCreateInfo, allocator, &sceneColorViews[i]),
+			"Creating the view of scene color target %u", i);
+	}
+	for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++)
+	{
+		for (uint32_t i = 0; i < numColorTargets; i++)
+		{
+			VkImageView colorView = dynamicResolutionEnabled ? sceneColorViews[frame] : swapchainImageViews[i];
+			VkImageView attachments[] = { depthImageViews[frame], colorView }; // In render pass order
+			VkFramebufferCreateInfo framebufferCreateInfo = {
+				VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+				nullptr, // pNext
+				0, // Flags
+				simpleRenderPass, // Render pass
+				2, // Attachment count
+				attachments, // Attachments
+				screenWidth, // Width
+				screenHeight, // Height
+				1 // Layers
+			};
+			HANDLE_VK(dispatch.vkCreateFramebuffer(devices[0], &framebufferCreateInfo, allocator, &framebuffers[frame * numColorTargets + i]),
+				"Creating the framebuffer for frame %u and color target %u", frame, i);
+		}
+	}
 }
 
-void VulkanEngine::createGraphicsPipeline(void)
+void VulkanEngine::buildRenderGraph(void)
 {
 	//////////////////////////////////////////////////////////////////////////////
 	//
-	// Create the shaders we'll use for the graphics pipeline
+	// Resources. Buffers stand for everything one part of the engine owns, they're
+	//	all synchronized with global memory barriers anyway.
+	// The bodies are carried over from the last frame's physics step, unless
+	//	it runs on the async compute queue: then the semaphore it signals has
+	//	already made them available.
 	//
 	//////////////////////////////////////////////////////////////////////////////
-	VkShaderModuleCreateInfo simpleVertexShaderCreateInfo = {
-		VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-		nullptr, // pNext
-		0, // flags
-		simpleVertexSPRVLength,
-		simpleVertexSPRV
+	depthResource = renderGraph.createImage("Depth", depthFormat, screenWidth, screenHeight);
+	backBufferResource = renderGraph.importImage("Back buffer", swapchainImageFormat, RG_ACCESS_ACQUIRE, RG_ACCESS_PRESENT);
+	uint32_t bodiesResource = renderGraph.importBuffer("Bodies", asyncComputeEnabled ? RG_ACCESS_NONE : RG_ACCESS_CARRIED, RG_ACCESS_NONE);
+	uint32_t asteroidDrawsResource = renderGraph.importBuffer("Asteroid draws", RG_ACCESS_CARRIED, RG_ACCESS_HOST_READ);
+	uint32_t remoteBodiesResource = devices.size() > 1
+		? renderGraph.importBuffer("Remote bodies", RG_ACCESS_CARRIED, RG_ACCESS_NONE)
+		: ~0U;
+	if (occlusionCullingEnabled)
+		hiZResource = renderGraph.importImage("Hi-Z pyramid", VK_FORMAT_R32_SFLOAT, RG_ACCESS_CARRIED, RG_ACCESS_NONE);
+	// Full size, so changing the resolution never means recreating it.
+	uint32_t colorResource = backBufferResource;
+	if (dynamicResolutionEnabled)
+	{
+		sceneColorResource = renderGraph.createImage("Scene color", swapchainImageFormat, screenWidth, screenHeight);
+		colorResource = sceneColorResource;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Passes, in the order they run
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	// Without an async compute queue, the physics step runs here ahead of everything that reads it.
+	if (!asyncComputeEnabled)
+	{
+		uint32_t physicsPass = renderGraph.addPass("Physics", [this](VkCommandBuffer commandBuffer, uint32_t) {
+			physics.recordStep(commandBuffer, PHYSICS_TIME_STEP);
+		});
+		renderGraph.addAccess(physicsPass, bodiesResource, RG_ACCESS_COMPUTE_WRITE);
+	}
+
+	// Bodies from the secondary devices, staged by stepSecondaryDevices(). Until the first
+	//	ones arrive the buffer's cleared instead, so the renderer doesn't draw garbage.
+	if (remoteBodiesResource != ~0U)
+	{
+		uint32_t remotePass = renderGraph.addPass("Remote bodies", [this](VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+			if (remoteBodiesStaged[frameIndex])
+			{
+				VkBufferCopy region = {
+					remoteBodiesSize * frameIndex, // Source offset
+					0, // Destination offset
+					remoteBodiesSize // Size
+				};
+				deviceDispatch[0].vkCmdCopyBuffer(commandBuffer, remoteStagingBuffer, remoteBodiesBuffer, 1, &region);
+				remoteBodiesStaged[frameIndex] = false;
+			}
+			else if (!remoteBodiesCleared)
+			{
+				deviceDispatch[0].vkCmdFillBuffer(commandBuffer, remoteBodiesBuffer, 0, VK_WHOLE_SIZE, 0);
+			}
+			remoteBodiesCleared = true;
+		});
+		renderGraph.addAccess(remotePass, remoteBodiesResource, RG_ACCESS_TRANSFER_WRITE);
+	}
+
+	// Cull the asteroids and pick their LODs, once their meshes are in. With occlusion culling this
+	//	is the first phase, against the pyramid built from last frame's depth.
+	uint32_t cullPass = renderGraph.addPass("Asteroid culling", [this](VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+		if (frameContext.drawAsteroids)
+			asteroidRenderer.recordCull(commandBuffer, frameIndex, physics.getCurrentStateIndex(), frameContext.camera, uploadArena);
+	});
+	renderGraph.addAccess(cullPass, bodiesResource, RG_ACCESS_COMPUTE_READ);
+	if (remoteBodiesResource != ~0U)
+		renderGraph.addAccess(cullPass, remoteBodiesResource, RG_ACCESS_COMPUTE_READ);
+	renderGraph.addAccess(cullPass, asteroidDrawsResource, RG_ACCESS_TRANSFER_WRITE);
+	renderGraph.addAccess(cullPass, asteroidDrawsResource, RG_ACCESS_COMPUTE_WRITE);
+	if (occlusionCullingEnabled)
+		renderGraph.addAccess(cullPass, hiZResource, RG_ACCESS_COMPUTE_READ);
+
+	// The draws. The late one only differs in loading what the first one drew.
+	auto addDrawPass = [&](const char *name, VkRenderPass renderPass) {
+		uint32_t drawPass = renderGraph.addPass(name, [this, renderPass](VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+			recordDraw(commandBuffer, frameIndex, renderPass);
+		});
+		renderGraph.addAccess(drawPass, depthResource, RG_ACCESS_DEPTH_ATTACHMENT);
+		renderGraph.addAccess(drawPass, colorResource, RG_ACCESS_COLOR_ATTACHMENT);
+		renderGraph.addAccess(drawPass, bodiesResource, RG_ACCESS_VERTEX_READ);
+		if (remoteBodiesResource != ~0U)
+			renderGraph.addAccess(drawPass, remoteBodiesResource, RG_ACCESS_VERTEX_READ);
+		renderGraph.addAccess(drawPass, asteroidDrawsResource, RG_ACCESS_INDIRECT_READ);
+		renderGraph.addAccess(drawPass, asteroidDrawsResource, RG_ACCESS_VERTEX_READ);
+	};
+	addDrawPass("Draw", simpleRenderPass);
+
+	// Occlusion culling's second phase: rebuild the pyramid from what was just drawn, then draw
+	//	whatever the first phase hid that isn't hidden by it.
+	if (occlusionCullingEnabled)
+	{
+		uint32_t hiZPass = renderGraph.addPass("Hi-Z pyramid", [this](VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+			if (frameContext.drawAsteroids)
+				hiZPyramid.record(commandBuffer, frameIndex, frameContext.camera.viewProj, frameContext.camera.viewportSize);
+		});
+		renderGraph.addAccess(hiZPass, depthResource, RG_ACCESS_COMPUTE_SAMPLED);
+		renderGraph.addAccess(hiZPass, hiZResource, RG_ACCESS_COMPUTE_WRITE);
+
+		uint32_t occlusionPass = renderGraph.addPass("Asteroid occlusion", [this](VkCommandBuffer commandBuffer, uint32_t) {
+			if (frameContext.drawAsteroids)
+				asteroidRenderer.recordLateCull(commandBuffer);
+		});
+		renderGraph.addAccess(occlusionPass, bodiesResource, RG_ACCESS_COMPUTE_READ);
+		if (remoteBodiesResource != ~0U)
+			renderGraph.addAccess(occlusionPass, remoteBodiesResource, RG_ACCESS_COMPUTE_READ);
+		renderGraph.addAccess(occlusionPass, asteroidDrawsResource, RG_ACCESS_TRANSFER_WRITE);
+		renderGraph.addAccess(occlusionPass, asteroidDrawsResource, RG_ACCESS_COMPUTE_WRITE);
+		renderGraph.addAccess(occlusionPass, hiZResource, RG_ACCESS_COMPUTE_READ);
+
+		addDrawPass("Late draw", lateRenderPass);
+	}
+
+	// Scale whatever part of the scene was drawn up to the back buffer.
+	if (dynamicResolutionEnabled)
+	{
+		uint32_t upscalePass = renderGraph.addPass("Upscale", [this](VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+			VkImageBlit region = {
+				{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 }, // Source subresource (aspect, mip, base layer, layers)
+				{ { 0, 0, 0 }, { static_cast<int32_t>(frameContext.renderWidth), static_cast<int32_t>(frameContext.renderHeight), 1 } }, // Source bounds
+				{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 }, // Destination subresource
+				{ { 0, 0, 0 }, { static_cast<int32_t>(screenWidth), static_cast<int32_t>(screenHeight), 1 } } // Destination bounds
+			};
+			deviceDispatch[0].vkCmdBlitImage(commandBuffer,
+				renderGraph.getImage(sceneColorResource, frameIndex), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				swapchainImages[frameContext.imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1, &region, VK_FILTER_LINEAR);
+		});
+		renderGraph.addAccess(upscalePass, sceneColorResource, RG_ACCESS_TRANSFER_READ);
+		renderGraph.addAccess(upscalePass, backBufferResource, RG_ACCESS_TRANSFER_WRITE);
+	}
+
+	renderGraph.compile();
+}
+
+void VulkanEngine::recordDraw(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkRenderPass renderPass)
+{
+	const DeviceDispatch &dispatch = deviceDispatch[0];
+
+	// The scene goes in the top left of the targets at its (dynamic) resolution.
+	VkViewport viewport = {
+		0, 0, // Starting X,Y position (top left)
+		static_cast<float>(frameContext.renderWidth), // View width
+		static_cast<float>(frameContext.renderHeight), // View height
+		0.0f, 1.0f // Depth Min,Max
 	};
+	dispatch.vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-	HANDLE_VK(vkCreateShaderModule(devices[0], &simpleVertexShaderCreateInfo, nullptr, &simpleVertexShaderModule),
-		"Creating simpleVertex shader module");
+	VkRect2D scissor = {
+		{ 0, 0 }, // offset
+		{ frameContext.renderWidth, frameContext.renderHeight } // extent
+	};
+	dispatch.vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-	VkShaderModuleCreateInfo simpleFragmentShaderCreateInfo = {
-		VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+	// The late render pass loads what the first one drew, so it has nothing to clear.
+	VkClearValue clearValues[2]; // In render pass attachment order
+	clearValues[0].depthStencil = { 0.0f, 0 }; // Depth (reversed, so 0 is the far plane), stencil
+	clearValues[1].color = { { 0.0f, 0.0f, 0.02f, 1.0f } };
+	bool clear = renderPass == simpleRenderPass;
+
+	// The render area's the whole target either way, so the depth outside the scene is cleared to the
+	//	far plane, and the Hi-Z pyramid's texels on its edge stay conservative.
+	VkRect2D renderArea = {
+		{ 0, 0 }, // offset
+		{ screenWidth, screenHeight } // extent
+	};
+	VkFramebuffer framebuffer = dynamicResolutionEnabled
+		? framebuffers[frameIndex]
+		: framebuffers[frameIndex * swapchainImages.size() + frameContext.imageIndex];
+	VkRenderPassBeginInfo renderPassBeginInfo = {
+		VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
 		nullptr, // pNext
-		0, // flags
-		simpleFragmentSPRVLength,
-		simpleFragmentSPRV
+		renderPass, // Render pass
+		framebuffer, // Framebuffer
+		renderArea, // Render area
+		clear ? 2U : 0U, // Clear value count
+		clear ? clearValues : nullptr // Clear values
 	};
 
-	HANDLE_VK(vkCreateShaderModule(devices[0], &simpleFragmentShaderCreateInfo, nullptr, &simpleFragmentShaderModule),
-		"Creating simpleFragment shader module");
+	dispatch.vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	if (frameContext.drawAsteroids)
+		asteroidRenderer.recordDraw(commandBuffer, meshPool.getVertexBuffer(), meshPool.getIndexBuffer());
+	dispatch.vkCmdEndRenderPass(commandBuffer);
+}
 
-	//////////////////////////////////////////////////////////////////////////////
-	// Create the render pass and pipeline layout
-	//////////////////////////////////////////////////////////////////////////////
-	createRenderPass();
-	createGraphicsPipelineLayout();
+void VulkanEngine::createPipelineCache(void)
+{
+	const DeviceDispatch &dispatch = deviceDispatch[0];
+
+	// Start from the last run's cache, and its kernel tuning if that was measured on this device.
+	std::vector<char> pipelineCacheData;
+	KernelTuning savedTuning;
+	kernelTuning = getDefaultKernelTuning(capabilities.getDevice(0));
+	if (USE_PIPELINE_CACHE_FILE
+		&& loadPipelineCacheFile(PIPELINE_CACHE_FILE, primaryDeviceProperties, pipelineCacheData, savedTuning)
+		&& savedTuning.autotuned)
+		kernelTuning = savedTuning;
 
-	//////////////////////////////////////////////////////////////////////////////
-	//
-	// Create the pipeline cache
-	//
-	//////////////////////////////////////////////////////////////////////////////
 	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {
 		VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
 		nullptr, // pNext
 		0, // flags
-		0, // Initial data size
-		nullptr // Initial data
+		pipelineCacheData.size(), // Initial data size
+		pipelineCacheData.empty() ? nullptr : pipelineCacheData.data() // Initial data
 	};
 
-	HANDLE_VK(vkCreatePipelineCache(devices[0], &pipelineCacheCreateInfo, nullptr, &pipelineCache),
+	HANDLE_VK(dispatch.vkCreatePipelineCache(devices[0], &pipelineCacheCreateInfo, hostMemory.getCallbacks(HOST_SCOPE_PIPELINE), &pipelineCache),
 		"Creating pipeline cache");
 
+	// The Hi-Z pyramid's build pipeline. Its images come with the depth buffers, in createFramebuffers().
+	if (occlusionCullingEnabled)
+		hiZPyramid.create(devices[0], dispatch, primaryDeviceMemoryProperties, shaderLibraries[0], pipelineCache,
+			hostMemory.getCallbacks(HOST_SCOPE_PIPELINE));
+}
+
+void VulkanEngine::createUploadArena(void)
+{
+	// One region per frame in flight, bound to the uniform buffer with dynamic offsets.
+	uploadArena.create(devices[0], deviceDispatch[0],
+		primaryDeviceMemoryProperties,
+		primaryDeviceProperties.limits,
+		UPLOAD_ARENA_FRAME_SIZE,
+		MAX_FRAMES_IN_FLIGHT,
+		UPLOAD_ARENA_BIND_RANGE,
+		hostMemory.getCallbacks(HOST_SCOPE_DEVICE));
+}
+
+void VulkanEngine::createMeshPool(void)
+{
+	// Uploads go on the graphics queue, in command buffers from its pool.
+	MeshVertexFormat vertexFormat = isEnvironmentFlagSet(QUANTIZED_VERTICES_ENV, USE_QUANTIZED_VERTICES != 0)
+		? MESH_VERTEX_FORMAT_QUANTIZED : MESH_VERTEX_FORMAT_FLOAT;
+	meshPool.create(devices[0], deviceDispatch[0],
+		primaryDeviceMemoryProperties,
+		primaryDeviceProperties.limits,
+		vertexFormat,
+		MESH_POOL_INDEX_TYPE,
+		MESH_POOL_VERTEX_CAPACITY,
+		MESH_POOL_INDEX_CAPACITY,
+		MESH_POOL_CLUSTER_CAPACITY,
+		MESH_STAGING_RING_SIZE,
+		graphicsTimeline,
+		commandPools[0],
+		hostMemory.getCallbacks(HOST_SCOPE_DEVICE));
+}
+
+void VulkanEngine::createAsteroidField(void)
+{
+	AsteroidShape shape = {
+		ASTEROID_NUM_LODS, // LODs
+		1.0f, // Radius
+		0.35f, // Displacement
+		1.5f, // Frequency
+		5 // Octaves
+	};
+	asteroidField.create(meshPool, graphicsTimeline, shape,
+		ASTEROID_GENERATOR_THREADS,
+		USE_ASTEROID_CACHE ? ASTEROID_CACHE_DIRECTORY : nullptr);
+
+	// Only queues the work, the meshes show up over the first frames (see drawFrame).
+	uint32_t seeds[ASTEROID_NUM_VARIANTS];
+	for (uint32_t i = 0; i < ASTEROID_NUM_VARIANTS; i++)
+		seeds[i] = ASTEROID_FIELD_SEED * 0x9e3779b9U + i;
+	asteroidField.request(seeds, ASTEROID_NUM_VARIANTS);
+}
+
+void VulkanEngine::createPhysics(void)
+{
+	const DeviceDispatch &dispatch = deviceDispatch[0];
+
+	// The graphics queue reads the state, so it's shared with the compute queue's family when that's another one.
+	std::vector<uint32_t> queueFamilies = { graphicsQueueFamilyIndex[0] };
+	if (computeQueueFamilyIndex[0] != graphicsQueueFamilyIndex[0])
+		queueFamilies.push_back(computeQueueFamilyIndex[0]);
+
+	// Measure the kernel constants if asked to and the pipeline cache file didn't have them.
+	if (!kernelTuning.autotuned && isEnvironmentFlagSet(KERNEL_AUTOTUNE_ENV, ENABLE_KERNEL_AUTOTUNE))
+	{
+		kernelTuning = autotuneKernels(devices[0], dispatch, capabilities.getDevice(0),
+			graphicsQueueFamilyIndex[0], graphicsQueues[0], commandPools[0],
+			shaderLibraries[0],
+			PHYSICS_NUM_BODIES,
+			kernelTuning,
+			hostMemory.getCallbacks(HOST_SCOPE_PIPELINE));
+	}
+	if (VERBOSE)
+		printf("Kernel tuning (%s): physics workgroups of %u x %u bodies\n",
+			kernelTuning.autotuned ? "autotuned" : "from the device limits",
+			kernelTuning.physics.workgroupSize, kernelTuning.physics.bodiesPerInvocation);
+
+	physics.create(devices[0], deviceDispatch[0],
+		primaryDeviceMemoryProperties,
+		PHYSICS_NUM_BODIES,
+		kernelTuning.physics,
+		queueFamilies,
+		shaderLibraries[0],
+		pipelineCache,
+		hostMemory.getCallbacks(HOST_SCOPE_PIPELINE));
+
 	//////////////////////////////////////////////////////////////////////////////
 	//
-	// Create the graphics pipeline.
+	// Every other device simulates bodies of its own on its graphics queue.
 	//
 	//////////////////////////////////////////////////////////////////////////////
-	VkPipelineShaderStageCreateInfo pipelineShaderStageCreateInfos[] = {
-		{ // Vertex Shader
-			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-			nullptr, // pNext
-			0, // Flags
-			VK_SHADER_STAGE_VERTEX_BIT, // Stage
-			simpleVertexShaderModule, // shader module
-			"main", // Shader entry point
-			nullptr // Specialization info
-		},
-		{ // Fragment Shader
-			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-			nullptr, // pNext
-			0, // Flags
-			VK_SHADER_STAGE_FRAGMENT_BIT, // Stage
-			simpleFragmentShaderModule, // Shader module
-			"main", // Shader entry point
-			nullptr // Specialization info
-		}
-	};
+	if (devices.size() < 2)
+		return;
 
-	VkVertexInputBindingDescription vertexInputBindingDescription = {
-		0, // Binding
-		sizeof(SimpleVertex), // Stride
-		VK_VERTEX_INPUT_RATE_VERTEX // Vertex Input Rate
-	};
+	// Created in place, the workers' timelines point at their names.
+	secondaryWorkers.resize(devices.size() - 1);
+	for (uint32_t i = 1; i < devices.size(); i++)
+	{
+		const VulkanCapabilities::DeviceInfo &deviceInfo = capabilities.getDevice(i);
+		secondaryWorkers[i - 1].create(i, devices[i], deviceDispatch[i],
+			graphicsQueues[i], commandPools[i],
+			deviceInfo.memoryProperties,
+			deviceInfo.properties.limits.timestampPeriod,
+			deviceInfo.queueFamilies[graphicsQueueFamilyIndex[i]],
+			graphicsQueueFamilyIndex[i],
+			shaderLibraries[i],
+			PHYSICS_SECONDARY_NUM_BODIES,
+			getDefaultKernelTuning(deviceInfo).physics,
+			MAX_FRAMES_IN_FLIGHT,
+			hostMemory.getCallbacks(HOST_SCOPE_DEVICE));
+		remoteBodiesSize += secondaryWorkers[i - 1].getStateSize();
+		numRemoteBodies += secondaryWorkers[i - 1].getNumBodies();
+	}
 
-	VkVertexInputAttributeDescription vertexAttributeDescription = {
-		0, // Location
-		0, // Binding
-		VK_FORMAT_R32G32B32_SFLOAT, // Format
-		0  // Offset
-	};
+	// Where the primary device gets the workers' results, and the staging it gets them through.
+	createBufferWithMemory(devices[0], dispatch, primaryDeviceMemoryProperties,
+		remoteBodiesSize,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, hostMemory.getCallbacks(HOST_SCOPE_DEVICE),
+		remoteBodiesBuffer, remoteBodiesMemory);
+	createBufferWithMemory(devices[0], dispatch, primaryDeviceMemoryProperties,
+		remoteBodiesSize * MAX_FRAMES_IN_FLIGHT,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, hostMemory.getCallbacks(HOST_SCOPE_DEVICE),
+		remoteStagingBuffer, remoteStagingMemory);
+	void *mappedData;
+	HANDLE_VK(dispatch.vkMapMemory(devices[0], remoteStagingMemory, 0, VK_WHOLE_SIZE, 0, &mappedData),
+		"Mapping the remote bodies staging buffer");
+	remoteStagingData = static_cast<uint8_t *>(mappedData);
 
-	VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {
-		VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-		nullptr, // pNext
-		0, // Flags
-		1, // Vertex Binding Description Count
-		&vertexInputBindingDescription, // Vertex Binding Descriptions
-		1, // Vertex Attribute Description Count
-		&vertexAttributeDescription, // Vertex Attribute Descriptions
-	};
+	if (VERBOSE)
+		printf("Multi-GPU physics: %u secondary devices, %llu KB staged per frame\n",
+			static_cast<uint32_t>(secondaryWorkers.size()), static_cast<unsigned long long>(remoteBodiesSize / 1024));
+}
 
-	VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo = {
-		VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-		nullptr, // pNext
-		0, // Flags
-		VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, // Topology
-		VK_FALSE // Primitive restart enable
+void VulkanEngine::createAsteroidRenderer(void)
+{
+	AsteroidLodConfig lodConfig = {
+		ASTEROID_INSTANCE_SCALE, // Instance scale
+		ASTEROID_FULL_DETAIL_PIXELS, // Full detail pixels
+		ASTEROID_IMPOSTOR_PIXELS, // Impostor pixels
+		ASTEROID_LOD_HYSTERESIS // Hysteresis
 	};
+	VkBuffer bodyBuffers[] = { physics.getStateBuffer(0), physics.getStateBuffer(1) };
+	bool clusterCulling = isEnvironmentFlagSet(CLUSTER_CULLING_ENV, USE_CLUSTER_CULLING != 0);
+
+	// With the bindless table the renderer reads the bodies through it, rather than from a
+	//	descriptor set per state buffer.
+	if (bindlessEnabled)
+		bindlessTable.create(devices[0], deviceDispatch[0], maxBindlessBuffers, maxBindlessImages);
+
+	// The meshes aren't ready yet, drawFrame() hands them over once they are.
+	asteroidRenderer.create(devices[0], deviceDispatch[0],
+		primaryDeviceMemoryProperties,
+		lodConfig,
+		meshPool,
+		physics.getNumBodies(),
+		clusterCulling ? ASTEROID_MAX_CLUSTERS : 0U,
+		multiDrawIndirectEnabled,
+		bodyBuffers,
+		remoteBodiesBuffer,
+		numRemoteBodies,
+		ASTEROID_NUM_VARIANTS,
+		MAX_FRAMES_IN_FLIGHT,
+		uploadArena,
+		simpleRenderPass,
+		occlusionCullingEnabled ? &hiZPyramid : nullptr,
+		bindlessEnabled ? &bindlessTable : nullptr,
+		shaderLibraries[0],
+		pipelineCache,
+		hostMemory.getCallbacks(HOST_SCOPE_PIPELINE));
+}
 
-	VkViewport viewport = {
-		0, 0, // Starting X,Y position (top left)
-		static_cast<float>(screenWidth), // View width
-		static_cast<float>(screenHeight), // View height
-		0.0f, 1.0f // Depth Min,Max 
-	};
+void VulkanEngine::stepSecondaryDevices(uint32_t frameIndex)
+{
+	// Pick up what each device produced the last time this frame came around (the staging region
+	//	is free, the frame's last graphics submit that copied out of it is done), then start the next step.
+	VkDeviceSize offset = 0;
+	bool staged = false;
+	for (SecondaryDeviceWorker &worker : secondaryWorkers)
+	{
+		staged |= worker.collect(frameIndex, remoteStagingData + remoteBodiesSize * frameIndex + offset);
+		worker.submitStep(frameIndex, PHYSICS_TIME_STEP);
+		offset += worker.getStateSize();
+	}
+	remoteBodiesStaged[frameIndex] = staged;
+}
 
-	VkRect2D scissor = {
-		{ 0, 0 }, // offset
-		{ 1, 1 }  // extent
-	};
+void VulkanEngine::submitPhysicsStep(uint32_t frameIndex)
+{
+	const DeviceDispatch &dispatch = deviceDispatch[0];
 
-	VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {
-		VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+	// The graphics work of the frame that last used this command buffer waited on it, and the CPU
+	//	has waited on that, so it's free to re-record.
+	VkCommandBuffer commandBuffer = computeCommandBuffers[frameIndex];
+	HANDLE_VK(dispatch.vkResetCommandBuffer(commandBuffer, 0),
+		"Resetting frame %u's async compute command buffer", frameIndex);
+
+	VkCommandBufferBeginInfo beginInfo = {
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 		nullptr, // pNext
-		0, // Flags
-		1, // Viewport Count
-		&viewport, // Viewport
-		1,
-		&scissor
-		//0, // Scissor Count
-		//nullptr // Scissors
+		VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, // Flags
+		nullptr // Inheritance info
 	};
+	HANDLE_VK(dispatch.vkBeginCommandBuffer(commandBuffer, &beginInfo),
+		"Beginning frame %u's async compute command buffer", frameIndex);
+
+	uint32_t targetStateIndex = static_cast<uint32_t>(physics.getStepNumber() % 2); // What recordStep() writes.
+	uint32_t physicsScope = gpuProfiler.beginScope(commandBuffer, "Physics", GPU_LANE_ASYNC_COMPUTE);
+	physics.recordStep(commandBuffer, PHYSICS_TIME_STEP);
+	gpuProfiler.endScope(commandBuffer, physicsScope);
+
+	HANDLE_VK(dispatch.vkEndCommandBuffer(commandBuffer),
+		"Ending frame %u's async compute command buffer", frameIndex);
+
+	// The step overwrites the state buffer the frame before last drew, so it waits for that frame's
+	//	graphics work (usually long done). Not for the last frame's, which only reads the buffer the step
+	//	reads too, so it can start while the graphics queue is still busy with it.
+	computeTimeline.submit(1, &commandBuffer,
+		{ { &graphicsTimeline, stateReadValues[targetStateIndex], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT } }, // Timeline waits
+		{}, // Binary waits
+		{ physicsDoneSemaphores[frameIndex] }); // Binary signals
+}
 
-	VkPipelineRasterizationStateCreateInfo rasterizationState = {
-		VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-		nullptr, // pNext,
-		0, // Flags
-		VK_FALSE, // Depth Clamp Enable
-		VK_FALSE, // Rasterizer Discard Enable (Turn off the Rasterizer)
-		VK_POLYGON_MODE_FILL, // Polygon Mode
-		VK_CULL_MODE_BACK_BIT, // Cull Mode
-		VK_FRONT_FACE_COUNTER_CLOCKWISE, // Front Face (Which way triangle vertices turn)
-		VK_FALSE, // Depth Bias Enable
-		0.0f, // Depth Bias constant factor
-		0.0f, // Depth Bias clamp
-		0.0f, // Depth Bias slope factor
-		1.0f // Line Width
-	};
-
-	VkPipelineMultisampleStateCreateInfo multisampleState = {
-		VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-		nullptr, // pNext,
-		0, // Flags
-		VK_SAMPLE_COUNT_1_BIT, // Resterization samples (sample count)
-		VK_FALSE, // Sample Shading Enable
-		1.0f, // Min Sample Shading
-		nullptr, // Sample Mask
-		VK_FALSE, // Alpha to Coverage Enable
-		VK_FALSE, // Alpha to One Enable
-	};
+void VulkanEngine::drawFrame(void)
+{
+	const DeviceDispatch &dispatch = deviceDispatch[0];
+
+	uint32_t frameIndex = static_cast<uint32_t>(frameNumber % MAX_FRAMES_IN_FLIGHT);
+	presentLatency.beginFrame();
+
+	if (swapchainOutOfDate)
+	{
+		recreateSwapchain();
+		if (swapchainOutOfDate)
+			return; // Still nothing to present to.
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Wait for the GPU to finish the last frame that used this frame's resources.
+	// This is the only place the CPU waits on the GPU.
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	auto frameWaitStart = PresentLatencyTracker::Clock::now();
+	graphicsTimeline.wait(frameTimelineValues[frameIndex]);
+	presentLatency.onFrameWaited(frameWaitStart);
+
+	deletionQueue.collect(graphicsTimeline.getCompletedValue());
+	if (asyncComputeEnabled)
+		computeTimeline.getCompletedValue(); // Retires its fences when there's no timeline semaphore.
+
+	// Everything the frame wrote last time is done, so its timestamps can be read, and the scene's
+	//	resolution follow them.
+	gpuProfiler.beginFrame(frameIndex);
+	if (dynamicResolutionEnabled && gpuProfiler.getNumFramesResolved() != numGpuFramesMeasured)
+	{
+		numGpuFramesMeasured = gpuProfiler.getNumFramesResolved();
+		dynamicResolution.update(gpuProfiler.getLastFrameMs(GPU_LANE_GRAPHICS));
+	}
 
-	VkPipelineDepthStencilStateCreateInfo depthStencilState = {
-		VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+	// Upload the asteroids that finished since the last frame. They go on the graphics queue ahead of
+	//	the frame's own submit.
+	asteroidRenderer.beginFrame(frameIndex);
+	if (!asteroidField.isReady() && asteroidField.update())
+		asteroidRenderer.setMeshes(asteroidField);
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Acquire the next swapchain image
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	uint32_t imageIndex;
+	auto acquireStart = PresentLatencyTracker::Clock::now();
+	VkResult result = dispatch.vkAcquireNextImageKHR(devices[0], swapchain, UINT64_MAX, imageAvailableSemaphores[frameIndex], VK_NULL_HANDLE, &imageIndex);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		// Nothing was acquired (or signaled), so just try again with a new swapchain next frame.
+		recreateSwapchain();
+		return;
+	}
+	else if (result == VK_SUBOPTIMAL_KHR)
+	{
+		// Still presentable and the semaphore will be signaled. Finish the frame and recreate after.
+		swapchainOutOfDate = true;
+	}
+	else
+	{
+		HANDLE_VK(result, "Acquiring next swapchain image");
+	}
+	presentLatency.onAcquired(imageIndex, acquireStart);
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Physics goes first on the async compute queue. Nothing can bail out of the
+	//	frame past this point, so the graphics submit always consumes its semaphore.
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	if (asyncComputeEnabled)
+		submitPhysicsStep(frameIndex);
+	if (!secondaryWorkers.empty())
+		stepSecondaryDevices(frameIndex);
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Record and submit
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	VkCommandBuffer commandBuffer = commandBuffers[frameIndex];
+	HANDLE_VK(dispatch.vkResetCommandBuffer(commandBuffer, 0),
+		"Resetting frame %u's command buffer", frameIndex);
+	recordFrame(commandBuffer, frameIndex, imageIndex);
+
+	// The swapchain semaphores have to stay binary, the timeline value takes the place of a frame fence.
+	// Only the stages that read the physics state wait on it, the rest of the frame overlaps the step.
+	if (asyncComputeEnabled)
+	{
+		frameTimelineValues[frameIndex] = graphicsTimeline.submit(1, &commandBuffer,
+			{}, // Timeline waits
+			{ // Binary waits
+				{ imageAvailableSemaphores[frameIndex], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT },
+				{ physicsDoneSemaphores[frameIndex], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT }
+			},
+			{ renderFinishedSemaphores[imageIndex] }); // Binary signals
+		stateReadValues[physics.getCurrentStateIndex()] = frameTimelineValues[frameIndex];
+	}
+	else
+	{
+		frameTimelineValues[frameIndex] = graphicsTimeline.submit(1, &commandBuffer,
+			{}, // Timeline waits
+			{ { imageAvailableSemaphores[frameIndex], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT } }, // Binary waits
+			{ renderFinishedSemaphores[imageIndex] }); // Binary signals
+	}
+	if (!frameNumber)
+		firstFrameTime = PresentLatencyTracker::Clock::now();
+	frameNumber++;
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Present
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	VkPresentInfoKHR presentInfo = {
+		VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
 		nullptr, // pNext
-		0, // Flags
-		VK_TRUE, // Depth Test Enable
-		VK_TRUE, // Depth Write Enable
-		VK_COMPARE_OP_LESS, // Depth Compare Op
-		VK_FALSE, // Depth Bounds Test Enable
-		VK_FALSE, // Stencil Test Enable
-		{ // Front Stencil Op State
-			VK_STENCIL_OP_KEEP, // Fail Op
-			VK_STENCIL_OP_KEEP, // Pass Op
-			VK_STENCIL_OP_KEEP, // Depth Fail Op
-			VK_COMPARE_OP_ALWAYS, // Compare Op
-			0U, // Compare Mask
-			0U, // Write Mask
-			0U  // Reference
-		},
-		{ // Back Stencil Op State
-			VK_STENCIL_OP_KEEP, // Fail Op
-			VK_STENCIL_OP_KEEP, // Pass Op
-			VK_STENCIL_OP_KEEP, // Depth Fail Op
-			VK_COMPARE_OP_ALWAYS, // Compare Op
-			0U, // Compare Mask
-			0U, // Write Mask
-			0U  // Reference
-		},
-		0.0f, // Min Depth Bounds
-		1.0f // Max Depth Bounds
+		1, // Wait semaphore count
+		&renderFinishedSemaphores[imageIndex], // Wait semaphores
+		1, // Swapchain count
+		&swapchain, // Swapchains
+		&imageIndex, // Image indices
+		nullptr // Results
 	};
 
-	VkPipelineColorBlendAttachmentState colorBlendAttachmentState = {
-		VK_FALSE, // Blend enable
-		VK_BLEND_FACTOR_ZERO, // Source color blend factor
-		VK_BLEND_FACTOR_ZERO, // Destination color blend factor
-		VK_BLEND_OP_ADD, // Color Blend operator
-		VK_BLEND_FACTOR_ZERO, // Source Alpha Blend factor
-		VK_BLEND_FACTOR_ZERO, // Destination alpha blend factor
-		VK_BLEND_OP_ADD, // Alhpa blend operator
-		VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT // Color Write mask
-	};
+	auto presentStart = PresentLatencyTracker::Clock::now();
+	result = dispatch.vkQueuePresentKHR(graphicsQueues[0], &presentInfo);
+	presentLatency.onPresented(imageIndex, presentStart);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+		swapchainOutOfDate = true;
+	else
+		HANDLE_VK(result, "Presenting swapchain image %u", imageIndex);
+
+	// Recreating here (instead of at the start of the next frame) gets the new swapchain going
+	//	while the GPU is still busy with the frame we just submitted.
+	if (swapchainOutOfDate)
+		recreateSwapchain();
+}
+
+void VulkanEngine::recordFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t imageIndex)
+{
+	const DeviceDispatch &dispatch = deviceDispatch[0];
 
-	VkPipelineColorBlendStateCreateInfo colorBlendState = {
-		VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+	VkCommandBufferBeginInfo beginInfo = {
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 		nullptr, // pNext
-		0, // Flags
-		VK_FALSE, // Logic Op Enable
-		VK_LOGIC_OP_COPY, // Logic Op
-		1, // Attachment count
-		&colorBlendAttachmentState, // Attachment states
-		{ 1.0f, 1.0f, 1.0f, 1.0f } // Blend Constants
+		VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, // Flags
+		nullptr // Inheritance info
 	};
+	HANDLE_VK(dispatch.vkBeginCommandBuffer(commandBuffer, &beginInfo),
+		"Beginning frame %u's command buffer", frameIndex);
+	uint32_t frameScope = gpuProfiler.beginScope(commandBuffer, "Frame", GPU_LANE_GRAPHICS);
 
-	VkGraphicsPipelineCreateInfo graphicsPipelineCreateInfo = {
-		VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-		nullptr, // pNext,
-		0, // flags
-		2, // Stage count
-		pipelineShaderStageCreateInfos, // Stages
-		&vertexInputStateCreateInfo, // Vertex Input State
-		&inputAssemblyStateCreateInfo, // Input Assembly State
-		nullptr, // Tessellation state
-		&viewportStateCreateInfo, // Viewport State
-		&rasterizationState, // Rasterization state
-		&multisampleState, // Multisample state
-		&depthStencilState, // Depth Stencil State
-		&colorBlendState, // Color Blend State
-		nullptr, // Dynamic State
-		simplePipelineLayout, // Layout. TODO: Create the pipeline layout and add it here.
-		simpleRenderPass, // Render pass
-		0, // Sub-pass index
-		VK_NULL_HANDLE, // Base Pipeline Handle
-		0 // Base pipeline index
-	};
-
-	HANDLE_VK(vkCreateGraphicsPipelines(devices[0], pipelineCache, 1, &graphicsPipelineCreateInfo, nullptr, &simpleGraphicsPipeline),
-		"Creating graphics pipeline");
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Per-frame uniforms (the culling's parameters) come out of this frame's region
+	//	of the upload arena. The timeline wait in drawFrame() guarantees the GPU is
+	//	done reading it.
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	uploadArena.beginFrame(frameIndex);
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Everything else is the render graph's passes, see buildRenderGraph().
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	frameContext.imageIndex = imageIndex;
+	frameContext.renderWidth = dynamicResolutionEnabled ? dynamicResolution.getRenderWidth() : screenWidth;
+	frameContext.renderHeight = dynamicResolutionEnabled ? dynamicResolution.getRenderHeight() : screenHeight;
+	frameContext.drawAsteroids = asteroidRenderer.hasMeshes();
+	if (frameContext.drawAsteroids)
+		getAsteroidCamera(frameContext.camera);
+	renderGraph.setImportedImage(backBufferResource, swapchainImages[imageIndex]);
+	if (occlusionCullingEnabled)
+	{
+		hiZPyramid.recordPrepare(commandBuffer);
+		renderGraph.setImportedImage(hiZResource, hiZPyramid.getImage());
+	}
+	renderGraph.execute(commandBuffer, frameIndex, gpuProfiler);
+	uploadArena.flush();
+
+	gpuProfiler.endScope(commandBuffer, frameScope);
+	HANDLE_VK(dispatch.vkEndCommandBuffer(commandBuffer),
+		"Ending frame %u's command buffer", frameIndex);
+}
+
+void VulkanEngine::getAsteroidCamera(AsteroidCamera &camera)
+{
+	// Goes around at a fixed rate per simulated second, so it moves the same whatever the frame rate.
+	float angle = CAMERA_ORBIT_SPEED * PHYSICS_TIME_STEP * static_cast<float>(frameNumber);
+	float eye[3] = { cosf(angle) * CAMERA_ORBIT_RADIUS, CAMERA_ORBIT_HEIGHT, sinf(angle) * CAMERA_ORBIT_RADIUS };
+	float target[3] = { cosf(angle + 0.3f) * CAMERA_ORBIT_RADIUS, 0.0f, sinf(angle + 0.3f) * CAMERA_ORBIT_RADIUS };
+	float worldUp[3] = { 0.0f, 1.0f, 0.0f };
+
+	float view[16];
+	float projection[16];
+	lookAtMatrix(eye, target, worldUp, view, camera.right, camera.up);
+	// The aspect is the screen's, which the scene's scaled up to. Its pixels are the scene's, so LODs
+	//	(and the Hi-Z tests) are picked at the resolution it's drawn at.
+	perspectiveMatrix(CAMERA_FOV_Y, static_cast<float>(screenWidth) / static_cast<float>(screenHeight), CAMERA_NEAR, CAMERA_FAR, projection);
+	float width = static_cast<float>(frameContext.renderWidth);
+	float height = static_cast<float>(frameContext.renderHeight);
+	multiplyMatrices(projection, view, camera.viewProj);
+
+	for (uint32_t i = 0; i < 3; i++)
+		camera.position[i] = eye[i];
+	camera.pixelsPerUnit = height / (2.0f * tanf(CAMERA_FOV_Y * 0.5f));
+	camera.viewportSize[0] = width;
+	camera.viewportSize[1] = height;
 }
@@ -4,54 +4,181 @@
 #include <stdint.h>
 #include <vector>
 #include <utility>
+#include "vulkanBindless.h"
+#include "vulkanUploadArena.h"
+#include "vulkanPresent.h"
+#include "vulkanDeletionQueue.h"
+#include "vulkanTimeline.h"
+#include "vulkanCapabilities.h"
+#include "vulkanDebugSink.h"
+#include "vulkanHostMemory.h"
+#include "vulkanDispatch.h"
+#include "vulkanShaders.h"
+#include "vulkanPhysics.h"
+#include "vulkanGpuProfiler.h"
+#include "vulkanMultiDevice.h"
+#include "vulkanKernelTuning.h"
+#include "vulkanMeshPool.h"
+#include "vulkanAsteroidField.h"
+#include "vulkanAsteroidRenderer.h"
+#include "vulkanHiZPyramid.h"
+#include "vulkanRenderGraph.h"
+#include "vulkanDynamicResolution.h"
+
+// How many frames the CPU can record ahead of the GPU.
+#define MAX_FRAMES_IN_FLIGHT 2
 
 struct SDL_Window;
 
 class VulkanEngine
 {
+	HostMemory hostMemory; // Allocation callbacks for every Vulkan object the engine creates, by scope.
+	HostArena initArena; // Temporary data during init and swapchain (re)creation.
 	VkInstance instance = 0;
 	bool khrSurfaceExtEnabled = false;
 	uint32_t numPhysicalDevices = 0;
-	VkPhysicalDevice *physicalDevices = nullptr;
-	std::vector<std::pair<uint32_t, VkQueueFamilyProperties *>> physicalDeviceQueueFamilies;
+	std::vector<VkPhysicalDevice> physicalDevices;
+	VulkanCapabilities capabilities; // Instance and physical device capabilities, queried once.
 	std::vector<uint32_t> graphicsQueueFamilyIndex; // One per physical device
 	std::vector<uint32_t> transferQueueFamilyIndex; // One per physical device
 	std::vector<VkQueue> graphicsQueues; // One per physical device
+	std::vector<uint32_t> computeQueueFamilyIndex; // One per physical device. The graphics family when there's no async compute queue.
+	std::vector<VkQueue> computeQueues; // One per physical device. The graphics queue when there's no async compute queue.
+	bool asyncComputeEnabled = false; // devices[0] has a compute queue of its own, physics runs on it.
 	std::vector<VkDevice> devices;
+	std::vector<DeviceDispatch> deviceDispatch; // One per device. Use these instead of the loader's vk* device functions.
+	std::vector<ShaderLibrary> shaderLibraries; // One per device.
+	VkPhysicalDeviceProperties primaryDeviceProperties; // Properties of physicalDevices[0]
+	VkPhysicalDeviceMemoryProperties primaryDeviceMemoryProperties; // Memory properties of physicalDevices[0]
 	std::vector<VkCommandPool> commandPools; // One per device.
-	std::vector<VkCommandBuffer> commandBuffers; // One per swapchain image. (ignoring multi-device for now)
+	std::vector<VkCommandBuffer> commandBuffers; // One per frame in flight. (ignoring multi-device for now)
+	std::vector<VkSemaphore> imageAvailableSemaphores; // One per frame in flight
+	uint64_t frameNumber = 0; // Number of frames submitted so far.
+	bool timelineSemaphoresEnabled = false; // VK_KHR_timeline_semaphore is enabled on devices[0].
+	bool multiDrawIndirectEnabled = false; // multiDrawIndirect and drawIndirectFirstInstance are enabled on devices[0].
+	QueueTimeline graphicsTimeline; // Counter for graphicsQueues[0].
+	uint64_t frameTimelineValues[MAX_FRAMES_IN_FLIGHT] = {}; // Graphics timeline value each frame in flight last signaled.
+	// Objects are queued with a graphics timeline value: 'graphicsTimeline.getNextValue()' for
+	//	anything used by the frame being recorded.
+	DeferredDeletionQueue deletionQueue;
+	QueueTimeline computeTimeline; // Counter for computeQueues[0]. (Only with async compute.)
+	VkCommandPool computeCommandPool = VK_NULL_HANDLE; // (Only with async compute.)
+	std::vector<VkCommandBuffer> computeCommandBuffers; // One per frame in flight. (Only with async compute.)
+	std::vector<VkSemaphore> physicsDoneSemaphores; // One per frame in flight, signaled by the physics step and waited on by the frame's graphics submit.
+	uint64_t stateReadValues[2] = {}; // Graphics timeline value of the last frame that read physics state buffer i. (Only with async compute.)
+	PhysicsSimulation physics;
+	GpuProfiler gpuProfiler;
+	// USE_MULTI_GPU: the other devices simulate bodies of their own, which get staged through host
+	//	memory into remoteBodiesBuffer on devices[0]. The asteroid renderer draws them after the local ones.
+	std::vector<SecondaryDeviceWorker> secondaryWorkers; // [i] runs on devices[i + 1]
+	VkBuffer remoteBodiesBuffer = VK_NULL_HANDLE; // Device local, every worker's bodies back to back.
+	VkDeviceMemory remoteBodiesMemory = VK_NULL_HANDLE;
+	VkBuffer remoteStagingBuffer = VK_NULL_HANDLE; // Host visible, one remoteBodiesSize region per frame in flight.
+	VkDeviceMemory remoteStagingMemory = VK_NULL_HANDLE;
+	uint8_t *remoteStagingData = nullptr;
+	VkDeviceSize remoteBodiesSize = 0;
+	uint32_t numRemoteBodies = 0;
+	bool remoteBodiesStaged[MAX_FRAMES_IN_FLIGHT] = {}; // The frame's staging region has to be copied to remoteBodiesBuffer.
+	bool remoteBodiesCleared = false; // Zeroed (massless, so never drawn) until the first copy lands.
+	PresentLatencyTracker::Clock::time_point firstFrameTime;
+	SDL_Window *window = nullptr;
 	uint32_t screenWidth;
 	uint32_t screenHeight;
-	VkSurfaceKHR surface;
-	VkSwapchainKHR swapchain;
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
+	VkSwapchainKHR swapchain = VK_NULL_HANDLE;
 	std::vector<VkImage> swapchainImages;
+	std::vector<VkImageView> swapchainImageViews; // One per swapchain image
+	std::vector<VkFramebuffer> framebuffers; // [frameIndex * swapchain images + imageIndex], or [frameIndex] with dynamic resolution.
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+	// The depth buffers are the render graph's transients, one per frame in flight so a frame's depth
+	//	test never waits on the last frame's. Attachment only (so lazily allocated where there's
+	//	memory for it) unless occlusion culling samples them for the Hi-Z pyramid.
+	VkImageView depthImageViews[MAX_FRAMES_IN_FLIGHT] = {};
+	VkImageView depthSampledViews[MAX_FRAMES_IN_FLIGHT] = {}; // Depth aspect only. (Only with occlusion culling.)
+	// Dynamic resolution: the scene's drawn to the top left of an offscreen target the size of the
+	//	swapchain (one per frame in flight, the render graph's), then blitted up to the back buffer.
+	bool dynamicResolutionEnabled = false;
+	DynamicResolution dynamicResolution;
+	uint64_t numGpuFramesMeasured = 0; // GPU profiler frames the controller's seen.
+	VkImageView sceneColorViews[MAX_FRAMES_IN_FLIGHT] = {}; // (Only with dynamic resolution.)
+	std::vector<VkSemaphore> renderFinishedSemaphores; // One per swapchain image, waited on by the present.
 	VkFormat swapchainImageFormat;
-	VkShaderModule simpleVertexShaderModule;
-	VkShaderModule simpleFragmentShaderModule;
-	VkRenderPass simpleRenderPass;
-	VkDescriptorSetLayout simpleDescriptorSetLayout;
-	VkPipelineLayout simplePipelineLayout;
-	VkPipelineCache pipelineCache;
-	VkPipeline simpleGraphicsPipeline;
-	VkDebugUtilsMessengerEXT debugUtilsMessenger; // (added cause the driver threw nullptr expressions =) )
+	VkImageUsageFlags swapchainImageUsage = 0;
+	PresentModePolicy presentModePolicy = PRESENT_POLICY_LOW_LATENCY;
+	VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	bool swapchainOutOfDate = false; // Recreate the swapchain before the next frame.
+	PresentLatencyTracker presentLatency;
+	VkRenderPass simpleRenderPass = VK_NULL_HANDLE;
+	// Occlusion culling draws in two passes over the same framebuffers: simpleRenderPass clears and
+	//	draws what the first culling phase kept, and stores the depth for the Hi-Z pyramid, then this
+	//	one loads both and draws what the second phase found. (Only with occlusion culling.)
+	VkRenderPass lateRenderPass = VK_NULL_HANDLE;
+	bool occlusionCullingEnabled = false;
+	HiZPyramid hiZPyramid; // Farthest depth of the first pass's draws. (Only with occlusion culling.)
+	// The frame's passes on devices[0], and every barrier between them. Declared by
+	//	buildRenderGraph() whenever the framebuffers are (re)created.
+	RenderGraph renderGraph;
+	uint32_t depthResource = 0; // renderGraph handles
+	uint32_t backBufferResource = 0;
+	uint32_t hiZResource = 0;
+	uint32_t sceneColorResource = 0;
+	// What the render graph's passes need to know about the frame being recorded.
+	struct FrameContext
+	{
+		uint32_t imageIndex;
+		uint32_t renderWidth; // What the scene's drawn at.
+		uint32_t renderHeight;
+		bool drawAsteroids;
+		AsteroidCamera camera;
+	};
+	FrameContext frameContext = {};
+	FrameUploadArena uploadArena; // Per-frame uniform/dynamic data, bound with dynamic offsets.
+	MeshPool meshPool; // Device-local geometry loaded from mesh files, uploaded on the graphics queue.
+	AsteroidField asteroidField; // Procedural asteroid meshes, generated in the background during startup.
+	AsteroidRenderer asteroidRenderer; // Draws the physics bodies as asteroids, LODs picked on the GPU.
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	KernelTuning kernelTuning = {}; // Constants the compute kernels get specialized with on devices[0].
+	bool bindlessEnabled = false; // Set when USE_BINDLESS is on and the device supports descriptor indexing.
+	uint32_t maxBindlessBuffers = 0;
+	uint32_t maxBindlessImages = 0;
+	BindlessDescriptorTable bindlessTable; // The asteroid renderer reads the bodies through it. (Only when bindlessEnabled.)
+	bool validationEnabled = false;
+	DebugMessageSink debugSink; // Prints the debug utils messages off the driver's thread.
+	VkDebugUtilsMessengerEXT debugUtilsMessenger = VK_NULL_HANDLE; // (added cause the driver threw nullptr expressions =) )
 
 	void createInstance(SDL_Window *sdlWindow);
 	void createDevices(void);
+	void createShaderLibraries(void);
 	void createCommandPools(void);
 	void createSurface(SDL_Window *sdlWindow);
-	void createSwapchain(uint32_t width, uint32_t height);
+	bool createSwapchain(uint32_t width, uint32_t height);
+	void recreateSwapchain(void);
+	void createSyncObjects(void);
 	void createRenderPass(void);
-	void createGraphicsPipelineLayout(void);
-	void createGraphicsPipeline(void);
-
-	struct SimpleVertex
-	{
-		float pos[3];
-	};
+	void createFramebuffers(void);
+	void buildRenderGraph(void);
+	void createPipelineCache(void);
+	void createUploadArena(void);
+	void createMeshPool(void);
+	void createAsteroidField(void);
+	void createPhysics(void);
+	void createAsteroidRenderer(void);
+	void submitPhysicsStep(uint32_t frameIndex);
+	void stepSecondaryDevices(uint32_t frameIndex);
+	void recordFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t imageIndex);
+	void recordDraw(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkRenderPass renderPass);
+	void getAsteroidCamera(AsteroidCamera &camera);
 
 public:
 	VulkanEngine(void);
 	~VulkanEngine(void);
 
 	void init(SDL_Window *sdlWindow, int screenWidth, int screenHeight);
+	void drawFrame(void);
+
+	// Let the engine know the window changed size. Not every platform reports it through vkAcquireNextImageKHR.
+	void onWindowResized(void) { swapchainOutOfDate = true; }
+
+	// Takes effect on the next frame by recreating the swapchain.
+	void setPresentModePolicy(PresentModePolicy policy);
 };
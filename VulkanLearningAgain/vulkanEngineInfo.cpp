@@ -1,4 +1,5 @@
 #include "vulkanEngineInfo.h"
+#include <vector>
 #include "vulkanDebug.h"
 
 // Squashing the overall definition of the tabbedPrintf to save on repeat lines.
@@ -15,75 +16,45 @@
 		printf(args...); \
 	};
 
-void printInstanceLayerExtensions(const char *layerName, uint8_t tabLayer = 0)
+void printInstanceLayerExtensions(const char *layerName, const std::vector<VkExtensionProperties> &extensionProperties, uint8_t tabLayer = 0)
 {
 	DEFINE_TABBED_PRINTF(tabLayer);
 
-	// Get what extensions are available.
-	uint32_t numInstanceLayerExtensions;
-	HANDLE_VK(vkEnumerateInstanceExtensionProperties(layerName,
-			&numInstanceLayerExtensions, nullptr),
-		"Querying number of Vulkan instance extensions for layer \"%s\"",
-		layerName);
-	VkExtensionProperties *extensionProperties = numInstanceLayerExtensions ?
-		new VkExtensionProperties[numInstanceLayerExtensions] : nullptr;
-	if (extensionProperties)
-	{
-		HANDLE_VK(vkEnumerateInstanceExtensionProperties(layerName,
-				&numInstanceLayerExtensions,
-				extensionProperties),
-			"Querying Vulkan instance layer properties (layer: %s)",
-			layerName);
-	}
-
-	tabbedPrintf("Num %sExtensions: %u\n", strlen(layerName) ? "" : "Instance ", numInstanceLayerExtensions);
-	for (uint32_t j = 0; j < numInstanceLayerExtensions; j++)
+	tabbedPrintf("Num %sExtensions: %zu\n", strlen(layerName) ? "" : "Instance ", extensionProperties.size());
+	for (const VkExtensionProperties &extension : extensionProperties)
 	{
 		tabbedPrintf("\t%s : %u.%u.%u\n",
-			extensionProperties[j].extensionName,
-			VK_VERSION_MAJOR(extensionProperties[j].specVersion),
-			VK_VERSION_MINOR(extensionProperties[j].specVersion),
-			VK_VERSION_PATCH(extensionProperties[j].specVersion));
+			extension.extensionName,
+			VK_VERSION_MAJOR(extension.specVersion),
+			VK_VERSION_MINOR(extension.specVersion),
+			VK_VERSION_PATCH(extension.specVersion));
 	}
-
-	// Cleanup
-	delete[] extensionProperties;
 }
 
-void printInstanceCapabilities(void)
+void printInstanceCapabilities(const VulkanCapabilities &capabilities)
 {
-	// Get what the instance layer properties are available.
-	uint32_t numInstanceProperties;
-	HANDLE_VK(vkEnumerateInstanceLayerProperties(&numInstanceProperties, nullptr),
-		"Querying number of Vulkan instance layer properties");
-	VkLayerProperties *instanceLayerProperties = numInstanceProperties ? new VkLayerProperties[numInstanceProperties] : nullptr;
-	if (instanceLayerProperties)
-	{
-		HANDLE_VK(vkEnumerateInstanceLayerProperties(&numInstanceProperties, instanceLayerProperties),
-			"Querying Vulkan instance layer properties");
-	}
-
 	// Print the instance capabilities out to the user
-	printf("Number of Vulkan Instance Layer Properties: %u\n", numInstanceProperties);
-	for (uint32_t i = 0; i < numInstanceProperties; i++)
+	const std::vector<VulkanCapabilities::LayerInfo> &instanceLayers = capabilities.getInstanceLayers();
+	printf("Number of Vulkan Instance Layer Properties: %zu\n", instanceLayers.size());
+	for (const VulkanCapabilities::LayerInfo &layer : instanceLayers)
 	{
 		printf("\t%s : %u.%u.%u : %u.%u.%u : %s\n",
-			instanceLayerProperties[i].layerName,
-			VK_VERSION_MAJOR(instanceLayerProperties[i].specVersion),
-			VK_VERSION_MINOR(instanceLayerProperties[i].specVersion),
-			VK_VERSION_PATCH(instanceLayerProperties[i].specVersion),
-			VK_VERSION_MAJOR(instanceLayerProperties[i].implementationVersion),
-			VK_VERSION_MINOR(instanceLayerProperties[i].implementationVersion),
-			VK_VERSION_PATCH(instanceLayerProperties[i].implementationVersion),
-			instanceLayerProperties[i].description);
-
-		// Get what extensions are available.
-		printInstanceLayerExtensions(instanceLayerProperties[i].layerName, 2);
+			layer.properties.layerName,
+			VK_VERSION_MAJOR(layer.properties.specVersion),
+			VK_VERSION_MINOR(layer.properties.specVersion),
+			VK_VERSION_PATCH(layer.properties.specVersion),
+			VK_VERSION_MAJOR(layer.properties.implementationVersion),
+			VK_VERSION_MINOR(layer.properties.implementationVersion),
+			VK_VERSION_PATCH(layer.properties.implementationVersion),
+			layer.properties.description);
+
+		// Print what extensions are available.
+		printInstanceLayerExtensions(layer.properties.layerName, layer.extensions, 2);
 	}
 
 
-	// Get what extensions are available for the instance itself.
-	printInstanceLayerExtensions("", 0);
+	// Print what extensions are available for the instance itself.
+	printInstanceLayerExtensions("", capabilities.getInstanceExtensions(), 0);
 
 	printf("\n");
 }
@@ -262,16 +233,14 @@ void printPhysicalDeviceProperties(VkPhysicalDeviceProperties &properties, bool
 	tabbedPrintf("\tresidencyNonResidentStrict: %s\n", properties.sparseProperties.residencyNonResidentStrict ? "TRUE" : "FALSE");
 }
 
-void printPhysicalDeviceQueueFamilyProperties(VkPhysicalDevice physicalDevice, uint8_t tabLayer)
+void printPhysicalDeviceQueueFamilyProperties(VkPhysicalDevice physicalDevice, const VulkanCapabilities::DeviceInfo &deviceInfo, uint8_t tabLayer)
 {
 	DEFINE_TABBED_PRINTF(tabLayer);
 
 	// Print the physical device queue family properties.
-	uint32_t numQueueFamilies;
-	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &numQueueFamilies, nullptr);
-	VkQueueFamilyProperties *queueFamilyProperties = new VkQueueFamilyProperties[numQueueFamilies];
-	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &numQueueFamilies, queueFamilyProperties);
-	
+	uint32_t numQueueFamilies = static_cast<uint32_t>(deviceInfo.queueFamilies.size());
+	const VkQueueFamilyProperties *queueFamilyProperties = deviceInfo.queueFamilies.data();
+
 	tabbedPrintf("Num queue family properties: %u\n", numQueueFamilies);
 	for (uint32_t j = 0; j < numQueueFamilies; j++)
 	{
@@ -297,81 +266,53 @@ void printPhysicalDeviceQueueFamilyProperties(VkPhysicalDevice physicalDevice, u
 			queueFamilyProperties[j].minImageTransferGranularity.depth);
 		putc('\n', stdout);
 	}
-
-	delete[] queueFamilyProperties;
 };
 
-void printPhysicalDeviceLayerExtensions(VkPhysicalDevice physicalDevice, const char *layerName, uint8_t tabLayer)
+void printPhysicalDeviceLayerExtensions(const char *layerName, const std::vector<VkExtensionProperties> &exts, uint8_t tabLayer)
 {
 	DEFINE_TABBED_PRINTF(tabLayer);
 
-	uint32_t numExt;
-	HANDLE_VK(vkEnumerateDeviceExtensionProperties(physicalDevice,
-			layerName, &numExt, nullptr),
-		"Querying for number of extensions of layer \"%s\" on physical device\n",
-		layerName);
-	tabbedPrintf("Number of %sextensions: %u\n", strlen(layerName) ? "" : "device ", numExt);
-	VkExtensionProperties *exts = numExt ? new VkExtensionProperties[numExt] : nullptr;
-	if (exts)
+	tabbedPrintf("Number of %sextensions: %zu\n", strlen(layerName) ? "" : "device ", exts.size());
+	for (const VkExtensionProperties &extension : exts)
 	{
-		HANDLE_VK(vkEnumerateDeviceExtensionProperties(physicalDevice,
-				layerName, &numExt, exts),
-			"Querying for number of extensions of layer \"%s\" on physical device\n",
-			layerName);
-
-		for (uint32_t k = 0; k < numExt; k++)
-		{
-			tabbedPrintf("\tExtension: %s : %u.%u.%u\n",
-				exts[k].extensionName,
-				VK_VERSION_MAJOR(exts[k].specVersion),
-				VK_VERSION_MINOR(exts[k].specVersion),
-				VK_VERSION_PATCH(exts[k].specVersion));
-		}
-
-		delete[] exts;
+		tabbedPrintf("\tExtension: %s : %u.%u.%u\n",
+			extension.extensionName,
+			VK_VERSION_MAJOR(extension.specVersion),
+			VK_VERSION_MINOR(extension.specVersion),
+			VK_VERSION_PATCH(extension.specVersion));
 	}
 }
 
-void printPhysicalDeviceLayers(VkPhysicalDevice physicalDevice, uint8_t tabLayer)
+void printPhysicalDeviceLayers(const VulkanCapabilities::DeviceInfo &deviceInfo, uint8_t tabLayer)
 {
 	DEFINE_TABBED_PRINTF(tabLayer);
 
-	uint32_t numLayers;
-	HANDLE_VK(vkEnumerateDeviceLayerProperties(physicalDevice, &numLayers, nullptr),
-		"Querying number of device layers on physical device\n");
-	VkLayerProperties *layers = numLayers ? new VkLayerProperties[numLayers] : nullptr;
-	if (layers)
+	if (deviceInfo.layers.size())
 	{
-		HANDLE_VK(vkEnumerateDeviceLayerProperties(physicalDevice, &numLayers, layers),
-			"Querying device layers on physical device\n");
-
-		tabbedPrintf("Number of device layers: %u\n", numLayers);
-		for (uint32_t j = 0; j < numLayers; j++)
+		tabbedPrintf("Number of device layers: %zu\n", deviceInfo.layers.size());
+		for (const VulkanCapabilities::LayerInfo &layer : deviceInfo.layers)
 		{
 			tabbedPrintf("\tLayer: %s : %u.%u.%u : %u.%u.%u : %s\n",
-				layers[j].layerName,
-				VK_VERSION_MAJOR(layers[j].specVersion),
-				VK_VERSION_MINOR(layers[j].specVersion),
-				VK_VERSION_PATCH(layers[j].specVersion),
-				VK_VERSION_MAJOR(layers[j].implementationVersion),
-				VK_VERSION_MINOR(layers[j].implementationVersion),
-				VK_VERSION_PATCH(layers[j].implementationVersion),
-				layers[j].description);
-
-			// Get the extensions for this layer
-			printPhysicalDeviceLayerExtensions(physicalDevice, layers[j].layerName, tabLayer+2);
+				layer.properties.layerName,
+				VK_VERSION_MAJOR(layer.properties.specVersion),
+				VK_VERSION_MINOR(layer.properties.specVersion),
+				VK_VERSION_PATCH(layer.properties.specVersion),
+				VK_VERSION_MAJOR(layer.properties.implementationVersion),
+				VK_VERSION_MINOR(layer.properties.implementationVersion),
+				VK_VERSION_PATCH(layer.properties.implementationVersion),
+				layer.properties.description);
+
+			// Print the extensions for this layer
+			printPhysicalDeviceLayerExtensions(layer.properties.layerName, layer.extensions, tabLayer+2);
 		}
-
-		delete[] layers;
 	}
 }
 
-void printPhysicalDeviceFeatures(VkPhysicalDevice physicalDevice, uint8_t tabLayer)
+void printPhysicalDeviceFeatures(const VulkanCapabilities::DeviceInfo &deviceInfo, uint8_t tabLayer)
 {
 	DEFINE_TABBED_PRINTF(tabLayer);
 
-	VkPhysicalDeviceFeatures features;
-	vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+	const VkPhysicalDeviceFeatures &features = deviceInfo.features;
 	tabbedPrintf("robustBufferAccess: %s\n", features.robustBufferAccess ? "True" : "False");
 	tabbedPrintf("fullDrawIndexUint32: %s\n", features.fullDrawIndexUint32 ? "True" : "False");
 	tabbedPrintf("imageCubeArray: %s\n", features.imageCubeArray ? "True" : "False");
@@ -427,14 +368,25 @@ void printPhysicalDeviceFeatures(VkPhysicalDevice physicalDevice, uint8_t tabLay
 	tabbedPrintf("sparseResidencyAliased: %s\n", features.sparseResidencyAliased ? "True" : "False");
 	tabbedPrintf("variableMultisampleRate: %s\n", features.variableMultisampleRate ? "True" : "False");
 	tabbedPrintf("inheritedQueries: %s\n", features.inheritedQueries ? "True" : "False");
+
+	// Descriptor indexing features (used for bindless descriptors)
+	const VkPhysicalDeviceDescriptorIndexingFeaturesEXT &indexingFeatures = deviceInfo.descriptorIndexingFeatures;
+	tabbedPrintf("Descriptor Indexing:\n");
+	tabbedPrintf("\truntimeDescriptorArray: %s\n", indexingFeatures.runtimeDescriptorArray ? "True" : "False");
+	tabbedPrintf("\tdescriptorBindingPartiallyBound: %s\n", indexingFeatures.descriptorBindingPartiallyBound ? "True" : "False");
+	tabbedPrintf("\tdescriptorBindingVariableDescriptorCount: %s\n", indexingFeatures.descriptorBindingVariableDescriptorCount ? "True" : "False");
+	tabbedPrintf("\tdescriptorBindingUpdateUnusedWhilePending: %s\n", indexingFeatures.descriptorBindingUpdateUnusedWhilePending ? "True" : "False");
+	tabbedPrintf("\tdescriptorBindingStorageBufferUpdateAfterBind: %s\n", indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind ? "True" : "False");
+	tabbedPrintf("\tdescriptorBindingSampledImageUpdateAfterBind: %s\n", indexingFeatures.descriptorBindingSampledImageUpdateAfterBind ? "True" : "False");
+	tabbedPrintf("\tshaderStorageBufferArrayNonUniformIndexing: %s\n", indexingFeatures.shaderStorageBufferArrayNonUniformIndexing ? "True" : "False");
+	tabbedPrintf("\tshaderSampledImageArrayNonUniformIndexing: %s\n", indexingFeatures.shaderSampledImageArrayNonUniformIndexing ? "True" : "False");
 }
 
-void printPhysicalDeviceMemoryDetails(VkPhysicalDevice physicalDevice, uint8_t tabLayer)
+void printPhysicalDeviceMemoryDetails(const VulkanCapabilities::DeviceInfo &deviceInfo, uint8_t tabLayer)
 {
 	DEFINE_TABBED_PRINTF(tabLayer);
 
-	VkPhysicalDeviceMemoryProperties memProps;
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProps);
+	const VkPhysicalDeviceMemoryProperties &memProps = deviceInfo.memoryProperties;
 
 	tabbedPrintf("Physical Memory Types:\n");
 	for (uint32_t j = 0; j < memProps.memoryTypeCount; j++)
@@ -465,11 +417,11 @@ void printPhysicalDisplayProperties(VkPhysicalDevice physicalDevice, uint8_t tab
 
 	uint32_t numPhysicalDisplays = 0;
 	HANDLE_VK(vkGetPhysicalDeviceDisplayPropertiesKHR(physicalDevice, &numPhysicalDisplays, nullptr), "Getting number of physical displays");
-	VkDisplayPropertiesKHR *displayProperties = numPhysicalDisplays ? new VkDisplayPropertiesKHR[numPhysicalDisplays] : nullptr;
+	std::vector<VkDisplayPropertiesKHR> displayProperties(numPhysicalDisplays);
 	tabbedPrintf("Number of physical displays: %u\n", numPhysicalDisplays);
-	if (displayProperties)
+	if (numPhysicalDisplays)
 	{
-		HANDLE_VK(vkGetPhysicalDeviceDisplayPropertiesKHR(physicalDevice, &numPhysicalDisplays, displayProperties),
+		HANDLE_VK(vkGetPhysicalDeviceDisplayPropertiesKHR(physicalDevice, &numPhysicalDisplays, displayProperties.data()),
 			"Getting physical display properties");
 
 		for (uint32_t i = 0; i < numPhysicalDisplays; i++)
@@ -486,38 +438,38 @@ void printPhysicalDisplayProperties(VkPhysicalDevice physicalDevice, uint8_t tab
 			tabbedPrintf("\tPersistent Content: %s\n", displayProperties[i].persistentContent ? "TRUE" : "FALSE");
 			// TODO: Print out display plane properties.
 		}
-
-		delete[] displayProperties;
 	}
 }
 
-void printPhysicalDeviceDetails(uint32_t numPhysicalDevices, VkPhysicalDevice * physicalDevices, bool printFullDeviceDetails)
+void printPhysicalDeviceDetails(const VulkanCapabilities &capabilities, VkPhysicalDevice * physicalDevices, bool printFullDeviceDetails)
 {
+	uint32_t numPhysicalDevices = capabilities.getNumDevices();
 	printf("Number of Vulkan physical devices: %u\n", numPhysicalDevices);
 	for (uint32_t i = 0; i < numPhysicalDevices; i++)
 	{
 		// Start with the physical device properties.
-		VkPhysicalDeviceProperties physicalDeviceProperties;
-		vkGetPhysicalDeviceProperties(physicalDevices[i], &physicalDeviceProperties);
+		const VulkanCapabilities::DeviceInfo &deviceInfo = capabilities.getDevice(i);
+		VkPhysicalDeviceProperties physicalDeviceProperties = deviceInfo.properties;
 
 		printf("\tDevice Name: %s\n", physicalDeviceProperties.deviceName);
 		if (printFullDeviceDetails)
 		{
 			// Print the remaining physical device properties without the name.
 			printPhysicalDeviceProperties(physicalDeviceProperties, false, 2);
+			printf("\t\tSubgroup Size: %u\n", deviceInfo.subgroupSize);
 
 			// Print the physical device queue family properties.
-			printPhysicalDeviceQueueFamilyProperties(physicalDevices[i], 2);
+			printPhysicalDeviceQueueFamilyProperties(physicalDevices[i], deviceInfo, 2);
 
 			// Print out layers and extensions
-			printPhysicalDeviceLayers(physicalDevices[i], 2);
+			printPhysicalDeviceLayers(deviceInfo, 2);
 
-			// Get the extensions for the overall device.
-			printPhysicalDeviceLayerExtensions(physicalDevices[i], "", 2);
+			// Print the extensions for the overall device.
+			printPhysicalDeviceLayerExtensions("", deviceInfo.extensions, 2);
 
-			// Get features
+			// Print features
 			printf("\t\tFeatures:\n");
-			printPhysicalDeviceFeatures(physicalDevices[i], 3);
+			printPhysicalDeviceFeatures(deviceInfo, 3);
 			putc('\n', stdout);
 
 			// Get the physical display properties
@@ -525,7 +477,7 @@ void printPhysicalDeviceDetails(uint32_t numPhysicalDevices, VkPhysicalDevice *
 			//printPhysicalDisplayProperties(physicalDevices[i], 2);
 
 			// Get the physical memory details
-			printPhysicalDeviceMemoryDetails(physicalDevices[i], 2);
+			printPhysicalDeviceMemoryDetails(deviceInfo, 2);
 		}
 	}
 	putc('\n', stdout);
@@ -633,10 +585,10 @@ void printPhysicalSurfaceDetails(VkPhysicalDevice *physicalDevices, uint32_t num
 		uint32_t numFormats;
 		HANDLE_VK(vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevices[i], surface, &numFormats, nullptr),
 			"Getting number of surface formats on device %u", i);
-		VkSurfaceFormatKHR *formats = numFormats ? new VkSurfaceFormatKHR[numFormats] : nullptr;
-		if (formats)
+		std::vector<VkSurfaceFormatKHR> formats(numFormats);
+		if (numFormats)
 		{
-			HANDLE_VK(vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevices[i], surface, &numFormats, formats),
+			HANDLE_VK(vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevices[i], surface, &numFormats, formats.data()),
 				"Getting surface formats on device %u", i);
 
 			printf("Num supported formats: %u\n", numFormats);
@@ -647,19 +599,17 @@ void printPhysicalSurfaceDetails(VkPhysicalDevice *physicalDevices, uint32_t num
 				putc('\n', stdout);
 			}
 
-			delete[] formats;
-
 			putc('\n', stdout);
 
 			// Print the present modes
 			uint32_t numPresentModes;
 			HANDLE_VK(vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevices[i], surface, &numPresentModes, nullptr),
 				"Getting number of physical surface present modes on device %u", i);
-			VkPresentModeKHR *presentModes = numPresentModes ? new VkPresentModeKHR[numPresentModes] : nullptr;
+			std::vector<VkPresentModeKHR> presentModes(numPresentModes);
 			printf("Num present modes: %u\n", numPresentModes);
-			if (presentModes)
+			if (numPresentModes)
 			{
-				HANDLE_VK(vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevices[i], surface, &numPresentModes, presentModes),
+				HANDLE_VK(vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevices[i], surface, &numPresentModes, presentModes.data()),
 					"Getting physical surface present modes on device %u", i);
 
 				for (uint32_t j = 0; j < numPresentModes; j++)
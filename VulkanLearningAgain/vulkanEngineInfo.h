@@ -2,8 +2,9 @@
 
 #include <stdint.h>
 #include <vulkan/vulkan.h>
+#include "vulkanCapabilities.h"
 
-void printInstanceCapabilities(void);
-void printPhysicalDeviceDetails(uint32_t numPhysicalDevices, VkPhysicalDevice *physicalDevices, bool printFullDeviceDetails);
+void printInstanceCapabilities(const VulkanCapabilities &capabilities);
+void printPhysicalDeviceDetails(const VulkanCapabilities &capabilities, VkPhysicalDevice *physicalDevices, bool printFullDeviceDetails);
 void printPhysicalSurfaceDetails(VkPhysicalDevice *physicalDevices, uint32_t numDevices, VkSurfaceKHR surface);
 void printFormatColorSpacePair(VkFormat format, VkColorSpaceKHR colorSpace);
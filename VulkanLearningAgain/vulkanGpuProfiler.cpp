@@ -0,0 +1,231 @@
+#include "vulkanGpuProfiler.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "vulkanDebug.h"
+
+const char *getGpuProfilerLaneName(GpuProfilerLane lane)
+{
+	switch (lane)
+	{
+	case GPU_LANE_GRAPHICS: return "Graphics";
+	case GPU_LANE_ASYNC_COMPUTE: return "Async compute";
+	default: return "Unknown";
+	}
+}
+
+void GpuProfiler::create(VkDevice device, const DeviceDispatch &dispatch, float timestampPeriod,
+	const uint32_t timestampValidBits[GPU_LANE_COUNT],
+	uint32_t numFrames, uint32_t maxScopesPerFrame,
+	const VkAllocationCallbacks *allocator)
+{
+	this->device = device;
+	this->dispatch = &dispatch;
+	this->maxScopesPerFrame = maxScopesPerFrame;
+	nanosecondsPerTick = timestampPeriod;
+
+	bool anyTimestamps = false;
+	for (uint32_t i = 0; i < GPU_LANE_COUNT; i++)
+	{
+		uint32_t validBits = timestampValidBits[i];
+		timestampMask[i] = validBits >= 64 ? ~0ULL : (validBits ? (1ULL << validBits) - 1 : 0);
+		anyTimestamps |= validBits != 0;
+	}
+
+	// Nothing can be timed, leave the profiler off.
+	if (!anyTimestamps)
+	{
+		if (VERBOSE)
+			printf("GPU profiler: Disabled (no timestamp support)\n");
+		return;
+	}
+
+	VkQueryPoolCreateInfo queryPoolCreateInfo = {
+		VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		nullptr, // pNext
+		0, // Flags
+		VK_QUERY_TYPE_TIMESTAMP, // Query type
+		numFrames * maxScopesPerFrame * 2, // Query count
+		0 // Pipeline statistics
+	};
+	HANDLE_VK(dispatch.vkCreateQueryPool(device, &queryPoolCreateInfo, allocator, &queryPool),
+		"Creating the GPU profiler query pool");
+
+	frameScopes.resize(numFrames);
+	queryResults.resize(maxScopesPerFrame * 2);
+}
+
+void GpuProfiler::destroy(const VkAllocationCallbacks *allocator)
+{
+	if (queryPool)
+		dispatch->vkDestroyQueryPool(device, queryPool, allocator);
+	queryPool = VK_NULL_HANDLE;
+}
+
+void GpuProfiler::beginFrame(uint32_t frameIndex)
+{
+	if (!queryPool)
+		return;
+
+	resolveFrame(frameIndex);
+	frameScopes[frameIndex].clear();
+	currentFrame = frameIndex;
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer commandBuffer, const char *name, GpuProfilerLane lane)
+{
+	if (!queryPool)
+		return ~0U;
+
+	std::vector<ScopeQuery> &scopes = frameScopes[currentFrame];
+	if (scopes.size() >= maxScopesPerFrame || !timestampMask[lane])
+	{
+		numScopesDropped++;
+		return ~0U;
+	}
+
+	uint32_t firstQuery = (currentFrame * maxScopesPerFrame + static_cast<uint32_t>(scopes.size())) * 2;
+	dispatch->vkCmdResetQueryPool(commandBuffer, queryPool, firstQuery, 2);
+	dispatch->vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, firstQuery);
+	scopes.push_back({ name, lane, firstQuery });
+
+	return static_cast<uint32_t>(scopes.size() - 1);
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scope)
+{
+	if (scope == ~0U)
+		return;
+
+	const ScopeQuery &query = frameScopes[currentFrame][scope];
+	dispatch->vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, query.firstQuery + 1);
+}
+
+GpuProfiler::ScopeStats &GpuProfiler::getScopeStats(const char *name, GpuProfilerLane lane)
+{
+	// Only a handful of scopes, a linear search is fine.
+	for (ScopeStats &stats : scopeStats)
+		if (stats.lane == lane && strcmp(stats.name, name) == 0)
+			return stats;
+
+	scopeStats.push_back({ name, lane, LatencyStat() });
+	return scopeStats.back();
+}
+
+// Length of the intersection of [aBegin, aEnd] and [bBegin, bEnd], in ticks.
+static uint64_t getOverlap(uint64_t aBegin, uint64_t aEnd, uint64_t bBegin, uint64_t bEnd)
+{
+	uint64_t begin = std::max(aBegin, bBegin);
+	uint64_t end = std::min(aEnd, bEnd);
+	return end > begin ? end - begin : 0;
+}
+
+void GpuProfiler::resolveFrame(uint32_t frameIndex)
+{
+	const std::vector<ScopeQuery> &scopes = frameScopes[frameIndex];
+	if (scopes.empty())
+		return;
+
+	// The frame's queries are contiguous, so they come back in one call.
+	uint32_t numQueries = static_cast<uint32_t>(scopes.size()) * 2;
+	VkResult result = dispatch->vkGetQueryPoolResults(device, queryPool,
+		scopes.front().firstQuery, numQueries, // First query, query count
+		numQueries * sizeof(uint64_t), queryResults.data(), sizeof(uint64_t), // Data size, data, stride
+		VK_QUERY_RESULT_64_BIT);
+	if (result == VK_NOT_READY)
+		return;
+	HANDLE_VK(result, "Getting the GPU profiler timestamps for frame %u", frameIndex);
+
+	LaneSpans spans = {};
+	for (uint32_t i = 0; i < scopes.size(); i++)
+	{
+		const ScopeQuery &scope = scopes[i];
+		uint64_t begin = queryResults[i * 2] & timestampMask[scope.lane];
+		uint64_t end = queryResults[i * 2 + 1] & timestampMask[scope.lane];
+		if (end < begin)
+			continue; // The counter wrapped.
+
+		getScopeStats(scope.name, scope.lane).time.add((end - begin) * nanosecondsPerTick * 1e-6);
+
+		if (!spans.valid[scope.lane])
+		{
+			spans.begin[scope.lane] = begin;
+			spans.end[scope.lane] = end;
+			spans.valid[scope.lane] = true;
+		}
+		else
+		{
+			spans.begin[scope.lane] = std::min(spans.begin[scope.lane], begin);
+			spans.end[scope.lane] = std::max(spans.end[scope.lane], end);
+		}
+	}
+
+	for (uint32_t lane = 0; lane < GPU_LANE_COUNT; lane++)
+		if (spans.valid[lane])
+			laneBusy[lane].add((spans.end[lane] - spans.begin[lane]) * nanosecondsPerTick * 1e-6);
+
+	// A frame's physics is submitted while the previous frame's graphics work can still be running,
+	//	so check it against both.
+	if (spans.valid[GPU_LANE_ASYNC_COMPUTE])
+	{
+		uint64_t overlap = 0;
+		if (spans.valid[GPU_LANE_GRAPHICS])
+			overlap += getOverlap(spans.begin[GPU_LANE_ASYNC_COMPUTE], spans.end[GPU_LANE_ASYNC_COMPUTE],
+				spans.begin[GPU_LANE_GRAPHICS], spans.end[GPU_LANE_GRAPHICS]);
+		if (lastFrameSpans.valid[GPU_LANE_GRAPHICS])
+			overlap += getOverlap(spans.begin[GPU_LANE_ASYNC_COMPUTE], spans.end[GPU_LANE_ASYNC_COMPUTE],
+				lastFrameSpans.begin[GPU_LANE_GRAPHICS], lastFrameSpans.end[GPU_LANE_GRAPHICS]);
+		asyncOverlap.add(overlap * nanosecondsPerTick * 1e-6);
+	}
+
+	lastFrameSpans = spans;
+	numFramesResolved++;
+}
+
+double GpuProfiler::getLastFrameMs(GpuProfilerLane lane) const
+{
+	if (!lastFrameSpans.valid[lane])
+		return 0.0;
+	return (lastFrameSpans.end[lane] - lastFrameSpans.begin[lane]) * nanosecondsPerTick * 1e-6;
+}
+
+double GpuProfiler::getBusyMsPerFrame(void) const
+{
+	if (!numFramesResolved)
+		return 0.0;
+
+	double totalMs = -asyncOverlap.totalMs;
+	for (uint32_t lane = 0; lane < GPU_LANE_COUNT; lane++)
+		totalMs += laneBusy[lane].totalMs;
+	return totalMs / numFramesResolved;
+}
+
+void GpuProfiler::printStats(void) const
+{
+	if (!queryPool)
+		return;
+
+	printf("GPU profiler stats (%llu frames):\n", static_cast<unsigned long long>(numFramesResolved));
+	for (const ScopeStats &stats : scopeStats)
+	{
+		char label[256];
+		snprintf(label, sizeof(label), "%s (%s)", stats.name, getGpuProfilerLaneName(stats.lane));
+		stats.time.print(label);
+	}
+	for (uint32_t lane = 0; lane < GPU_LANE_COUNT; lane++)
+	{
+		if (laneBusy[lane].count)
+		{
+			printf("\t%s lane busy: %.3lf ms/frame\n",
+				getGpuProfilerLaneName(static_cast<GpuProfilerLane>(lane)), laneBusy[lane].average());
+		}
+	}
+	if (asyncOverlap.count)
+	{
+		double asyncMs = laneBusy[GPU_LANE_ASYNC_COMPUTE].average();
+		printf("\tAsync compute overlapped with graphics: %.3lf ms/frame (%.1lf%% of the async work)\n",
+			asyncOverlap.average(), asyncMs > 0.0 ? 100.0 * asyncOverlap.average() / asyncMs : 0.0);
+	}
+	if (numScopesDropped)
+		printf("\tScopes not timed: %llu\n", static_cast<unsigned long long>(numScopesDropped));
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+#include "vulkanDispatch.h"
+#include "vulkanPresent.h"
+
+// Which queue a profiled scope ran on. Scopes on different lanes can overlap on the GPU.
+enum GpuProfilerLane
+{
+	GPU_LANE_GRAPHICS,
+	GPU_LANE_ASYNC_COMPUTE,
+	GPU_LANE_COUNT
+};
+
+const char *getGpuProfilerLaneName(GpuProfilerLane lane);
+
+// GPU timings for named scopes, from timestamp queries.
+// Each frame in flight gets its own slice of the query pool, and a frame's results are read back
+//	by beginFrame() the next time its index comes around (after the CPU has waited on it), so
+//	reading them never stalls.
+// Besides the per-scope times, it measures how much of the async compute lane's time ran
+//	alongside graphics work (from this frame or the one before), which is the time the async
+//	queue saved over running everything back to back on one queue.
+// Assumes the queues of one device share a timestamp clock, which they do on the desktop drivers.
+class GpuProfiler
+{
+	struct ScopeQuery
+	{
+		const char *name;
+		GpuProfilerLane lane;
+		uint32_t firstQuery; // Begin, end is the next one.
+	};
+
+	struct ScopeStats
+	{
+		const char *name;
+		GpuProfilerLane lane;
+		LatencyStat time;
+	};
+
+	// Span from the first scope start to the last scope end on each lane for one frame.
+	struct LaneSpans
+	{
+		uint64_t begin[GPU_LANE_COUNT];
+		uint64_t end[GPU_LANE_COUNT];
+		bool valid[GPU_LANE_COUNT];
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	const DeviceDispatch *dispatch = nullptr;
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	double nanosecondsPerTick = 1.0;
+	uint64_t timestampMask[GPU_LANE_COUNT] = {}; // 0 for lanes whose queue can't write timestamps.
+	uint32_t maxScopesPerFrame = 0;
+	uint32_t currentFrame = 0;
+
+	std::vector<std::vector<ScopeQuery>> frameScopes; // Scopes written by each frame in flight.
+	std::vector<uint64_t> queryResults;
+	std::vector<ScopeStats> scopeStats;
+	LaneSpans lastFrameSpans = {};
+
+	// Stats
+	uint64_t numFramesResolved = 0;
+	uint64_t numScopesDropped = 0; // Ran out of queries or the lane doesn't support timestamps.
+	LatencyStat laneBusy[GPU_LANE_COUNT];
+	LatencyStat asyncOverlap; // Async compute time that ran at the same time as graphics work.
+
+	void resolveFrame(uint32_t frameIndex);
+	ScopeStats &getScopeStats(const char *name, GpuProfilerLane lane);
+
+public:
+	// 'timestampValidBits' is VkQueueFamilyProperties::timestampValidBits of each lane's queue family.
+	void create(VkDevice device, const DeviceDispatch &dispatch, float timestampPeriod,
+		const uint32_t timestampValidBits[GPU_LANE_COUNT],
+		uint32_t numFrames, uint32_t maxScopesPerFrame,
+		const VkAllocationCallbacks *allocator);
+	void destroy(const VkAllocationCallbacks *allocator);
+
+	// Read back the results 'frameIndex' wrote last time and start recording it again.
+	// The GPU must be done with everything that frame submitted.
+	void beginFrame(uint32_t frameIndex);
+
+	// Write a begin timestamp into 'commandBuffer'. Returns the scope to end, or ~0U if it won't be timed.
+	// Has to be recorded outside of a render pass (the scope's queries get reset here).
+	uint32_t beginScope(VkCommandBuffer commandBuffer, const char *name, GpuProfilerLane lane);
+	void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+	bool isEnabled(void) const { return queryPool != VK_NULL_HANDLE; }
+
+	// Average time per frame the device was busy on any lane (overlapping lanes only count once).
+	double getBusyMsPerFrame(void) const;
+	// Time from the first scope's start to the last one's end on 'lane' in the last frame read back
+	//	(0 if it had none). A new one's been read back whenever getNumFramesResolved() goes up.
+	double getLastFrameMs(GpuProfilerLane lane) const;
+	uint64_t getNumFramesResolved(void) const { return numFramesResolved; }
+	void printStats(void) const;
+};
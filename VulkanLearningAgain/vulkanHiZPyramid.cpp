@@ -0,0 +1,363 @@
+#include "vulkanHiZPyramid.h"
+#include <stdio.h>
+#include <string.h>
+#include "vulkanDebug.h"
+#include "vulkanMemory.h"
+
+// local_size_x and local_size_y in hiZBuild.glsl
+#define HI_Z_WORKGROUP_SIZE 8
+
+void HiZPyramid::create(VkDevice device, const DeviceDispatch &dispatch,
+	const VkPhysicalDeviceMemoryProperties &memoryProperties,
+	ShaderLibrary &shaders,
+	VkPipelineCache pipelineCache,
+	const VkAllocationCallbacks *allocator)
+{
+	this->device = device;
+	this->dispatch = &dispatch;
+	this->allocator = allocator;
+	this->memoryProperties = memoryProperties;
+
+	// Only ever read with texelFetch, but a sampled image still needs a sampler.
+	VkSamplerCreateInfo samplerCreateInfo = {
+		VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		nullptr, // pNext
+		0, // Flags
+		VK_FILTER_NEAREST, // Mag filter
+		VK_FILTER_NEAREST, // Min filter
+		VK_SAMPLER_MIPMAP_MODE_NEAREST, // Mipmap mode
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, // Address mode U
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, // Address mode V
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, // Address mode W
+		0.0f, // Mip LOD bias
+		VK_FALSE, // Anisotropy enable
+		1.0f, // Max anisotropy
+		VK_FALSE, // Compare enable
+		VK_COMPARE_OP_ALWAYS, // Compare op
+		0.0f, // Min LOD
+		VK_LOD_CLAMP_NONE, // Max LOD
+		VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK, // Border color
+		VK_FALSE // Unnormalized coordinates
+	};
+	HANDLE_VK(dispatch.vkCreateSampler(device, &samplerCreateInfo, allocator, &sampler),
+		"Creating the Hi-Z sampler");
+
+	VkDescriptorSetLayoutBinding buildBindings[] = {
+		{
+			0, // Binding
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // Descriptor Type
+			1, // Descriptor count
+			VK_SHADER_STAGE_COMPUTE_BIT, // Stage flags
+			nullptr // Immutable samplers
+		},
+		{
+			1, // Binding
+			VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Descriptor Type
+			1, // Descriptor count
+			VK_SHADER_STAGE_COMPUTE_BIT, // Stage flags
+			nullptr // Immutable samplers
+		}
+	};
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		nullptr, // pNext
+		0, // flags
+		2, // Binding Count
+		buildBindings
+	};
+	HANDLE_VK(dispatch.vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, allocator, &buildSetLayout),
+		"Creating the Hi-Z build descriptor set layout");
+
+	// Readers only get the first binding.
+	descriptorSetLayoutCreateInfo.bindingCount = 1;
+	HANDLE_VK(dispatch.vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, allocator, &readSetLayout),
+		"Creating the Hi-Z read descriptor set layout");
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
+		VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		nullptr, // pNext
+		0, // flags
+		1, // Set Layout Count
+		&buildSetLayout, // Set Layouts
+		0, // Num Push Constant Ranges
+		nullptr // Push Constant Ranges
+	};
+	HANDLE_VK(dispatch.vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, allocator, &pipelineLayout),
+		"Creating the Hi-Z pipeline layout");
+
+	VkComputePipelineCreateInfo computePipelineCreateInfo = {
+		VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		nullptr, // pNext
+		0, // flags
+		{ // Stage
+			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			nullptr, // pNext
+			0, // Flags
+			VK_SHADER_STAGE_COMPUTE_BIT, // Stage
+			shaders.getModule("hiZBuild.glsl", VK_SHADER_STAGE_COMPUTE_BIT), // Shader module
+			"main", // Shader entry point
+			nullptr // Specialization info
+		},
+		pipelineLayout, // Layout
+		VK_NULL_HANDLE, // Base Pipeline Handle
+		0 // Base pipeline index
+	};
+	HANDLE_VK(dispatch.vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, allocator, &buildPipeline),
+		"Creating the Hi-Z build pipeline");
+}
+
+void HiZPyramid::retire(DeferredDeletionQueue &deletionQueue, uint64_t retireValue)
+{
+	deletionQueue.enqueue(VK_OBJECT_TYPE_DESCRIPTOR_POOL, descriptorPool, retireValue, allocator);
+	deletionQueue.enqueue(VK_OBJECT_TYPE_IMAGE_VIEW, readView, retireValue, allocator);
+	for (VkImageView view : levelViews)
+		deletionQueue.enqueue(VK_OBJECT_TYPE_IMAGE_VIEW, view, retireValue, allocator);
+	deletionQueue.enqueue(VK_OBJECT_TYPE_IMAGE, image, retireValue, allocator);
+	deletionQueue.enqueue(VK_OBJECT_TYPE_DEVICE_MEMORY, memory, retireValue, allocator);
+
+	descriptorPool = VK_NULL_HANDLE;
+	readView = VK_NULL_HANDLE;
+	levelViews.clear();
+	image = VK_NULL_HANDLE;
+	memory = VK_NULL_HANDLE;
+	depthSets.clear();
+	levelSets.clear();
+	readSet = VK_NULL_HANDLE;
+}
+
+void HiZPyramid::destroy(void)
+{
+	if (!device)
+		return;
+
+	if (descriptorPool)
+		dispatch->vkDestroyDescriptorPool(device, descriptorPool, allocator);
+	if (readView)
+		dispatch->vkDestroyImageView(device, readView, allocator);
+	for (VkImageView view : levelViews)
+		dispatch->vkDestroyImageView(device, view, allocator);
+	if (image)
+		dispatch->vkDestroyImage(device, image, allocator);
+	if (memory)
+		dispatch->vkFreeMemory(device, memory, allocator);
+	if (buildPipeline)
+		dispatch->vkDestroyPipeline(device, buildPipeline, allocator);
+	if (pipelineLayout)
+		dispatch->vkDestroyPipelineLayout(device, pipelineLayout, allocator);
+	if (buildSetLayout)
+		dispatch->vkDestroyDescriptorSetLayout(device, buildSetLayout, allocator);
+	if (readSetLayout)
+		dispatch->vkDestroyDescriptorSetLayout(device, readSetLayout, allocator);
+	if (sampler)
+		dispatch->vkDestroySampler(device, sampler, allocator);
+
+	device = VK_NULL_HANDLE;
+}
+
+void HiZPyramid::resize(uint32_t depthWidth, uint32_t depthHeight, const VkImageView *depthViews, uint32_t numDepthViews,
+	DeferredDeletionQueue &deletionQueue, uint64_t retireValue)
+{
+	retire(deletionQueue, retireValue);
+
+	width = (depthWidth + 1) / 2;
+	height = (depthHeight + 1) / 2;
+	numLevels = 1;
+	for (uint32_t levelWidth = width, levelHeight = height; levelWidth > 1 || levelHeight > 1; numLevels++)
+	{
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Image and views
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	VkImageCreateInfo imageCreateInfo = {
+		VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		nullptr, // pNext
+		0, // Flags
+		VK_IMAGE_TYPE_2D, // Image type
+		VK_FORMAT_R32_SFLOAT, // Format
+		{ width, height, 1 }, // Extent
+		numLevels, // Mip levels
+		1, // Array layers
+		VK_SAMPLE_COUNT_1_BIT, // Samples
+		VK_IMAGE_TILING_OPTIMAL, // Tiling
+		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, // Usage
+		VK_SHARING_MODE_EXCLUSIVE, // Sharing mode
+		0, // Queue family index count
+		nullptr, // Queue family indices
+		VK_IMAGE_LAYOUT_UNDEFINED // Initial layout
+	};
+	createImageWithMemory(device, *dispatch, memoryProperties, imageCreateInfo,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocator,
+		image, memory, nullptr, &memorySize);
+
+	VkImageViewCreateInfo imageViewCreateInfo = {
+		VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		nullptr, // pNext
+		0, // Flags
+		image, // Image
+		VK_IMAGE_VIEW_TYPE_2D, // View type
+		VK_FORMAT_R32_SFLOAT, // Format
+		{ VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY }, // Components
+		{ VK_IMAGE_ASPECT_COLOR_BIT, 0, numLevels, 0, 1 } // Subresource range (aspect, base mip, levels, base layer, layers)
+	};
+	HANDLE_VK(dispatch->vkCreateImageView(device, &imageViewCreateInfo, allocator, &readView),
+		"Creating the Hi-Z view");
+
+	levelViews.resize(numLevels);
+	imageViewCreateInfo.subresourceRange.levelCount = 1;
+	for (uint32_t level = 0; level < numLevels; level++)
+	{
+		imageViewCreateInfo.subresourceRange.baseMipLevel = level;
+		HANDLE_VK(dispatch->vkCreateImageView(device, &imageViewCreateInfo, allocator, &levelViews[level]),
+			"Creating the view of Hi-Z level %u", level);
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Descriptors: a build set per depth buffer for level 0, one per level after
+	//	that, and the read set.
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	uint32_t numBuildSets = numDepthViews + numLevels - 1;
+	VkDescriptorPoolSize poolSizes[] = {
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, numBuildSets + 1 }, // Type, descriptor count
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, numBuildSets }
+	};
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		nullptr, // pNext
+		0, // flags
+		numBuildSets + 1, // Max sets
+		2, // Pool size count
+		poolSizes // Pool sizes
+	};
+	HANDLE_VK(dispatch->vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, allocator, &descriptorPool),
+		"Creating the Hi-Z descriptor pool");
+
+	std::vector<VkDescriptorSetLayout> setLayouts(numBuildSets, buildSetLayout);
+	setLayouts.push_back(readSetLayout);
+	std::vector<VkDescriptorSet> sets(setLayouts.size());
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		nullptr, // pNext
+		descriptorPool, // Descriptor pool
+		static_cast<uint32_t>(sets.size()), // Descriptor set count
+		setLayouts.data() // Set layouts
+	};
+	HANDLE_VK(dispatch->vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, sets.data()),
+		"Allocating the Hi-Z descriptor sets");
+	depthSets.assign(sets.begin(), sets.begin() + numDepthViews);
+	levelSets.assign(sets.begin() + numDepthViews, sets.begin() + numBuildSets);
+	readSet = sets.back();
+
+	// Two writes per build set, one for the read set.
+	std::vector<VkDescriptorImageInfo> imageInfos;
+	imageInfos.reserve(numBuildSets * 2 + 1);
+	std::vector<VkWriteDescriptorSet> descriptorWrites;
+	auto addWrite = [&](VkDescriptorSet set, uint32_t binding, VkDescriptorType type, VkImageView view, VkImageLayout layout) {
+		imageInfos.push_back({ type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ? sampler : VK_NULL_HANDLE, view, layout });
+		descriptorWrites.push_back({
+			VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			nullptr, // pNext
+			set, // Destination set
+			binding, // Destination binding
+			0, // Destination array element
+			1, // Descriptor count
+			type, // Descriptor type
+			&imageInfos.back(), // Image info
+			nullptr, // Buffer info
+			nullptr // Texel buffer view
+		});
+	};
+	for (uint32_t i = 0; i < numDepthViews; i++)
+	{
+		addWrite(depthSets[i], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, depthViews[i], VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+		addWrite(depthSets[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levelViews[0], VK_IMAGE_LAYOUT_GENERAL);
+	}
+	for (uint32_t level = 1; level < numLevels; level++)
+	{
+		addWrite(levelSets[level - 1], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL);
+		addWrite(levelSets[level - 1], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levelViews[level], VK_IMAGE_LAYOUT_GENERAL);
+	}
+	addWrite(readSet, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, readView, VK_IMAGE_LAYOUT_GENERAL);
+	dispatch->vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+	needsLayoutTransition = true;
+	built = false;
+
+	if (VERBOSE)
+		printf("Hi-Z pyramid: %u x %u, %u levels, %.2lf MB\n", width, height, numLevels, memorySize / (1024.0 * 1024.0));
+}
+
+void HiZPyramid::recordPrepare(VkCommandBuffer commandBuffer)
+{
+	if (!needsLayoutTransition)
+		return;
+	needsLayoutTransition = false;
+
+	VkImageMemoryBarrier imageBarrier = {
+		VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		nullptr, // pNext
+		0, // Source access mask
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, // Destination access mask
+		VK_IMAGE_LAYOUT_UNDEFINED, // Old layout
+		VK_IMAGE_LAYOUT_GENERAL, // New layout
+		VK_QUEUE_FAMILY_IGNORED, // Source queue family
+		VK_QUEUE_FAMILY_IGNORED, // Destination queue family
+		image, // Image
+		{ VK_IMAGE_ASPECT_COLOR_BIT, 0, numLevels, 0, 1 } // Subresource range
+	};
+	dispatch->vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+}
+
+void HiZPyramid::record(VkCommandBuffer commandBuffer, uint32_t depthIndex, const float viewProj[16], const float viewportSize[2])
+{
+	// Each level reads the one before it.
+	VkMemoryBarrier levelBarrier = {
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		nullptr, // pNext
+		VK_ACCESS_SHADER_WRITE_BIT, // Source access mask
+		VK_ACCESS_SHADER_READ_BIT // Destination access mask
+	};
+
+	dispatch->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, buildPipeline);
+	uint32_t levelWidth = width, levelHeight = height;
+	for (uint32_t level = 0; level < numLevels; level++)
+	{
+		VkDescriptorSet set = level == 0 ? depthSets[depthIndex] : levelSets[level - 1];
+		dispatch->vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout,
+			0, 1, &set, // First set, set count, sets
+			0, nullptr); // Dynamic offset count, dynamic offsets
+		dispatch->vkCmdDispatch(commandBuffer,
+			(levelWidth + HI_Z_WORKGROUP_SIZE - 1) / HI_Z_WORKGROUP_SIZE,
+			(levelHeight + HI_Z_WORKGROUP_SIZE - 1) / HI_Z_WORKGROUP_SIZE, 1);
+		if (level + 1 < numLevels)
+		{
+			dispatch->vkCmdPipelineBarrier(commandBuffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+		}
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+	}
+
+	memcpy(builtViewProj, viewProj, sizeof(builtViewProj));
+	memcpy(builtViewportSize, viewportSize, sizeof(builtViewportSize));
+	built = true;
+	numBuilds++;
+}
+
+void HiZPyramid::printStats(void) const
+{
+	printf("Hi-Z pyramid stats:\n");
+	printf("\tSize: %u x %u, %u levels, %.2lf MB\n", width, height, numLevels, memorySize / (1024.0 * 1024.0));
+	printf("\tBuilds: %llu\n", static_cast<unsigned long long>(numBuilds));
+}
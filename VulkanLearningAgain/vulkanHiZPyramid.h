@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+#include "vulkanDispatch.h"
+#include "vulkanShaders.h"
+#include "vulkanDeletionQueue.h"
+
+// Hierarchical Z: a mip chain of a depth buffer where every texel holds the farthest depth
+//	(reversed Z, so the smallest value) of the area it covers, built in compute by hiZBuild.glsl.
+// Level 0 is half the depth buffer's size (rounded up), so the texel at pixel p on level L is
+//	p / 2^(L + 1). Something whose nearest depth is farther than a texel's value is hidden behind
+//	everything in that texel's area.
+// Readers get it as a combined image sampler (set layout getReadSetLayout(), one binding 0, for
+//	compute) in GENERAL layout, and read it with texelFetch.
+class HiZPyramid
+{
+	VkDevice device = VK_NULL_HANDLE;
+	const DeviceDispatch *dispatch = nullptr;
+	const VkAllocationCallbacks *allocator = nullptr;
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+
+	VkSampler sampler = VK_NULL_HANDLE;
+	VkDescriptorSetLayout buildSetLayout = VK_NULL_HANDLE;
+	VkDescriptorSetLayout readSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline buildPipeline = VK_NULL_HANDLE;
+
+	// Recreated by resize()
+	uint32_t width = 0; // Of level 0
+	uint32_t height = 0;
+	uint32_t numLevels = 0;
+	VkImage image = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize memorySize = 0;
+	VkImageView readView = VK_NULL_HANDLE; // Every level
+	std::vector<VkImageView> levelViews;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> depthSets; // Builds level 0, one per depth buffer.
+	std::vector<VkDescriptorSet> levelSets; // [i] builds level i + 1 from level i.
+	VkDescriptorSet readSet = VK_NULL_HANDLE;
+	bool needsLayoutTransition = false;
+	bool built = false; // Has contents since the last resize.
+	float builtViewProj[16] = {};
+	float builtViewportSize[2] = {};
+
+	// Stats
+	uint64_t numBuilds = 0;
+
+	void retire(DeferredDeletionQueue &deletionQueue, uint64_t retireValue);
+
+public:
+	void create(VkDevice device, const DeviceDispatch &dispatch,
+		const VkPhysicalDeviceMemoryProperties &memoryProperties,
+		ShaderLibrary &shaders,
+		VkPipelineCache pipelineCache,
+		const VkAllocationCallbacks *allocator);
+	void destroy(void);
+
+	// (Re)create the pyramid for depth buffers of 'depthWidth' x 'depthHeight', built from
+	//	'depthViews' (depth aspect only, in DEPTH_STENCIL_READ_ONLY_OPTIMAL when built from).
+	// What it replaces goes to 'deletionQueue' to be destroyed once the GPU passes 'retireValue'.
+	void resize(uint32_t depthWidth, uint32_t depthHeight, const VkImageView *depthViews, uint32_t numDepthViews,
+		DeferredDeletionQueue &deletionQueue, uint64_t retireValue);
+
+	// Get a freshly resized pyramid into GENERAL. Record before anything that binds getReadSet() each
+	//	frame, outside of a render pass. Does nothing the rest of the time.
+	void recordPrepare(VkCommandBuffer commandBuffer);
+
+	// Build every level from depth buffer 'depthIndex', which was rendered with 'viewProj' to a
+	//	viewport of 'viewportSize' pixels at its top left (the rest cleared to the far plane). Only the
+	//	levels are ordered between each other: the caller waits for the depth writes and whatever
+	//	read the last build, and makes the result visible to its readers (the render graph does).
+	void record(VkCommandBuffer commandBuffer, uint32_t depthIndex, const float viewProj[16], const float viewportSize[2]);
+
+	VkDescriptorSetLayout getReadSetLayout(void) const { return readSetLayout; }
+	VkDescriptorSet getReadSet(void) const { return readSet; }
+	VkImage getImage(void) const { return image; }
+	bool isBuilt(void) const { return built; }
+	const float *getBuiltViewProj(void) const { return builtViewProj; }
+	const float *getBuiltViewportSize(void) const { return builtViewportSize; }
+	uint32_t getWidth(void) const { return width; }
+	uint32_t getHeight(void) const { return height; }
+	uint32_t getNumLevels(void) const { return numLevels; }
+	void printStats(void) const;
+};
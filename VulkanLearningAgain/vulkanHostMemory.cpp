@@ -0,0 +1,339 @@
+#include "vulkanHostMemory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <new>
+#include <algorithm>
+#include "vulkanMemory.h"
+
+// Aligned malloc/free. (MSVC doesn't have aligned_alloc.)
+static void *alignedAlloc(size_t size, size_t alignment)
+{
+#ifdef _MSC_VER
+	return _aligned_malloc(size, alignment);
+#else
+	return aligned_alloc(alignment, static_cast<size_t>(alignUp(size, alignment)));
+#endif
+}
+
+static void alignedFree(void *ptr)
+{
+#ifdef _MSC_VER
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+const char *getHostMemoryScopeName(HostMemoryScope scope)
+{
+	switch (scope)
+	{
+	case HOST_SCOPE_INSTANCE: return "Instance";
+	case HOST_SCOPE_DEVICE: return "Device";
+	case HOST_SCOPE_PIPELINE: return "Pipeline";
+	case HOST_SCOPE_SWAPCHAIN: return "Swapchain";
+	default: return "Unknown scope";
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Arena
+//
+//////////////////////////////////////////////////////////////////////////////
+HostArena::~HostArena(void)
+{
+	for (Block &block : blocks)
+		alignedFree(block.data);
+}
+
+void *HostArena::allocate(size_t size, size_t alignment)
+{
+	assert(alignment && (alignment & (alignment - 1)) == 0);
+
+	// Find a block with room, moving on to (or making) the next one if the current one is full.
+	size_t offset = blocks.empty() ? 0 : static_cast<size_t>(alignUp(currentOffset, alignment));
+	size_t padding = offset - currentOffset;
+	while (blocks.empty() || offset + size > blocks[currentBlock].size)
+	{
+		if (!blocks.empty() && currentBlock + 1 < blocks.size())
+		{
+			currentBlock++;
+		}
+		else
+		{
+			// Oversized allocations get a block of their own.
+			size_t newBlockSize = std::max(blockSize, static_cast<size_t>(alignUp(size, alignment)));
+			Block block = { static_cast<char *>(alignedAlloc(newBlockSize, std::max(alignment, alignof(std::max_align_t)))), newBlockSize };
+			if (!block.data)
+				throw std::bad_alloc();
+			blocks.push_back(block);
+			currentBlock = static_cast<uint32_t>(blocks.size() - 1);
+			numBlockAllocations++;
+		}
+		offset = 0;
+		padding = 0;
+	}
+
+	void *ptr = blocks[currentBlock].data + offset;
+	bytesInUse += padding + size;
+	currentOffset = offset + size;
+	peakBytesInUse = std::max(peakBytesInUse, bytesInUse);
+	numAllocations++;
+	return ptr;
+}
+
+void HostArena::rewind(const Marker &marker)
+{
+	currentBlock = marker.block;
+	currentOffset = marker.offset;
+	bytesInUse = marker.bytesInUse;
+}
+
+void HostArena::printStats(const char *name) const
+{
+	size_t totalBlockSize = 0;
+	for (const Block &block : blocks)
+		totalBlockSize += block.size;
+
+	printf("%s arena stats:\n", name);
+	printf("\tAllocations: %llu\n", static_cast<unsigned long long>(numAllocations));
+	printf("\tPeak use: %zu bytes\n", peakBytesInUse);
+	printf("\tBlocks: %zu (%zu bytes, %llu mallocs)\n", blocks.size(), totalBlockSize,
+		static_cast<unsigned long long>(numBlockAllocations));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Size class pool
+//
+//////////////////////////////////////////////////////////////////////////////
+SizeClassPool::~SizeClassPool(void)
+{
+	for (void *chunk : chunks)
+		alignedFree(chunk);
+}
+
+uint32_t SizeClassPool::getSizeClass(size_t size)
+{
+	uint32_t sizeClass = 0;
+	for (size_t classSize = MIN_SIZE; classSize < size; classSize <<= 1)
+		sizeClass++;
+	return sizeClass;
+}
+
+void *SizeClassPool::allocate(size_t size)
+{
+	assert(size <= MAX_SIZE);
+	uint32_t sizeClass = getSizeClass(size);
+	numAllocations++;
+
+	if (freeLists[sizeClass])
+	{
+		FreeSlot *slot = freeLists[sizeClass];
+		freeLists[sizeClass] = slot->next;
+		numFreeListHits++;
+		return slot;
+	}
+
+	// Carve a new chunk up into slots of this class. Chunks are MAX_SIZE aligned, so every slot
+	//	is aligned to its own size.
+	char *chunk = static_cast<char *>(alignedAlloc(CHUNK_SIZE, MAX_SIZE));
+	if (!chunk)
+		return nullptr;
+	chunks.push_back(chunk);
+
+	size_t classSize = MIN_SIZE << sizeClass;
+	for (size_t offset = classSize; offset + classSize <= CHUNK_SIZE; offset += classSize)
+	{
+		FreeSlot *slot = reinterpret_cast<FreeSlot *>(chunk + offset);
+		slot->next = freeLists[sizeClass];
+		freeLists[sizeClass] = slot;
+	}
+
+	return chunk;
+}
+
+void SizeClassPool::free(void *ptr, size_t size)
+{
+	uint32_t sizeClass = getSizeClass(size);
+	FreeSlot *slot = static_cast<FreeSlot *>(ptr);
+	slot->next = freeLists[sizeClass];
+	freeLists[sizeClass] = slot;
+}
+
+void SizeClassPool::printStats(void) const
+{
+	printf("\tPool: %llu allocations, %llu from free lists, %zu chunks (%zu bytes)\n",
+		static_cast<unsigned long long>(numAllocations),
+		static_cast<unsigned long long>(numFreeListHits),
+		chunks.size(), chunks.size() * CHUNK_SIZE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Tracking allocation callbacks
+//
+// Every allocation is laid out as [padding][AllocationHeader][user memory], where the header and
+//	padding together are 'alignment' bytes (at least 16), so the user memory stays aligned.
+//
+//////////////////////////////////////////////////////////////////////////////
+struct AllocationHeader
+{
+	size_t size; // Requested size
+	uint32_t headerSize; // Bytes before the user memory
+	uint32_t scope; // HostMemoryScope it was charged to
+};
+#define ALLOCATION_HEADER_SPACE 16
+static_assert(sizeof(AllocationHeader) <= ALLOCATION_HEADER_SPACE, "AllocationHeader has to fit in the minimum alignment");
+
+static AllocationHeader *getHeader(void *ptr)
+{
+	return reinterpret_cast<AllocationHeader *>(static_cast<char *>(ptr) - ALLOCATION_HEADER_SPACE);
+}
+
+HostMemory::HostMemory(void)
+{
+	for (uint32_t i = 0; i < HOST_SCOPE_COUNT; i++)
+	{
+		contexts[i] = { this, static_cast<HostMemoryScope>(i) };
+		callbacks[i] = {
+			&contexts[i], // pUserData
+			allocationFunc,
+			reallocationFunc,
+			freeFunc,
+			internalAllocationFunc,
+			internalFreeFunc
+		};
+	}
+}
+
+void *HostMemory::allocate(HostMemoryScope scope, size_t size, size_t alignment, VkSystemAllocationScope systemScope)
+{
+	size_t headerSize = std::max(alignment, static_cast<size_t>(ALLOCATION_HEADER_SPACE));
+	size_t totalSize = headerSize + size;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	char *base = static_cast<char *>(totalSize <= SizeClassPool::MAX_SIZE ? pool.allocate(totalSize) : alignedAlloc(totalSize, headerSize));
+	if (!base)
+		return nullptr;
+
+	char *ptr = base + headerSize;
+	AllocationHeader *header = getHeader(ptr);
+	header->size = size;
+	header->headerSize = static_cast<uint32_t>(headerSize);
+	header->scope = scope;
+
+	ScopeStats &scopeStats = stats[scope];
+	scopeStats.numAllocations++;
+	scopeStats.bytesInUse += size;
+	scopeStats.peakBytesInUse = std::max(scopeStats.peakBytesInUse, scopeStats.bytesInUse);
+	if (systemScope <= VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE)
+		scopeStats.numBySystemScope[systemScope]++;
+
+	return ptr;
+}
+
+void HostMemory::release(void *ptr)
+{
+	AllocationHeader *header = getHeader(ptr);
+	size_t size = header->size;
+	size_t headerSize = header->headerSize;
+	char *base = static_cast<char *>(ptr) - headerSize;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	ScopeStats &scopeStats = stats[header->scope];
+	scopeStats.numFrees++;
+	scopeStats.bytesInUse -= size;
+
+	if (headerSize + size <= SizeClassPool::MAX_SIZE)
+		pool.free(base, headerSize + size);
+	else
+		alignedFree(base);
+}
+
+size_t HostMemory::getAllocationSize(void *ptr)
+{
+	return getHeader(ptr)->size;
+}
+
+void *HostMemory::allocationFunc(void *pUserData, size_t size, size_t alignment, VkSystemAllocationScope allocationScope)
+{
+	ScopeContext *context = static_cast<ScopeContext *>(pUserData);
+	return context->owner->allocate(context->scope, size, alignment, allocationScope);
+}
+
+void *HostMemory::reallocationFunc(void *pUserData, void *pOriginal, size_t size, size_t alignment, VkSystemAllocationScope allocationScope)
+{
+	ScopeContext *context = static_cast<ScopeContext *>(pUserData);
+	if (!pOriginal)
+		return context->owner->allocate(context->scope, size, alignment, allocationScope);
+	if (size == 0)
+	{
+		context->owner->release(pOriginal);
+		return nullptr;
+	}
+
+	// On failure the original has to be left alone.
+	void *ptr = context->owner->allocate(context->scope, size, alignment, allocationScope);
+	if (!ptr)
+		return nullptr;
+	memcpy(ptr, pOriginal, std::min(size, getAllocationSize(pOriginal)));
+	context->owner->release(pOriginal);
+
+	std::lock_guard<std::mutex> lock(context->owner->mutex);
+	context->owner->stats[context->scope].numReallocations++;
+	return ptr;
+}
+
+void HostMemory::freeFunc(void *pUserData, void *pMemory)
+{
+	if (pMemory)
+		static_cast<ScopeContext *>(pUserData)->owner->release(pMemory);
+}
+
+void HostMemory::internalAllocationFunc(void *pUserData, size_t size, VkInternalAllocationType allocationType, VkSystemAllocationScope allocationScope)
+{
+	ScopeContext *context = static_cast<ScopeContext *>(pUserData);
+	std::lock_guard<std::mutex> lock(context->owner->mutex);
+	ScopeStats &scopeStats = context->owner->stats[context->scope];
+	scopeStats.internalBytesInUse += size;
+	scopeStats.peakInternalBytesInUse = std::max(scopeStats.peakInternalBytesInUse, scopeStats.internalBytesInUse);
+}
+
+void HostMemory::internalFreeFunc(void *pUserData, size_t size, VkInternalAllocationType allocationType, VkSystemAllocationScope allocationScope)
+{
+	ScopeContext *context = static_cast<ScopeContext *>(pUserData);
+	std::lock_guard<std::mutex> lock(context->owner->mutex);
+	context->owner->stats[context->scope].internalBytesInUse -= size;
+}
+
+void HostMemory::printReport(void)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	static const char *systemScopeNames[] = { "command", "object", "cache", "device", "instance" };
+
+	printf("Host memory report:\n");
+	for (uint32_t i = 0; i < HOST_SCOPE_COUNT; i++)
+	{
+		const ScopeStats &scopeStats = stats[i];
+		printf("\t%s: %zu bytes in use (peak %zu), %llu allocations, %llu reallocations, %llu frees\n",
+			getHostMemoryScopeName(static_cast<HostMemoryScope>(i)),
+			scopeStats.bytesInUse,
+			scopeStats.peakBytesInUse,
+			static_cast<unsigned long long>(scopeStats.numAllocations),
+			static_cast<unsigned long long>(scopeStats.numReallocations),
+			static_cast<unsigned long long>(scopeStats.numFrees));
+		printf("\t\tBy lifetime:");
+		for (uint32_t j = 0; j <= VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE; j++)
+			printf(" %s %llu", systemScopeNames[j], static_cast<unsigned long long>(scopeStats.numBySystemScope[j]));
+		putc('\n', stdout);
+		if (scopeStats.peakInternalBytesInUse)
+			printf("\t\tInternal (driver owned): %zu bytes in use (peak %zu)\n",
+				scopeStats.internalBytesInUse, scopeStats.peakInternalBytesInUse);
+	}
+	pool.printStats();
+}
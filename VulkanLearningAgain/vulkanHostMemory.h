@@ -0,0 +1,189 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+#include <mutex>
+
+// Which part of the engine a host allocation gets charged to.
+// Each scope has its own VkAllocationCallbacks, so the driver's allocations show up per subsystem.
+enum HostMemoryScope
+{
+	HOST_SCOPE_INSTANCE, // Instance and instance children (debug messenger)
+	HOST_SCOPE_DEVICE, // Devices, command pools, sync objects, descriptors, buffers and memory
+	HOST_SCOPE_PIPELINE, // Shader modules, render passes, layouts, pipeline caches and pipelines
+	HOST_SCOPE_SWAPCHAIN, // Swapchains and their per-image objects
+	HOST_SCOPE_COUNT
+};
+
+const char *getHostMemoryScopeName(HostMemoryScope scope);
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Arena
+//
+//////////////////////////////////////////////////////////////////////////////
+
+// Linear allocator for temporary data (enumeration results and the like).
+// Nothing is freed individually. A HostArenaScope rewinds everything allocated while it was alive,
+//	and the blocks are kept for the next scope, so steady state use never touches malloc.
+// Only for trivially destructible types. Not thread safe.
+class HostArena
+{
+	struct Block
+	{
+		char *data;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t blockSize;
+	uint32_t currentBlock = 0; // Index of the block being allocated from.
+	size_t currentOffset = 0; // Bytes used in the current block.
+
+	// Stats
+	size_t bytesInUse = 0;
+	size_t peakBytesInUse = 0;
+	uint64_t numAllocations = 0;
+	uint64_t numBlockAllocations = 0;
+
+public:
+	struct Marker
+	{
+		uint32_t block;
+		size_t offset;
+		size_t bytesInUse;
+	};
+
+	explicit HostArena(size_t blockSize = 64 * 1024) : blockSize(blockSize) {}
+	~HostArena(void);
+	HostArena(const HostArena &) = delete;
+	HostArena &operator=(const HostArena &) = delete;
+
+	void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	template<typename T>
+	T *allocateArray(size_t count) { return static_cast<T *>(allocate(sizeof(T) * count, alignof(T))); }
+
+	Marker getMarker(void) const { return { currentBlock, currentOffset, bytesInUse }; }
+	void rewind(const Marker &marker);
+
+	void printStats(const char *name) const;
+};
+
+// Rewinds the arena to where it was when the scope was opened.
+class HostArenaScope
+{
+	HostArena &arena;
+	HostArena::Marker marker;
+
+public:
+	explicit HostArenaScope(HostArena &arena) : arena(arena), marker(arena.getMarker()) {}
+	~HostArenaScope(void) { arena.rewind(marker); }
+	HostArenaScope(const HostArenaScope &) = delete;
+	HostArenaScope &operator=(const HostArenaScope &) = delete;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Size class pool
+//
+//////////////////////////////////////////////////////////////////////////////
+
+// Power of 2 size classes (16 bytes to 4KB) carved out of 64KB chunks, with a free list per class.
+// Freed slots go back on their class's free list, chunks are only released by the destructor.
+// A slot is aligned to its own size. Not thread safe.
+class SizeClassPool
+{
+public:
+	static const size_t MIN_SIZE = 16;
+	static const size_t MAX_SIZE = 4096;
+	static const size_t NUM_SIZE_CLASSES = 9; // 16, 32, ... 4096
+	static const size_t CHUNK_SIZE = 64 * 1024;
+
+private:
+	struct FreeSlot
+	{
+		FreeSlot *next;
+	};
+
+	FreeSlot *freeLists[NUM_SIZE_CLASSES] = {};
+	std::vector<void *> chunks;
+
+	// Stats
+	uint64_t numAllocations = 0;
+	uint64_t numFreeListHits = 0;
+
+	static uint32_t getSizeClass(size_t size);
+
+public:
+	SizeClassPool(void) = default;
+	~SizeClassPool(void);
+	SizeClassPool(const SizeClassPool &) = delete;
+	SizeClassPool &operator=(const SizeClassPool &) = delete;
+
+	// 'size' must be <= MAX_SIZE. The same size has to be passed to free().
+	void *allocate(size_t size);
+	void free(void *ptr, size_t size);
+
+	void printStats(void) const;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Tracking allocation callbacks
+//
+//////////////////////////////////////////////////////////////////////////////
+
+// VkAllocationCallbacks for each HostMemoryScope, backed by a SizeClassPool for small allocations
+//	and aligned malloc for the rest. Every allocation is charged to the scope whose callbacks it
+//	came through, so printReport() can break the driver's host memory use down by subsystem.
+// The callbacks may be called from any thread, so they share one mutex.
+// Objects have to be destroyed with the same scope's callbacks they were created with.
+class HostMemory
+{
+	struct ScopeContext
+	{
+		HostMemory *owner;
+		HostMemoryScope scope;
+	};
+
+	struct ScopeStats
+	{
+		uint64_t numAllocations = 0;
+		uint64_t numReallocations = 0;
+		uint64_t numFrees = 0;
+		size_t bytesInUse = 0;
+		size_t peakBytesInUse = 0;
+		size_t internalBytesInUse = 0; // Reported through the internal allocation notifications.
+		size_t peakInternalBytesInUse = 0;
+		uint64_t numBySystemScope[VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1] = {};
+	};
+
+	std::mutex mutex;
+	SizeClassPool pool;
+	ScopeContext contexts[HOST_SCOPE_COUNT];
+	VkAllocationCallbacks callbacks[HOST_SCOPE_COUNT];
+	ScopeStats stats[HOST_SCOPE_COUNT];
+
+	void *allocate(HostMemoryScope scope, size_t size, size_t alignment, VkSystemAllocationScope systemScope);
+	void release(void *ptr);
+	static size_t getAllocationSize(void *ptr);
+
+	static VKAPI_ATTR void *VKAPI_CALL allocationFunc(void *pUserData, size_t size, size_t alignment, VkSystemAllocationScope allocationScope);
+	static VKAPI_ATTR void *VKAPI_CALL reallocationFunc(void *pUserData, void *pOriginal, size_t size, size_t alignment, VkSystemAllocationScope allocationScope);
+	static VKAPI_ATTR void VKAPI_CALL freeFunc(void *pUserData, void *pMemory);
+	static VKAPI_ATTR void VKAPI_CALL internalAllocationFunc(void *pUserData, size_t size, VkInternalAllocationType allocationType, VkSystemAllocationScope allocationScope);
+	static VKAPI_ATTR void VKAPI_CALL internalFreeFunc(void *pUserData, size_t size, VkInternalAllocationType allocationType, VkSystemAllocationScope allocationScope);
+
+public:
+	HostMemory(void);
+	HostMemory(const HostMemory &) = delete;
+	HostMemory &operator=(const HostMemory &) = delete;
+
+	const VkAllocationCallbacks *getCallbacks(HostMemoryScope scope) const { return &callbacks[scope]; }
+
+	// Anything still in use when this is printed (after everything's destroyed) was leaked by someone.
+	void printReport(void);
+};
@@ -0,0 +1,269 @@
+#include "vulkanKernelTuning.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "vulkanDebug.h"
+#include "fileUtils.h"
+
+// Default workgroups are at least this wide, in whole subgroups.
+#define DEFAULT_MIN_WORKGROUP_SIZE 64U
+#define CPU_BODIES_PER_INVOCATION 4U
+
+// The sweep tries workgroups from a subgroup (but no fewer than this many invocations) up to the
+//	device maximum, each with every unroll factor, and times this many steps of each.
+#define AUTOTUNE_MIN_WORKGROUP_SIZE 16U
+#define AUTOTUNE_MAX_WORKGROUP_SIZE 1024U
+#define AUTOTUNE_NUM_STEPS 16
+static const uint32_t AUTOTUNE_BODIES_PER_INVOCATION[] = { 1, 2, 4, 8 };
+
+// Bump this whenever the layout of the pipeline cache file (or KernelTuning) changes.
+#define PIPELINE_CACHE_FILE_MAGIC 0x4C504B56U // "VKPL"
+#define PIPELINE_CACHE_FILE_VERSION 1U
+
+// Sanity limit on the pipeline cache data, so a corrupt file can't ask for gigabytes.
+#define PIPELINE_CACHE_FILE_MAX_DATA (256U * 1024U * 1024U)
+
+static uint32_t getMaxWorkgroupSize(const VkPhysicalDeviceLimits &limits)
+{
+	return std::min(limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupInvocations);
+}
+
+KernelTuning getDefaultKernelTuning(const VulkanCapabilities::DeviceInfo &deviceInfo)
+{
+	uint32_t subgroupSize = std::max(deviceInfo.subgroupSize, 1U);
+	uint32_t workgroupSize = subgroupSize;
+	while (workgroupSize < DEFAULT_MIN_WORKGROUP_SIZE)
+		workgroupSize *= 2;
+	workgroupSize = std::min(workgroupSize, getMaxWorkgroupSize(deviceInfo.properties.limits));
+
+	KernelTuning tuning = {
+		{ // Physics
+			workgroupSize, // Workgroup size
+			deviceInfo.properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU ? CPU_BODIES_PER_INVOCATION : 1U // Bodies per invocation
+		},
+		VK_FALSE // Autotuned
+	};
+	return tuning;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Autotuning
+//
+//////////////////////////////////////////////////////////////////////////////
+
+// Milliseconds per step of 'config', from timestamps around AUTOTUNE_NUM_STEPS steps.
+static double timePhysicsConfig(VkDevice device, const DeviceDispatch &dispatch,
+	const VulkanCapabilities::DeviceInfo &deviceInfo,
+	uint32_t queueFamilyIndex, VkQueue queue, VkCommandBuffer commandBuffer,
+	VkQueryPool queryPool, VkFence fence,
+	ShaderLibrary &shaders, uint32_t numBodies, const PhysicsKernelConfig &config,
+	const VkAllocationCallbacks *allocator)
+{
+	PhysicsSimulation physics;
+	physics.create(device, dispatch, deviceInfo.memoryProperties, numBodies, config,
+		{ queueFamilyIndex }, // Queue families
+		shaders,
+		VK_NULL_HANDLE, // Pipeline cache (the losing configs shouldn't end up in it)
+		allocator);
+
+	VkCommandBufferBeginInfo beginInfo = {
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		nullptr, // pNext
+		VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, // Flags
+		nullptr // Inheritance info
+	};
+	HANDLE_VK(dispatch.vkResetCommandBuffer(commandBuffer, 0), "Resetting the autotune command buffer");
+	HANDLE_VK(dispatch.vkBeginCommandBuffer(commandBuffer, &beginInfo), "Beginning the autotune command buffer");
+
+	// The first step scatters the bodies, it isn't timed. A BOTTOM_OF_PIPE timestamp is written
+	//	once everything before it is done, so the scatter's time doesn't leak into the steps'.
+	dispatch.vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+	physics.recordStep(commandBuffer, 1.0f / 60.0f);
+	dispatch.vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 0);
+	for (uint32_t i = 0; i < AUTOTUNE_NUM_STEPS; i++)
+		physics.recordStep(commandBuffer, 1.0f / 60.0f);
+	dispatch.vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+	HANDLE_VK(dispatch.vkEndCommandBuffer(commandBuffer), "Ending the autotune command buffer");
+
+	VkSubmitInfo submitInfo = {
+		VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		nullptr, // pNext
+		0, // Wait semaphore count
+		nullptr, // Wait semaphores
+		nullptr, // Wait stages
+		1, // Command buffer count
+		&commandBuffer, // Command buffers
+		0, // Signal semaphore count
+		nullptr // Signal semaphores
+	};
+	HANDLE_VK(dispatch.vkResetFences(device, 1, &fence), "Resetting the autotune fence");
+	HANDLE_VK(dispatch.vkQueueSubmit(queue, 1, &submitInfo, fence), "Submitting the autotune steps");
+	HANDLE_VK(dispatch.vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX), "Waiting for the autotune steps");
+
+	uint64_t timestamps[2];
+	HANDLE_VK(dispatch.vkGetQueryPoolResults(device, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT),
+		"Getting the autotune timestamps");
+
+	physics.destroy(allocator);
+
+	uint32_t validBits = deviceInfo.queueFamilies[queueFamilyIndex].timestampValidBits;
+	uint64_t mask = validBits >= 64 ? ~0ULL : (1ULL << validBits) - 1;
+	uint64_t ticks = (timestamps[1] - timestamps[0]) & mask;
+	return ticks * static_cast<double>(deviceInfo.properties.limits.timestampPeriod) * 1e-6 / AUTOTUNE_NUM_STEPS;
+}
+
+KernelTuning autotuneKernels(VkDevice device, const DeviceDispatch &dispatch,
+	const VulkanCapabilities::DeviceInfo &deviceInfo,
+	uint32_t queueFamilyIndex, VkQueue queue, VkCommandPool commandPool,
+	ShaderLibrary &shaders,
+	uint32_t numBodies,
+	const KernelTuning &defaults,
+	const VkAllocationCallbacks *allocator)
+{
+	if (!deviceInfo.queueFamilies[queueFamilyIndex].timestampValidBits)
+	{
+		fprintf(stderr, "Warning: Can't autotune the kernels, queue family %u has no timestamps\n", queueFamilyIndex);
+		return defaults;
+	}
+
+	VkCommandBufferAllocateInfo commandBufferAllocInfo = {
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		nullptr, // pNext
+		commandPool, // Command Pool
+		VK_COMMAND_BUFFER_LEVEL_PRIMARY, // Buffer level
+		1 // Num command buffers to alloc
+	};
+	VkCommandBuffer commandBuffer;
+	HANDLE_VK(dispatch.vkAllocateCommandBuffers(device, &commandBufferAllocInfo, &commandBuffer),
+		"Allocating the autotune command buffer");
+
+	VkQueryPoolCreateInfo queryPoolCreateInfo = {
+		VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		nullptr, // pNext
+		0, // Flags
+		VK_QUERY_TYPE_TIMESTAMP, // Query type
+		2, // Query count
+		0 // Pipeline statistics
+	};
+	VkQueryPool queryPool;
+	HANDLE_VK(dispatch.vkCreateQueryPool(device, &queryPoolCreateInfo, allocator, &queryPool),
+		"Creating the autotune query pool");
+
+	VkFenceCreateInfo fenceCreateInfo = {
+		VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		nullptr, // pNext
+		0 // Flags
+	};
+	VkFence fence;
+	HANDLE_VK(dispatch.vkCreateFence(device, &fenceCreateInfo, allocator, &fence),
+		"Creating the autotune fence");
+
+	if (VERBOSE)
+		printf("Kernel autotune (%u bodies, %u steps per config):\n", numBodies, AUTOTUNE_NUM_STEPS);
+
+	KernelTuning best = defaults;
+	double bestMs = 1e30;
+	uint32_t maxWorkgroupSize = std::min(getMaxWorkgroupSize(deviceInfo.properties.limits), AUTOTUNE_MAX_WORKGROUP_SIZE);
+	for (uint32_t workgroupSize = std::max(deviceInfo.subgroupSize, AUTOTUNE_MIN_WORKGROUP_SIZE);
+		workgroupSize <= maxWorkgroupSize; workgroupSize *= 2)
+	{
+		for (uint32_t bodiesPerInvocation : AUTOTUNE_BODIES_PER_INVOCATION)
+		{
+			PhysicsKernelConfig config = { workgroupSize, bodiesPerInvocation };
+			double ms = timePhysicsConfig(device, dispatch, deviceInfo, queueFamilyIndex, queue, commandBuffer,
+				queryPool, fence, shaders, numBodies, config, allocator);
+			if (VERBOSE)
+				printf("\tPhysics %u x %u: %.4lf ms/step\n", workgroupSize, bodiesPerInvocation, ms);
+
+			if (ms < bestMs)
+			{
+				bestMs = ms;
+				best.physics = config;
+				best.autotuned = VK_TRUE;
+			}
+		}
+	}
+
+	dispatch.vkDestroyFence(device, fence, allocator);
+	dispatch.vkDestroyQueryPool(device, queryPool, allocator);
+	dispatch.vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+	return best;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Pipeline cache file
+// Layout: magic, version, vendor ID, device ID, driver version, pipeline cache UUID,
+//	KernelTuning, pipeline cache data size, pipeline cache data.
+//
+//////////////////////////////////////////////////////////////////////////////
+bool loadPipelineCacheFile(const char *path, const VkPhysicalDeviceProperties &properties,
+	std::vector<char> &cacheData, KernelTuning &tuning)
+{
+	FILE *file = openFile(path, "rb");
+	if (!file)
+		return false;
+
+	uint32_t header[5];
+	uint8_t uuid[VK_UUID_SIZE];
+	uint32_t dataSize = 0;
+	bool ok = fread(header, sizeof(header), 1, file) == 1
+		&& fread(uuid, sizeof(uuid), 1, file) == 1;
+
+	// Anything from another device or driver is as good as no file at all.
+	ok = ok && header[0] == PIPELINE_CACHE_FILE_MAGIC && header[1] == PIPELINE_CACHE_FILE_VERSION
+		&& header[2] == properties.vendorID && header[3] == properties.deviceID
+		&& header[4] == properties.driverVersion
+		&& memcmp(uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+
+	KernelTuning loadedTuning;
+	ok = ok && fread(&loadedTuning, sizeof(loadedTuning), 1, file) == 1
+		&& fread(&dataSize, sizeof(dataSize), 1, file) == 1
+		&& dataSize <= PIPELINE_CACHE_FILE_MAX_DATA;
+	if (ok)
+	{
+		cacheData.resize(dataSize);
+		ok = dataSize == 0 || fread(cacheData.data(), 1, dataSize, file) == dataSize;
+	}
+	fclose(file);
+
+	if (!ok)
+	{
+		cacheData.clear();
+		return false;
+	}
+
+	tuning = loadedTuning;
+	if (VERBOSE)
+		printf("Pipeline cache: %u bytes loaded from \"%s\"\n", dataSize, path);
+	return true;
+}
+
+void savePipelineCacheFile(const char *path, const VkPhysicalDeviceProperties &properties,
+	const std::vector<char> &cacheData, const KernelTuning &tuning)
+{
+	FILE *file = openFile(path, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Warning: Failed to open pipeline cache \"%s\" for writing\n", path);
+		return;
+	}
+
+	uint32_t header[5] = {
+		PIPELINE_CACHE_FILE_MAGIC,
+		PIPELINE_CACHE_FILE_VERSION,
+		properties.vendorID,
+		properties.deviceID,
+		properties.driverVersion
+	};
+	uint32_t dataSize = static_cast<uint32_t>(cacheData.size());
+	fwrite(header, sizeof(header), 1, file);
+	fwrite(properties.pipelineCacheUUID, VK_UUID_SIZE, 1, file);
+	fwrite(&tuning, sizeof(tuning), 1, file);
+	fwrite(&dataSize, sizeof(dataSize), 1, file);
+	if (dataSize)
+		fwrite(cacheData.data(), 1, dataSize, file);
+	fclose(file);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+#include "vulkanDispatch.h"
+#include "vulkanCapabilities.h"
+#include "vulkanShaders.h"
+#include "vulkanPhysics.h"
+
+// Per device constants the compute kernels get specialized with.
+struct KernelTuning
+{
+	PhysicsKernelConfig physics;
+	VkBool32 autotuned; // Measured by autotuneKernels() rather than guessed from the limits.
+};
+
+// A guess from the device limits: workgroups at least a couple of subgroups wide (so the scheduler
+//	has more than one to switch between), clamped to the device's maximum workgroup size.
+// CPU implementations get fewer, longer invocations, since each invocation is a loop iteration there.
+KernelTuning getDefaultKernelTuning(const VulkanCapabilities::DeviceInfo &deviceInfo);
+
+// Time every candidate physics config (workgroups from one subgroup up to the device maximum,
+//	times a few unroll factors) on 'queue' and return the fastest. Takes a while, and blocks
+//	on the queue, so it's meant to run once and be saved with the pipeline cache.
+// Returns 'defaults' if the queue can't write timestamps.
+KernelTuning autotuneKernels(VkDevice device, const DeviceDispatch &dispatch,
+	const VulkanCapabilities::DeviceInfo &deviceInfo,
+	uint32_t queueFamilyIndex, VkQueue queue, VkCommandPool commandPool,
+	ShaderLibrary &shaders,
+	uint32_t numBodies,
+	const KernelTuning &defaults,
+	const VkAllocationCallbacks *allocator);
+
+// The pipeline cache's data and the kernel tuning are saved to one file, since both are only good
+//	for the device and driver they came from. The file's keyed on the vendor, device, driver version
+//	and pipeline cache UUID, and a file for anything else is ignored.
+// Returns false if the file is missing, corrupt or for another device.
+bool loadPipelineCacheFile(const char *path, const VkPhysicalDeviceProperties &properties,
+	std::vector<char> &cacheData, KernelTuning &tuning);
+void savePipelineCacheFile(const char *path, const VkPhysicalDeviceProperties &properties,
+	const std::vector<char> &cacheData, const KernelTuning &tuning);
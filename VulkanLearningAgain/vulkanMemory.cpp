@@ -0,0 +1,131 @@
+#include "vulkanMemory.h"
+#include <stdio.h>
+#include <stdexcept>
+#include "vulkanDebug.h"
+
+uint32_t findMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties &memoryProperties,
+	uint32_t memoryTypeBits,
+	VkMemoryPropertyFlags requiredFlags,
+	VkMemoryPropertyFlags preferredFlags)
+{
+	// First pass looks for everything we want, second pass settles for what we need.
+	VkMemoryPropertyFlags passFlags[] = { requiredFlags | preferredFlags, requiredFlags };
+	for (VkMemoryPropertyFlags flags : passFlags)
+	{
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+		{
+			if ((memoryTypeBits & (1U << i))
+				&& (memoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
+			{
+				return i;
+			}
+		}
+	}
+
+	return ~0U;
+}
+
+void createBufferWithMemory(VkDevice device, const DeviceDispatch &dispatch,
+	const VkPhysicalDeviceMemoryProperties &memoryProperties,
+	VkDeviceSize size,
+	VkBufferUsageFlags usage,
+	VkMemoryPropertyFlags requiredFlags,
+	VkMemoryPropertyFlags preferredFlags,
+	const VkAllocationCallbacks *allocator,
+	VkBuffer &buffer,
+	VkDeviceMemory &memory,
+	VkMemoryPropertyFlags *selectedFlags,
+	uint32_t numQueueFamilies,
+	const uint32_t *queueFamilyIndices)
+{
+	VkBufferCreateInfo bufferCreateInfo = {
+		VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		nullptr, // pNext
+		0, // flags
+		size, // Size
+		usage, // Usage
+		numQueueFamilies > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE, // Sharing mode
+		numQueueFamilies > 1 ? numQueueFamilies : 0, // Queue family index count
+		numQueueFamilies > 1 ? queueFamilyIndices : nullptr // Queue family indices
+	};
+
+	HANDLE_VK(dispatch.vkCreateBuffer(device, &bufferCreateInfo, allocator, &buffer),
+		"Creating buffer of %llu bytes", static_cast<unsigned long long>(size));
+
+	VkMemoryRequirements memoryRequirements;
+	dispatch.vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
+
+	uint32_t memoryTypeIndex = findMemoryTypeIndex(memoryProperties,
+		memoryRequirements.memoryTypeBits, requiredFlags, preferredFlags);
+	if (memoryTypeIndex == ~0U)
+	{
+		dispatch.vkDestroyBuffer(device, buffer, allocator);
+		buffer = VK_NULL_HANDLE;
+		fprintf(stderr, "Error (%s:%u): No memory type with flags 0x%X for a buffer of %llu bytes\n",
+			__FILE__, __LINE__, requiredFlags, static_cast<unsigned long long>(size));
+		throw std::runtime_error("Failed to find a suitable memory type for buffer");
+	}
+
+	VkMemoryAllocateInfo memoryAllocateInfo = {
+		VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		nullptr, // pNext
+		memoryRequirements.size, // Allocation size
+		memoryTypeIndex // Memory type index
+	};
+
+	HANDLE_VK(dispatch.vkAllocateMemory(device, &memoryAllocateInfo, allocator, &memory),
+		"Allocating %llu bytes of buffer memory", static_cast<unsigned long long>(memoryRequirements.size));
+
+	HANDLE_VK(dispatch.vkBindBufferMemory(device, buffer, memory, 0),
+		"Binding buffer memory");
+
+	if (selectedFlags)
+		*selectedFlags = memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+}
+
+void createImageWithMemory(VkDevice device, const DeviceDispatch &dispatch,
+	const VkPhysicalDeviceMemoryProperties &memoryProperties,
+	const VkImageCreateInfo &imageCreateInfo,
+	VkMemoryPropertyFlags requiredFlags,
+	VkMemoryPropertyFlags preferredFlags,
+	const VkAllocationCallbacks *allocator,
+	VkImage &image,
+	VkDeviceMemory &memory,
+	VkMemoryPropertyFlags *selectedFlags,
+	VkDeviceSize *allocationSize)
+{
+	HANDLE_VK(dispatch.vkCreateImage(device, &imageCreateInfo, allocator, &image),
+		"Creating %u x %u image", imageCreateInfo.extent.width, imageCreateInfo.extent.height);
+
+	VkMemoryRequirements memoryRequirements;
+	dispatch.vkGetImageMemoryRequirements(device, image, &memoryRequirements);
+
+	uint32_t memoryTypeIndex = findMemoryTypeIndex(memoryProperties,
+		memoryRequirements.memoryTypeBits, requiredFlags, preferredFlags);
+	if (memoryTypeIndex == ~0U)
+	{
+		dispatch.vkDestroyImage(device, image, allocator);
+		image = VK_NULL_HANDLE;
+		fprintf(stderr, "Error (%s:%u): No memory type with flags 0x%X for a %u x %u image\n",
+			__FILE__, __LINE__, requiredFlags, imageCreateInfo.extent.width, imageCreateInfo.extent.height);
+		throw std::runtime_error("Failed to find a suitable memory type for image");
+	}
+
+	VkMemoryAllocateInfo memoryAllocateInfo = {
+		VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		nullptr, // pNext
+		memoryRequirements.size, // Allocation size
+		memoryTypeIndex // Memory type index
+	};
+
+	HANDLE_VK(dispatch.vkAllocateMemory(device, &memoryAllocateInfo, allocator, &memory),
+		"Allocating %llu bytes of image memory", static_cast<unsigned long long>(memoryRequirements.size));
+
+	HANDLE_VK(dispatch.vkBindImageMemory(device, image, memory, 0),
+		"Binding image memory");
+
+	if (selectedFlags)
+		*selectedFlags = memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+	if (allocationSize)
+		*allocationSize = memoryRequirements.size;
+}
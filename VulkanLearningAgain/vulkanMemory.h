@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include "vulkanDispatch.h"
+
+// Finds a memory type that has all of the required property flags.
+// Memory types that also have the preferred flags are picked first.
+// Returns ~0U if nothing suitable is found.
+uint32_t findMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties &memoryProperties,
+	uint32_t memoryTypeBits,
+	VkMemoryPropertyFlags requiredFlags,
+	VkMemoryPropertyFlags preferredFlags = 0);
+
+// Creates a buffer with its own dedicated memory allocation and binds the two together.
+// Both are created with 'allocator', so free them with it too.
+// Passing more than one queue family makes the buffer CONCURRENT between them.
+// Throws on failure.
+void createBufferWithMemory(VkDevice device, const DeviceDispatch &dispatch,
+	const VkPhysicalDeviceMemoryProperties &memoryProperties,
+	VkDeviceSize size,
+	VkBufferUsageFlags usage,
+	VkMemoryPropertyFlags requiredFlags,
+	VkMemoryPropertyFlags preferredFlags,
+	const VkAllocationCallbacks *allocator,
+	VkBuffer &buffer,
+	VkDeviceMemory &memory,
+	VkMemoryPropertyFlags *selectedFlags = nullptr,
+	uint32_t numQueueFamilies = 0,
+	const uint32_t *queueFamilyIndices = nullptr);
+
+// Creates an image with its own dedicated memory allocation and binds the two together.
+// Both are created with 'allocator', so free them with it too.
+// Throws on failure.
+void createImageWithMemory(VkDevice device, const DeviceDispatch &dispatch,
+	const VkPhysicalDeviceMemoryProperties &memoryProperties,
+	const VkImageCreateInfo &imageCreateInfo,
+	VkMemoryPropertyFlags requiredFlags,
+	VkMemoryPropertyFlags preferredFlags,
+	const VkAllocationCallbacks *allocator,
+	VkImage &image,
+	VkDeviceMemory &memory,
+	VkMemoryPropertyFlags *selectedFlags = nullptr,
+	VkDeviceSize *allocationSize = nullptr);
+
+// Rounds 'value' up to the next multiple of 'alignment'. 'alignment' must be a power of 2.
+inline VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Rounds 'value' down to the previous multiple of 'alignment'. 'alignment' must be a power of 2.
+inline VkDeviceSize alignDown(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return value & ~(alignment - 1);
+}
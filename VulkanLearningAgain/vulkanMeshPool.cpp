@@ -0,0 +1,562 @@
+#include "vulkanMeshPool.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdexcept>
+#include <algorithm>
+#include "vulkanDebug.h"
+#include "vulkanMemory.h"
+#include "vulkanPresent.h"
+#include "mappedFile.h"
+
+// Blobs are staged in pieces of at most this fraction of the ring, so one big mesh can't hold
+//	the whole ring up while its batch is still being recorded.
+#define MESH_STAGING_CHUNK_DIVISOR 4
+
+// Each buffer has this fraction of its capacity again past the end, that compact() bounces moves
+//	through when there's no other free space above the meshes.
+#define MESH_MOVE_SCRATCH_DIVISOR 16
+
+void MeshPool::create(VkDevice device, const DeviceDispatch &dispatch,
+	const VkPhysicalDeviceMemoryProperties &memoryProperties,
+	const VkPhysicalDeviceLimits &limits,
+	MeshVertexFormat vertexFormat,
+	VkIndexType indexType,
+	VkDeviceSize vertexCapacity,
+	VkDeviceSize indexCapacity,
+	VkDeviceSize clusterCapacity,
+	VkDeviceSize stagingSize,
+	QueueTimeline &timeline,
+	VkCommandPool commandPool,
+	const VkAllocationCallbacks *allocator)
+{
+	this->device = device;
+	this->dispatch = &dispatch;
+	this->allocator = allocator;
+	this->timeline = &timeline;
+	this->commandPool = commandPool;
+	this->vertexFormat = vertexFormat;
+	this->indexType = indexType;
+	vertexRanges.reset(vertexCapacity);
+	indexRanges.reset(indexCapacity);
+	clusterRanges.reset(clusterCapacity);
+	copyAlignment = std::min<VkDeviceSize>(std::max<VkDeviceSize>(limits.optimalBufferCopyOffsetAlignment, 16), 4096);
+
+	staging.create(device, dispatch, memoryProperties, limits, stagingSize, timeline, allocator);
+
+	createBufferWithMemory(device, dispatch, memoryProperties, getBufferSize(vertexCapacity),
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocator,
+		vertexBuffer, vertexMemory);
+	createBufferWithMemory(device, dispatch, memoryProperties, getBufferSize(indexCapacity),
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocator,
+		indexBuffer, indexMemory);
+	createBufferWithMemory(device, dispatch, memoryProperties, getBufferSize(clusterCapacity),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocator,
+		clusterBuffer, clusterMemory);
+
+	if (VERBOSE)
+		printf("Mesh pool: %llu KB of %s vertices (%u bytes each), %llu KB of %u-bit indices, %llu KB of clusters\n",
+			static_cast<unsigned long long>(vertexCapacity / 1024),
+			getMeshVertexFormatName(vertexFormat), getMeshVertexStride(vertexFormat),
+			static_cast<unsigned long long>(indexCapacity / 1024), getIndexSize() * 8,
+			static_cast<unsigned long long>(clusterCapacity / 1024));
+}
+
+void MeshPool::destroy(void)
+{
+	// The device is idle by now, so every batch can go whether it finished or not.
+	std::vector<VkCommandBuffer> commandBuffers = freeCommandBuffers;
+	for (const SubmittedBatch &batch : submittedBatches)
+		commandBuffers.push_back(batch.commandBuffer);
+	if (batchCommandBuffer)
+		commandBuffers.push_back(batchCommandBuffer);
+	if (!commandBuffers.empty())
+		dispatch->vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+	freeCommandBuffers.clear();
+	submittedBatches.clear();
+	batchCommandBuffer = VK_NULL_HANDLE;
+
+	if (vertexBuffer)
+		dispatch->vkDestroyBuffer(device, vertexBuffer, allocator);
+	if (vertexMemory)
+		dispatch->vkFreeMemory(device, vertexMemory, allocator);
+	if (indexBuffer)
+		dispatch->vkDestroyBuffer(device, indexBuffer, allocator);
+	if (indexMemory)
+		dispatch->vkFreeMemory(device, indexMemory, allocator);
+	if (clusterBuffer)
+		dispatch->vkDestroyBuffer(device, clusterBuffer, allocator);
+	if (clusterMemory)
+		dispatch->vkFreeMemory(device, clusterMemory, allocator);
+	vertexBuffer = VK_NULL_HANDLE;
+	vertexMemory = VK_NULL_HANDLE;
+	indexBuffer = VK_NULL_HANDLE;
+	indexMemory = VK_NULL_HANDLE;
+	clusterBuffer = VK_NULL_HANDLE;
+	clusterMemory = VK_NULL_HANDLE;
+
+	staging.destroy();
+}
+
+void MeshPool::beginBatch(void)
+{
+	// Reuse the command buffers of batches the GPU is done with.
+	while (!submittedBatches.empty() && timeline->isComplete(submittedBatches.front().timelineValue))
+	{
+		freeCommandBuffers.push_back(submittedBatches.front().commandBuffer);
+		submittedBatches.pop_front();
+	}
+
+	if (freeCommandBuffers.empty())
+	{
+		VkCommandBufferAllocateInfo allocateInfo = {
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			nullptr, // pNext
+			commandPool, // Command pool
+			VK_COMMAND_BUFFER_LEVEL_PRIMARY, // Level
+			1 // Command buffer count
+		};
+		HANDLE_VK(dispatch->vkAllocateCommandBuffers(device, &allocateInfo, &batchCommandBuffer),
+			"Allocating a mesh upload command buffer");
+	}
+	else
+	{
+		batchCommandBuffer = freeCommandBuffers.back();
+		freeCommandBuffers.pop_back();
+		HANDLE_VK(dispatch->vkResetCommandBuffer(batchCommandBuffer, 0),
+			"Resetting a mesh upload command buffer");
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		nullptr, // pNext
+		VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, // Flags
+		nullptr // Inheritance info
+	};
+	HANDLE_VK(dispatch->vkBeginCommandBuffer(batchCommandBuffer, &beginInfo),
+		"Beginning a mesh upload command buffer");
+}
+
+void MeshPool::stageBlob(const uint8_t *data, VkDeviceSize size, VkBuffer destination, VkDeviceSize destinationOffset)
+{
+	VkDeviceSize maxChunkSize = alignDown(staging.getSize() / MESH_STAGING_CHUNK_DIVISOR, copyAlignment);
+	while (size)
+	{
+		VkDeviceSize chunkSize = std::min(size, maxChunkSize);
+		void *stagingData;
+		VkDeviceSize stagingOffset;
+		if (!staging.reserve(chunkSize, copyAlignment, false, stagingData, stagingOffset))
+		{
+			// Full of this batch's own copies (or ones still in flight). Send this batch off so its
+			//	space can come back, and wait for the oldest space to.
+			flush();
+			if (!staging.reserve(chunkSize, copyAlignment, true, stagingData, stagingOffset))
+			{
+				fprintf(stderr, "Error (%s:%u): Failed to reserve %llu bytes of the staging ring\n", __FILE__, __LINE__,
+					static_cast<unsigned long long>(chunkSize));
+				throw std::runtime_error("Failed to reserve staging ring space");
+			}
+		}
+
+		// Straight from the file mapping to the staging memory, the only CPU copy the data gets.
+		memcpy(stagingData, data, static_cast<size_t>(chunkSize));
+
+		if (!batchCommandBuffer)
+			beginBatch();
+		VkBufferCopy region = {
+			stagingOffset, // Source offset
+			destinationOffset, // Destination offset
+			chunkSize // Size
+		};
+		dispatch->vkCmdCopyBuffer(batchCommandBuffer, staging.getBuffer(), destination, 1, &region);
+		numCopies++;
+
+		data += chunkSize;
+		destinationOffset += chunkSize;
+		size -= chunkSize;
+	}
+}
+
+bool MeshPool::load(const char *path, uint32_t &meshId)
+{
+	MappedFile file;
+	if (!file.open(path))
+	{
+		fprintf(stderr, "Warning: Can't map mesh file \"%s\"\n", path);
+		numBadFiles++;
+		return false;
+	}
+
+	file.prefetch();
+	return load(file.getData(), file.getSize(), path, meshId);
+}
+
+bool MeshPool::load(const void *data, size_t size, const char *name, uint32_t &meshId)
+{
+	const MeshFileHeader *header = validateMeshFile(data, size);
+	if (!header)
+	{
+		fprintf(stderr, "Warning: \"%s\" isn't a version %u mesh file, or is damaged\n", name, MESH_FILE_VERSION);
+		numBadFiles++;
+		return false;
+	}
+	if (header->vertexFormat != vertexFormat)
+	{
+		fprintf(stderr, "Warning: \"%s\" has %s vertices, the mesh pool holds %s ones\n", name,
+			getMeshVertexFormatName(static_cast<MeshVertexFormat>(header->vertexFormat)), getMeshVertexFormatName(vertexFormat));
+		numBadFiles++;
+		return false;
+	}
+	if (header->indexSize != getIndexSize())
+	{
+		fprintf(stderr, "Warning: \"%s\" has %u-bit indices, the mesh pool holds %u-bit ones\n", name,
+			header->indexSize * 8, getIndexSize() * 8);
+		numBadFiles++;
+		return false;
+	}
+
+	// Vertices are aligned to their stride so the LODs' vertex offsets (in vertices) come out whole.
+	MeshEntry entry = {};
+	entry.vertexSize = header->vertexDataSize;
+	entry.indexSize = header->indexDataSize;
+	entry.clusterSize = header->clusterDataSize;
+	bool vertexFits = vertexRanges.allocate(entry.vertexSize, header->vertexStride, entry.vertexStart);
+	bool indexFits = indexRanges.allocate(entry.indexSize, sizeof(uint32_t), entry.indexStart);
+	bool clusterFits = clusterRanges.allocate(entry.clusterSize, sizeof(uint32_t), entry.clusterStart);
+	if (!vertexFits || !indexFits || !clusterFits)
+	{
+		if (vertexFits)
+			vertexRanges.free(entry.vertexStart, entry.vertexSize);
+		if (indexFits)
+			indexRanges.free(entry.indexStart, entry.indexSize);
+		if (clusterFits)
+			clusterRanges.free(entry.clusterStart, entry.clusterSize);
+		return false;
+	}
+
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	stageBlob(bytes + header->vertexDataOffset, entry.vertexSize, vertexBuffer, entry.vertexStart);
+	stageBlob(bytes + header->indexDataOffset, entry.indexSize, indexBuffer, entry.indexStart);
+	stageBlob(bytes + header->clusterDataOffset, entry.clusterSize, clusterBuffer, entry.clusterStart);
+
+	PooledMesh &mesh = entry.mesh;
+	mesh.clusterOffset = entry.clusterStart;
+	mesh.numClusters = header->numClusters;
+	mesh.numClusterVertices = header->numClusterVertices;
+	mesh.numLods = header->numLods;
+	for (uint32_t i = 0; i < header->numLods; i++)
+	{
+		mesh.lods[i] = header->lods[i];
+		mesh.lods[i].firstIndex += static_cast<uint32_t>(entry.indexStart / header->indexSize);
+		mesh.lods[i].vertexOffset += static_cast<int32_t>(entry.vertexStart / header->vertexStride);
+	}
+	memcpy(mesh.boundsMin, header->boundsMin, sizeof(mesh.boundsMin));
+	memcpy(mesh.boundsMax, header->boundsMax, sizeof(mesh.boundsMax));
+	memcpy(mesh.boundingSphere, header->boundingSphere, sizeof(mesh.boundingSphere));
+
+	entry.live = true;
+	if (freeMeshIds.empty())
+	{
+		meshId = static_cast<uint32_t>(meshes.size());
+		meshes.push_back(entry);
+	}
+	else
+	{
+		meshId = freeMeshIds.back();
+		freeMeshIds.pop_back();
+		meshes[meshId] = entry;
+	}
+
+	numMeshesLoaded++;
+	numBytesLoaded += header->vertexDataSize + header->indexDataSize + header->clusterDataSize;
+	return true;
+}
+
+uint64_t MeshPool::flush(void)
+{
+	if (!batchCommandBuffer)
+		return timeline->getLastSubmittedValue();
+
+	// One barrier for everything in the batch. Later submits on the same queue are covered by it too.
+	VkMemoryBarrier barrier = {
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		nullptr, // pNext
+		VK_ACCESS_TRANSFER_WRITE_BIT, // Source access mask
+		VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT // Destination access mask
+	};
+	dispatch->vkCmdPipelineBarrier(batchCommandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, // Dependency flags
+		1, &barrier,
+		0, nullptr,
+		0, nullptr);
+
+	HANDLE_VK(dispatch->vkEndCommandBuffer(batchCommandBuffer),
+		"Ending a mesh upload command buffer");
+
+	uint64_t value = timeline->getNextValue();
+	staging.commit(value);
+	timeline->submit(1, &batchCommandBuffer);
+
+	SubmittedBatch batch = {
+		batchCommandBuffer, // Command buffer
+		value // Timeline value
+	};
+	submittedBatches.push_back(batch);
+	batchCommandBuffer = VK_NULL_HANDLE;
+	numBatches++;
+	return value;
+}
+
+void MeshPool::unload(uint32_t meshId)
+{
+	MeshEntry &entry = meshes[meshId];
+	assert(entry.live);
+	vertexRanges.free(entry.vertexStart, entry.vertexSize);
+	indexRanges.free(entry.indexStart, entry.indexSize);
+	clusterRanges.free(entry.clusterStart, entry.clusterSize);
+	entry.live = false;
+	freeMeshIds.push_back(meshId);
+	numUnloads++;
+}
+
+VkDeviceSize MeshPool::getBufferSize(VkDeviceSize capacity) const
+{
+	return alignUp(capacity, copyAlignment) + alignUp(capacity / MESH_MOVE_SCRATCH_DIVISOR, copyAlignment);
+}
+
+void MeshPool::recordMove(VkBuffer buffer, VkDeviceSize source, VkDeviceSize destination, VkDeviceSize size,
+	VkDeviceSize scratchStart, VkDeviceSize scratchEnd)
+{
+	// Copies within a buffer can't overlap. A move shorter than its size goes through the scratch
+	//	space instead, as a copy there and one back (in pieces of the scratch's size if it has to).
+	//	If the scratch is even smaller than the shift, the move goes straight across in pieces of
+	//	the shift. Each copy waits for the last, whose source or destination it overwrites.
+	VkDeviceSize shift = source - destination;
+	VkDeviceSize scratchSize = scratchEnd - scratchStart;
+	bool bounce = shift < size && scratchSize > shift;
+	VkMemoryBarrier barrier = {
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		nullptr, // pNext
+		VK_ACCESS_TRANSFER_WRITE_BIT, // Source access mask
+		VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT // Destination access mask
+	};
+	auto copy = [&](VkDeviceSize from, VkDeviceSize to, VkDeviceSize bytes) {
+		VkBufferCopy region = {
+			from, // Source offset
+			to, // Destination offset
+			bytes // Size
+		};
+		dispatch->vkCmdCopyBuffer(batchCommandBuffer, buffer, buffer, 1, &region);
+		dispatch->vkCmdPipelineBarrier(batchCommandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+		numCopies++;
+	};
+	for (VkDeviceSize moved = 0; moved < size;)
+	{
+		VkDeviceSize pieceSize = std::min(bounce ? scratchSize : shift, size - moved);
+		if (bounce)
+		{
+			copy(source + moved, scratchStart, pieceSize);
+			copy(scratchStart, destination + moved, pieceSize);
+			numBouncedPieces++;
+		}
+		else
+		{
+			copy(source + moved, destination + moved, pieceSize);
+		}
+		moved += pieceSize;
+	}
+}
+
+VkDeviceSize MeshPool::compact(void)
+{
+	// Live meshes in the order they sit in each buffer, moved down one after the other.
+	std::vector<uint32_t> order;
+	for (uint32_t meshId = 0; meshId < meshes.size(); meshId++)
+	{
+		if (meshes[meshId].live)
+			order.push_back(meshId);
+	}
+	if (order.empty())
+	{
+		reset();
+		return 0;
+	}
+
+	if (!batchCommandBuffer)
+		beginBatch();
+
+	// Earlier batches only made their copies visible to the draws and compute.
+	VkMemoryBarrier barrier = {
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		nullptr, // pNext
+		VK_ACCESS_TRANSFER_WRITE_BIT, // Source access mask
+		VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT // Destination access mask
+	};
+	dispatch->vkCmdPipelineBarrier(batchCommandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	VkDeviceSize bytesMoved = 0;
+	uint32_t vertexStride = getMeshVertexStride(vertexFormat);
+	uint32_t indexSize = getIndexSize();
+	struct BufferRanges
+	{
+		VkBuffer buffer;
+		RangeAllocator *ranges;
+		VkDeviceSize alignment;
+		VkDeviceSize MeshEntry::*start;
+		VkDeviceSize MeshEntry::*size;
+	};
+	BufferRanges buffers[] = {
+		{ vertexBuffer, &vertexRanges, vertexStride, &MeshEntry::vertexStart, &MeshEntry::vertexSize },
+		{ indexBuffer, &indexRanges, sizeof(uint32_t), &MeshEntry::indexStart, &MeshEntry::indexSize },
+		{ clusterBuffer, &clusterRanges, sizeof(uint32_t), &MeshEntry::clusterStart, &MeshEntry::clusterSize }
+	};
+	for (uint32_t b = 0; b < 3; b++)
+	{
+		// Reallocating in the order they're in puts each one at or below where it was, and above
+		//	everything that's already been moved.
+		const BufferRanges &buffer = buffers[b];
+		VkDeviceSize scratchStart = alignUp(buffer.ranges->getHighWaterMark(), copyAlignment); // Nothing moves above it.
+		VkDeviceSize scratchEnd = getBufferSize(buffer.ranges->getCapacity());
+		std::sort(order.begin(), order.end(), [&](uint32_t first, uint32_t second) {
+			return meshes[first].*buffer.start < meshes[second].*buffer.start;
+		});
+		buffer.ranges->reset(buffer.ranges->getCapacity());
+		for (uint32_t meshId : order)
+		{
+			MeshEntry &entry = meshes[meshId];
+			VkDeviceSize oldStart = entry.*buffer.start;
+			VkDeviceSize newStart = 0;
+			buffer.ranges->allocate(entry.*buffer.size, buffer.alignment, newStart);
+			if (newStart == oldStart || !(entry.*buffer.size))
+				continue;
+
+			recordMove(buffer.buffer, oldStart, newStart, entry.*buffer.size, scratchStart, scratchEnd);
+			bytesMoved += entry.*buffer.size;
+			entry.*buffer.start = newStart;
+
+			// Point the mesh table at where it ended up.
+			PooledMesh &mesh = entry.mesh;
+			for (uint32_t i = 0; i < mesh.numLods; i++)
+			{
+				if (b == 0)
+					mesh.lods[i].vertexOffset -= static_cast<int32_t>((oldStart - newStart) / vertexStride);
+				else if (b == 1)
+					mesh.lods[i].firstIndex -= static_cast<uint32_t>((oldStart - newStart) / indexSize);
+			}
+			if (b == 2)
+				mesh.clusterOffset = newStart;
+		}
+	}
+
+	numCompactions++;
+	numBytesMoved += bytesMoved;
+	return bytesMoved;
+}
+
+void MeshPool::reset(void)
+{
+	assert(!batchCommandBuffer);
+	vertexRanges.reset(vertexRanges.getCapacity());
+	indexRanges.reset(indexRanges.getCapacity());
+	clusterRanges.reset(clusterRanges.getCapacity());
+	meshes.clear();
+	freeMeshIds.clear();
+}
+
+void MeshPool::printStats(void) const
+{
+	printf("Mesh pool stats:\n");
+	printf("\tMeshes loaded: %llu (%llu bytes)\n",
+		static_cast<unsigned long long>(numMeshesLoaded),
+		static_cast<unsigned long long>(numBytesLoaded));
+	printf("\tUpload batches: %llu, copies: %llu\n",
+		static_cast<unsigned long long>(numBatches),
+		static_cast<unsigned long long>(numCopies));
+	printf("\tMeshes in the pool: %u (%llu unloaded, %llu compactions moving %llu bytes, %llu pieces bounced through scratch)\n",
+		static_cast<uint32_t>(meshes.size() - freeMeshIds.size()),
+		static_cast<unsigned long long>(numUnloads),
+		static_cast<unsigned long long>(numCompactions),
+		static_cast<unsigned long long>(numBytesMoved),
+		static_cast<unsigned long long>(numBouncedPieces));
+	printf("\tVertices: %s, %u bytes each. Indices: %u-bit\n",
+		getMeshVertexFormatName(vertexFormat), getMeshVertexStride(vertexFormat), getIndexSize() * 8);
+	const char *bufferNames[] = { "Vertex", "Index", "Cluster" };
+	const RangeAllocator *ranges[] = { &vertexRanges, &indexRanges, &clusterRanges };
+	for (uint32_t i = 0; i < 3; i++)
+		printf("\t%s buffer: %llu / %llu bytes used, up to %llu, %u free ranges (largest %llu bytes)\n", bufferNames[i],
+			static_cast<unsigned long long>(ranges[i]->getBytesUsed()),
+			static_cast<unsigned long long>(ranges[i]->getCapacity()),
+			static_cast<unsigned long long>(ranges[i]->getHighWaterMark()),
+			ranges[i]->getNumFreeRanges(),
+			static_cast<unsigned long long>(ranges[i]->getLargestFreeRange()));
+	if (numBadFiles)
+		printf("\tFiles that failed to load: %llu\n", static_cast<unsigned long long>(numBadFiles));
+	staging.printStats();
+}
+
+void benchmarkMeshLoading(MeshPool &pool, QueueTimeline &timeline, const char *path, uint32_t numLoads)
+{
+	MappedFile file;
+	if (!file.open(path))
+	{
+		fprintf(stderr, "Warning: Can't map \"%s\", skipping the mesh load benchmark\n", path);
+		return;
+	}
+	uint64_t fileSize = file.getSize();
+	file.close();
+
+	// Everything from mapping the first file to the GPU finishing the last copy. The file was just
+	//	written, so it's coming out of the OS's file cache rather than off the disk.
+	PresentLatencyTracker::Clock::time_point start = PresentLatencyTracker::Clock::now();
+	uint32_t numLoaded = 0;
+	std::vector<uint32_t> meshIds(numLoads);
+	while (numLoaded < numLoads && pool.load(path, meshIds[numLoaded]))
+		numLoaded++;
+	double recordMs = PresentLatencyTracker::millisecondsSince(start);
+	timeline.wait(pool.flush());
+	double totalMs = PresentLatencyTracker::millisecondsSince(start);
+
+	double seconds = totalMs / 1000.0;
+	printf("Mesh load benchmark (\"%s\", %llu bytes):\n", path, static_cast<unsigned long long>(fileSize));
+	printf("\tLoaded %u meshes in %.3lf ms (%.3lf ms of it on the CPU)\n", numLoaded, totalMs, recordMs);
+	if (numLoaded && seconds > 0.0)
+		printf("\t%.3lf GB/s, %.0lf meshes/s\n",
+			static_cast<double>(fileSize) * numLoaded / seconds / 1e9,
+			numLoaded / seconds);
+
+	// Churn: free every other mesh and load into the gaps, then free every other one again and
+	//	close the gaps up.
+	uint32_t numUnloaded = 0;
+	for (uint32_t i = 0; i < numLoaded; i += 2, numUnloaded++)
+		pool.unload(meshIds[i]);
+	uint32_t numReloaded = 0;
+	for (uint32_t i = 0; i < numLoaded && numReloaded < numUnloaded; i += 2)
+	{
+		if (!pool.load(path, meshIds[i]))
+			break;
+		numReloaded++;
+	}
+	timeline.wait(pool.flush());
+	for (uint32_t i = 1; i < numLoaded; i += 2)
+		pool.unload(meshIds[i]);
+
+	start = PresentLatencyTracker::Clock::now();
+	VkDeviceSize bytesMoved = pool.compact();
+	timeline.wait(pool.flush());
+	double compactMs = PresentLatencyTracker::millisecondsSince(start);
+	printf("\tReloaded %u of %u unloaded meshes into the gaps they left\n", numReloaded, numUnloaded);
+	printf("\tCompacted in %.3lf ms, moving %llu bytes\n", compactMs, static_cast<unsigned long long>(bytesMoved));
+
+	pool.reset();
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "vulkanDispatch.h"
+#include "vulkanTimeline.h"
+#include "vulkanStagingRing.h"
+#include "vulkanRangeAllocator.h"
+#include "meshFile.h"
+
+// A mesh uploaded into a MeshPool. Draw LOD i with the pool's index buffer bound at offset 0 as the
+//	pool's index type, and lods[i].firstIndex / numIndices / vertexOffset straight into
+//	vkCmdDrawIndexed. Both are into the whole pool's buffers, so every mesh in the pool draws with
+//	the same bindings, and their draws can go in one multi-draw.
+// Its clusters are at 'clusterOffset' in the pool's cluster buffer, laid out as in the file:
+//	'numClusters' MeshClusters, then 'numClusterVertices' cluster vertices, then the cluster triangles.
+struct PooledMesh
+{
+	VkDeviceSize clusterOffset; // Bytes into the pool's cluster buffer.
+	uint32_t numClusters;
+	uint32_t numClusterVertices;
+	uint32_t numLods;
+	MeshFileLod lods[MESH_FILE_MAX_LODS];
+	float boundsMin[3];
+	float boundsMax[3];
+	float boundingSphere[4]; // xyz center, w radius
+};
+
+// Device-local vertex, index and cluster buffers that mesh files get loaded into.
+// Loading maps the file and copies its blobs from the mapping into the staging ring, so the bytes
+//	only get touched once on the CPU, and the copies into the pool are recorded into a batch that
+//	flush() submits.
+// Each mesh's ranges of the buffers are sub-allocated (RangeAllocator), so unloading one frees
+//	them for the next load, and compact() moves the rest down over the gaps. Meshes are referred
+//	to by id, through the pool's mesh table, since compacting moves them.
+class MeshPool
+{
+	// A mesh and the ranges of the buffers it holds.
+	struct MeshEntry
+	{
+		PooledMesh mesh;
+		VkDeviceSize vertexStart;
+		VkDeviceSize vertexSize;
+		VkDeviceSize indexStart;
+		VkDeviceSize indexSize;
+		VkDeviceSize clusterStart;
+		VkDeviceSize clusterSize;
+		bool live;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	const DeviceDispatch *dispatch = nullptr;
+	const VkAllocationCallbacks *allocator = nullptr; // The buffers' and the staging ring's.
+	QueueTimeline *timeline = nullptr;
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkDeviceSize copyAlignment = 16;
+	MeshVertexFormat vertexFormat = MESH_VERTEX_FORMAT_QUANTIZED;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+	StagingRing staging;
+
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory vertexMemory = VK_NULL_HANDLE;
+	RangeAllocator vertexRanges;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory indexMemory = VK_NULL_HANDLE;
+	RangeAllocator indexRanges;
+	VkBuffer clusterBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory clusterMemory = VK_NULL_HANDLE;
+	RangeAllocator clusterRanges;
+
+	// The mesh table, indexed by id. Unloaded entries' ids get reused.
+	std::vector<MeshEntry> meshes;
+	std::vector<uint32_t> freeMeshIds;
+
+	// Upload batches
+	VkCommandBuffer batchCommandBuffer = VK_NULL_HANDLE; // Being recorded, VK_NULL_HANDLE between batches.
+	struct SubmittedBatch
+	{
+		VkCommandBuffer commandBuffer;
+		uint64_t timelineValue;
+	};
+	std::deque<SubmittedBatch> submittedBatches;
+	std::vector<VkCommandBuffer> freeCommandBuffers;
+
+	// Stats
+	uint64_t numMeshesLoaded = 0;
+	uint64_t numBytesLoaded = 0; // Vertex and index data copied from files.
+	uint64_t numBatches = 0;
+	uint64_t numCopies = 0;
+	uint64_t numBadFiles = 0;
+	uint64_t numUnloads = 0;
+	uint64_t numCompactions = 0;
+	uint64_t numBytesMoved = 0; // By compactions
+	uint64_t numBouncedPieces = 0; // Pieces of overlapping moves copied through the scratch space.
+
+	void beginBatch(void);
+	void stageBlob(const uint8_t *data, VkDeviceSize size, VkBuffer destination, VkDeviceSize destinationOffset);
+	void recordMove(VkBuffer buffer, VkDeviceSize source, VkDeviceSize destination, VkDeviceSize size,
+		VkDeviceSize scratchStart, VkDeviceSize scratchEnd);
+	uint32_t getIndexSize(void) const { return indexType == VK_INDEX_TYPE_UINT16 ? 2U : 4U; }
+	VkDeviceSize getBufferSize(VkDeviceSize capacity) const; // The capacity and the move scratch past it.
+
+public:
+	// Uploads are submitted to 'timeline's queue, with command buffers from 'commandPool' (which has
+	//	to be for that queue's family and allow resetting individual command buffers).
+	// Every mesh shares the one vertex and one index buffer, so they all have to be in 'vertexFormat',
+	//	with 'indexType' indices.
+	void create(VkDevice device, const DeviceDispatch &dispatch,
+		const VkPhysicalDeviceMemoryProperties &memoryProperties,
+		const VkPhysicalDeviceLimits &limits,
+		MeshVertexFormat vertexFormat,
+		VkIndexType indexType,
+		VkDeviceSize vertexCapacity,
+		VkDeviceSize indexCapacity,
+		VkDeviceSize clusterCapacity,
+		VkDeviceSize stagingSize,
+		QueueTimeline &timeline,
+		VkCommandPool commandPool,
+		const VkAllocationCallbacks *allocator);
+	void destroy(void);
+
+	// Map 'path' and record its upload into the current batch, setting 'meshId' to its entry in
+	//	the mesh table. Returns false if the file can't be mapped, isn't a valid mesh file in the
+	//	pool's vertex format and index type, or doesn't fit in any of the pool's free ranges.
+	// May submit the batch early when the staging ring fills up. The mesh is ready to draw once the
+	//	timeline reaches the value of the next flush().
+	bool load(const char *path, uint32_t &meshId);
+
+	// The same for a mesh file that's already in memory ('name' is only for messages).
+	bool load(const void *data, size_t size, const char *name, uint32_t &meshId);
+
+	// Free a mesh's ranges (and its id) for later loads. The GPU has to be done with it.
+	void unload(uint32_t meshId);
+
+	// Move every mesh down over the gaps unloading left, so the free space is in one range at the
+	//	end of each buffer again. The moves are recorded into the current batch, for flush().
+	// A mesh that overlaps where it's going is bounced through the space past the buffer's last
+	//	allocation, or the scratch each buffer keeps past its capacity when that's all there is.
+	// The GPU has to be done with the pool's meshes, the same as for reset(), and anything built
+	//	from getMesh() has to be built again after (the draws see the new places once flush()'s
+	//	value is reached). Returns the bytes moved.
+	VkDeviceSize compact(void);
+
+	// Submit everything loaded since the last flush, ending with a barrier that makes it visible to
+	//	vertex input, the vertex shader and compute. Returns the timeline value it's done at.
+	uint64_t flush(void);
+
+	// Forget every mesh. The GPU has to be done with them.
+	void reset(void);
+
+	const PooledMesh &getMesh(uint32_t meshId) const { return meshes[meshId].mesh; }
+	MeshVertexFormat getVertexFormat(void) const { return vertexFormat; }
+	VkIndexType getIndexType(void) const { return indexType; }
+	VkBuffer getVertexBuffer(void) const { return vertexBuffer; }
+	VkBuffer getIndexBuffer(void) const { return indexBuffer; }
+	VkBuffer getClusterBuffer(void) const { return clusterBuffer; } // A storage buffer.
+	VkDeviceSize getVertexBytesUsed(void) const { return vertexRanges.getBytesUsed(); }
+	VkDeviceSize getIndexBytesUsed(void) const { return indexRanges.getBytesUsed(); }
+	VkDeviceSize getClusterBytesUsed(void) const { return clusterRanges.getBytesUsed(); }
+	void printStats(void) const;
+};
+
+// Load 'path' into 'pool' 'numLoads' times (or until it's full) and print the throughput from
+//	mapping the first file to the last copy landing, in GB/s of file data and meshes/s. Then unload
+//	every other one, load half as many again into the gaps, and compact what's left, timing that.
+// Resets the pool afterwards, so run it before anything real is loaded.
+void benchmarkMeshLoading(MeshPool &pool, QueueTimeline &timeline, const char *path, uint32_t numLoads);
@@ -0,0 +1,178 @@
+#include "vulkanMultiDevice.h"
+#include <stdio.h>
+#include <string.h>
+#include "vulkanDebug.h"
+#include "vulkanMemory.h"
+
+// Scopes the worker times per frame (just the step and its readback).
+#define SECONDARY_PROFILER_MAX_SCOPES 2
+
+void SecondaryDeviceWorker::create(uint32_t deviceIndex, VkDevice device, const DeviceDispatch &dispatch,
+	VkQueue queue, VkCommandPool commandPool,
+	const VkPhysicalDeviceMemoryProperties &memoryProperties,
+	float timestampPeriod,
+	const VkQueueFamilyProperties &queueFamily,
+	uint32_t queueFamilyIndex,
+	ShaderLibrary &shaders,
+	uint32_t numBodies,
+	const PhysicsKernelConfig &physicsConfig,
+	uint32_t numFrames,
+	const VkAllocationCallbacks *allocator)
+{
+	this->deviceIndex = deviceIndex;
+	this->device = device;
+	this->dispatch = &dispatch;
+	this->commandPool = commandPool;
+	snprintf(name, sizeof(name), "Device %u", deviceIndex);
+
+	// Only the primary device gets timeline semaphores, so this one's tracked with fences.
+	timeline.create(device, dispatch, queue, false, name);
+
+	physics.create(device, dispatch, memoryProperties, numBodies, physicsConfig,
+		{ queueFamilyIndex }, // Queue families
+		shaders,
+		VK_NULL_HANDLE, // Pipeline cache
+		allocator);
+
+	uint32_t timestampValidBits[GPU_LANE_COUNT] = { queueFamily.timestampValidBits, 0U };
+	profiler.create(device, dispatch, timestampPeriod, timestampValidBits,
+		numFrames, SECONDARY_PROFILER_MAX_SCOPES, allocator);
+
+	commandBuffers.resize(numFrames);
+	VkCommandBufferAllocateInfo commandBufferAllocInfo = {
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		nullptr, // pNext
+		commandPool, // Command Pool
+		VK_COMMAND_BUFFER_LEVEL_PRIMARY, // Buffer level
+		numFrames // Num command buffers to alloc
+	};
+	HANDLE_VK(dispatch.vkAllocateCommandBuffers(device, &commandBufferAllocInfo, commandBuffers.data()),
+		"Allocating %u command buffers on device %u", numFrames, deviceIndex);
+
+	// The CPU reads these back, so cached memory is a lot faster when there is some.
+	readbacks.resize(numFrames);
+	for (Readback &readback : readbacks)
+	{
+		createBufferWithMemory(device, dispatch, memoryProperties,
+			physics.getStateSize(),
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			VK_MEMORY_PROPERTY_HOST_CACHED_BIT, allocator,
+			readback.buffer, readback.memory);
+		HANDLE_VK(dispatch.vkMapMemory(device, readback.memory, 0, VK_WHOLE_SIZE, 0, &readback.mappedData),
+			"Mapping a readback buffer on device %u", deviceIndex);
+	}
+}
+
+void SecondaryDeviceWorker::destroy(const VkAllocationCallbacks *allocator)
+{
+	if (!device)
+		return;
+
+	for (Readback &readback : readbacks)
+	{
+		dispatch->vkDestroyBuffer(device, readback.buffer, allocator);
+		dispatch->vkFreeMemory(device, readback.memory, allocator);
+	}
+	readbacks.clear();
+
+	if (!commandBuffers.empty())
+		dispatch->vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+	commandBuffers.clear();
+
+	profiler.destroy(allocator);
+	physics.destroy(allocator);
+	timeline.destroy();
+	device = VK_NULL_HANDLE;
+}
+
+bool SecondaryDeviceWorker::collect(uint32_t frameIndex, void *destination)
+{
+	Readback &readback = readbacks[frameIndex];
+	if (!readback.timelineValue)
+		return false;
+
+	PresentLatencyTracker::Clock::time_point collectStart = PresentLatencyTracker::Clock::now();
+	if (!timeline.isComplete(readback.timelineValue))
+		numStalls++;
+	timeline.wait(readback.timelineValue);
+
+	memcpy(destination, readback.mappedData, static_cast<size_t>(physics.getStateSize()));
+	readback.timelineValue = 0;
+	collectTime.add(PresentLatencyTracker::millisecondsSince(collectStart));
+	numCollected++;
+	return true;
+}
+
+void SecondaryDeviceWorker::submitStep(uint32_t frameIndex, float timeStep)
+{
+	// collect() (or the frame never having been used) means the device is done with the frame.
+	assert(!readbacks[frameIndex].timelineValue);
+	profiler.beginFrame(frameIndex);
+
+	VkCommandBuffer commandBuffer = commandBuffers[frameIndex];
+	HANDLE_VK(dispatch->vkResetCommandBuffer(commandBuffer, 0),
+		"Resetting frame %u's command buffer on device %u", frameIndex, deviceIndex);
+
+	VkCommandBufferBeginInfo beginInfo = {
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		nullptr, // pNext
+		VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, // Flags
+		nullptr // Inheritance info
+	};
+	HANDLE_VK(dispatch->vkBeginCommandBuffer(commandBuffer, &beginInfo),
+		"Beginning frame %u's command buffer on device %u", frameIndex, deviceIndex);
+
+	uint32_t physicsScope = profiler.beginScope(commandBuffer, "Physics", GPU_LANE_GRAPHICS);
+	physics.recordStep(commandBuffer, timeStep);
+	profiler.endScope(commandBuffer, physicsScope);
+
+	VkMemoryBarrier toCopyBarrier = {
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		nullptr, // pNext
+		VK_ACCESS_SHADER_WRITE_BIT, // Source access mask
+		VK_ACCESS_TRANSFER_READ_BIT // Destination access mask
+	};
+	dispatch->vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 1, &toCopyBarrier, 0, nullptr, 0, nullptr);
+
+	uint32_t readbackScope = profiler.beginScope(commandBuffer, "Readback", GPU_LANE_GRAPHICS);
+	VkBufferCopy region = {
+		0, // Source offset
+		0, // Destination offset
+		physics.getStateSize() // Size
+	};
+	dispatch->vkCmdCopyBuffer(commandBuffer, physics.getCurrentState(), readbacks[frameIndex].buffer, 1, &region);
+	profiler.endScope(commandBuffer, readbackScope);
+
+	VkMemoryBarrier toHostBarrier = {
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		nullptr, // pNext
+		VK_ACCESS_TRANSFER_WRITE_BIT, // Source access mask
+		VK_ACCESS_HOST_READ_BIT // Destination access mask
+	};
+	dispatch->vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &toHostBarrier, 0, nullptr, 0, nullptr);
+
+	HANDLE_VK(dispatch->vkEndCommandBuffer(commandBuffer),
+		"Ending frame %u's command buffer on device %u", frameIndex, deviceIndex);
+
+	readbacks[frameIndex].timelineValue = timeline.submit(1, &commandBuffer);
+	numSteps++;
+}
+
+void SecondaryDeviceWorker::printStats(void) const
+{
+	printf("Device %u worker stats:\n", deviceIndex);
+	printf("\tSteps: %llu, collected: %llu (%llu stalled on the device)\n",
+		static_cast<unsigned long long>(numSteps),
+		static_cast<unsigned long long>(numCollected),
+		static_cast<unsigned long long>(numStalls));
+	collectTime.print("Collect (wait + copy out)");
+	timeline.printStats();
+	profiler.printStats();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+#include "vulkanDispatch.h"
+#include "vulkanTimeline.h"
+#include "vulkanPhysics.h"
+#include "vulkanGpuProfiler.h"
+#include "vulkanPresent.h"
+
+// Runs a share of the physics on a secondary device (USE_MULTI_GPU) and hands the results to the
+//	primary device through host memory, since two VkDevices can't see each other's memory without
+//	external memory extensions.
+// Each frame in flight has a host visible readback buffer. submitStep() steps the bodies and copies
+//	them into the frame's readback buffer. The next time the frame index comes around, collect()
+//	waits for that (usually long done) and copies the bodies out for the primary to upload, so the
+//	primary renders the secondary's results from MAX_FRAMES_IN_FLIGHT frames ago.
+//
+// Two software ICDs are enough to exercise this on one machine, e.g.
+//	VK_ICD_FILENAMES=lvp_icd.json;vk_swiftshader_icd.json
+class SecondaryDeviceWorker
+{
+	struct Readback
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		void *mappedData = nullptr;
+		uint64_t timelineValue = 0; // Value of the submit that fills it. 0 when nothing's pending.
+	};
+
+	uint32_t deviceIndex = 0;
+	char name[32] = {}; // For the timeline. The vector of workers mustn't move after create().
+	VkDevice device = VK_NULL_HANDLE;
+	const DeviceDispatch *dispatch = nullptr;
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> commandBuffers; // One per frame in flight.
+	std::vector<Readback> readbacks; // One per frame in flight.
+	QueueTimeline timeline;
+	PhysicsSimulation physics;
+	GpuProfiler profiler;
+
+	// Stats
+	uint64_t numSteps = 0;
+	uint64_t numCollected = 0;
+	uint64_t numStalls = 0; // collect() had to block on the secondary device.
+	LatencyStat collectTime; // Waiting plus copying out of the readback buffer.
+
+public:
+	// Uses 'queue' and 'commandPool' (from the device's graphics family, so it can write timestamps
+	//	per 'queueFamily') for the steps and the readback copies.
+	void create(uint32_t deviceIndex, VkDevice device, const DeviceDispatch &dispatch,
+		VkQueue queue, VkCommandPool commandPool,
+		const VkPhysicalDeviceMemoryProperties &memoryProperties,
+		float timestampPeriod,
+		const VkQueueFamilyProperties &queueFamily,
+		uint32_t queueFamilyIndex,
+		ShaderLibrary &shaders,
+		uint32_t numBodies,
+		const PhysicsKernelConfig &physicsConfig,
+		uint32_t numFrames,
+		const VkAllocationCallbacks *allocator);
+	void destroy(const VkAllocationCallbacks *allocator);
+
+	// Copy the bodies the last step on 'frameIndex' produced into 'destination' (getStateSize() bytes).
+	// Returns false if that frame hasn't submitted anything yet.
+	bool collect(uint32_t frameIndex, void *destination);
+
+	// Step the bodies and read them back into 'frameIndex's readback buffer. Call after collect().
+	void submitStep(uint32_t frameIndex, float timeStep);
+
+	VkDeviceSize getStateSize(void) const { return physics.getStateSize(); }
+	uint32_t getNumBodies(void) const { return physics.getNumBodies(); }
+	double getBusyMsPerFrame(void) const { return profiler.getBusyMsPerFrame(); }
+	void printStats(void) const;
+};
@@ -0,0 +1,245 @@
+#include "vulkanPhysics.h"
+#include <stdio.h>
+#include <stdexcept>
+#include "vulkanDebug.h"
+#include "vulkanMemory.h"
+
+// Gravitational parameter of the mass everything orbits.
+#define PHYSICS_CENTRAL_MASS 1000.0f
+
+void PhysicsSimulation::create(VkDevice device, const DeviceDispatch &dispatch,
+	const VkPhysicalDeviceMemoryProperties &memoryProperties,
+	uint32_t numBodies,
+	const PhysicsKernelConfig &config,
+	const std::vector<uint32_t> &queueFamilies,
+	ShaderLibrary &shaders,
+	VkPipelineCache pipelineCache,
+	const VkAllocationCallbacks *allocator)
+{
+	this->device = device;
+	this->dispatch = &dispatch;
+	this->numBodies = numBodies;
+	this->config = config;
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// State buffers
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		createBufferWithMemory(device, dispatch, memoryProperties,
+			getStateSize(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocator,
+			stateBuffers[i], stateMemory[i], nullptr,
+			static_cast<uint32_t>(queueFamilies.size()), queueFamilies.data());
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Descriptors. Set i reads the other buffer and writes buffer i.
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	VkDescriptorSetLayoutBinding bindings[] = {
+		{ // Previous state
+			0, // Binding
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // Descriptor Type
+			1, // Descriptor count
+			VK_SHADER_STAGE_COMPUTE_BIT, // Stage flags
+			nullptr // Immutable samplers
+		},
+		{ // Next state
+			1, // Binding
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // Descriptor Type
+			1, // Descriptor count
+			VK_SHADER_STAGE_COMPUTE_BIT, // Stage flags
+			nullptr // Immutable samplers
+		}
+	};
+
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		nullptr, // pNext
+		0, // flags
+		2, // Binding Count
+		bindings
+	};
+	HANDLE_VK(dispatch.vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, allocator, &descriptorSetLayout),
+		"Creating the physics descriptor set layout");
+
+	VkDescriptorPoolSize poolSize = {
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // Type
+		4 // Descriptor count
+	};
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		nullptr, // pNext
+		0, // flags
+		2, // Max sets
+		1, // Pool size count
+		&poolSize // Pool sizes
+	};
+	HANDLE_VK(dispatch.vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, allocator, &descriptorPool),
+		"Creating the physics descriptor pool");
+
+	VkDescriptorSetLayout setLayouts[] = { descriptorSetLayout, descriptorSetLayout };
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		nullptr, // pNext
+		descriptorPool, // Descriptor pool
+		2, // Descriptor set count
+		setLayouts // Set layouts
+	};
+	HANDLE_VK(dispatch.vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, descriptorSets),
+		"Allocating the physics descriptor sets");
+
+	VkDescriptorBufferInfo bufferInfos[2][2];
+	VkWriteDescriptorSet descriptorWrites[4];
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		bufferInfos[i][0] = { stateBuffers[(i + 1) % 2], 0, VK_WHOLE_SIZE }; // Previous state
+		bufferInfos[i][1] = { stateBuffers[i], 0, VK_WHOLE_SIZE }; // Next state
+		for (uint32_t binding = 0; binding < 2; binding++)
+		{
+			descriptorWrites[i * 2 + binding] = {
+				VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				nullptr, // pNext
+				descriptorSets[i], // Destination set
+				binding, // Destination binding
+				0, // Destination array element
+				1, // Descriptor count
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // Descriptor type
+				nullptr, // Image info
+				&bufferInfos[i][binding], // Buffer info
+				nullptr // Texel buffer view
+			};
+		}
+	}
+	dispatch.vkUpdateDescriptorSets(device, 4, descriptorWrites, 0, nullptr);
+
+	//////////////////////////////////////////////////////////////////////////////
+	//
+	// Pipeline
+	//
+	//////////////////////////////////////////////////////////////////////////////
+	VkPushConstantRange pushConstantRange = {
+		VK_SHADER_STAGE_COMPUTE_BIT, // Stage flags
+		0, // Offset
+		sizeof(StepParams) // Size
+	};
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
+		VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		nullptr, // pNext
+		0, // flags
+		1, // Set Layout Count
+		&descriptorSetLayout, // Set Layouts
+		1, // Num Push Constant Ranges
+		&pushConstantRange // Push Constant Ranges
+	};
+	HANDLE_VK(dispatch.vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, allocator, &pipelineLayout),
+		"Creating the physics pipeline layout");
+
+	// Two pipelines from the one shader, so the first step's scatter is a compile time path
+	//	instead of a branch every step takes.
+	SpecializationConstants specialization;
+	specialization.setUint(0, config.workgroupSize);
+	specialization.setUint(1, config.bodiesPerInvocation);
+
+	VkShaderModule shaderModule = shaders.getModule("physicsCompute.glsl", VK_SHADER_STAGE_COMPUTE_BIT);
+	VkPipeline *pipelines[] = { &stepPipeline, &scatterPipeline };
+	for (uint32_t scatter = 0; scatter < 2; scatter++)
+	{
+		specialization.setBool(2, scatter != 0);
+
+		VkComputePipelineCreateInfo computePipelineCreateInfo = {
+			VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+			nullptr, // pNext
+			0, // flags
+			{ // Stage
+				VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+				nullptr, // pNext
+				0, // Flags
+				VK_SHADER_STAGE_COMPUTE_BIT, // Stage
+				shaderModule, // Shader module
+				"main", // Shader entry point
+				specialization.getInfo() // Specialization info
+			},
+			pipelineLayout, // Layout
+			VK_NULL_HANDLE, // Base Pipeline Handle
+			0 // Base pipeline index
+		};
+		HANDLE_VK(dispatch.vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, allocator, pipelines[scatter]),
+			"Creating the physics %s pipeline", scatter ? "scatter" : "step");
+	}
+
+	if (VERBOSE)
+		printf("Physics: %u bodies, %llu KB of state per buffer, workgroups of %u x %u bodies\n",
+			numBodies, static_cast<unsigned long long>(getStateSize() / 1024),
+			config.workgroupSize, config.bodiesPerInvocation);
+}
+
+void PhysicsSimulation::destroy(const VkAllocationCallbacks *allocator)
+{
+	if (!device)
+		return;
+
+	if (scatterPipeline)
+		dispatch->vkDestroyPipeline(device, scatterPipeline, allocator);
+	if (stepPipeline)
+		dispatch->vkDestroyPipeline(device, stepPipeline, allocator);
+	if (pipelineLayout)
+		dispatch->vkDestroyPipelineLayout(device, pipelineLayout, allocator);
+	if (descriptorPool)
+		dispatch->vkDestroyDescriptorPool(device, descriptorPool, allocator);
+	if (descriptorSetLayout)
+		dispatch->vkDestroyDescriptorSetLayout(device, descriptorSetLayout, allocator);
+
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		if (stateBuffers[i])
+			dispatch->vkDestroyBuffer(device, stateBuffers[i], allocator);
+		if (stateMemory[i])
+			dispatch->vkFreeMemory(device, stateMemory[i], allocator);
+	}
+
+	device = VK_NULL_HANDLE;
+}
+
+void PhysicsSimulation::recordStep(VkCommandBuffer commandBuffer, float timeStep)
+{
+	uint32_t writeIndex = static_cast<uint32_t>(stepNumber % 2);
+
+	// Last step's writes have to land before this step reads them.
+	if (stepNumber)
+	{
+		VkMemoryBarrier stateBarrier = {
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			nullptr, // pNext
+			VK_ACCESS_SHADER_WRITE_BIT, // Source access mask
+			VK_ACCESS_SHADER_READ_BIT // Destination access mask
+		};
+		dispatch->vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &stateBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	StepParams params = {
+		timeStep,
+		numBodies,
+		PHYSICS_CENTRAL_MASS
+	};
+
+	dispatch->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, stepNumber ? stepPipeline : scatterPipeline);
+	dispatch->vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout,
+		0, 1, &descriptorSets[writeIndex], // First set, set count, sets
+		0, nullptr); // Dynamic offset count, dynamic offsets
+	dispatch->vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+	uint32_t bodiesPerWorkgroup = config.workgroupSize * config.bodiesPerInvocation;
+	dispatch->vkCmdDispatch(commandBuffer, (numBodies + bodiesPerWorkgroup - 1) / bodiesPerWorkgroup, 1, 1);
+
+	stepNumber++;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+#include "vulkanDispatch.h"
+#include "vulkanShaders.h"
+
+// Constants physicsCompute.glsl gets specialized with (its constant_ids 0 and 1).
+struct PhysicsKernelConfig
+{
+	uint32_t workgroupSize; // local_size_x
+	uint32_t bodiesPerInvocation; // Bodies each invocation steps, unrolled.
+};
+
+// GPU side body simulation (see physicsCompute.glsl).
+// The state lives in two device local storage buffers that swap roles every step: a step reads
+//	the one the previous step wrote and writes the other. Whoever reads getCurrentState() has to
+//	be done with it before the step after next is recorded (the frames in flight wait covers this).
+// The buffers are shared CONCURRENT between the queue families passed to create(), so the steps
+//	can run on an async compute queue and be read on the graphics queue without ownership transfers.
+class PhysicsSimulation
+{
+public:
+	struct Body
+	{
+		float posMass[4]; // xyz position, w mass
+		float velocity[4]; // xyz velocity, w unused
+	};
+
+private:
+	struct StepParams
+	{
+		float timeStep;
+		uint32_t numBodies;
+		float centralMass;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	const DeviceDispatch *dispatch = nullptr;
+	uint32_t numBodies = 0;
+	PhysicsKernelConfig config = {};
+	VkBuffer stateBuffers[2] = {};
+	VkDeviceMemory stateMemory[2] = {};
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet descriptorSets[2] = {}; // [i] writes stateBuffers[i]
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline scatterPipeline = VK_NULL_HANDLE; // The first step, specialized with SCATTER.
+	VkPipeline stepPipeline = VK_NULL_HANDLE;
+	uint64_t stepNumber = 0; // Steps recorded so far.
+
+public:
+	void create(VkDevice device, const DeviceDispatch &dispatch,
+		const VkPhysicalDeviceMemoryProperties &memoryProperties,
+		uint32_t numBodies,
+		const PhysicsKernelConfig &config,
+		const std::vector<uint32_t> &queueFamilies,
+		ShaderLibrary &shaders,
+		VkPipelineCache pipelineCache,
+		const VkAllocationCallbacks *allocator);
+	void destroy(const VkAllocationCallbacks *allocator);
+
+	// Record one step into 'commandBuffer' (on a compute capable queue).
+	// The first step scatters the bodies instead. Waits on the previous step's writes if it was
+	//	recorded on the same queue, anything else has to be synchronized by the caller.
+	void recordStep(VkCommandBuffer commandBuffer, float timeStep);
+
+	// The buffer the last recorded step writes.
+	VkBuffer getCurrentState(void) const { return stateBuffers[getCurrentStateIndex()]; }
+	uint32_t getCurrentStateIndex(void) const { return static_cast<uint32_t>((stepNumber + 1) % 2); }
+	VkBuffer getStateBuffer(uint32_t index) const { return stateBuffers[index]; }
+	VkDeviceSize getStateSize(void) const { return sizeof(Body) * numBodies; }
+	uint32_t getNumBodies(void) const { return numBodies; }
+	uint64_t getStepNumber(void) const { return stepNumber; }
+	const PhysicsKernelConfig &getConfig(void) const { return config; }
+};
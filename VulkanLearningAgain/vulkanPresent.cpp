@@ -0,0 +1,113 @@
+#include "vulkanPresent.h"
+#include <stdio.h>
+#include <algorithm>
+#include "vulkanDebug.h"
+
+VkPresentModeKHR selectPresentMode(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, PresentModePolicy policy)
+{
+	std::vector<VkPresentModeKHR> preferredModes;
+	switch (policy)
+	{
+	case PRESENT_POLICY_LOW_LATENCY:
+		preferredModes = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+		break;
+	case PRESENT_POLICY_UNCAPPED:
+		preferredModes = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+		break;
+	case PRESENT_POLICY_ADAPTIVE_VSYNC:
+		preferredModes = { VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+		break;
+	case PRESENT_POLICY_VSYNC:
+		break;
+	}
+
+	uint32_t numPresentModes;
+	HANDLE_VK(vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &numPresentModes, nullptr),
+		"Getting number of surface present modes");
+	std::vector<VkPresentModeKHR> presentModes(numPresentModes);
+	HANDLE_VK(vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &numPresentModes, presentModes.data()),
+		"Getting surface present modes");
+
+	for (VkPresentModeKHR preferredMode : preferredModes)
+	{
+		if (std::find(presentModes.begin(), presentModes.end(), preferredMode) != presentModes.end())
+			return preferredMode;
+	}
+
+	// FIFO is required to be supported.
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+const char *getPresentModeName(VkPresentModeKHR presentMode)
+{
+	switch (presentMode)
+	{
+	case VK_PRESENT_MODE_IMMEDIATE_KHR: return "VK_PRESENT_MODE_IMMEDIATE_KHR";
+	case VK_PRESENT_MODE_MAILBOX_KHR: return "VK_PRESENT_MODE_MAILBOX_KHR";
+	case VK_PRESENT_MODE_FIFO_KHR: return "VK_PRESENT_MODE_FIFO_KHR";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "VK_PRESENT_MODE_FIFO_RELAXED_KHR";
+	case VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR: return "VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR";
+	case VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR: return "VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR";
+	default: return "Unknown present mode";
+	}
+}
+
+void LatencyStat::add(double ms)
+{
+	if (count == 0 || ms < minMs)
+		minMs = ms;
+	if (count == 0 || ms > maxMs)
+		maxMs = ms;
+	totalMs += ms;
+	count++;
+}
+
+void LatencyStat::print(const char *name) const
+{
+	if (count)
+		printf("\t%s: avg %.3lf ms, min %.3lf ms, max %.3lf ms (%llu samples)\n",
+			name, average(), minMs, maxMs, static_cast<unsigned long long>(count));
+	else
+		printf("\t%s: no samples\n", name);
+}
+
+void PresentLatencyTracker::onSwapchainCreated(uint32_t numImages, bool isRecreation)
+{
+	presentTimes.assign(numImages, Clock::time_point());
+	imagePresented.assign(numImages, false);
+	if (isRecreation)
+		numSwapchainRecreations++;
+}
+
+void PresentLatencyTracker::onAcquired(uint32_t imageIndex, Clock::time_point acquireStart)
+{
+	Clock::time_point now = Clock::now();
+	acquireWait.add(std::chrono::duration<double, std::milli>(now - acquireStart).count());
+
+	if (imageIndex < imagePresented.size() && imagePresented[imageIndex])
+		presentToReacquire.add(std::chrono::duration<double, std::milli>(now - presentTimes[imageIndex]).count());
+}
+
+void PresentLatencyTracker::onPresented(uint32_t imageIndex, Clock::time_point presentStart)
+{
+	Clock::time_point now = Clock::now();
+	presentCall.add(std::chrono::duration<double, std::milli>(now - presentStart).count());
+	cpuFrameTime.add(std::chrono::duration<double, std::milli>(now - frameStartTime).count());
+
+	if (imageIndex < imagePresented.size())
+	{
+		presentTimes[imageIndex] = presentStart;
+		imagePresented[imageIndex] = true;
+	}
+}
+
+void PresentLatencyTracker::printStats(void) const
+{
+	printf("Present latency stats:\n");
+	frameWait.print("Frame wait");
+	acquireWait.print("Acquire wait");
+	presentCall.print("vkQueuePresentKHR");
+	presentToReacquire.print("Present to re-acquire");
+	cpuFrameTime.print("CPU frame time");
+	printf("\tSwapchain recreations: %llu\n", static_cast<unsigned long long>(numSwapchainRecreations));
+}
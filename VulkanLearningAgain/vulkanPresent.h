@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+#include <chrono>
+
+// How the swapchain present mode gets picked.
+// Each policy walks its own preference list and takes the first mode the surface supports.
+//	FIFO is always supported, so every list ends with it.
+enum PresentModePolicy
+{
+	PRESENT_POLICY_LOW_LATENCY, // MAILBOX -> IMMEDIATE -> FIFO_RELAXED -> FIFO (no tearing if MAILBOX is there)
+	PRESENT_POLICY_UNCAPPED, // IMMEDIATE -> MAILBOX -> FIFO_RELAXED -> FIFO (lowest latency, may tear)
+	PRESENT_POLICY_ADAPTIVE_VSYNC, // FIFO_RELAXED -> FIFO (tears only when a frame misses vblank)
+	PRESENT_POLICY_VSYNC // FIFO
+};
+
+VkPresentModeKHR selectPresentMode(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, PresentModePolicy policy);
+const char *getPresentModeName(VkPresentModeKHR presentMode);
+
+// Min/max/average of one timing, in milliseconds.
+struct LatencyStat
+{
+	double minMs = 0.0;
+	double maxMs = 0.0;
+	double totalMs = 0.0;
+	uint64_t count = 0;
+
+	void add(double ms);
+	double average(void) const { return count ? totalMs / count : 0.0; }
+	void print(const char *name) const;
+};
+
+// CPU side measurements of the frame loop around acquire and present.
+// "Present to re-acquire" is the time between queueing an image for present and getting that
+//	same image back from vkAcquireNextImageKHR. That's how long the image was held by the
+//	presentation engine, so it's an upper bound on how long a frame waits to hit the screen.
+class PresentLatencyTracker
+{
+public:
+	typedef std::chrono::high_resolution_clock Clock;
+
+private:
+	std::vector<Clock::time_point> presentTimes; // When each swapchain image was last queued for present.
+	std::vector<bool> imagePresented; // Whether presentTimes holds a valid time for the image.
+	Clock::time_point frameStartTime;
+
+	LatencyStat frameWait; // Blocked waiting for the GPU to finish the frame's previous use.
+	LatencyStat acquireWait; // Blocked in vkAcquireNextImageKHR.
+	LatencyStat presentCall; // Time spent in vkQueuePresentKHR.
+	LatencyStat presentToReacquire;
+	LatencyStat cpuFrameTime; // Start of the frame to present returning.
+	uint64_t numSwapchainRecreations = 0;
+
+public:
+	static double millisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// Forget the per-image present times. Call whenever the swapchain is (re)created.
+	void onSwapchainCreated(uint32_t numImages, bool isRecreation);
+
+	void beginFrame(void) { frameStartTime = Clock::now(); }
+	void onFrameWaited(Clock::time_point waitStart) { frameWait.add(millisecondsSince(waitStart)); }
+	void onAcquired(uint32_t imageIndex, Clock::time_point acquireStart);
+	void onPresented(uint32_t imageIndex, Clock::time_point presentStart);
+
+	void printStats(void) const;
+};
@@ -0,0 +1,96 @@
+#include "vulkanRangeAllocator.h"
+#include <assert.h>
+#include <algorithm>
+#include "vulkanMemory.h"
+
+void RangeAllocator::reset(VkDeviceSize capacity)
+{
+	this->capacity = capacity;
+	bytesUsed = 0;
+	freeRanges.clear();
+	if (capacity)
+		freeRanges.push_back({ 0, capacity });
+}
+
+bool RangeAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset)
+{
+	if (!size)
+	{
+		offset = 0;
+		return true;
+	}
+
+	for (size_t i = 0; i < freeRanges.size(); i++)
+	{
+		FreeRange range = freeRanges[i];
+		VkDeviceSize start = alignUp(range.offset, alignment);
+		VkDeviceSize end = range.offset + range.size;
+		if (start > end || end - start < size)
+			continue;
+
+		// Whatever's left either side stays free, in order.
+		FreeRange front = { range.offset, start - range.offset };
+		FreeRange back = { start + size, end - start - size };
+		if (front.size && back.size)
+		{
+			freeRanges[i] = front;
+			freeRanges.insert(freeRanges.begin() + i + 1, back);
+		}
+		else if (front.size)
+			freeRanges[i] = front;
+		else if (back.size)
+			freeRanges[i] = back;
+		else
+			freeRanges.erase(freeRanges.begin() + i);
+
+		offset = start;
+		bytesUsed += size;
+		return true;
+	}
+	return false;
+}
+
+void RangeAllocator::free(VkDeviceSize offset, VkDeviceSize size)
+{
+	if (!size)
+		return;
+	assert(offset + size <= capacity && size <= bytesUsed);
+	bytesUsed -= size;
+
+	// The first free range after it, then merge with the ones either side.
+	std::vector<FreeRange>::iterator next = std::lower_bound(freeRanges.begin(), freeRanges.end(), offset,
+		[](const FreeRange &range, VkDeviceSize offset) { return range.offset < offset; });
+	bool mergePrevious = next != freeRanges.begin() && (next - 1)->offset + (next - 1)->size == offset;
+	bool mergeNext = next != freeRanges.end() && offset + size == next->offset;
+	if (mergePrevious && mergeNext)
+	{
+		(next - 1)->size += size + next->size;
+		freeRanges.erase(next);
+	}
+	else if (mergePrevious)
+		(next - 1)->size += size;
+	else if (mergeNext)
+	{
+		next->offset = offset;
+		next->size += size;
+	}
+	else
+		freeRanges.insert(next, { offset, size });
+}
+
+VkDeviceSize RangeAllocator::getHighWaterMark(void) const
+{
+	// Everything past the last free range is allocated, unless it runs to the end.
+	if (freeRanges.empty())
+		return capacity;
+	const FreeRange &last = freeRanges.back();
+	return last.offset + last.size == capacity ? last.offset : capacity;
+}
+
+VkDeviceSize RangeAllocator::getLargestFreeRange(void) const
+{
+	VkDeviceSize largest = 0;
+	for (const FreeRange &range : freeRanges)
+		largest = std::max(largest, range.size);
+	return largest;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+
+// Hands out ranges of something 'capacity' bytes long (a buffer, usually) and takes them back.
+// The free ranges are kept sorted by offset, allocations take the first one they fit in, and a
+//	freed range merges with the free ones either side of it, so freeing everything always ends
+//	with one range again. Alignment padding in front of an allocation stays free.
+// Doesn't touch the memory itself, so moving things to close the gaps is up to the owner.
+class RangeAllocator
+{
+	struct FreeRange
+	{
+		VkDeviceSize offset;
+		VkDeviceSize size;
+	};
+
+	std::vector<FreeRange> freeRanges;
+	VkDeviceSize capacity = 0;
+	VkDeviceSize bytesUsed = 0;
+
+public:
+	// Forget every allocation, leaving [0, capacity) free.
+	void reset(VkDeviceSize capacity);
+
+	// Returns false, leaving 'offset' alone, if no free range fits 'size' at 'alignment' (a power of 2).
+	// Empty allocations always succeed, at offset 0.
+	bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset);
+
+	// 'offset' and 'size' have to be exactly what was allocated.
+	void free(VkDeviceSize offset, VkDeviceSize size);
+
+	VkDeviceSize getCapacity(void) const { return capacity; }
+	VkDeviceSize getBytesUsed(void) const { return bytesUsed; }
+	// The end of the last allocation. Closing the gaps below it would bring it down to about getBytesUsed().
+	VkDeviceSize getHighWaterMark(void) const;
+	VkDeviceSize getLargestFreeRange(void) const;
+	uint32_t getNumFreeRanges(void) const { return static_cast<uint32_t>(freeRanges.size()); }
+};
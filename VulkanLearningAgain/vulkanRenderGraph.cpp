@@ -0,0 +1,939 @@
+#include "vulkanRenderGraph.h"
+#include <stdio.h>
+#include <stdexcept>
+#include <algorithm>
+#include "vulkanDebug.h"
+#include "vulkanMemory.h"
+
+// What each RenderGraphAccess means to a barrier, and the usage a transient needs for it.
+struct RenderGraphAccessInfo
+{
+	VkPipelineStageFlags stages;
+	VkAccessFlags access;
+	VkImageLayout layout;
+	VkImageUsageFlags imageUsage;
+	VkBufferUsageFlags bufferUsage;
+	bool write;
+};
+
+static const RenderGraphAccessInfo accessInfos[RG_ACCESS_COUNT] = {
+	{ // RG_ACCESS_NONE
+		0, 0, VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, false
+	},
+	{ // RG_ACCESS_CARRIED (resolved by compile())
+		0, 0, VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, false
+	},
+	{ // RG_ACCESS_ACQUIRE: the semaphore wait, which the first use has to come after like a write.
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, true
+	},
+	{ // RG_ACCESS_PRESENT
+		VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 0, 0, false
+	},
+	{ // RG_ACCESS_HOST_READ
+		VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, 0, 0, false
+	},
+	{ // RG_ACCESS_COLOR_ATTACHMENT
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 0, true
+	},
+	{ // RG_ACCESS_DEPTH_ATTACHMENT
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0, true
+	},
+	{ // RG_ACCESS_COMPUTE_SAMPLED
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_IMAGE_USAGE_SAMPLED_BIT, VK_BUFFER_USAGE_UNIFORM_TEXEL_BUFFER_BIT, false
+	},
+	{ // RG_ACCESS_COMPUTE_READ
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL,
+		VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false
+	},
+	{ // RG_ACCESS_COMPUTE_WRITE
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL,
+		VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true
+	},
+	{ // RG_ACCESS_VERTEX_READ
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+		VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_IMAGE_USAGE_SAMPLED_BIT, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false
+	},
+	{ // RG_ACCESS_INDIRECT_READ
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+		0, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, false
+	},
+	{ // RG_ACCESS_TRANSFER_READ
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, false
+	},
+	{ // RG_ACCESS_TRANSFER_WRITE
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_BUFFER_USAGE_TRANSFER_DST_BIT, true
+	}
+};
+
+// Only writes have to be made available, reads just need ordering.
+static const VkAccessFlags writeAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+// Usage that lets an image live in lazily allocated memory.
+static const VkImageUsageFlags attachmentUsageMask = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+	VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+static bool isDepthFormat(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_D16_UNORM:
+	case VK_FORMAT_X8_D24_UNORM_PACK32:
+	case VK_FORMAT_D32_SFLOAT:
+	case VK_FORMAT_D16_UNORM_S8_UINT:
+	case VK_FORMAT_D24_UNORM_S8_UINT:
+	case VK_FORMAT_D32_SFLOAT_S8_UINT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static VkImageAspectFlags getFormatAspects(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_D16_UNORM_S8_UINT:
+	case VK_FORMAT_D24_UNORM_S8_UINT:
+	case VK_FORMAT_D32_SFLOAT_S8_UINT:
+		return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+	case VK_FORMAT_S8_UINT:
+		return VK_IMAGE_ASPECT_STENCIL_BIT;
+	default:
+		return isDepthFormat(format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+	}
+}
+
+void RenderGraph::create(VkDevice device, const DeviceDispatch &dispatch,
+	const VkPhysicalDeviceMemoryProperties &memoryProperties,
+	VkDeviceSize bufferImageGranularity,
+	uint32_t numFrames,
+	const VkAllocationCallbacks *allocator)
+{
+	this->device = device;
+	this->dispatch = &dispatch;
+	this->memoryProperties = memoryProperties;
+	this->bufferImageGranularity = std::max<VkDeviceSize>(bufferImageGranularity, 1);
+	this->numFrames = numFrames;
+	this->allocator = allocator;
+}
+
+void RenderGraph::destroy(void)
+{
+	if (!device)
+		return;
+
+	for (Resource &resource : resources)
+	{
+		for (VkImage image : resource.images)
+			dispatch->vkDestroyImage(device, image, allocator);
+		for (VkBuffer buffer : resource.buffers)
+			dispatch->vkDestroyBuffer(device, buffer, allocator);
+		for (VkDeviceMemory memory : resource.memory)
+			dispatch->vkFreeMemory(device, memory, allocator);
+	}
+	for (VkDeviceMemory memory : aliasedMemory)
+		dispatch->vkFreeMemory(device, memory, allocator);
+	resources.clear();
+	passes.clear();
+	aliasedMemory.clear();
+
+	device = VK_NULL_HANDLE;
+}
+
+void RenderGraph::reset(DeferredDeletionQueue &deletionQueue, uint64_t retireValue)
+{
+	for (Resource &resource : resources)
+	{
+		for (VkImage image : resource.images)
+			deletionQueue.enqueue(VK_OBJECT_TYPE_IMAGE, image, retireValue, allocator);
+		for (VkBuffer buffer : resource.buffers)
+			deletionQueue.enqueue(VK_OBJECT_TYPE_BUFFER, buffer, retireValue, allocator);
+		for (VkDeviceMemory memory : resource.memory)
+			deletionQueue.enqueue(VK_OBJECT_TYPE_DEVICE_MEMORY, memory, retireValue, allocator);
+	}
+	for (VkDeviceMemory memory : aliasedMemory)
+		deletionQueue.enqueue(VK_OBJECT_TYPE_DEVICE_MEMORY, memory, retireValue, allocator);
+	resources.clear();
+	passes.clear();
+	aliasedMemory.clear();
+	aliasedMemorySize = 0;
+	compiled = false;
+}
+
+uint32_t RenderGraph::importImage(const char *name, VkFormat format, RenderGraphAccess initialAccess, RenderGraphAccess finalAccess)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.isImage = true;
+	resource.imported = true;
+	resource.initialAccess = initialAccess;
+	resource.finalAccess = finalAccess;
+	resource.format = format;
+	resources.push_back(resource);
+	return static_cast<uint32_t>(resources.size() - 1);
+}
+
+uint32_t RenderGraph::importBuffer(const char *name, RenderGraphAccess initialAccess, RenderGraphAccess finalAccess)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.isImage = false;
+	resource.imported = true;
+	resource.initialAccess = initialAccess;
+	resource.finalAccess = finalAccess;
+	resources.push_back(resource);
+	return static_cast<uint32_t>(resources.size() - 1);
+}
+
+uint32_t RenderGraph::createImage(const char *name, VkFormat format, uint32_t width, uint32_t height)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.isImage = true;
+	resource.format = format;
+	resource.width = width;
+	resource.height = height;
+	resources.push_back(resource);
+	return static_cast<uint32_t>(resources.size() - 1);
+}
+
+uint32_t RenderGraph::createBuffer(const char *name, VkDeviceSize size)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.isImage = false;
+	resource.size = size;
+	resources.push_back(resource);
+	return static_cast<uint32_t>(resources.size() - 1);
+}
+
+uint32_t RenderGraph::addPass(const char *name, RecordFunction record)
+{
+	Pass pass = {};
+	pass.name = name;
+	pass.record = record;
+	passes.push_back(pass);
+	return static_cast<uint32_t>(passes.size() - 1);
+}
+
+void RenderGraph::addAccess(uint32_t pass, uint32_t resource, RenderGraphAccess access)
+{
+	if (access < RG_ACCESS_COLOR_ATTACHMENT || access >= RG_ACCESS_COUNT)
+	{
+		fprintf(stderr, "Error (%s:%u): Render graph pass %s can't access %s that way (%d)\n", __FILE__, __LINE__,
+			passes[pass].name, resources[resource].name, access);
+		throw std::runtime_error("Invalid render graph access");
+	}
+
+	const RenderGraphAccessInfo &info = accessInfos[access];
+	const Resource &declared = resources[resource];
+	VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	if (declared.isImage)
+	{
+		layout = info.layout;
+		if (access == RG_ACCESS_COMPUTE_SAMPLED && isDepthFormat(declared.format))
+			layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	}
+
+	for (PassAccess &existing : passes[pass].accesses)
+	{
+		if (existing.resource != resource)
+			continue;
+		if (existing.layout != layout)
+		{
+			fprintf(stderr, "Error (%s:%u): Render graph pass %s uses %s in two layouts\n", __FILE__, __LINE__,
+				passes[pass].name, declared.name);
+			throw std::runtime_error("Conflicting render graph image layouts");
+		}
+		existing.stages |= info.stages;
+		existing.access |= info.access;
+		existing.write = existing.write || info.write;
+		existing.imageUsage |= info.imageUsage;
+		existing.bufferUsage |= info.bufferUsage;
+		return;
+	}
+
+	PassAccess passAccess = {
+		resource, // Resource
+		info.stages, // Stages
+		info.access, // Access
+		layout, // Layout
+		info.write, // Write
+		info.imageUsage, // Image usage
+		info.bufferUsage // Buffer usage
+	};
+	passes[pass].accesses.push_back(passAccess);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Compiling
+//
+//////////////////////////////////////////////////////////////////////////////
+void RenderGraph::compile(void)
+{
+	cullPasses();
+	createTransients();
+	placeAliasedTransients();
+	buildBarriers();
+	compiled = true;
+
+	if (VERBOSE)
+	{
+		printf("Render graph: %u of %u passes, %u barriers (%u image, %u memory) per frame",
+			numLivePasses, static_cast<uint32_t>(passes.size()), numBarrierCalls, numImageBarriers, numMemoryBarriers);
+		printf(", transients %.2lf MB aliased into %.2lf MB + %.2lf MB lazily allocated per frame\n",
+			unaliasedSize / (1024.0 * 1024.0), aliasedMemorySize / (1024.0 * 1024.0), lazySize / (1024.0 * 1024.0));
+		for (const Pass &pass : passes)
+		{
+			if (!pass.live)
+				printf("\tCulled pass %s, nothing reads what it writes\n", pass.name);
+		}
+	}
+}
+
+void RenderGraph::cullPasses(void)
+{
+	// Walk back from the end: a pass is live if it writes an import (which someone outside the
+	//	graph sees) or something a live pass after it reads.
+	std::vector<bool> needed(resources.size(), false);
+	for (uint32_t i = 0; i < resources.size(); i++)
+		needed[i] = resources[i].imported;
+	numLivePasses = 0;
+	for (uint32_t i = static_cast<uint32_t>(passes.size()); i-- > 0;)
+	{
+		Pass &pass = passes[i];
+		pass.live = false;
+		for (const PassAccess &access : pass.accesses)
+		{
+			if (access.write && needed[access.resource])
+				pass.live = true;
+		}
+		if (!pass.live)
+			continue;
+		numLivePasses++;
+		for (const PassAccess &access : pass.accesses)
+			needed[access.resource] = true;
+	}
+
+	// Lifetimes and usage come from the live passes only.
+	for (Resource &resource : resources)
+	{
+		resource.firstPass = ~0U;
+		resource.lastPass = 0;
+		resource.imageUsage = 0;
+		resource.bufferUsage = 0;
+	}
+	for (uint32_t i = 0; i < passes.size(); i++)
+	{
+		if (!passes[i].live)
+			continue;
+		for (const PassAccess &access : passes[i].accesses)
+		{
+			Resource &resource = resources[access.resource];
+			if (resource.firstPass == ~0U)
+				resource.firstPass = i;
+			resource.lastPass = i;
+			resource.imageUsage |= access.imageUsage;
+			resource.bufferUsage |= access.bufferUsage;
+		}
+	}
+}
+
+void RenderGraph::createTransients(void)
+{
+	lazySize = 0;
+	for (Resource &resource : resources)
+	{
+		resource.lazy = false;
+		resource.aliased = false;
+		if (resource.imported || resource.firstPass == ~0U)
+			continue;
+
+		// Attachment only images never have to leave the tile on a tiler, so they're transient
+		//	attachments and can go in lazily allocated memory.
+		bool attachmentOnly = resource.isImage && (resource.imageUsage & ~attachmentUsageMask) == 0;
+		if (attachmentOnly)
+			resource.imageUsage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+
+		if (resource.isImage)
+		{
+			VkImageCreateInfo imageCreateInfo = {
+				VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+				nullptr, // pNext
+				0, // Flags
+				VK_IMAGE_TYPE_2D, // Image type
+				resource.format, // Format
+				{ resource.width, resource.height, 1 }, // Extent
+				1, // Mip levels
+				1, // Array layers
+				VK_SAMPLE_COUNT_1_BIT, // Samples
+				VK_IMAGE_TILING_OPTIMAL, // Tiling
+				resource.imageUsage, // Usage
+				VK_SHARING_MODE_EXCLUSIVE, // Sharing mode
+				0, // Queue family index count
+				nullptr, // Queue family indices
+				VK_IMAGE_LAYOUT_UNDEFINED // Initial layout
+			};
+			resource.images.resize(numFrames);
+			for (uint32_t frame = 0; frame < numFrames; frame++)
+			{
+				HANDLE_VK(dispatch->vkCreateImage(device, &imageCreateInfo, allocator, &resource.images[frame]),
+					"Creating render graph image %s for frame %u", resource.name, frame);
+			}
+			dispatch->vkGetImageMemoryRequirements(device, resource.images[0], &resource.requirements);
+		}
+		else
+		{
+			VkBufferCreateInfo bufferCreateInfo = {
+				VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+				nullptr, // pNext
+				0, // Flags
+				resource.size, // Size
+				resource.bufferUsage, // Usage
+				VK_SHARING_MODE_EXCLUSIVE, // Sharing mode
+				0, // Queue family index count
+				nullptr // Queue family indices
+			};
+			resource.buffers.resize(numFrames);
+			for (uint32_t frame = 0; frame < numFrames; frame++)
+			{
+				HANDLE_VK(dispatch->vkCreateBuffer(device, &bufferCreateInfo, allocator, &resource.buffers[frame]),
+					"Creating render graph buffer %s for frame %u", resource.name, frame);
+			}
+			dispatch->vkGetBufferMemoryRequirements(device, resource.buffers[0], &resource.requirements);
+		}
+
+		uint32_t lazyType = attachmentOnly
+			? findMemoryTypeIndex(memoryProperties, resource.requirements.memoryTypeBits,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+			: ~0U;
+		if (lazyType == ~0U)
+		{
+			resource.aliased = true; // Placed by placeAliasedTransients()
+			continue;
+		}
+
+		resource.lazy = true;
+		resource.memory.resize(numFrames);
+		for (uint32_t frame = 0; frame < numFrames; frame++)
+		{
+			VkMemoryAllocateInfo allocateInfo = {
+				VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+				nullptr, // pNext
+				resource.requirements.size, // Allocation size
+				lazyType // Memory type index
+			};
+			HANDLE_VK(dispatch->vkAllocateMemory(device, &allocateInfo, allocator, &resource.memory[frame]),
+				"Allocating lazily allocated memory for render graph image %s", resource.name);
+			HANDLE_VK(dispatch->vkBindImageMemory(device, resource.images[frame], resource.memory[frame], 0),
+				"Binding render graph image %s", resource.name);
+		}
+		lazySize += resource.requirements.size;
+	}
+}
+
+void RenderGraph::placeAliasedTransients(void)
+{
+	// Biggest first, each at the lowest offset where it doesn't overlap anything placed that's
+	//	alive at the same time as it. Everything shares one allocation per frame in flight, so they
+	//	have to agree on a memory type. One that doesn't gets memory of its own.
+	std::vector<uint32_t> order;
+	uint32_t memoryTypeBits = ~0U;
+	for (uint32_t i = 0; i < resources.size(); i++)
+	{
+		if (resources[i].aliased)
+			order.push_back(i);
+	}
+	std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+		return resources[a].requirements.size > resources[b].requirements.size;
+	});
+
+	std::vector<uint32_t> placed;
+	unaliasedSize = 0;
+	aliasedMemorySize = 0;
+	for (uint32_t index : order)
+	{
+		Resource &resource = resources[index];
+		if ((memoryTypeBits & resource.requirements.memoryTypeBits) == 0)
+		{
+			resource.aliased = false;
+			continue;
+		}
+		memoryTypeBits &= resource.requirements.memoryTypeBits;
+
+		VkDeviceSize alignment = std::max(resource.requirements.alignment, bufferImageGranularity);
+		std::vector<uint32_t> overlapping;
+		for (uint32_t other : placed)
+		{
+			if (resources[other].firstPass <= resource.lastPass && resource.firstPass <= resources[other].lastPass)
+				overlapping.push_back(other);
+		}
+
+		// The lowest fit is at 0 or right after something it overlaps.
+		VkDeviceSize bestOffset = ~0ULL;
+		std::vector<VkDeviceSize> candidates(1, 0);
+		for (uint32_t other : overlapping)
+			candidates.push_back(alignUp(resources[other].offset + resources[other].requirements.size, alignment));
+		for (VkDeviceSize candidate : candidates)
+		{
+			bool fits = true;
+			for (uint32_t other : overlapping)
+			{
+				const Resource &otherResource = resources[other];
+				if (candidate < otherResource.offset + otherResource.requirements.size
+					&& otherResource.offset < candidate + resource.requirements.size)
+				{
+					fits = false;
+					break;
+				}
+			}
+			if (fits)
+				bestOffset = std::min(bestOffset, candidate);
+		}
+
+		resource.offset = bestOffset;
+		aliasedMemorySize = std::max(aliasedMemorySize, bestOffset + resource.requirements.size);
+		unaliasedSize += resource.requirements.size;
+		placed.push_back(index);
+	}
+
+	if (!placed.empty())
+	{
+		uint32_t memoryType = findMemoryTypeIndex(memoryProperties, memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		if (memoryType == ~0U)
+		{
+			fprintf(stderr, "Error (%s:%u): No device local memory for the render graph's transients\n", __FILE__, __LINE__);
+			throw std::runtime_error("No memory type for render graph transients");
+		}
+
+		aliasedMemory.resize(numFrames);
+		for (uint32_t frame = 0; frame < numFrames; frame++)
+		{
+			VkMemoryAllocateInfo allocateInfo = {
+				VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+				nullptr, // pNext
+				aliasedMemorySize, // Allocation size
+				memoryType // Memory type index
+			};
+			HANDLE_VK(dispatch->vkAllocateMemory(device, &allocateInfo, allocator, &aliasedMemory[frame]),
+				"Allocating the render graph's transient memory for frame %u", frame);
+			for (uint32_t index : placed)
+			{
+				Resource &resource = resources[index];
+				if (resource.isImage)
+				{
+					HANDLE_VK(dispatch->vkBindImageMemory(device, resource.images[frame], aliasedMemory[frame], resource.offset),
+						"Binding render graph image %s", resource.name);
+				}
+				else
+				{
+					HANDLE_VK(dispatch->vkBindBufferMemory(device, resource.buffers[frame], aliasedMemory[frame], resource.offset),
+						"Binding render graph buffer %s", resource.name);
+				}
+			}
+		}
+	}
+
+	// What didn't agree on the memory type.
+	for (uint32_t index : order)
+	{
+		Resource &resource = resources[index];
+		if (resource.aliased)
+			continue;
+		uint32_t memoryType = findMemoryTypeIndex(memoryProperties, resource.requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		if (memoryType == ~0U)
+		{
+			fprintf(stderr, "Error (%s:%u): No device local memory for render graph resource %s\n", __FILE__, __LINE__, resource.name);
+			throw std::runtime_error("No memory type for render graph transient");
+		}
+		resource.memory.resize(numFrames);
+		for (uint32_t frame = 0; frame < numFrames; frame++)
+		{
+			VkMemoryAllocateInfo allocateInfo = {
+				VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+				nullptr, // pNext
+				resource.requirements.size, // Allocation size
+				memoryType // Memory type index
+			};
+			HANDLE_VK(dispatch->vkAllocateMemory(device, &allocateInfo, allocator, &resource.memory[frame]),
+				"Allocating memory for render graph resource %s", resource.name);
+			if (resource.isImage)
+			{
+				HANDLE_VK(dispatch->vkBindImageMemory(device, resource.images[frame], resource.memory[frame], 0),
+					"Binding render graph image %s", resource.name);
+			}
+			else
+			{
+				HANDLE_VK(dispatch->vkBindBufferMemory(device, resource.buffers[frame], resource.memory[frame], 0),
+					"Binding render graph buffer %s", resource.name);
+			}
+		}
+	}
+}
+
+void RenderGraph::addBarrier(BarrierBatch &batch, uint32_t resource, ResourceState &state, const PassAccess &access)
+{
+	bool isImage = resources[resource].isImage;
+	bool layoutChange = isImage && access.layout != state.layout;
+
+	// Writes (and layout transitions, which write) wait on everything since the last write, reads
+	//	only on the last write, and only if it hasn't already been made visible to them.
+	bool needed;
+	VkPipelineStageFlags srcStages;
+	if (access.write || layoutChange)
+	{
+		srcStages = state.writeStages | state.readStages;
+		needed = layoutChange || srcStages != 0;
+	}
+	else
+	{
+		srcStages = state.writeStages;
+		needed = state.writeStages != 0
+			&& ((access.stages & ~state.visibleStages) != 0 || (access.access & ~state.visibleAccess) != 0);
+	}
+
+	if (needed)
+	{
+		batch.srcStages |= srcStages ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		batch.dstStages |= access.stages;
+		// Without a write to make available or a layout to change, it's just an execution dependency.
+		if (layoutChange || state.writeAccess)
+		{
+			if (isImage)
+			{
+				ImageBarrier imageBarrier = {
+					resource, // Resource
+					state.writeAccess, // Source access
+					access.access, // Destination access
+					state.layout, // Old layout
+					access.layout // New layout
+				};
+				batch.imageBarriers.push_back(imageBarrier);
+			}
+			else
+			{
+				batch.memorySrcAccess |= state.writeAccess;
+				batch.memoryDstAccess |= access.access;
+				batch.hasMemoryBarrier = true;
+			}
+		}
+	}
+
+	if (access.write || layoutChange)
+	{
+		state.layout = isImage ? access.layout : state.layout;
+		state.writeStages = access.stages;
+		state.writeAccess = access.write ? (access.access & writeAccessMask) : 0;
+		state.readStages = access.write ? 0 : access.stages;
+		state.visibleStages = access.stages;
+		state.visibleAccess = access.access;
+	}
+	else
+	{
+		state.readStages |= access.stages;
+		if (needed)
+		{
+			state.visibleStages |= access.stages;
+			state.visibleAccess |= access.access;
+		}
+	}
+}
+
+// The state a resource is in after 'access' (for the imports' initial and final states).
+static void setAccessState(RenderGraphAccess access, VkImageLayout &layout, VkPipelineStageFlags &writeStages,
+	VkAccessFlags &writeAccess, VkPipelineStageFlags &readStages)
+{
+	const RenderGraphAccessInfo &info = accessInfos[access];
+	layout = info.layout;
+	writeStages = info.write ? info.stages : 0;
+	writeAccess = info.write ? (info.access & writeAccessMask) : 0;
+	readStages = info.write ? 0 : info.stages;
+}
+
+void RenderGraph::simulate(std::vector<ResourceState> &states, bool recordBarriers)
+{
+	BarrierBatch scratch = {};
+	for (uint32_t i = 0; i < passes.size(); i++)
+	{
+		Pass &pass = passes[i];
+		if (!pass.live)
+			continue;
+		BarrierBatch &batch = recordBarriers ? pass.barriers : scratch;
+		for (const PassAccess &access : pass.accesses)
+		{
+			// A transient's memory may have been something else's earlier in the frame, which has to
+			//	be done with it first.
+			const Resource &resource = resources[access.resource];
+			if (resource.aliased && resource.firstPass == i)
+			{
+				ResourceState &state = states[access.resource];
+				for (uint32_t other = 0; other < resources.size(); other++)
+				{
+					const Resource &otherResource = resources[other];
+					if (other == access.resource || !otherResource.aliased || otherResource.lastPass >= i)
+						continue;
+					if (otherResource.offset < resource.offset + resource.requirements.size
+						&& resource.offset < otherResource.offset + otherResource.requirements.size)
+					{
+						state.writeStages |= states[other].writeStages | states[other].readStages;
+						state.writeAccess |= states[other].writeAccess;
+					}
+				}
+			}
+			addBarrier(batch, access.resource, states[access.resource], access);
+		}
+	}
+
+	BarrierBatch &batch = recordBarriers ? finalBarriers : scratch;
+	for (uint32_t i = 0; i < resources.size(); i++)
+	{
+		const Resource &resource = resources[i];
+		if (!resource.imported || resource.finalAccess == RG_ACCESS_NONE || resource.finalAccess == RG_ACCESS_CARRIED)
+			continue;
+		const RenderGraphAccessInfo &info = accessInfos[resource.finalAccess];
+		PassAccess access = {
+			i, // Resource
+			info.stages, // Stages
+			info.access, // Access
+			resource.isImage ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED, // Layout
+			false, // Write
+			0, // Image usage
+			0 // Buffer usage
+		};
+		addBarrier(batch, i, states[i], access);
+	}
+}
+
+void RenderGraph::buildBarriers(void)
+{
+	for (Pass &pass : passes)
+		pass.barriers = {};
+	finalBarriers = {};
+
+	// Carried imports start where the frame leaves them, so walk the frame once to find out where
+	//	that is, then again for real.
+	std::vector<ResourceState> states(resources.size());
+	for (uint32_t walk = 0; walk < 2; walk++)
+	{
+		std::vector<ResourceState> endStates = states;
+		for (uint32_t i = 0; i < resources.size(); i++)
+		{
+			const Resource &resource = resources[i];
+			ResourceState &state = states[i];
+			if (resource.imported && resource.initialAccess == RG_ACCESS_CARRIED)
+			{
+				state = walk == 0 ? ResourceState() : endStates[i];
+				continue;
+			}
+			state = {};
+			if (resource.imported)
+				setAccessState(resource.initialAccess, state.layout, state.writeStages, state.writeAccess, state.readStages);
+			if (!resource.isImage)
+				state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			state.visibleStages = state.writeStages;
+			state.visibleAccess = state.writeAccess;
+		}
+		simulate(states, walk == 1);
+	}
+
+	numBarrierCalls = 0;
+	numImageBarriers = 0;
+	numMemoryBarriers = 0;
+	for (const Pass &pass : passes)
+	{
+		if (!pass.live || !pass.barriers.srcStages)
+			continue;
+		numBarrierCalls++;
+		numImageBarriers += static_cast<uint32_t>(pass.barriers.imageBarriers.size());
+		numMemoryBarriers += pass.barriers.hasMemoryBarrier ? 1 : 0;
+	}
+	if (finalBarriers.srcStages)
+	{
+		numBarrierCalls++;
+		numImageBarriers += static_cast<uint32_t>(finalBarriers.imageBarriers.size());
+		numMemoryBarriers += finalBarriers.hasMemoryBarrier ? 1 : 0;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Executing
+//
+//////////////////////////////////////////////////////////////////////////////
+VkImage RenderGraph::getImageHandle(uint32_t resource, uint32_t frameIndex) const
+{
+	const Resource &declared = resources[resource];
+	if (declared.imported)
+		return declared.importedImage;
+	return declared.images.empty() ? VK_NULL_HANDLE : declared.images[frameIndex];
+}
+
+VkBuffer RenderGraph::getBuffer(uint32_t resource, uint32_t frameIndex) const
+{
+	const Resource &declared = resources[resource];
+	return declared.buffers.empty() ? VK_NULL_HANDLE : declared.buffers[frameIndex];
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch &batch, uint32_t frameIndex)
+{
+	if (!batch.srcStages)
+		return;
+
+	VkMemoryBarrier memoryBarrier = {
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		nullptr, // pNext
+		batch.memorySrcAccess, // Source access mask
+		batch.memoryDstAccess // Destination access mask
+	};
+
+	imageBarrierScratch.clear();
+	for (const ImageBarrier &barrier : batch.imageBarriers)
+	{
+		VkImage image = getImageHandle(barrier.resource, frameIndex);
+		if (!image)
+			continue;
+		VkImageMemoryBarrier imageBarrier = {
+			VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			nullptr, // pNext
+			barrier.srcAccess, // Source access mask
+			barrier.dstAccess, // Destination access mask
+			barrier.oldLayout, // Old layout
+			barrier.newLayout, // New layout
+			VK_QUEUE_FAMILY_IGNORED, // Source queue family
+			VK_QUEUE_FAMILY_IGNORED, // Destination queue family
+			image, // Image
+			{ getFormatAspects(resources[barrier.resource].format), 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS } // Subresource range
+		};
+		imageBarrierScratch.push_back(imageBarrier);
+	}
+	uint32_t numBarriers = static_cast<uint32_t>(imageBarrierScratch.size());
+
+	dispatch->vkCmdPipelineBarrier(commandBuffer, batch.srcStages, batch.dstStages, 0,
+		batch.hasMemoryBarrier ? 1 : 0, &memoryBarrier,
+		0, nullptr,
+		numBarriers, imageBarrierScratch.data());
+	totalBarrierCalls++;
+	totalImageBarriers += numBarriers;
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer, uint32_t frameIndex, GpuProfiler &profiler)
+{
+	if (!compiled)
+	{
+		fprintf(stderr, "Error (%s:%u): Executing a render graph that hasn't been compiled\n", __FILE__, __LINE__);
+		throw std::runtime_error("Render graph not compiled");
+	}
+
+	for (const Pass &pass : passes)
+	{
+		if (!pass.live)
+			continue;
+		uint32_t scope = profiler.beginScope(commandBuffer, pass.name, GPU_LANE_GRAPHICS);
+		recordBarriers(commandBuffer, pass.barriers, frameIndex);
+		pass.record(commandBuffer, frameIndex);
+		profiler.endScope(commandBuffer, scope);
+	}
+	recordBarriers(commandBuffer, finalBarriers, frameIndex);
+	numFramesExecuted++;
+}
+
+void RenderGraph::printStats(void) const
+{
+	printf("Render graph stats:\n");
+	printf("\tPasses: %u of %u live\n", numLivePasses, static_cast<uint32_t>(passes.size()));
+	printf("\tBarriers per frame: %u vkCmdPipelineBarrier (%u image, %u memory barriers)\n",
+		numBarrierCalls, numImageBarriers, numMemoryBarriers);
+	if (numFramesExecuted)
+		printf("\tRecorded: %.2lf vkCmdPipelineBarrier and %.2lf image barriers per frame over %llu frames\n",
+			static_cast<double>(totalBarrierCalls) / numFramesExecuted,
+			static_cast<double>(totalImageBarriers) / numFramesExecuted,
+			static_cast<unsigned long long>(numFramesExecuted));
+	printf("\tAliased transients: %.2lf MB in %.2lf MB per frame in flight, %.2lf MB saved over %u frames\n",
+		unaliasedSize / (1024.0 * 1024.0), aliasedMemorySize / (1024.0 * 1024.0),
+		numFrames * (unaliasedSize - aliasedMemorySize) / (1024.0 * 1024.0), numFrames);
+
+	// Lazily allocated memory only gets committed as the GPU needs it, so see how much it did.
+	VkDeviceSize committedBytes = 0;
+	for (const Resource &resource : resources)
+	{
+		if (!resource.lazy)
+			continue;
+		for (VkDeviceMemory memory : resource.memory)
+		{
+			VkDeviceSize memoryCommittedBytes = 0;
+			dispatch->vkGetDeviceMemoryCommitment(device, memory, &memoryCommittedBytes);
+			committedBytes += memoryCommittedBytes;
+		}
+	}
+	if (lazySize)
+		printf("\tLazily allocated transients: %.2lf MB over %u frames, %.2lf MB committed\n",
+			numFrames * lazySize / (1024.0 * 1024.0), numFrames, committedBytes / (1024.0 * 1024.0));
+}
+
+void RenderGraph::checkAliasing(VkDevice device, const DeviceDispatch &dispatch,
+	const VkPhysicalDeviceMemoryProperties &memoryProperties,
+	VkDeviceSize bufferImageGranularity,
+	const VkAllocationCallbacks *allocator)
+{
+	// Scratch A is done with before scratch B is first written, so they should share memory, and
+	//	the write to B has to wait for the reads of A. Nothing reads what the last pass writes.
+	RenderGraph graph;
+	graph.create(device, dispatch, memoryProperties, bufferImageGranularity, 1, allocator);
+	uint32_t output = graph.importBuffer("Check output", RG_ACCESS_NONE, RG_ACCESS_HOST_READ);
+	uint32_t scratchA = graph.createBuffer("Check scratch A", 64 * 1024);
+	uint32_t scratchB = graph.createBuffer("Check scratch B", 64 * 1024);
+	uint32_t unread = graph.createBuffer("Check unread", 4 * 1024);
+	RecordFunction nothing = [](VkCommandBuffer, uint32_t) {};
+
+	uint32_t writeA = graph.addPass("Write A", nothing);
+	graph.addAccess(writeA, scratchA, RG_ACCESS_COMPUTE_WRITE);
+	uint32_t readA = graph.addPass("Read A", nothing);
+	graph.addAccess(readA, scratchA, RG_ACCESS_COMPUTE_READ);
+	graph.addAccess(readA, output, RG_ACCESS_COMPUTE_WRITE);
+	uint32_t writeB = graph.addPass("Write B", nothing);
+	graph.addAccess(writeB, scratchB, RG_ACCESS_TRANSFER_WRITE);
+	uint32_t readB = graph.addPass("Read B", nothing);
+	graph.addAccess(readB, scratchB, RG_ACCESS_COMPUTE_READ);
+	graph.addAccess(readB, output, RG_ACCESS_COMPUTE_WRITE);
+	uint32_t dead = graph.addPass("Dead", nothing);
+	graph.addAccess(dead, unread, RG_ACCESS_COMPUTE_WRITE);
+
+	graph.compile();
+
+	const Resource &a = graph.resources[scratchA];
+	const Resource &b = graph.resources[scratchB];
+	const BarrierBatch &barrier = graph.passes[writeB].barriers;
+	std::vector<const char *> failures;
+	if (!a.aliased || !b.aliased || a.offset != b.offset)
+		failures.push_back("the scratch buffers don't share memory");
+	if (graph.aliasedMemorySize >= graph.unaliasedSize)
+		failures.push_back("aliasing saved no memory");
+	if (!(barrier.srcStages & VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) || !(barrier.dstStages & VK_PIPELINE_STAGE_TRANSFER_BIT)
+		|| !barrier.hasMemoryBarrier || !(barrier.memorySrcAccess & VK_ACCESS_SHADER_WRITE_BIT))
+		failures.push_back("writing scratch B doesn't wait for scratch A");
+	if (graph.passes[dead].live || graph.numLivePasses != 4)
+		failures.push_back("the pass nobody reads wasn't culled");
+
+	if (VERBOSE && failures.empty())
+		printf("Render graph aliasing check: passed, %.0lf KB of transients in %.0lf KB\n",
+			graph.unaliasedSize / 1024.0, graph.aliasedMemorySize / 1024.0);
+	graph.destroy();
+
+	for (const char *failure : failures)
+		fprintf(stderr, "Error (%s:%u): Render graph aliasing check: %s\n", __FILE__, __LINE__, failure);
+	if (!failures.empty())
+		throw std::runtime_error("Render graph aliasing check failed");
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+#include <functional>
+#include "vulkanDispatch.h"
+#include "vulkanDeletionQueue.h"
+#include "vulkanGpuProfiler.h"
+
+// How a pass uses a resource. Each one implies the stages, access mask and (for images) layout
+//	the barriers are built from, and whether it writes.
+enum RenderGraphAccess
+{
+	RG_ACCESS_NONE, // Nothing to wait on, and an image's contents are undefined.
+	RG_ACCESS_CARRIED, // Imports only: starts each frame in whatever state the frame before left it in.
+	RG_ACCESS_ACQUIRE, // Swapchain image, waited on at color attachment output.
+	RG_ACCESS_PRESENT,
+	RG_ACCESS_HOST_READ,
+	RG_ACCESS_COLOR_ATTACHMENT,
+	RG_ACCESS_DEPTH_ATTACHMENT,
+	RG_ACCESS_COMPUTE_SAMPLED, // Depth images are sampled in DEPTH_STENCIL_READ_ONLY_OPTIMAL.
+	RG_ACCESS_COMPUTE_READ, // Storage buffers, and images in GENERAL.
+	RG_ACCESS_COMPUTE_WRITE,
+	RG_ACCESS_VERTEX_READ, // Vertex input (vertices and indices) and vertex shader storage reads.
+	RG_ACCESS_INDIRECT_READ,
+	RG_ACCESS_TRANSFER_READ, // Copy and blit sources.
+	RG_ACCESS_TRANSFER_WRITE,
+	RG_ACCESS_COUNT
+};
+
+// A frame's passes and the resources they pass between them, declared up front so the barriers
+//	don't have to be placed by hand:
+//	- Every pass declares what it reads and writes, and compile() works out the fewest barriers
+//		(and layout transitions) that order them, batched into one vkCmdPipelineBarrier per pass.
+//	- Passes that only write transient resources nobody reads are culled.
+//	- Transient images and buffers are created by the graph, one per frame in flight, and the ones
+//		whose lifetimes (first to last pass using them) don't overlap share memory. Images only
+//		ever used as attachments go in lazily allocated memory instead, where there is some.
+// Imported resources belong to someone else. Buffers are tracked as a whole and synchronized with
+//	global memory barriers, the same as the rest of the engine does, so an imported buffer can
+//	stand for a group of them ("everything the culling writes").
+// The graph is static between compiles: declare it, compile() it, then execute() it every frame.
+//	Anything that changes per frame is up to the passes' record functions.
+class RenderGraph
+{
+public:
+	typedef std::function<void(VkCommandBuffer commandBuffer, uint32_t frameIndex)> RecordFunction;
+
+private:
+	struct Resource
+	{
+		const char *name;
+		bool isImage;
+		bool imported;
+		RenderGraphAccess initialAccess; // Imports
+		RenderGraphAccess finalAccess; // Imports, RG_ACCESS_NONE leaves them as the last pass did.
+		VkFormat format; // Images
+		uint32_t width; // Transient images
+		uint32_t height;
+		VkDeviceSize size; // Transient buffers
+		VkImage importedImage;
+
+		// Set by compile()
+		uint32_t firstPass; // Live passes only, ~0U when none use it.
+		uint32_t lastPass;
+		VkImageUsageFlags imageUsage;
+		VkBufferUsageFlags bufferUsage;
+		bool lazy; // Attachment only image in its own lazily allocated memory.
+		bool aliased; // In the frame's shared memory at 'offset'.
+		VkDeviceSize offset;
+		VkMemoryRequirements requirements; // Of each frame's instance
+		std::vector<VkImage> images; // Per frame in flight (transients)
+		std::vector<VkBuffer> buffers;
+		std::vector<VkDeviceMemory> memory; // Per frame in flight, when not aliased.
+	};
+
+	// Everything one pass does to one resource.
+	struct PassAccess
+	{
+		uint32_t resource;
+		VkPipelineStageFlags stages;
+		VkAccessFlags access;
+		VkImageLayout layout;
+		bool write;
+		VkImageUsageFlags imageUsage; // What a transient needs for it.
+		VkBufferUsageFlags bufferUsage;
+	};
+
+	struct ImageBarrier
+	{
+		uint32_t resource;
+		VkAccessFlags srcAccess;
+		VkAccessFlags dstAccess;
+		VkImageLayout oldLayout;
+		VkImageLayout newLayout;
+	};
+
+	// One vkCmdPipelineBarrier. Buffers share a global memory barrier.
+	struct BarrierBatch
+	{
+		VkPipelineStageFlags srcStages;
+		VkPipelineStageFlags dstStages;
+		VkAccessFlags memorySrcAccess;
+		VkAccessFlags memoryDstAccess;
+		bool hasMemoryBarrier;
+		std::vector<ImageBarrier> imageBarriers;
+	};
+
+	struct Pass
+	{
+		const char *name;
+		RecordFunction record;
+		std::vector<PassAccess> accesses;
+		bool live;
+		BarrierBatch barriers; // Recorded before the pass.
+	};
+
+	// Where a resource stands between passes while compile() walks the frame.
+	struct ResourceState
+	{
+		VkImageLayout layout;
+		VkPipelineStageFlags writeStages; // Of the last write (or layout transition).
+		VkAccessFlags writeAccess;
+		VkPipelineStageFlags readStages; // Since the last write.
+		VkPipelineStageFlags visibleStages; // The last write has been made visible to these.
+		VkAccessFlags visibleAccess;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	const DeviceDispatch *dispatch = nullptr;
+	const VkAllocationCallbacks *allocator = nullptr;
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+	VkDeviceSize bufferImageGranularity = 1;
+	uint32_t numFrames = 0;
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	BarrierBatch finalBarriers; // Puts the imports in their final state after the last pass.
+	std::vector<VkDeviceMemory> aliasedMemory; // Per frame in flight
+	VkDeviceSize aliasedMemorySize = 0;
+	bool compiled = false;
+	std::vector<VkImageMemoryBarrier> imageBarrierScratch; // For recordBarriers()
+
+	// Stats, from the last compile()
+	uint32_t numLivePasses = 0;
+	uint32_t numBarrierCalls = 0; // Per frame
+	uint32_t numImageBarriers = 0;
+	uint32_t numMemoryBarriers = 0;
+	VkDeviceSize unaliasedSize = 0; // What the aliased transients would take on their own, per frame.
+	VkDeviceSize lazySize = 0;
+	// Stats, over the run
+	uint64_t numFramesExecuted = 0;
+	uint64_t totalBarrierCalls = 0;
+	uint64_t totalImageBarriers = 0;
+
+	void cullPasses(void);
+	void createTransients(void);
+	void placeAliasedTransients(void);
+	void buildBarriers(void);
+	void simulate(std::vector<ResourceState> &states, bool recordBarriers);
+	void addBarrier(BarrierBatch &batch, uint32_t resource, ResourceState &state, const PassAccess &access);
+	void recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch &batch, uint32_t frameIndex);
+	VkImage getImageHandle(uint32_t resource, uint32_t frameIndex) const;
+
+public:
+	// 'bufferImageGranularity' is the device limit, aliased transients are spaced by it.
+	void create(VkDevice device, const DeviceDispatch &dispatch,
+		const VkPhysicalDeviceMemoryProperties &memoryProperties,
+		VkDeviceSize bufferImageGranularity,
+		uint32_t numFrames,
+		const VkAllocationCallbacks *allocator);
+	void destroy(void);
+
+	// Forget the passes and resources so the graph can be declared again. The last compile's
+	//	transients go to 'deletionQueue', to be destroyed once the GPU passes 'retireValue'.
+	void reset(DeferredDeletionQueue &deletionQueue, uint64_t retireValue);
+
+	// Resources, returned as handles for addAccess().
+	// Imported images get their VkImage from setImportedImage() before each execute().
+	uint32_t importImage(const char *name, VkFormat format, RenderGraphAccess initialAccess, RenderGraphAccess finalAccess);
+	uint32_t importBuffer(const char *name, RenderGraphAccess initialAccess, RenderGraphAccess finalAccess);
+	uint32_t createImage(const char *name, VkFormat format, uint32_t width, uint32_t height);
+	uint32_t createBuffer(const char *name, VkDeviceSize size);
+
+	// Passes run in the order they're added. A pass can use a resource more than one way, but an
+	//	image has to be in the one layout for all of them.
+	uint32_t addPass(const char *name, RecordFunction record);
+	void addAccess(uint32_t pass, uint32_t resource, RenderGraphAccess access);
+
+	// Cull, create and alias the transients, and work out the barriers. Throws on a bad graph.
+	void compile(void);
+
+	void setImportedImage(uint32_t resource, VkImage image) { resources[resource].importedImage = image; }
+	// The transients of 'frameIndex', valid until the next reset(). Usage is whatever the passes
+	//	declared they do with them.
+	VkImage getImage(uint32_t resource, uint32_t frameIndex) const { return getImageHandle(resource, frameIndex); }
+	VkBuffer getBuffer(uint32_t resource, uint32_t frameIndex) const;
+	bool isPassLive(uint32_t pass) const { return passes[pass].live; }
+
+	// Record every live pass with its barriers, each in a GPU profiler scope of its name, then the
+	//	transitions to the imports' final states. Outside of a render pass.
+	void execute(VkCommandBuffer commandBuffer, uint32_t frameIndex, GpuProfiler &profiler);
+
+	void printStats(void) const;
+
+	// The engine's own graph doesn't give its transients disjoint lifetimes yet, so nothing in it
+	//	aliases. This compiles a small graph that does, on 'device', and throws unless two
+	//	transients end up sharing memory with a barrier between them and a dead pass is culled.
+	static void checkAliasing(VkDevice device, const DeviceDispatch &dispatch,
+		const VkPhysicalDeviceMemoryProperties &memoryProperties,
+		VkDeviceSize bufferImageGranularity,
+		const VkAllocationCallbacks *allocator);
+};
@@ -0,0 +1,289 @@
+#include "vulkanShaders.h"
+#include <stdio.h>
+#include <string.h>
+#include "vulkanDebug.h"
+#include "fileUtils.h"
+
+// Bump this to throw away every cached shader: when the compile options change, or when shaderc
+//	comes from anywhere other than the SDK VK_HEADER_VERSION names.
+#define SHADER_CACHE_VERSION 1U
+
+#define SPIRV_MAGIC 0x07230203U
+
+// 64-bit FNV-1a, continued from 'hash' (start with SHADER_HASH_SEED).
+#define SHADER_HASH_SEED 0xcbf29ce484222325ULL
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size)
+{
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static shaderc_shader_kind getShaderKind(VkShaderStageFlagBits stage)
+{
+	switch (stage)
+	{
+	case VK_SHADER_STAGE_VERTEX_BIT: return shaderc_vertex_shader;
+	case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT: return shaderc_tess_control_shader;
+	case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT: return shaderc_tess_evaluation_shader;
+	case VK_SHADER_STAGE_GEOMETRY_BIT: return shaderc_geometry_shader;
+	case VK_SHADER_STAGE_FRAGMENT_BIT: return shaderc_fragment_shader;
+	case VK_SHADER_STAGE_COMPUTE_BIT: return shaderc_compute_shader;
+	default: return shaderc_glsl_infer_from_source;
+	}
+}
+
+void SpecializationConstants::setUint(uint32_t constantId, uint32_t value)
+{
+	for (const VkSpecializationMapEntry &entry : entries)
+	{
+		if (entry.constantID == constantId)
+		{
+			values[entry.offset / sizeof(uint32_t)] = value;
+			return;
+		}
+	}
+
+	entries.push_back({
+		constantId, // Constant ID
+		static_cast<uint32_t>(values.size() * sizeof(uint32_t)), // Offset
+		sizeof(uint32_t) // Size
+	});
+	values.push_back(value);
+}
+
+void SpecializationConstants::setFloat(uint32_t constantId, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	setUint(constantId, bits);
+}
+
+const VkSpecializationInfo *SpecializationConstants::getInfo(void)
+{
+	if (entries.empty())
+		return nullptr;
+
+	info = {
+		static_cast<uint32_t>(entries.size()), // Map entry count
+		entries.data(), // Map entries
+		values.size() * sizeof(uint32_t), // Data size
+		values.data() // Data
+	};
+	return &info;
+}
+
+void ShaderLibrary::create(VkDevice device, const DeviceDispatch &dispatch,
+	const char *sourceDirectory, const char *cacheDirectory, bool optimize,
+	const VkAllocationCallbacks *allocator)
+{
+	this->device = device;
+	this->dispatch = &dispatch;
+	this->allocator = allocator;
+	this->sourceDirectory = sourceDirectory;
+	this->optimize = optimize;
+
+	if (cacheDirectory)
+	{
+		if (createDirectory(cacheDirectory))
+			this->cacheDirectory = cacheDirectory;
+		else
+			fprintf(stderr, "Warning: Can't create the shader cache directory \"%s\", shaders won't be cached\n", cacheDirectory);
+	}
+}
+
+void ShaderLibrary::destroy(void)
+{
+	for (auto &module : modules)
+		dispatch->vkDestroyShaderModule(device, module.second, allocator);
+	modules.clear();
+
+	if (compiler)
+		shaderc_compiler_release(compiler);
+	compiler = nullptr;
+}
+
+uint64_t ShaderLibrary::hashShader(const std::vector<char> &source, VkShaderStageFlagBits stage,
+	const ShaderDefine *defines, uint32_t numDefines) const
+{
+	// Everything that changes the output goes in, with separators so moving bytes between
+	//	fields changes the hash.
+	uint32_t spirvVersion = 0, spirvRevision = 0;
+	shaderc_get_spv_version(&spirvVersion, &spirvRevision);
+	uint32_t header[] = { SHADER_CACHE_VERSION, VK_HEADER_VERSION, spirvVersion, spirvRevision, static_cast<uint32_t>(stage), optimize ? 1U : 0U };
+
+	uint64_t hash = hashBytes(SHADER_HASH_SEED, header, sizeof(header));
+	for (uint32_t i = 0; i < numDefines; i++)
+	{
+		hash = hashBytes(hash, defines[i].name, strlen(defines[i].name) + 1);
+		if (defines[i].value)
+			hash = hashBytes(hash, defines[i].value, strlen(defines[i].value));
+		hash = hashBytes(hash, "\n", 1);
+	}
+	return hashBytes(hash, source.data(), source.size());
+}
+
+bool ShaderLibrary::loadCachedSpirv(const std::string &cachePath, std::vector<uint32_t> &spirv)
+{
+	PresentLatencyTracker::Clock::time_point loadStart = PresentLatencyTracker::Clock::now();
+
+	std::vector<char> data;
+	if (!readFile(cachePath.c_str(), data))
+		return false;
+
+	// A half written or otherwise damaged entry just gets compiled again.
+	uint32_t magic = 0;
+	if (data.size() < sizeof(uint32_t) * 5 || data.size() % sizeof(uint32_t) != 0)
+		return false;
+	memcpy(&magic, data.data(), sizeof(magic));
+	if (magic != SPIRV_MAGIC)
+		return false;
+
+	spirv.resize(data.size() / sizeof(uint32_t));
+	memcpy(spirv.data(), data.data(), data.size());
+
+	cacheLoadTime.add(PresentLatencyTracker::millisecondsSince(loadStart));
+	numCacheHits++;
+	return true;
+}
+
+void ShaderLibrary::saveCachedSpirv(const std::string &cachePath, const std::vector<uint32_t> &spirv)
+{
+	// Written to a temporary and renamed into place, so a crash mid-write can't leave a bad entry
+	//	under the real name. It replaces whatever's there, which may be a damaged entry that failed
+	//	to load.
+	std::string tempPath = cachePath + ".tmp";
+	FILE *file = openFile(tempPath.c_str(), "wb");
+	if (!file)
+	{
+		numCacheWriteFailures++;
+		return;
+	}
+	bool ok = fwrite(spirv.data(), sizeof(uint32_t), spirv.size(), file) == spirv.size();
+	ok = fclose(file) == 0 && ok;
+
+	if (!ok || !replaceFile(tempPath.c_str(), cachePath.c_str()))
+	{
+		remove(tempPath.c_str());
+		numCacheWriteFailures++;
+	}
+}
+
+void ShaderLibrary::compile(const char *fileName, const std::vector<char> &source, VkShaderStageFlagBits stage,
+	const ShaderDefine *defines, uint32_t numDefines, std::vector<uint32_t> &spirv)
+{
+	PresentLatencyTracker::Clock::time_point compileStart = PresentLatencyTracker::Clock::now();
+
+	if (!compiler)
+		compiler = shaderc_compiler_initialize();
+	if (!compiler)
+	{
+		fprintf(stderr, "Error (%s:%u): Failed to initialize the shader compiler\n", __FILE__, __LINE__);
+		throw std::runtime_error("Failed to initialize the shader compiler");
+	}
+
+	shaderc_compile_options_t options = shaderc_compile_options_initialize();
+	shaderc_compile_options_set_target_env(options, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+	shaderc_compile_options_set_optimization_level(options,
+		optimize ? shaderc_optimization_level_performance : shaderc_optimization_level_zero);
+	for (uint32_t i = 0; i < numDefines; i++)
+	{
+		const char *value = defines[i].value ? defines[i].value : "";
+		shaderc_compile_options_add_macro_definition(options,
+			defines[i].name, strlen(defines[i].name), value, strlen(value));
+	}
+
+	shaderc_compilation_result_t result = shaderc_compile_into_spv(compiler,
+		source.data(), source.size(), getShaderKind(stage), fileName, "main", options);
+	shaderc_compile_options_release(options);
+
+	if (shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success)
+	{
+		fprintf(stderr, "Error (%s:%u): Failed to compile %s:\n%s\n", __FILE__, __LINE__,
+			fileName, shaderc_result_get_error_message(result));
+		shaderc_result_release(result);
+		throw std::runtime_error("Failed to compile a shader");
+	}
+	if (shaderc_result_get_num_warnings(result))
+		fprintf(stderr, "Warning: %s", shaderc_result_get_error_message(result));
+
+	size_t length = shaderc_result_get_length(result);
+	spirv.resize(length / sizeof(uint32_t));
+	memcpy(spirv.data(), shaderc_result_get_bytes(result), length);
+	shaderc_result_release(result);
+
+	compileTime.add(PresentLatencyTracker::millisecondsSince(compileStart));
+	numCompiles++;
+}
+
+VkShaderModule ShaderLibrary::getModule(const char *fileName, VkShaderStageFlagBits stage,
+	const ShaderDefine *defines, uint32_t numDefines)
+{
+	numRequests++;
+
+	std::string sourcePath = sourceDirectory + "/" + fileName;
+	std::vector<char> source;
+	if (!readFile(sourcePath.c_str(), source))
+	{
+		fprintf(stderr, "Error (%s:%u): Failed to read shader source \"%s\"\n", __FILE__, __LINE__, sourcePath.c_str());
+		throw std::runtime_error("Failed to read shader source");
+	}
+
+	uint64_t hash = hashShader(source, stage, defines, numDefines);
+	auto found = modules.find(hash);
+	if (found != modules.end())
+	{
+		numModulesReused++;
+		return found->second;
+	}
+
+	std::string cachePath;
+	if (!cacheDirectory.empty())
+	{
+		char hashName[32];
+		snprintf(hashName, sizeof(hashName), "%016llx.spv", static_cast<unsigned long long>(hash));
+		cachePath = cacheDirectory + "/" + hashName;
+	}
+
+	std::vector<uint32_t> spirv;
+	if (cachePath.empty() || !loadCachedSpirv(cachePath, spirv))
+	{
+		compile(fileName, source, stage, defines, numDefines, spirv);
+		if (!cachePath.empty())
+			saveCachedSpirv(cachePath, spirv);
+	}
+
+	VkShaderModuleCreateInfo shaderModuleCreateInfo = {
+		VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		nullptr, // pNext
+		0, // flags
+		spirv.size() * sizeof(uint32_t), // Code size
+		spirv.data() // Code
+	};
+	VkShaderModule module;
+	HANDLE_VK(dispatch->vkCreateShaderModule(device, &shaderModuleCreateInfo, allocator, &module),
+		"Creating the %s shader module", fileName);
+
+	modules.emplace(hash, module);
+	return module;
+}
+
+void ShaderLibrary::printStats(const char *name) const
+{
+	printf("%s shader stats:\n", name);
+	printf("\tModules requested: %llu, reused: %llu, loaded from the cache: %llu, compiled: %llu\n",
+		static_cast<unsigned long long>(numRequests),
+		static_cast<unsigned long long>(numModulesReused),
+		static_cast<unsigned long long>(numCacheHits),
+		static_cast<unsigned long long>(numCompiles));
+	if (cacheLoadTime.count)
+		cacheLoadTime.print("Cache load");
+	if (compileTime.count)
+		compileTime.print("Compile");
+	if (numCacheWriteFailures)
+		printf("\tFailed cache writes: %llu\n", static_cast<unsigned long long>(numCacheWriteFailures));
+}
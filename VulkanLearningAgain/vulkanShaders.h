@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <shaderc/shaderc.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "vulkanDispatch.h"
+#include "vulkanPresent.h"
+
+// A preprocessor define passed to the shader compiler. 'value' can be nullptr for a plain #define NAME.
+struct ShaderDefine
+{
+	const char *name;
+	const char *value;
+};
+
+// Builds the VkSpecializationInfo for a shader stage out of 32-bit constants (uint, int, float and
+//	bool constants in GLSL are all 4 bytes), keyed by their constant_id.
+// getInfo() points into the builder, so it has to outlive the pipeline creation.
+class SpecializationConstants
+{
+	std::vector<VkSpecializationMapEntry> entries;
+	std::vector<uint32_t> values;
+	VkSpecializationInfo info = {};
+
+public:
+	void setUint(uint32_t constantId, uint32_t value);
+	void setFloat(uint32_t constantId, float value);
+	void setBool(uint32_t constantId, bool value) { setUint(constantId, value ? VK_TRUE : VK_FALSE); }
+
+	// nullptr when nothing's been set, so the shader's defaults are used.
+	const VkSpecializationInfo *getInfo(void);
+};
+
+// Turns GLSL source files into shader modules at runtime, through shaderc (the library glslc is
+//	built on, shipped with the Vulkan SDK).
+// Compiled SPIR-V is cached on disk under a hash of everything that goes into the compile (the
+//	source text, the stage, the defines and the compiler build), so a warm start just reads the
+//	.spv back. shaderc can't report its own build, so the compiler is identified by the Vulkan SDK
+//	it's built against (shaderc_shared.dll is copied out of the same SDK). Editing a shader changes its hash, so a stale entry is never used, it's just left
+//	behind. #include isn't supported, since included files wouldn't be part of the hash.
+// Modules are kept for the life of the library and handed out again for the same key.
+class ShaderLibrary
+{
+	VkDevice device = VK_NULL_HANDLE;
+	const DeviceDispatch *dispatch = nullptr;
+	const VkAllocationCallbacks *allocator = nullptr;
+	std::string sourceDirectory;
+	std::string cacheDirectory; // Empty when there's no cache.
+	bool optimize = true;
+	shaderc_compiler_t compiler = nullptr; // Created on the first cache miss.
+	std::unordered_map<uint64_t, VkShaderModule> modules;
+
+	// Stats
+	uint64_t numRequests = 0;
+	uint64_t numModulesReused = 0;
+	uint64_t numCacheHits = 0;
+	uint64_t numCompiles = 0;
+	uint64_t numCacheWriteFailures = 0;
+	LatencyStat cacheLoadTime; // Reading a .spv from the cache.
+	LatencyStat compileTime; // Compiling (and optimizing) a source file.
+
+	uint64_t hashShader(const std::vector<char> &source, VkShaderStageFlagBits stage,
+		const ShaderDefine *defines, uint32_t numDefines) const;
+	bool loadCachedSpirv(const std::string &cachePath, std::vector<uint32_t> &spirv);
+	void saveCachedSpirv(const std::string &cachePath, const std::vector<uint32_t> &spirv);
+	void compile(const char *fileName, const std::vector<char> &source, VkShaderStageFlagBits stage,
+		const ShaderDefine *defines, uint32_t numDefines, std::vector<uint32_t> &spirv);
+
+public:
+	// Sources are read from 'sourceDirectory'. A null 'cacheDirectory' compiles every shader every run.
+	// 'optimize' runs the SPIR-V optimizer (for performance) over the compiled shaders.
+	void create(VkDevice device, const DeviceDispatch &dispatch,
+		const char *sourceDirectory, const char *cacheDirectory, bool optimize,
+		const VkAllocationCallbacks *allocator);
+	void destroy(void);
+
+	// Shader module for 'fileName' compiled as 'stage' with 'defines'. The library owns it.
+	// Throws if the source can't be read or doesn't compile.
+	VkShaderModule getModule(const char *fileName, VkShaderStageFlagBits stage,
+		const ShaderDefine *defines = nullptr, uint32_t numDefines = 0);
+
+	void printStats(const char *name) const;
+};
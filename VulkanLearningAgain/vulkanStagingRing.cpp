@@ -0,0 +1,161 @@
+#include "vulkanStagingRing.h"
+#include <stdio.h>
+#include <assert.h>
+#include <algorithm>
+#include "vulkanDebug.h"
+#include "vulkanMemory.h"
+
+// The ring's size is a multiple of this, so any alignment up to it stays aligned across wraps.
+#define STAGING_RING_MAX_ALIGNMENT 4096U
+
+void StagingRing::create(VkDevice device, const DeviceDispatch &dispatch,
+	const VkPhysicalDeviceMemoryProperties &memoryProperties,
+	const VkPhysicalDeviceLimits &limits,
+	VkDeviceSize size,
+	QueueTimeline &timeline,
+	const VkAllocationCallbacks *allocator)
+{
+	this->device = device;
+	this->dispatch = &dispatch;
+	this->allocator = allocator;
+	this->timeline = &timeline;
+	nonCoherentAtomSize = std::max<VkDeviceSize>(limits.nonCoherentAtomSize, 1);
+	this->size = alignUp(size, std::max<VkDeviceSize>(nonCoherentAtomSize, STAGING_RING_MAX_ALIGNMENT));
+
+	// Only the CPU writes it and the GPU reads it once, so plain host memory is fine. Coherent
+	//	memory saves the flushes.
+	VkMemoryPropertyFlags selectedFlags = 0;
+	createBufferWithMemory(device, dispatch, memoryProperties, this->size,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, allocator,
+		buffer, memory, &selectedFlags);
+	isCoherent = (selectedFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+	void *data;
+	HANDLE_VK(dispatch.vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data),
+		"Mapping the staging ring");
+	mappedData = static_cast<uint8_t *>(data);
+
+	if (VERBOSE)
+		printf("Staging ring: %llu KB, %s\n",
+			static_cast<unsigned long long>(this->size / 1024),
+			isCoherent ? "coherent" : "non-coherent");
+}
+
+void StagingRing::destroy(void)
+{
+	if (mappedData)
+		dispatch->vkUnmapMemory(device, memory);
+	if (buffer)
+		dispatch->vkDestroyBuffer(device, buffer, allocator);
+	if (memory)
+		dispatch->vkFreeMemory(device, memory, allocator);
+
+	mappedData = nullptr;
+	buffer = VK_NULL_HANDLE;
+	memory = VK_NULL_HANDLE;
+	inFlight.clear();
+}
+
+void StagingRing::retire(void)
+{
+	while (!inFlight.empty() && timeline->isComplete(inFlight.front().timelineValue))
+	{
+		tail = inFlight.front().end;
+		inFlight.pop_front();
+	}
+}
+
+bool StagingRing::reserve(VkDeviceSize bytes, VkDeviceSize alignment, bool wait, void *&cpuPointer, VkDeviceSize &offset)
+{
+	assert(alignment && alignment <= STAGING_RING_MAX_ALIGNMENT && (alignment & (alignment - 1)) == 0);
+	if (bytes > size)
+		return false;
+
+	// Anything that would run off the end starts over at the beginning, skipping the rest of the lap.
+	uint64_t start = alignUp(head, alignment);
+	bool wrapped = start % size + bytes > size;
+	if (wrapped)
+		start = (start / size + 1) * size;
+
+	bool stalled = false;
+	while (start + bytes - tail > size)
+	{
+		retire();
+		if (start + bytes - tail <= size)
+			break;
+
+		// What's left in the way is either still on the GPU, or hasn't even been submitted.
+		if (!wait || inFlight.empty())
+			return false;
+		timeline->wait(inFlight.front().timelineValue);
+		stalled = true;
+	}
+
+	head = start + bytes;
+	offset = start % size;
+	cpuPointer = mappedData + offset;
+
+	numReserves++;
+	numBytesReserved += bytes;
+	numWraps += wrapped ? 1 : 0;
+	numStalls += stalled ? 1 : 0;
+	highWaterMark = std::max(highWaterMark, head - tail);
+	return true;
+}
+
+void StagingRing::flushRange(uint64_t start, uint64_t end)
+{
+	// Up to two ranges if it wrapped. Rounded out to whole atoms, the ring's size is a multiple of them.
+	VkMappedMemoryRange ranges[2];
+	uint32_t numRanges = 0;
+	while (start < end)
+	{
+		VkDeviceSize rangeStart = start % size;
+		VkDeviceSize rangeEnd = std::min<uint64_t>(rangeStart + (end - start), size);
+		start += rangeEnd - rangeStart;
+
+		rangeStart = alignDown(rangeStart, nonCoherentAtomSize);
+		rangeEnd = std::min(alignUp(rangeEnd, nonCoherentAtomSize), size);
+		ranges[numRanges++] = {
+			VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+			nullptr, // pNext
+			memory, // Memory
+			rangeStart, // Offset
+			rangeEnd - rangeStart // Size
+		};
+	}
+	if (numRanges)
+		HANDLE_VK(dispatch->vkFlushMappedMemoryRanges(device, numRanges, ranges),
+			"Flushing the staging ring");
+}
+
+void StagingRing::commit(uint64_t timelineValue)
+{
+	if (head == pendingStart)
+		return;
+
+	if (!isCoherent)
+		flushRange(pendingStart, head);
+
+	Region region = {
+		head, // End
+		timelineValue // Timeline value
+	};
+	inFlight.push_back(region);
+	pendingStart = head;
+}
+
+void StagingRing::printStats(void) const
+{
+	printf("Staging ring stats:\n");
+	printf("\tReserved: %llu bytes in %llu reservations, wrapped %llu times\n",
+		static_cast<unsigned long long>(numBytesReserved),
+		static_cast<unsigned long long>(numReserves),
+		static_cast<unsigned long long>(numWraps));
+	printf("\tHigh-water mark: %llu / %llu bytes\n",
+		static_cast<unsigned long long>(highWaterMark),
+		static_cast<unsigned long long>(size));
+	printf("\tReserves that waited on the GPU: %llu\n", static_cast<unsigned long long>(numStalls));
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <deque>
+#include "vulkanDispatch.h"
+#include "vulkanTimeline.h"
+
+// Ring buffer of host-visible memory for streaming data up to device-local buffers and images.
+// It's persistently mapped, so the CPU writes (or copies straight out of a mapped file) into the
+//	pointer reserve() hands back, and the GPU copies out of the buffer at the matching offset.
+// Space is handed out in order and given back in order: commit() tags everything reserved since
+//	the last commit with the timeline value of the submit that reads it, and it's reused once the
+//	timeline gets there.
+class StagingRing
+{
+	VkDevice device = VK_NULL_HANDLE;
+	const DeviceDispatch *dispatch = nullptr;
+	const VkAllocationCallbacks *allocator = nullptr;
+	QueueTimeline *timeline = nullptr;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	uint8_t *mappedData = nullptr;
+	bool isCoherent = false;
+	VkDeviceSize nonCoherentAtomSize = 1;
+	VkDeviceSize size = 0;
+
+	// Positions only ever go up, the buffer offset is the position modulo 'size'.
+	uint64_t head = 0; // Next free byte.
+	uint64_t tail = 0; // Oldest byte still in use.
+	uint64_t pendingStart = 0; // Reserved since the last commit from here to 'head'.
+
+	struct Region
+	{
+		uint64_t end; // Position the region ends at (it starts where the previous one ended).
+		uint64_t timelineValue;
+	};
+	std::deque<Region> inFlight; // In commit order.
+
+	// Stats
+	uint64_t numReserves = 0;
+	uint64_t numBytesReserved = 0;
+	uint64_t numWraps = 0;
+	uint64_t numStalls = 0; // Reserves that had to wait on the GPU to get space back.
+	uint64_t highWaterMark = 0;
+
+	void retire(void);
+	void flushRange(uint64_t start, uint64_t end);
+
+public:
+	// 'timeline' is the queue the copies out of the ring are submitted to.
+	void create(VkDevice device, const DeviceDispatch &dispatch,
+		const VkPhysicalDeviceMemoryProperties &memoryProperties,
+		const VkPhysicalDeviceLimits &limits,
+		VkDeviceSize size,
+		QueueTimeline &timeline,
+		const VkAllocationCallbacks *allocator);
+	void destroy(void);
+
+	// Reserve 'bytes' aligned to 'alignment' (a power of 2). Returns false if there isn't room.
+	// With 'wait' it blocks on the GPU for committed space to come back, so it only fails when the
+	//	uncommitted reservations are in the way (or 'bytes' is bigger than the ring).
+	bool reserve(VkDeviceSize bytes, VkDeviceSize alignment, bool wait, void *&cpuPointer, VkDeviceSize &offset);
+
+	// Flush everything reserved since the last commit (on non-coherent memory) and hand it to the
+	//	submit that will signal 'timelineValue'. Call right before that submit.
+	void commit(uint64_t timelineValue);
+
+	VkBuffer getBuffer(void) const { return buffer; }
+	VkDeviceSize getSize(void) const { return size; }
+	VkDeviceSize getPendingSize(void) const { return head - pendingStart; }
+	void printStats(void) const;
+};
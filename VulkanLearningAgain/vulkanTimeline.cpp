@@ -0,0 +1,256 @@
+#include "vulkanTimeline.h"
+#include <stdio.h>
+#include <stdexcept>
+#include <algorithm>
+#include "vulkanDebug.h"
+
+void QueueTimeline::create(VkDevice device, const DeviceDispatch &dispatch, VkQueue queue, bool useTimelineSemaphore, const char *name)
+{
+	this->device = device;
+	this->dispatch = &dispatch;
+	this->queue = queue;
+	this->useTimelineSemaphore = useTimelineSemaphore;
+	this->name = name;
+
+	if (useTimelineSemaphore)
+	{
+		// The KHR entry points aren't exported by the loader, they're only in the dispatch table.
+		assert(dispatch.vkWaitSemaphoresKHR && dispatch.vkGetSemaphoreCounterValueKHR);
+
+		VkSemaphoreTypeCreateInfoKHR semaphoreTypeCreateInfo = {
+			VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR,
+			nullptr, // pNext
+			VK_SEMAPHORE_TYPE_TIMELINE_KHR, // Semaphore type
+			0 // Initial value
+		};
+
+		VkSemaphoreCreateInfo semaphoreCreateInfo = {
+			VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+			&semaphoreTypeCreateInfo, // pNext
+			0 // Flags
+		};
+
+		HANDLE_VK(dispatch.vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore),
+			"Creating the %s timeline semaphore", name);
+	}
+
+	if (VERBOSE)
+		printf("%s queue timeline: %s\n", name, useTimelineSemaphore ? "timeline semaphore" : "fences (no timeline semaphore support)");
+}
+
+void QueueTimeline::destroy(void)
+{
+	if (semaphore)
+		dispatch->vkDestroySemaphore(device, semaphore, nullptr);
+	semaphore = VK_NULL_HANDLE;
+
+	for (const PendingFence &pending : pendingFences)
+		dispatch->vkDestroyFence(device, pending.fence, nullptr);
+	for (VkFence fence : freeFences)
+		dispatch->vkDestroyFence(device, fence, nullptr);
+	pendingFences.clear();
+	freeFences.clear();
+}
+
+uint64_t QueueTimeline::submit(uint32_t numCommandBuffers, const VkCommandBuffer *commandBuffers,
+	std::initializer_list<TimelineWait> timelineWaits,
+	std::initializer_list<BinarySemaphoreWait> binaryWaits,
+	std::initializer_list<VkSemaphore> binarySignals)
+{
+	assert(timelineWaits.size() + binaryWaits.size() <= MAX_SUBMIT_SEMAPHORES);
+	assert(binarySignals.size() < MAX_SUBMIT_SEMAPHORES);
+
+	// Binary semaphores ignore their entry in the value arrays, but the arrays have to line up.
+	VkSemaphore waitSemaphores[MAX_SUBMIT_SEMAPHORES];
+	uint64_t waitValues[MAX_SUBMIT_SEMAPHORES];
+	VkPipelineStageFlags waitStages[MAX_SUBMIT_SEMAPHORES];
+	VkSemaphore signalSemaphores[MAX_SUBMIT_SEMAPHORES];
+	uint64_t signalValues[MAX_SUBMIT_SEMAPHORES];
+	uint32_t numWaits = 0;
+	uint32_t numSignals = 0;
+
+	for (const BinarySemaphoreWait &binaryWait : binaryWaits)
+	{
+		waitSemaphores[numWaits] = binaryWait.semaphore;
+		waitValues[numWaits] = 0;
+		waitStages[numWaits] = binaryWait.stageMask;
+		numWaits++;
+	}
+
+	for (const TimelineWait &timelineWait : timelineWaits)
+	{
+		// Already done, nothing to wait for.
+		if (timelineWait.timeline->isComplete(timelineWait.value))
+			continue;
+
+		// Both ends need a timeline semaphore: this submit to take the wait values, and the other
+		//	queue to have something to wait on.
+		if (useTimelineSemaphore && timelineWait.timeline->usesTimelineSemaphore())
+		{
+			waitSemaphores[numWaits] = timelineWait.timeline->getSemaphore();
+			waitValues[numWaits] = timelineWait.value;
+			waitStages[numWaits] = timelineWait.stageMask;
+			numWaits++;
+		}
+		else
+		{
+			// Without them there's no way to wait on a value on the GPU.
+			timelineWait.timeline->wait(timelineWait.value);
+			numFallbackCpuWaits++;
+		}
+	}
+
+	for (VkSemaphore binarySignal : binarySignals)
+	{
+		signalSemaphores[numSignals] = binarySignal;
+		signalValues[numSignals] = 0;
+		numSignals++;
+	}
+
+	uint64_t value = lastSubmittedValue + 1;
+	VkFence fence = VK_NULL_HANDLE;
+	if (useTimelineSemaphore)
+	{
+		signalSemaphores[numSignals] = semaphore;
+		signalValues[numSignals] = value;
+		numSignals++;
+	}
+	else
+	{
+		fence = getFence();
+	}
+
+	VkTimelineSemaphoreSubmitInfoKHR timelineSubmitInfo = {
+		VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+		nullptr, // pNext
+		numWaits, // Wait value count
+		waitValues, // Wait values
+		numSignals, // Signal value count
+		signalValues // Signal values
+	};
+
+	VkSubmitInfo submitInfo = {
+		VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		useTimelineSemaphore ? &timelineSubmitInfo : nullptr, // pNext
+		numWaits, // Wait semaphore count
+		waitSemaphores, // Wait semaphores
+		waitStages, // Wait stages
+		numCommandBuffers, // Command buffer count
+		commandBuffers, // Command buffers
+		numSignals, // Signal semaphore count
+		signalSemaphores // Signal semaphores
+	};
+
+	HANDLE_VK(dispatch->vkQueueSubmit(queue, 1, &submitInfo, fence),
+		"Submitting value %llu on the %s queue", static_cast<unsigned long long>(value), name);
+
+	if (fence)
+		pendingFences.push_back({ value, fence });
+	lastSubmittedValue = value;
+	numSubmits++;
+
+	return value;
+}
+
+uint64_t QueueTimeline::getCompletedValue(void)
+{
+	if (useTimelineSemaphore)
+	{
+		uint64_t value;
+		HANDLE_VK(dispatch->vkGetSemaphoreCounterValueKHR(device, semaphore, &value),
+			"Getting the %s timeline value", name);
+		completedValue = std::max(completedValue, value);
+	}
+	else
+	{
+		retireFences(false, 0);
+	}
+
+	return completedValue;
+}
+
+void QueueTimeline::wait(uint64_t value)
+{
+	assert(value <= lastSubmittedValue);
+	numCpuWaits++;
+	if (isComplete(value))
+		return;
+
+	numCpuStalls++;
+	if (useTimelineSemaphore)
+	{
+		VkSemaphoreWaitInfoKHR waitInfo = {
+			VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+			nullptr, // pNext
+			0, // Flags
+			1, // Semaphore count
+			&semaphore, // Semaphores
+			&value // Values
+		};
+		HANDLE_VK(dispatch->vkWaitSemaphoresKHR(device, &waitInfo, UINT64_MAX),
+			"Waiting for value %llu on the %s timeline", static_cast<unsigned long long>(value), name);
+		completedValue = std::max(completedValue, value);
+	}
+	else
+	{
+		retireFences(true, value);
+	}
+}
+
+VkFence QueueTimeline::getFence(void)
+{
+	if (!freeFences.empty())
+	{
+		VkFence fence = freeFences.back();
+		freeFences.pop_back();
+		return fence;
+	}
+
+	VkFenceCreateInfo fenceCreateInfo = {
+		VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		nullptr, // pNext
+		0 // Flags
+	};
+
+	VkFence fence;
+	HANDLE_VK(dispatch->vkCreateFence(device, &fenceCreateInfo, nullptr, &fence),
+		"Creating a fence for the %s queue", name);
+	return fence;
+}
+
+void QueueTimeline::retireFences(bool wait, uint64_t value)
+{
+	// Fences finish in submit order, so stop at the first one that isn't done.
+	while (!pendingFences.empty())
+	{
+		PendingFence &pending = pendingFences.front();
+		if (wait && pending.value <= value)
+		{
+			HANDLE_VK(dispatch->vkWaitForFences(device, 1, &pending.fence, VK_TRUE, UINT64_MAX),
+				"Waiting for value %llu on the %s queue", static_cast<unsigned long long>(pending.value), name);
+		}
+		else if (dispatch->vkGetFenceStatus(device, pending.fence) != VK_SUCCESS)
+		{
+			break;
+		}
+
+		HANDLE_VK(dispatch->vkResetFences(device, 1, &pending.fence), "Resetting a %s queue fence", name);
+		freeFences.push_back(pending.fence);
+		completedValue = pending.value;
+		pendingFences.pop_front();
+	}
+}
+
+void QueueTimeline::printStats(void) const
+{
+	printf("%s queue timeline stats (%s):\n", name, useTimelineSemaphore ? "timeline semaphore" : "fences");
+	printf("\tSubmits: %llu (last value %llu, completed %llu)\n",
+		static_cast<unsigned long long>(numSubmits),
+		static_cast<unsigned long long>(lastSubmittedValue),
+		static_cast<unsigned long long>(completedValue));
+	printf("\tCPU waits: %llu (%llu stalled)\n",
+		static_cast<unsigned long long>(numCpuWaits),
+		static_cast<unsigned long long>(numCpuStalls));
+	if (!useTimelineSemaphore)
+		printf("\tCross-queue waits done on the CPU: %llu\n", static_cast<unsigned long long>(numFallbackCpuWaits));
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include <initializer_list>
+#include "vulkanDispatch.h"
+
+// Max semaphores of each kind (timeline waits, binary waits, binary signals) one submit can use.
+#define MAX_SUBMIT_SEMAPHORES 8
+
+class QueueTimeline;
+
+// Wait on the GPU for 'value' on another queue's timeline before 'stageMask'.
+struct TimelineWait
+{
+	QueueTimeline *timeline;
+	uint64_t value;
+	VkPipelineStageFlags stageMask;
+};
+
+// Wait on a plain binary semaphore (e.g. swapchain image acquire).
+struct BinarySemaphoreWait
+{
+	VkSemaphore semaphore;
+	VkPipelineStageFlags stageMask;
+};
+
+// A monotonically increasing counter for one queue.
+// Every submit through submit() signals the next value, and everything else (CPU waits, GPU
+//	waits from other queues, resource retirement) is expressed against those values.
+// Backed by a VK_KHR_timeline_semaphore semaphore when the device supports it. Otherwise every
+//	submit gets a fence, and GPU waits on other queues fall back to waiting on the CPU.
+class QueueTimeline
+{
+	VkDevice device = VK_NULL_HANDLE;
+	const DeviceDispatch *dispatch = nullptr;
+	VkQueue queue = VK_NULL_HANDLE;
+	const char *name = "";
+	bool useTimelineSemaphore = false;
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+
+	uint64_t lastSubmittedValue = 0;
+	uint64_t completedValue = 0; // Last value seen as done by the CPU.
+
+	// Fence fallback
+	struct PendingFence
+	{
+		uint64_t value;
+		VkFence fence;
+	};
+	std::deque<PendingFence> pendingFences; // In submit order, one per value.
+	std::vector<VkFence> freeFences;
+
+	// Stats
+	uint64_t numSubmits = 0;
+	uint64_t numCpuWaits = 0;
+	uint64_t numCpuStalls = 0; // CPU waits where the value wasn't done yet.
+	uint64_t numFallbackCpuWaits = 0; // GPU waits turned into CPU waits because either timeline has no timeline semaphore.
+
+	VkFence getFence(void);
+	void retireFences(bool wait, uint64_t value);
+
+public:
+	// 'useTimelineSemaphore' must only be set when VK_KHR_timeline_semaphore is enabled on the device.
+	void create(VkDevice device, const DeviceDispatch &dispatch, VkQueue queue, bool useTimelineSemaphore, const char *name);
+	void destroy(void);
+
+	// Submit and signal the next value on this timeline. Returns the value.
+	uint64_t submit(uint32_t numCommandBuffers, const VkCommandBuffer *commandBuffers,
+		std::initializer_list<TimelineWait> timelineWaits = {},
+		std::initializer_list<BinarySemaphoreWait> binaryWaits = {},
+		std::initializer_list<VkSemaphore> binarySignals = {});
+
+	// Poll the GPU for the last value it finished.
+	uint64_t getCompletedValue(void);
+	bool isComplete(uint64_t value) { return value <= completedValue || value <= getCompletedValue(); }
+
+	// Block the CPU until 'value' is done.
+	void wait(uint64_t value);
+
+	uint64_t getLastSubmittedValue(void) const { return lastSubmittedValue; }
+	uint64_t getNextValue(void) const { return lastSubmittedValue + 1; } // What the next submit will signal.
+	bool usesTimelineSemaphore(void) const { return useTimelineSemaphore; }
+	VkSemaphore getSemaphore(void) const { return semaphore; }
+	void printStats(void) const;
+};
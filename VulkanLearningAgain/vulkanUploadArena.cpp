@@ -0,0 +1,160 @@
+#include "vulkanUploadArena.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+#include <algorithm>
+#include "vulkanDebug.h"
+#include "vulkanMemory.h"
+
+void FrameUploadArena::create(VkDevice device, const DeviceDispatch &dispatch,
+	const VkPhysicalDeviceMemoryProperties &memoryProperties,
+	const VkPhysicalDeviceLimits &limits,
+	VkDeviceSize frameSize,
+	uint32_t numFrames,
+	VkDeviceSize bindRange,
+	const VkAllocationCallbacks *allocator,
+	VkBufferUsageFlags usage)
+{
+	this->device = device;
+	this->dispatch = &dispatch;
+	this->allocator = allocator;
+	this->numFrames = numFrames;
+	this->bindRange = bindRange;
+	allocationAlignment = std::max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment);
+	nonCoherentAtomSize = std::max<VkDeviceSize>(limits.nonCoherentAtomSize, 1);
+
+	// Keep each frame's region aligned to both the offset alignment and the flush granularity
+	//	so flushing one frame can never touch the bytes of another frame.
+	VkDeviceSize regionAlignment = std::max(allocationAlignment, nonCoherentAtomSize);
+	this->frameSize = alignUp(frameSize, regionAlignment);
+
+	// Pad the end so a slice at the very end of the last region can still be bound with the full bind range.
+	VkDeviceSize bufferSize = this->frameSize * numFrames + alignUp(bindRange, regionAlignment);
+
+	// Device-local + host-visible memory (if there is any) is the fastest for the GPU to read.
+	VkMemoryPropertyFlags selectedFlags = 0;
+	createBufferWithMemory(device, dispatch, memoryProperties, bufferSize, usage,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, allocator,
+		buffer, memory, &selectedFlags);
+	isCoherent = (selectedFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+	// Map it once and leave it mapped.
+	void *data;
+	HANDLE_VK(dispatch.vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data),
+		"Mapping the frame upload arena");
+	mappedData = static_cast<uint8_t *>(data);
+
+	if (VERBOSE)
+		printf("Frame upload arena: %u x %llu bytes, alignment %llu, %s\n",
+			numFrames,
+			static_cast<unsigned long long>(this->frameSize),
+			static_cast<unsigned long long>(allocationAlignment),
+			isCoherent ? "coherent" : "non-coherent");
+}
+
+void FrameUploadArena::destroy(void)
+{
+	if (mappedData)
+		dispatch->vkUnmapMemory(device, memory);
+	if (buffer)
+		dispatch->vkDestroyBuffer(device, buffer, allocator);
+	if (memory)
+		dispatch->vkFreeMemory(device, memory, allocator);
+
+	mappedData = nullptr;
+	buffer = VK_NULL_HANDLE;
+	memory = VK_NULL_HANDLE;
+}
+
+void FrameUploadArena::beginFrame(uint32_t frameIndex)
+{
+	assert(frameIndex < numFrames);
+
+	// Roll the stats over from the frame that just finished recording.
+	if (numFramesUsed)
+	{
+		bytesWrittenLastFrame = bytesWrittenThisFrame;
+		highWaterMark = std::max(highWaterMark, head);
+	}
+	numFramesUsed++;
+
+	currentFrame = frameIndex;
+	frameBase = frameSize * frameIndex;
+	head = 0;
+	flushedHead = 0;
+	bytesWrittenThisFrame = 0;
+}
+
+void *FrameUploadArena::allocate(VkDeviceSize size, uint32_t &dynamicOffset)
+{
+	VkDeviceSize offset = alignUp(head, allocationAlignment);
+	if (offset + size > frameSize)
+	{
+		fprintf(stderr, "Error (%s:%u): Frame upload arena is out of space (%llu + %llu > %llu bytes)\n",
+			__FILE__, __LINE__,
+			static_cast<unsigned long long>(offset),
+			static_cast<unsigned long long>(size),
+			static_cast<unsigned long long>(frameSize));
+		throw std::runtime_error("Frame upload arena is out of space");
+	}
+
+	head = offset + size;
+	bytesWrittenThisFrame += size;
+	totalBytesWritten += size;
+	numAllocations++;
+
+	dynamicOffset = static_cast<uint32_t>(frameBase + offset);
+	return mappedData + frameBase + offset;
+}
+
+uint32_t FrameUploadArena::push(const void *data, VkDeviceSize size)
+{
+	uint32_t dynamicOffset;
+	memcpy(allocate(size, dynamicOffset), data, static_cast<size_t>(size));
+	return dynamicOffset;
+}
+
+void FrameUploadArena::flush(void)
+{
+	if (head == flushedHead)
+		return;
+
+	if (!isCoherent)
+	{
+		// Everything since the last flush is one contiguous range, so it's always one call.
+		VkDeviceSize start = alignDown(frameBase + flushedHead, nonCoherentAtomSize);
+		VkDeviceSize end = alignUp(frameBase + head, nonCoherentAtomSize);
+		VkMappedMemoryRange range = {
+			VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+			nullptr, // pNext
+			memory, // Memory
+			start, // Offset
+			end - start // Size
+		};
+		HANDLE_VK(dispatch->vkFlushMappedMemoryRanges(device, 1, &range),
+			"Flushing %llu bytes of the frame upload arena", static_cast<unsigned long long>(end - start));
+
+		numFlushCalls++;
+		numFlushedBytes += end - start;
+	}
+
+	flushedHead = head;
+}
+
+void FrameUploadArena::printStats(void) const
+{
+	printf("Frame upload arena stats:\n");
+	printf("\tFrames: %llu\n", static_cast<unsigned long long>(numFramesUsed));
+	printf("\tBytes written last frame: %llu\n", static_cast<unsigned long long>(bytesWrittenLastFrame));
+	printf("\tHigh-water mark: %llu / %llu bytes per frame\n",
+		static_cast<unsigned long long>(std::max(highWaterMark, head)),
+		static_cast<unsigned long long>(frameSize));
+	printf("\tTotal bytes written: %llu in %llu allocations\n",
+		static_cast<unsigned long long>(totalBytesWritten),
+		static_cast<unsigned long long>(numAllocations));
+	printf("\tFlushes: %llu (%llu bytes)%s\n",
+		static_cast<unsigned long long>(numFlushCalls),
+		static_cast<unsigned long long>(numFlushedBytes),
+		isCoherent ? " - memory is coherent" : "");
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include "vulkanDispatch.h"
+
+// Per-frame transient upload arena.
+// One persistently mapped, host-visible buffer split into a region per frame in flight.
+//	Each frame bump-allocates aligned slices out of its region (uniform data, per-view and
+//	per-object constants, etc.) and binds them through UNIFORM_BUFFER_DYNAMIC offsets into
+//	the one descriptor, so nothing gets created or updated per draw.
+// A frame's region is only reused once the caller calls beginFrame() with that frame index
+//	again, which must happen after the GPU is done with the frame.
+class FrameUploadArena
+{
+	VkDevice device = VK_NULL_HANDLE;
+	const DeviceDispatch *dispatch = nullptr;
+	const VkAllocationCallbacks *allocator = nullptr;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	uint8_t *mappedData = nullptr;
+	bool isCoherent = false;
+	VkDeviceSize allocationAlignment = 0; // Max of minUniformBufferOffsetAlignment and minStorageBufferOffsetAlignment
+	VkDeviceSize nonCoherentAtomSize = 0;
+	VkDeviceSize frameSize = 0;
+	VkDeviceSize bindRange = 0; // Range the dynamic descriptor covers past each offset.
+	uint32_t numFrames = 0;
+
+	uint32_t currentFrame = 0;
+	VkDeviceSize frameBase = 0; // Start of the current frame's region in the buffer.
+	VkDeviceSize head = 0; // Next free byte, relative to frameBase.
+	VkDeviceSize flushedHead = 0; // Everything before this (relative to frameBase) has been flushed.
+
+	// Stats
+	uint64_t numFramesUsed = 0;
+	VkDeviceSize bytesWrittenThisFrame = 0;
+	VkDeviceSize bytesWrittenLastFrame = 0;
+	VkDeviceSize highWaterMark = 0;
+	uint64_t totalBytesWritten = 0;
+	uint64_t numAllocations = 0;
+	uint64_t numFlushCalls = 0;
+	uint64_t numFlushedBytes = 0;
+
+public:
+	// 'bindRange' is the range of the UNIFORM_BUFFER_DYNAMIC descriptor pointed at the buffer.
+	//	Every slice can be bound with it, so it must be at least as big as the largest uniform block.
+	void create(VkDevice device, const DeviceDispatch &dispatch,
+		const VkPhysicalDeviceMemoryProperties &memoryProperties,
+		const VkPhysicalDeviceLimits &limits,
+		VkDeviceSize frameSize,
+		uint32_t numFrames,
+		VkDeviceSize bindRange,
+		const VkAllocationCallbacks *allocator,
+		VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	void destroy(void);
+
+	// Start writing into the region for 'frameIndex'. The GPU must be done reading it.
+	void beginFrame(uint32_t frameIndex);
+
+	// Hand out an aligned slice of the current frame's region.
+	// Returns a CPU pointer to write to and the dynamic offset to bind it with.
+	void *allocate(VkDeviceSize size, uint32_t &dynamicOffset);
+
+	template<typename T>
+	T *allocate(uint32_t &dynamicOffset)
+	{
+		return static_cast<T *>(allocate(sizeof(T), dynamicOffset));
+	}
+
+	// Allocate and copy in one go.
+	uint32_t push(const void *data, VkDeviceSize size);
+
+	// Flush everything written since the last flush with one vkFlushMappedMemoryRanges call.
+	// Nothing to do on coherent memory. Call before submitting work that reads the slices.
+	void flush(void);
+
+	VkBuffer getBuffer(void) const { return buffer; }
+	VkDeviceSize getBindRange(void) const { return bindRange; }
+	VkDeviceSize getBytesWrittenThisFrame(void) const { return bytesWrittenThisFrame; }
+	VkDeviceSize getBytesWrittenLastFrame(void) const { return bytesWrittenLastFrame; }
+	VkDeviceSize getHighWaterMark(void) const { return highWaterMark; }
+	void printStats(void) const;
+};